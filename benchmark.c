@@ -0,0 +1,778 @@
+#include <time.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "journal.h"
+
+/**
+ * Benchmark suite with reproducible scenarios.
+ *
+ * Each scenario creates its own journal (benchmark.dat/idx in the current
+ * directory) with deterministic content (fixed-length records, timestamp
+ * equals seqnum) and reports the latency distribution of the measured
+ * operation. Random seqnums and timestamps are drawn from a fixed seed.
+ *
+ * Results are written as CSV (default) or JSON, one row per scenario and
+ * parameter, to compare versions.
+ */
+
+#define JOURNAL_NAME        "benchmark"
+#define FILL_BATCH          100
+#define MAX_READERS         64
+
+typedef struct {
+    size_t num_entries;
+    size_t bytes_per_record;
+    size_t num_samples;
+    size_t num_readers;
+    size_t num_rounds;
+    unsigned int seed;
+    bool json;
+    const char *scenarios;
+    FILE *out;
+} params_t;
+
+typedef struct {
+    const char *scenario;
+    char param[64];
+    size_t num_samples;
+    double ops_per_sec;
+    uint64_t avg_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+} result_t;
+
+typedef struct {
+    ldb_journal_t *journal;
+    const params_t *params;
+    uint64_t *samples;
+    size_t num_samples;
+    unsigned int seed;
+    int rc;
+} args_read_t;
+
+static size_t num_results = 0;
+
+static uint64_t get_nanos(void)
+{
+    struct timespec ts = {0};
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+        return 0;
+
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+
+    return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+// Nearest-rank percentile (samples sorted).
+static uint64_t percentile(const uint64_t *samples, size_t len, double p)
+{
+    size_t rank = (size_t) (p * (double) len + 0.999999);
+
+    return samples[(rank == 0 ? 0 : rank - 1)];
+}
+
+static void print_result(const params_t *params, const result_t *result)
+{
+    FILE *out = params->out;
+
+    if (params->json) {
+        fprintf(out, "%s\n  {\"scenario\": \"%s\", \"param\": \"%s\", \"samples\": %zu, \"ops_per_sec\": %.2lf, "
+                "\"avg_ns\": %llu, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}",
+                (num_results == 0 ? "" : ","), result->scenario, result->param, result->num_samples, result->ops_per_sec,
+                (unsigned long long) result->avg_ns, (unsigned long long) result->p50_ns, (unsigned long long) result->p99_ns,
+                (unsigned long long) result->p999_ns, (unsigned long long) result->max_ns);
+    }
+    else {
+        fprintf(out, "%s,%s,%zu,%.2lf,%llu,%llu,%llu,%llu,%llu\n",
+                result->scenario, result->param, result->num_samples, result->ops_per_sec,
+                (unsigned long long) result->avg_ns, (unsigned long long) result->p50_ns, (unsigned long long) result->p99_ns,
+                (unsigned long long) result->p999_ns, (unsigned long long) result->max_ns);
+    }
+
+    fflush(out);
+    num_results++;
+}
+
+// Computes the statistics of the latencies (samples are sorted).
+// Throughput is computed from the elapsed time (0 = sum of latencies).
+static void report(const params_t *params, const char *scenario, const char *param, uint64_t *samples, size_t len, uint64_t elapsed_ns)
+{
+    result_t result = { .scenario = scenario, .num_samples = len };
+    uint64_t sum = 0;
+
+    snprintf(result.param, sizeof(result.param), "%s", param);
+
+    if (len == 0) {
+        print_result(params, &result);
+        return;
+    }
+
+    qsort(samples, len, sizeof(uint64_t), compare_u64);
+
+    for (size_t i = 0; i < len; i++)
+        sum += samples[i];
+
+    elapsed_ns = (elapsed_ns == 0 ? sum : elapsed_ns);
+
+    result.ops_per_sec = (elapsed_ns > 0 ? (double) len * 1e9 / (double) elapsed_ns : 0.0);
+    result.avg_ns = sum / len;
+    result.p50_ns = percentile(samples, len, 0.50);
+    result.p99_ns = percentile(samples, len, 0.99);
+    result.p999_ns = percentile(samples, len, 0.999);
+    result.max_ns = samples[len - 1];
+
+    print_result(params, &result);
+}
+
+static void fail(const char *msg, int rc)
+{
+    fprintf(stderr, "Error: %s (%s)\n", msg, ldb_strerror(rc));
+    exit(EXIT_FAILURE);
+}
+
+static void remove_journal(void)
+{
+    remove(JOURNAL_NAME ".dat");
+    remove(JOURNAL_NAME ".idx");
+}
+
+static ldb_journal_t * open_journal(bool check)
+{
+    ldb_journal_t *journal = ldb_alloc();
+    int rc = LDB_OK;
+
+    if (!journal)
+        fail("out of memory", LDB_ERR_MEM);
+
+    if ((rc = ldb_open(journal, "", JOURNAL_NAME, check)) != LDB_OK)
+        fail("opening journal", rc);
+
+    return journal;
+}
+
+static void close_journal(ldb_journal_t *journal)
+{
+    ldb_close(journal);
+    ldb_free(journal);
+}
+
+// Appends entries [seqnum1, seqnum1 + len) in batches (timestamp = seqnum).
+static void fill_journal(ldb_journal_t *journal, uint64_t seqnum1, size_t len, const char *data, size_t data_len)
+{
+    ldb_entry_t entries[FILL_BATCH] = {{0}};
+    int rc = LDB_OK;
+
+    for (size_t i = 0; i < len; i += FILL_BATCH)
+    {
+        size_t n = (len - i < FILL_BATCH ? len - i : FILL_BATCH);
+
+        for (size_t j = 0; j < n; j++) {
+            entries[j].seqnum = seqnum1 + i + j;
+            entries[j].timestamp = seqnum1 + i + j;
+            entries[j].data = (char *) data;
+            entries[j].data_len = (uint32_t) data_len;
+        }
+
+        if ((rc = ldb_append(journal, entries, n, NULL)) != LDB_OK)
+            fail("appending entries", rc);
+    }
+}
+
+// Creates a new journal with num_entries entries (seqnums from 1).
+static ldb_journal_t * create_journal(const params_t *params, size_t num_entries)
+{
+    char *data = calloc(params->bytes_per_record ? params->bytes_per_record : 1, 1);
+
+    if (!data)
+        fail("out of memory", LDB_ERR_MEM);
+
+    remove_journal();
+
+    ldb_journal_t *journal = open_journal(false);
+    fill_journal(journal, 1, num_entries, data, params->bytes_per_record);
+
+    free(data);
+    return journal;
+}
+
+static uint64_t * alloc_samples(size_t len)
+{
+    uint64_t *samples = calloc(len ? len : 1, sizeof(uint64_t));
+
+    if (!samples)
+        fail("out of memory", LDB_ERR_MEM);
+
+    return samples;
+}
+
+// Drops the journal files from the page cache (written pages are flushed first).
+static void drop_cache(void)
+{
+    const char *filenames[] = { JOURNAL_NAME ".dat", JOURNAL_NAME ".idx" };
+
+    for (size_t i = 0; i < sizeof(filenames)/sizeof(filenames[0]); i++)
+    {
+        int fd = open(filenames[i], O_RDONLY);
+
+        if (fd == -1)
+            continue;
+
+        (void) fdatasync(fd);
+        (void) posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+static bool is_enabled(const params_t *params, const char *scenario)
+{
+    const char *str = params->scenarios;
+    size_t len = strlen(scenario);
+
+    if (str == NULL)
+        return true;
+
+    while ((str = strstr(str, scenario)) != NULL)
+    {
+        bool begin = (str == params->scenarios || str[-1] == ',');
+        bool end = (str[len] == '\0' || str[len] == ',');
+
+        if (begin && end)
+            return true;
+
+        str += len;
+    }
+
+    return false;
+}
+
+// Append latency of single-entry appends.
+static void run_append(const params_t *params, bool force_sync)
+{
+    const char *scenario = (force_sync ? "append_fsync" : "append");
+    size_t num_samples = (force_sync ? params->num_samples / 10 + 1 : params->num_samples);
+    uint64_t *samples = alloc_samples(num_samples);
+    char *data = calloc(params->bytes_per_record ? params->bytes_per_record : 1, 1);
+    char param[64] = {0};
+    int rc = LDB_OK;
+
+    if (!data)
+        fail("out of memory", LDB_ERR_MEM);
+
+    remove_journal();
+
+    ldb_journal_t *journal = open_journal(false);
+    ldb_set_fsync(journal, force_sync);
+
+    uint64_t t0 = get_nanos();
+
+    for (size_t i = 0; i < num_samples; i++)
+    {
+        ldb_entry_t entry = {
+            .seqnum = i + 1,
+            .timestamp = i + 1,
+            .data = data,
+            .data_len = (uint32_t) params->bytes_per_record
+        };
+
+        uint64_t t1 = get_nanos();
+
+        if ((rc = ldb_append(journal, &entry, 1, NULL)) != LDB_OK)
+            fail("appending entry", rc);
+
+        samples[i] = get_nanos() - t1;
+    }
+
+    snprintf(param, sizeof(param), "bpr=%zu", params->bytes_per_record);
+    report(params, scenario, param, samples, num_samples, get_nanos() - t0);
+
+    close_journal(journal);
+    free(samples);
+    free(data);
+}
+
+// Append latency of FILL_BATCH-entry appends (entries array or contiguous buffer).
+static void run_append_batch(const params_t *params, bool contiguous)
+{
+    const char *scenario = (contiguous ? "append_buf" : "append_batch");
+    size_t num_samples = params->num_samples / FILL_BATCH + 1;
+    uint64_t *samples = alloc_samples(num_samples);
+    char *arena = calloc(FILL_BATCH * (params->bytes_per_record ? params->bytes_per_record : 1), 1);
+    ldb_entry_t entries[FILL_BATCH] = {{0}};
+    uint32_t lengths[FILL_BATCH] = {0};
+    char param[64] = {0};
+    int rc = LDB_OK;
+
+    if (!arena)
+        fail("out of memory", LDB_ERR_MEM);
+
+    for (size_t j = 0; j < FILL_BATCH; j++)
+        lengths[j] = (uint32_t) params->bytes_per_record;
+
+    remove_journal();
+
+    ldb_journal_t *journal = open_journal(false);
+
+    uint64_t t0 = get_nanos();
+
+    for (size_t i = 0; i < num_samples; i++)
+    {
+        uint64_t t1 = get_nanos();
+
+        if (contiguous) {
+            rc = ldb_append_buf(journal, i * FILL_BATCH + 1, NULL, lengths, FILL_BATCH, arena, NULL);
+        }
+        else {
+            for (size_t j = 0; j < FILL_BATCH; j++) {
+                entries[j].seqnum = i * FILL_BATCH + j + 1;
+                entries[j].timestamp = 0;
+                entries[j].data = arena + j * params->bytes_per_record;
+                entries[j].data_len = lengths[j];
+            }
+
+            rc = ldb_append(journal, entries, FILL_BATCH, NULL);
+        }
+
+        if (rc != LDB_OK)
+            fail("appending entries", rc);
+
+        samples[i] = get_nanos() - t1;
+    }
+
+    snprintf(param, sizeof(param), "batch=%d", FILL_BATCH);
+    report(params, scenario, param, samples, num_samples, get_nanos() - t0);
+
+    close_journal(journal);
+    free(samples);
+    free(arena);
+}
+
+// Reads one entry at random (cold = page cache dropped before each read) or sequentially.
+static void run_read(const params_t *params, const char *scenario, bool random, bool cold)
+{
+    size_t num_samples = (cold ? params->num_samples / 10 + 1 : params->num_samples);
+    uint64_t *samples = alloc_samples(num_samples);
+    size_t buf_len = params->bytes_per_record + 1024;
+    char *buf = malloc(buf_len);
+    unsigned int seed = params->seed;
+    ldb_entry_t entry = {0};
+    char param[64] = {0};
+    uint64_t elapsed = 0;
+    size_t num = 0;
+    int rc = LDB_OK;
+
+    if (!buf)
+        fail("out of memory", LDB_ERR_MEM);
+
+    ldb_journal_t *journal = create_journal(params, params->num_entries);
+
+    // warm-up
+    for (uint64_t seqnum = 1; !cold && seqnum <= params->num_entries; seqnum += FILL_BATCH)
+        ldb_read(journal, seqnum, &entry, 1, buf, buf_len, &num);
+
+    for (size_t i = 0; i < num_samples; i++)
+    {
+        uint64_t seqnum = (random ? 1 + (uint64_t) rand_r(&seed) % params->num_entries : 1 + i % params->num_entries);
+
+        if (cold)
+            drop_cache();
+
+        uint64_t t1 = get_nanos();
+
+        if ((rc = ldb_read(journal, seqnum, &entry, 1, buf, buf_len, &num)) != LDB_OK || num != 1)
+            fail("reading entry", rc);
+
+        samples[i] = get_nanos() - t1;
+        elapsed += samples[i];
+    }
+
+    snprintf(param, sizeof(param), "entries=%zu", params->num_entries);
+    report(params, scenario, param, samples, num_samples, elapsed);
+
+    close_journal(journal);
+    free(samples);
+    free(buf);
+}
+
+// Search of random timestamps.
+static void run_search(const params_t *params)
+{
+    uint64_t *samples = alloc_samples(params->num_samples);
+    unsigned int seed = params->seed;
+    char param[64] = {0};
+    uint64_t seqnum = 0;
+    int rc = LDB_OK;
+
+    ldb_journal_t *journal = create_journal(params, params->num_entries);
+
+    uint64_t t0 = get_nanos();
+
+    for (size_t i = 0; i < params->num_samples; i++)
+    {
+        uint64_t ts = 1 + (uint64_t) rand_r(&seed) % params->num_entries;
+        ldb_search_e mode = (i % 2 == 0 ? LDB_SEARCH_LOWER : LDB_SEARCH_UPPER);
+
+        uint64_t t1 = get_nanos();
+
+        if ((rc = ldb_search(journal, ts, mode, &seqnum)) != LDB_OK)
+            fail("searching entry", rc);
+
+        samples[i] = get_nanos() - t1;
+    }
+
+    snprintf(param, sizeof(param), "entries=%zu", params->num_entries);
+    report(params, "search", param, samples, params->num_samples, get_nanos() - t0);
+
+    close_journal(journal);
+    free(samples);
+}
+
+static void * run_reader(void *ptr)
+{
+    args_read_t *args = (args_read_t *) ptr;
+    size_t buf_len = args->params->bytes_per_record + 1024;
+    char *buf = malloc(buf_len);
+    size_t num_entries = args->params->num_entries;
+    ldb_entry_t entry = {0};
+    size_t num = 0;
+
+    args->rc = (buf ? LDB_OK : LDB_ERR_MEM);
+
+    for (size_t i = 0; i < args->num_samples && args->rc == LDB_OK; i++)
+    {
+        uint64_t seqnum = 1 + (uint64_t) rand_r(&args->seed) % num_entries;
+        uint64_t t1 = get_nanos();
+
+        args->rc = ldb_read(args->journal, seqnum, &entry, 1, buf, buf_len, &num);
+        args->samples[i] = get_nanos() - t1;
+    }
+
+    free(buf);
+    return NULL;
+}
+
+// Random reads using 1, 2, 4, ..., num_readers concurrent readers.
+static void run_readers(const params_t *params)
+{
+    size_t per_reader = params->num_samples;
+    uint64_t *samples = alloc_samples(per_reader * params->num_readers);
+    pthread_t threads[MAX_READERS];
+    args_read_t args[MAX_READERS];
+    char param[64] = {0};
+
+    ldb_journal_t *journal = create_journal(params, params->num_entries);
+
+    for (size_t n = 1; ; n = (2 * n < params->num_readers ? 2 * n : params->num_readers))
+    {
+        uint64_t t0 = get_nanos();
+
+        for (size_t i = 0; i < n; i++) {
+            args[i] = (args_read_t) {
+                .journal = journal,
+                .params = params,
+                .samples = samples + i * per_reader,
+                .num_samples = per_reader,
+                .seed = params->seed + (unsigned int) i,
+                .rc = LDB_OK
+            };
+            pthread_create(&threads[i], NULL, run_reader, &args[i]);
+        }
+
+        for (size_t i = 0; i < n; i++)
+            pthread_join(threads[i], NULL);
+
+        uint64_t elapsed = get_nanos() - t0;
+
+        for (size_t i = 0; i < n; i++) {
+            if (args[i].rc != LDB_OK)
+                fail("reading entry", args[i].rc);
+        }
+
+        snprintf(param, sizeof(param), "readers=%zu", n);
+        report(params, "read_readers", param, samples, n * per_reader, elapsed);
+
+        if (n == params->num_readers)
+            break;
+    }
+
+    close_journal(journal);
+    free(samples);
+}
+
+// Smallest journal size of the scenarios depending on the journal size (1%, 10%, 100%).
+static size_t first_size(const params_t *params)
+{
+    size_t size = params->num_entries;
+
+    while (size % 10 == 0 && size > params->num_entries / 100)
+        size /= 10;
+
+    return size;
+}
+
+// Purge and rollback of half the journal for increasing journal sizes.
+static void run_purge_rollback(const params_t *params, bool purge)
+{
+    uint64_t *samples = alloc_samples(params->num_rounds);
+    char param[64] = {0};
+
+    for (size_t size = first_size(params); size <= params->num_entries; size *= 10)
+    {
+        for (size_t i = 0; i < params->num_rounds; i++)
+        {
+            ldb_journal_t *journal = create_journal(params, size);
+            uint64_t seqnum = 1 + size / 2;
+
+            uint64_t t1 = get_nanos();
+            long rc = (purge ? ldb_purge(journal, seqnum) : ldb_rollback(journal, seqnum));
+            samples[i] = get_nanos() - t1;
+
+            if (rc < 0)
+                fail(purge ? "purging journal" : "rolling back journal", (int) rc);
+
+            close_journal(journal);
+        }
+
+        snprintf(param, sizeof(param), "entries=%zu", size);
+        report(params, (purge ? "purge" : "rollback"), param, samples, params->num_rounds, 0);
+    }
+
+    free(samples);
+}
+
+// Open time of a journal cleanly closed (check or not) and when the idx file must be rebuilt.
+static void run_open(const params_t *params, const char *scenario, bool check, bool rebuild)
+{
+    uint64_t *samples = alloc_samples(params->num_rounds);
+    char param[64] = {0};
+
+    for (size_t size = first_size(params); size <= params->num_entries; size *= 10)
+    {
+        close_journal(create_journal(params, size));
+
+        for (size_t i = 0; i < params->num_rounds; i++)
+        {
+            if (rebuild)
+                remove(JOURNAL_NAME ".idx");
+
+            uint64_t t1 = get_nanos();
+            ldb_journal_t *journal = open_journal(check);
+            samples[i] = get_nanos() - t1;
+
+            close_journal(journal);
+        }
+
+        snprintf(param, sizeof(param), "entries=%zu", size);
+        report(params, scenario, param, samples, params->num_rounds, 0);
+    }
+
+    free(samples);
+}
+
+static void help(void)
+{
+    const char *msg = \
+        "usage: benchmark [OPTION]..." "\n" \
+        "\n" \
+        "Runs the benchmark scenarios and prints the latencies (CSV or JSON)." "\n" \
+        "\n" \
+        "Arguments:" "\n" \
+        "   -h, --help                 Display this help and quit." "\n" \
+        "   -j, --json                 Output in JSON format (default: CSV)." "\n" \
+        "   -o, --output=FILE          Output file (default: stdout)." "\n" \
+        "   --entries=NUM              Number of entries in the journal (default: 100000)." "\n" \
+        "   --bpr=NUM                  Bytes per record (default: 256)." "\n" \
+        "   --samples=NUM              Samples per scenario (default: 10000)." "\n" \
+        "   --readers=NUM              Maximum number of concurrent readers (default: 8)." "\n" \
+        "   --rounds=NUM               Samples of purge, rollback and open scenarios (default: 3)." "\n" \
+        "   --seed=NUM                 Random seed (default: 1)." "\n" \
+        "   --scenarios=LIST           Comma-separated scenarios to run (default: all)." "\n" \
+        "\n" \
+        "Scenarios:" "\n" \
+        "   append, append_fsync, append_batch, append_buf, read_seq, read_random," "\n" \
+        "   read_cold, search, read_readers, purge, rollback, open, open_check," "\n" \
+        "   open_rebuild" "\n" \
+        "\n" \
+        "Examples:" "\n" \
+        "   benchmark --json -o results.json" "\n" \
+        "   benchmark --entries=1000000 --bpr=1024 --scenarios=read_random,search" "\n" \
+        "\n";
+
+    printf("%s", msg);
+}
+
+static size_t parse_int(const char *str, const char *arg)
+{
+    char *endptr = NULL;
+
+    errno = 0;
+    unsigned long long val = strtoull(str, &endptr, 10);
+
+    if (!isdigit((unsigned char) *str) || errno == ERANGE || *endptr != 0) {
+        fprintf(stderr, "Error: argument '%s' has an invalid value (%s)\n", arg, str);
+        exit(EXIT_FAILURE);
+    }
+
+    return (size_t) val;
+}
+
+static void parse_args(int argc, char *argv[], params_t *params)
+{
+    const char* const options1 = "hjo:" ;
+    const struct option options2[] = {
+        { "help",       0,  NULL,  'h' },
+        { "json",       0,  NULL,  'j' },
+        { "output",     1,  NULL,  'o' },
+        { "entries",    1,  NULL,  301 },
+        { "bpr",        1,  NULL,  302 },
+        { "samples",    1,  NULL,  303 },
+        { "readers",    1,  NULL,  304 },
+        { "rounds",     1,  NULL,  305 },
+        { "seed",       1,  NULL,  306 },
+        { "scenarios",  1,  NULL,  307 },
+        { NULL,         0,  NULL,   0  }
+    };
+
+    *params = (params_t) {
+        .num_entries = 100000,
+        .bytes_per_record = 256,
+        .num_samples = 10000,
+        .num_readers = 8,
+        .num_rounds = 3,
+        .seed = 1,
+        .json = false,
+        .scenarios = NULL,
+        .out = stdout
+    };
+
+    while (true)
+    {
+        int curropt = getopt_long(argc, argv, options1, options2, NULL);
+
+        if (curropt == -1)
+            break;
+
+        switch(curropt)
+        {
+            case '?': // invalid option
+                fprintf(stderr, "use --help option for more information\n");
+                exit(EXIT_FAILURE);
+            case 'h':
+                help();
+                exit(EXIT_SUCCESS);
+            case 'j':
+                params->json = true;
+                break;
+            case 'o':
+                if ((params->out = fopen(optarg, "w")) == NULL) {
+                    fprintf(stderr, "Error: cannot open %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 301:
+                params->num_entries = parse_int(optarg, "entries");
+                break;
+            case 302:
+                params->bytes_per_record = parse_int(optarg, "bpr");
+                break;
+            case 303:
+                params->num_samples = parse_int(optarg, "samples");
+                break;
+            case 304:
+                params->num_readers = parse_int(optarg, "readers");
+                break;
+            case 305:
+                params->num_rounds = parse_int(optarg, "rounds");
+                break;
+            case 306:
+                params->seed = (unsigned int) parse_int(optarg, "seed");
+                break;
+            case 307:
+                params->scenarios = optarg;
+                break;
+            default:
+                fprintf(stderr, "Unexpected error\n");
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (params->num_entries == 0 || params->num_samples == 0 || params->num_rounds == 0) {
+        fprintf(stderr, "Error: entries, samples and rounds must be greater than 0\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (params->num_readers == 0 || params->num_readers > MAX_READERS) {
+        fprintf(stderr, "Error: readers must be between 1 and %d\n", MAX_READERS);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    params_t params = {0};
+
+    parse_args(argc, argv, &params);
+
+    if (params.json) {
+        fprintf(params.out, "{\n\"version\": \"%d.%d.%d\", \"entries\": %zu, \"bpr\": %zu, \"seed\": %u,\n\"results\": [",
+                LDB_VERSION_MAJOR, LDB_VERSION_MINOR, LDB_VERSION_PATCH,
+                params.num_entries, params.bytes_per_record, params.seed);
+    }
+    else {
+        fprintf(params.out, "scenario,param,samples,ops_per_sec,avg_ns,p50_ns,p99_ns,p999_ns,max_ns\n");
+    }
+
+    if (is_enabled(&params, "append"))
+        run_append(&params, false);
+    if (is_enabled(&params, "append_fsync"))
+        run_append(&params, true);
+    if (is_enabled(&params, "append_batch"))
+        run_append_batch(&params, false);
+    if (is_enabled(&params, "append_buf"))
+        run_append_batch(&params, true);
+    if (is_enabled(&params, "read_seq"))
+        run_read(&params, "read_seq", false, false);
+    if (is_enabled(&params, "read_random"))
+        run_read(&params, "read_random", true, false);
+    if (is_enabled(&params, "read_cold"))
+        run_read(&params, "read_cold", true, true);
+    if (is_enabled(&params, "search"))
+        run_search(&params);
+    if (is_enabled(&params, "read_readers"))
+        run_readers(&params);
+    if (is_enabled(&params, "purge"))
+        run_purge_rollback(&params, true);
+    if (is_enabled(&params, "rollback"))
+        run_purge_rollback(&params, false);
+    if (is_enabled(&params, "open"))
+        run_open(&params, "open", false, false);
+    if (is_enabled(&params, "open_check"))
+        run_open(&params, "open_check", true, false);
+    if (is_enabled(&params, "open_rebuild"))
+        run_open(&params, "open_rebuild", false, true);
+
+    if (params.json)
+        fprintf(params.out, "\n]\n}\n");
+
+    if (params.out != stdout)
+        fclose(params.out);
+
+    remove_journal();
+
+    return EXIT_SUCCESS;
+}
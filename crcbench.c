@@ -0,0 +1,73 @@
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "journal.h"
+#include "journal.c"
+
+/**
+ * Micro-benchmark comparing the crc32 methods.
+ * 
+ * All methods give identical checksums (on-disk values unchanged).
+ * Hardware method is available when compiled with ARMv8 CRC support
+ * (ex. -march=armv8-a+crc).
+ */
+
+#define MIN_BYTES_PER_METHOD    (512 * 1024 * 1024)
+
+typedef uint32_t (*crc32_method_t)(const unsigned char *bytes, size_t len, uint32_t crc);
+
+static double get_seconds(void)
+{
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void run_method(const char *name, crc32_method_t method, const unsigned char *buf, size_t len)
+{
+    size_t iterations = MIN_BYTES_PER_METHOD / len + 1;
+    uint32_t crc = 0xFFFFFFFF;
+
+    // warm-up (lazy tables initialization, caches)
+    crc = method(buf, len, crc);
+
+    double t0 = get_seconds();
+
+    for (size_t i = 0; i < iterations; i++)
+        crc = method(buf, len, crc);
+
+    double seconds = get_seconds() - t0;
+    double mbps = (double) iterations * (double) len / seconds / 1e6;
+
+    printf("%-10s %10zu %12.2lf  %08x\n", name, len, mbps, (unsigned) ~crc);
+}
+
+int main(void)
+{
+    const size_t sizes[] = { 16, 64, 4096, 1024 * 1024 };
+    const size_t max_len = sizes[sizeof(sizes)/sizeof(sizes[0]) - 1];
+    unsigned char *buf = (unsigned char *) malloc(max_len);
+
+    if (buf == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < max_len; i++)
+        buf[i] = (unsigned char) rand();
+
+    printf("method          bytes         MB/s  checksum\n");
+
+    for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    {
+        run_method("bytewise", ldb_crc32_bytewise, buf, sizes[i]);
+#ifdef LDB_CRC32_ARMV8
+        run_method("armv8", ldb_crc32_armv8, buf, sizes[i]);
+#else
+        run_method("slice-8", ldb_crc32_slice8, buf, sizes[i]);
+#endif
+    }
+
+    free(buf);
+    return EXIT_SUCCESS;
+}
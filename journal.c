@@ -11,26 +11,77 @@
 #include <pthread.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <dirent.h>
 #include "journal.h"
 
+#if defined(__linux__)
+    #include <sys/sendfile.h>
+    #define LDB_SENDFILE
+#endif
+
+#if defined(__ARM_FEATURE_CRC32) && defined(__ORDER_LITTLE_ENDIAN__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    #include <arm_acle.h>
+    #define LDB_CRC32_ARMV8
+#endif
+
 /**
  * Rule of thumb:
  * 
  *   - We use FILE and fwrite() to write to files. 
  *     These methods are buffered and faster than write() system call.
+ *   - Except append, that uses writev() to write a batch of entries
+ *     (record headers, user data and padding) with one system call per 
+ *     file, avoiding the copy to the FILE buffer.
  *   - We use file descriptor and read() to read from files.
  *     All read content was previosuly flushed by fwrite().
  *     We rely on the filesystem cache for buffering.
+ *   - In mmap mode, reads are served from a read-only mapping.
+ *     The mapping window is larger than the file and grows by doubling.
+ *     Content beyond the window is read using pread().
+ *   - Shipped and ingested raw content is copied by the kernel between 
+ *     file descriptors (sendfile() on Linux).
  */
 
 #define LDB_EXT_DAT             ".dat"
 #define LDB_EXT_IDX             ".idx"
-#define LDB_EXT_TMP             ".tmp"
+#define LDB_EXT_TMP_DAT         ".dat.tmp"
+#define LDB_EXT_TMP_IDX         ".idx.tmp"
 #define LDB_PATH_SEPARATOR      "/"
 #define LDB_NAME_MAX_LENGTH     32
 #define LDB_DAT_MAGIC_NUMBER    0x74616478656C706E
 #define LDB_IDX_MAGIC_NUMBER    0x78646978656C706E
-#define LDB_FILE_FORMAT         2
+#define LDB_FILE_FORMAT         2       // Fixed records (ldb_record_dat_t header, data padded to 8 bytes)
+#define LDB_FILE_FORMAT_DENSE   3       // Dense records (varint header, no padding)
+#define LDB_FILE_FORMAT_BATCH   4       // Dense records framed by batch (one checksum per batch)
+#define LDB_HEADER_MAX          40      // Maximum record header length (any format)
+#define LDB_DENSE_MIN_LEN       6       // Dense header: tag + timestamp delta + checksum
+#define LDB_BATCH_MIN_LEN       3       // Batch member header: tag + timestamp delta + batch offset
+#define LDB_BATCH_FIELDS_LEN    12      // Batch header fields after the timestamp: num + len + checksum
+#define LDB_DENSE_VALID         1u      // Dense tag flags (tag = stored length << 3 | flags), 0 means no record
+#define LDB_DENSE_BASE          2u      // Absolute seqnum and timestamp follow the tag (otherwise timestamp delta)
+                                        // Batch format: the record is the batch header
+#define LDB_DENSE_COMPRESSED    4u      // Stored data is compressed (see LDB_DATA_COMPRESSED)
+#define LDB_IDX_FORMAT          4       // Compact idx (new idx files). Files with another format are rebuilt on open
+#define LDB_IDX_FORMAT_WIDE     3       // One ldb_record_idx_t per entry (still read and appended)
+#define LDB_IDX_BLOCK_LEN       4096    // Compact idx block: first record + 509 deltas
+#define LDB_IDX_BLOCK_RECORDS   (1 + (LDB_IDX_BLOCK_LEN - sizeof(ldb_record_idx_t)) / sizeof(uint64_t))
+#define LDB_IDX_POS_BITS        40      // Delta = timestamp (24 bits) | pos (40 bits), block spans less than 1 TB
+#define LDB_IDX_POS_MASK        ((UINT64_C(1) << LDB_IDX_POS_BITS) - 1)
+#define LDB_IDX_TS_UNKNOWN      0xFFFFFFu // Timestamp delta overflow (timestamp read from the dat record)
+#define LDB_MMAP_MIN_LEN        (4 * 1024 * 1024)
+#define LDB_IOV_ENTRIES         64      // Entries per writev() call (3 iovecs per entry, below IOV_MAX)
+#define LDB_SPARSE_STRIDE       128     // Initial sparse index interval (128 idx records = 3KB)
+#define LDB_SCAN_CHUNK          (8 * 1024 * 1024) // Bytes read at once when the dat file is scanned
+#define LDB_SCAN_THREADS        8       // Maximum threads verifying checksums on scan
+#define LDB_DATA_COMPRESSED     0x80000000u // Flag in ldb_record_dat_t.data_len (payload is compressed)
+#define LDB_COMPRESS_MIN_LEN    64      // Smaller entries are stored uncompressed
+#define LDB_LZ_HASH_BITS        12      // Match finder table size (4096 positions)
+#define LDB_LZ_MIN_MATCH        4       // LZ4 block format constants
+#define LDB_LZ_LAST_LITERALS    5
+#define LDB_LZ_MF_LIMIT         12
+#define LDB_LZ_MAX_OFFSET       65535
 
 #if defined(__GNUC__) || defined(__clang__) || defined(__INTEL_LLVM_COMPILER) 
     #define LDB_INLINE  __attribute__((const)) __attribute__((always_inline)) inline
@@ -40,6 +91,23 @@
     #define PACKED      /**/
 #endif
 
+// Metrics and the published state use atomics (plain operations elsewhere)
+#if defined(__GNUC__) || defined(__clang__)
+    #define LDB_ATOMIC_ADD(ptr, val)        __atomic_fetch_add((ptr), (val), __ATOMIC_RELAXED)
+    #define LDB_ATOMIC_LOAD(ptr)            __atomic_load_n((ptr), __ATOMIC_RELAXED)
+    #define LDB_ATOMIC_CAS(ptr, exp, val)   __atomic_compare_exchange_n((ptr), (exp), (val), true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+    #define LDB_ATOMIC_STORE(ptr, val)      __atomic_store_n((ptr), (val), __ATOMIC_RELAXED)
+    #define LDB_ATOMIC_LOAD_ACQ(ptr)        __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+    #define LDB_ATOMIC_STORE_REL(ptr, val)  __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#else
+    #define LDB_ATOMIC_ADD(ptr, val)        (*(ptr) += (val))
+    #define LDB_ATOMIC_LOAD(ptr)            (*(ptr))
+    #define LDB_ATOMIC_CAS(ptr, exp, val)   (*(ptr) = (val), true)
+    #define LDB_ATOMIC_STORE(ptr, val)      (*(ptr) = (val))
+    #define LDB_ATOMIC_LOAD_ACQ(ptr)        (*(ptr))
+    #define LDB_ATOMIC_STORE_REL(ptr, val)  (*(ptr) = (val))
+#endif
+
 #if defined __has_attribute
     #if __has_attribute(__fallthrough__)
         # define fallthrough   __attribute__((__fallthrough__))
@@ -56,42 +124,71 @@ typedef struct ldb_state_t {
     uint64_t timestamp2;          // Timestamp of the last entry.
 } ldb_state_t;
 
-typedef struct ldb_impl_t
-{
-    // Fixed data (unchanged)
-    char *name;                   // Journal name
-    char *path;                   // Directory where files are located
-    char *dat_path;               // Data filepath (path + filename)
-    char *idx_path;               // Index filepath (path + filename)
-    uint32_t format;              // File format
-    bool force_fsync;             // Force fsync after flush
-
-    // Shared data (accessed by both threads)
-    pthread_mutex_t mutex_state;  // Prevents race condition on state values
-    pthread_mutex_t mutex_files;  // Preserve coherence between shared variable and file contents
-    ldb_state_t state;            // First and last seqnums and timestamps
-    FILE *dat_fp;                 // Data file pointer (used to write)
-    FILE *idx_fp;                 // Index file pointer (used to write)
-
-    // Thread-write variables
-    char padding[64];             // Padding to avoid destructive interference between threads
-    size_t dat_end;               // Last position on data file
-
-} ldb_impl_t;
+typedef struct ldb_map_t {
+    char *addr;                   // Mapped address (NULL means not mapped).
+    size_t len;                   // Mapped length (can exceed the file size).
+    size_t size;                  // Length of the mapped file content (atomic, grows on publish).
+    struct ldb_map_t *next;       // Next retired mapping (pinned by views).
+} ldb_map_t;
+
+typedef struct ldb_sample_t {
+    uint64_t seqnum;              // Sampled seqnum (seqnum % stride = 0).
+    uint64_t timestamp;           // Timestamp of the sampled entry.
+} ldb_sample_t;
+
+typedef struct ldb_sparse_t {
+    ldb_sample_t *samples;        // Sampled idx records sorted by seqnum.
+    size_t len;                   // Number of samples.
+    size_t capacity;              // Allocated samples.
+    size_t max_len;               // Maximum number of samples (0 means disabled).
+    uint64_t stride;              // Sampling interval (doubles when max_len is reached).
+} ldb_sparse_t;
+
+typedef struct ldb_writeback_t {
+    char *buf;                    // Encoded idx records not yet written to the idx file.
+    size_t pos;                   // Idx file position of buf (written content ends here).
+    size_t len;                   // Length of the content of buf.
+    size_t capacity;              // Allocated bytes.
+    size_t num;                   // Number of entries in buf.
+    size_t max_entries;           // Entries kept before writing them (0 means disabled).
+} ldb_writeback_t;
+
+typedef struct ldb_request_t {
+    void *target;                 // Journal of the request (manager only, NULL otherwise).
+    ldb_entry_t *entries;         // Entries to append (owned by the submitter).
+    const uint32_t *lengths;      // Data lengths of a contiguous buffer request (NULL = entries request).
+    const uint64_t *timestamps;   // Timestamps of a contiguous buffer request (NULL = system assigned).
+    const char *buf;              // Data of a contiguous buffer request.
+    uint64_t seqnum;              // First seqnum of a contiguous buffer request (0 = system assigned).
+    size_t len;                   // Number of entries to append.
+    size_t num;                   // Number of appended entries.
+    int ret;                      // Append result.
+    bool done;                    // Request committed (protected by mutex_queue).
+    struct ldb_request_t *next;   // Next request in queue.
+} ldb_request_t;
+
+typedef struct ldb_group_t {
+    pthread_t thread;             // Writer thread
+    void (*commit)(void *arg, struct ldb_request_t *batch); // Writes and commits a batch (called by writer thread)
+    void *arg;                    // Commit function argument
+    pthread_mutex_t mutex_write;  // Serializes batches with rollback and purge
+    pthread_mutex_t mutex_queue;  // Protects queue values
+    pthread_cond_t cond_submit;   // Signaled when a request is queued (wakes writer)
+    pthread_cond_t cond_commit;   // Signaled when a batch is taken or committed (wakes submitters)
+    ldb_request_t *head;          // First queued request
+    ldb_request_t *tail;          // Last queued request
+    size_t queue_len;             // Number of queued entries
+    size_t queue_max;             // Maximum number of queued entries
+    bool stop;                    // Writer thread ends once queue is empty
+} ldb_group_t;
 
 typedef struct PACKED ldb_header_dat_t {
     uint64_t magic_number;
     uint32_t format;
-    uint32_t padding;
+    uint32_t codec;               // Codec used to compress records (see ldb_codec_e).
     char metadata[LDB_METADATA_LEN];
 } ldb_header_dat_t;
 
-typedef struct PACKED ldb_header_idx_t {
-    uint64_t magic_number;
-    uint32_t format;
-    uint32_t padding;
-} ldb_header_idx_t;
-
 typedef struct PACKED ldb_record_dat_t {
     uint64_t seqnum;
     uint64_t timestamp;
@@ -105,6 +202,66 @@ typedef struct PACKED ldb_record_idx_t {
     uint64_t pos;
 } ldb_record_idx_t;
 
+typedef struct PACKED ldb_header_idx_t {
+    uint64_t magic_number;
+    uint32_t format;
+    uint32_t padding;
+    ldb_record_idx_t checkpoint;  // Last verified record at clean close (0 if none).
+} ldb_header_idx_t;
+
+typedef struct ldb_impl_t
+{
+    // Fixed data (unchanged)
+    char *name;                   // Journal name
+    char *path;                   // Directory where files are located
+    char *dat_path;               // Data filepath (path + filename)
+    char *idx_path;               // Index filepath (path + filename)
+    uint32_t format;              // File format
+    bool force_fsync;             // Force fsync after flush
+    bool verify_checksum;         // Verify checksum on read
+    int mmap_mode;                // Memory-mapped files (see ldb_mmap_e)
+    int codec;                    // Codec used on append (see ldb_codec_e)
+    size_t prealloc;              // Bytes allocated ahead of the files end (0 = disabled)
+    bool metrics_enabled;         // Metrics are collected
+    uint32_t idx_format;          // Index file format (LDB_IDX_FORMAT or LDB_IDX_FORMAT_WIDE)
+
+    // Published state (seqlock, own cache line)
+    char padding_state[64];       // Padding to avoid destructive interference with fixed data
+    uint64_t state_seq;           // Sequence of the state (odd while it is being updated)
+    ldb_state_t state;            // First and last seqnums and timestamps
+    char padding_shared[64];      // Padding to avoid destructive interference with shared data
+
+    // Shared data (accessed by both threads)
+    pthread_mutex_t mutex_state;  // Prevents race condition on views, sparse index and notify pipe
+    pthread_rwlock_t rwlock_files; // Preserve coherence between shared variable and file contents
+    FILE *dat_fp;                 // Data file pointer (used to write)
+    FILE *idx_fp;                 // Index file pointer (used to write)
+    ldb_map_t dat_map;            // Data file mapping (used to read)
+    ldb_map_t idx_map;            // Index file mapping (used to read)
+    pthread_cond_t cond_views;    // Signaled when the last view is released
+    pthread_cond_t cond_append;   // Signaled when appended entries are published (monotonic clock)
+    int notify_fd[2];             // Pipe written when entries are published (-1 means not created)
+    size_t num_views;             // Number of pinned views (protected by mutex_state)
+    ldb_map_t *retired;           // Replaced data mappings waiting for views release
+    ldb_group_t *group;           // Group commit (NULL means disabled)
+    ldb_sparse_t sparse;          // Sparse timestamp index (protected by mutex_state)
+    pthread_mutex_t mutex_idx;    // Prevents race condition on the idx write-behind buffer
+    ldb_writeback_t writeback;    // Idx records not yet written (protected by mutex_idx)
+    uint64_t epoch;               // Incremented when content is rolled back or purged (rwlock_files in W mode)
+    ldb_metrics_t metrics;        // Hot-path metrics (atomic values)
+
+    // Thread-write variables
+    char padding[64];             // Padding to avoid destructive interference between threads
+    size_t dat_end;               // Last position on data file
+    size_t dat_alloc;             // Allocated length of the data file
+    size_t idx_alloc;             // Allocated length of the index file
+    ldb_record_idx_t checkpoint;  // Last verified record (records up to it are not verified on open)
+    ldb_record_idx_t idx_block;   // First record of the last idx block written (compact format)
+    char *zbuf;                   // Compressed payloads of the entries being written
+    size_t zbuf_len;              // Length of zbuf
+
+} ldb_impl_t;
+
 /* generated using the AUTODIN II polynomial
  *    x^32 + x^26 + x^23 + x^22 + x^16 +
  *    x^12 + x^11 + x^10 + x^8 + x^7 + x^5 + x^4 + x^2 + x^1 + 1
@@ -146,6 +303,77 @@ static const uint32_t ldb_crctab[256] = {
 
 #define LDB_CRC(crc, ch)     (crc = (crc >> 8) ^ ldb_crctab[(crc ^ (ch)) & 0xff])
 
+// Byte-at-a-time method (reference).
+// crc is the internal register value (inverted checksum).
+static uint32_t ldb_crc32_bytewise(const unsigned char *bytes, size_t len, uint32_t crc)
+{
+    for (size_t i = 0; i < len; i++)
+        LDB_CRC(crc, bytes[i]);
+
+    return crc;
+}
+
+#ifndef LDB_CRC32_ARMV8
+
+// Slice-by-8 tables (ldb_crctab8[0] = ldb_crctab).
+// Computed once from ldb_crctab on first use.
+static uint32_t ldb_crctab8[8][256];
+static pthread_once_t ldb_crctab8_once = PTHREAD_ONCE_INIT;
+
+static void ldb_crc32_init(void)
+{
+    for (size_t i = 0; i < 256; i++)
+        ldb_crctab8[0][i] = ldb_crctab[i];
+
+    for (size_t k = 1; k < 8; k++)
+        for (size_t i = 0; i < 256; i++)
+            ldb_crctab8[k][i] = (ldb_crctab8[k-1][i] >> 8) ^ ldb_crctab[ldb_crctab8[k-1][i] & 0xff];
+}
+
+// Slice-by-8 method (8 bytes per iteration, identical results).
+// Words are composed byte by byte (endianness and alignment agnostic).
+static uint32_t ldb_crc32_slice8(const unsigned char *bytes, size_t len, uint32_t crc)
+{
+    pthread_once(&ldb_crctab8_once, ldb_crc32_init);
+
+    while (len >= 8)
+    {
+        uint32_t one = crc ^ ((uint32_t) bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24);
+        uint32_t two = ((uint32_t) bytes[4] | (uint32_t) bytes[5] << 8 | (uint32_t) bytes[6] << 16 | (uint32_t) bytes[7] << 24);
+
+        crc = ldb_crctab8[7][one & 0xff] ^
+              ldb_crctab8[6][(one >> 8) & 0xff] ^
+              ldb_crctab8[5][(one >> 16) & 0xff] ^
+              ldb_crctab8[4][one >> 24] ^
+              ldb_crctab8[3][two & 0xff] ^
+              ldb_crctab8[2][(two >> 8) & 0xff] ^
+              ldb_crctab8[1][(two >> 16) & 0xff] ^
+              ldb_crctab8[0][two >> 24];
+
+        bytes += 8;
+        len -= 8;
+    }
+
+    return ldb_crc32_bytewise(bytes, len, crc);
+}
+
+#else
+
+// ARMv8 CRC32 instructions (same polynomial, identical results).
+static uint32_t ldb_crc32_armv8(const unsigned char *bytes, size_t len, uint32_t crc)
+{
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        crc = __crc32d(crc, word);
+        bytes += 8;
+        len -= 8;
+    }
+
+    return ldb_crc32_bytewise(bytes, len, crc);
+}
+#endif
+
 /**
  * Computes the crc32 checksum.
  * 
@@ -161,12 +389,11 @@ uint32_t ldb_crc32(const char *bytes, size_t len, uint32_t checksum)
     if (bytes == NULL || len == 0)
         return checksum;
 
-    checksum = ~checksum;
-
-    for (size_t i = 0; i < len; i++)
-        LDB_CRC(checksum, (unsigned char) bytes[i]);
-
-    return ~checksum;
+#ifdef LDB_CRC32_ARMV8
+    return ~ldb_crc32_armv8((const unsigned char *) bytes, len, ~checksum);
+#else
+    return ~ldb_crc32_slice8((const unsigned char *) bytes, len, ~checksum);
+#endif
 }
 
 const char * ldb_strerror(int errnum)
@@ -232,6 +459,78 @@ static size_t ldb_padding(size_t value) {
     return round_up - value;
 }
 
+// Bytes stored after the record header (ldb_record_dat_t.data_len without flags).
+LDB_INLINE
+static size_t ldb_stored_len(uint32_t data_len) {
+    return (size_t) (data_len & ~LDB_DATA_COMPRESSED);
+}
+
+// Dense and batch formats use varint headers.
+LDB_INLINE
+static bool ldb_is_dense(uint32_t format) {
+    return (format == LDB_FILE_FORMAT_DENSE || format == LDB_FILE_FORMAT_BATCH);
+}
+
+// Padding after the stored data (dense records are not padded).
+LDB_INLINE
+static size_t ldb_padding_dat(uint32_t format, size_t len) {
+    return (ldb_is_dense(format) ? 0 : ldb_padding(len));
+}
+
+// Bytes used by a record in the dat file (header + stored data + padding).
+LDB_INLINE
+static size_t ldb_record_len(uint32_t format, size_t header_len, uint32_t data_len) {
+    size_t len = ldb_stored_len(data_len);
+    return header_len + len + ldb_padding_dat(format, len);
+}
+
+// Minimum length of a record in the dat file.
+LDB_INLINE
+static size_t ldb_min_record_len(uint32_t format) {
+    switch (format) {
+        case LDB_FILE_FORMAT_DENSE: return LDB_DENSE_MIN_LEN;
+        case LDB_FILE_FORMAT_BATCH: return LDB_BATCH_MIN_LEN;
+        default: return sizeof(ldb_record_dat_t);
+    }
+}
+
+// Writes value as a varint (7 bits per byte, little endian).
+// Returns the number of written bytes (max 10).
+static size_t ldb_put_varint(char *buf, uint64_t value)
+{
+    size_t len = 0;
+
+    while (value >= 0x80) {
+        buf[len++] = (char) (value | 0x80);
+        value >>= 7;
+    }
+
+    buf[len++] = (char) value;
+
+    return len;
+}
+
+// Reads a varint from buf.
+// Returns the number of read bytes (0 = incomplete or invalid).
+static size_t ldb_get_varint(const char *buf, size_t len, uint64_t *value)
+{
+    uint64_t ret = 0;
+
+    for (size_t i = 0; i < len && i < 10; i++)
+    {
+        unsigned char byte = (unsigned char) buf[i];
+
+        ret |= (uint64_t) (byte & 0x7F) << (7 * i);
+
+        if ((byte & 0x80) == 0) {
+            *value = ret;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
 LDB_INLINE
 static bool ldb_is_valid_obj(ldb_impl_t *obj) {
     return (obj &&
@@ -248,1632 +547,7259 @@ static void ldb_reset_state(ldb_state_t *state) {
     }
 }
 
-static int ldb_close_files(ldb_impl_t *obj)
+// Returns the monotonic clock in nanoseconds if metrics are enabled, 0 otherwise.
+static uint64_t ldb_metrics_now(const ldb_impl_t *obj)
 {
-    if (!obj)
-        return LDB_OK;
+    struct timespec ts = {0};
 
-    int ret = LDB_OK;
+    if (!obj->metrics_enabled || clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+        return 0;
 
-    if (obj->idx_fp != NULL)
-    {
-        int idx_fd = fileno(obj->idx_fp);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
 
-        flock(idx_fd, LOCK_UN);
+static void ldb_metrics_sample(ldb_histogram_t *hist, uint64_t ns)
+{
+    size_t bucket = 0;
+    uint64_t max = LDB_ATOMIC_LOAD(&hist->max_ns);
 
-        if (fclose(obj->idx_fp) != 0)
-            ret = LDB_ERR_WRITE_IDX;
+    while (bucket + 1 < LDB_METRICS_BUCKETS && (ns >> (bucket + 1)) != 0)
+        bucket++;
 
-        obj->idx_fp = NULL;
+    LDB_ATOMIC_ADD(&hist->count, 1);
+    LDB_ATOMIC_ADD(&hist->sum_ns, ns);
+    LDB_ATOMIC_ADD(&hist->buckets[bucket], 1);
+
+    while (ns > max && !LDB_ATOMIC_CAS(&hist->max_ns, &max, ns))
+        ;
+}
+
+// Adds the time elapsed since t0 (see ldb_metrics_now()) to hist.
+static void ldb_metrics_time(ldb_impl_t *obj, ldb_histogram_t *hist, uint64_t t0)
+{
+    uint64_t t1 = (t0 == 0 ? 0 : ldb_metrics_now(obj));
+
+    if (t1 != 0)
+        ldb_metrics_sample(hist, (t1 > t0 ? t1 - t0 : 0));
+}
+
+static void ldb_metrics_add(ldb_impl_t *obj, uint64_t *counter, uint64_t value)
+{
+    if (obj->metrics_enabled)
+        LDB_ATOMIC_ADD(counter, value);
+}
+
+// Locks the state mutex (wait time is sampled, 0 if uncontended).
+static void ldb_lock_state(ldb_impl_t *obj)
+{
+    if (!obj->metrics_enabled) {
+        pthread_mutex_lock(&obj->mutex_state);
+        return;
     }
 
-    if (obj->dat_fp != NULL)
-    { 
-        int dat_fd = fileno(obj->dat_fp);
+    if (pthread_mutex_trylock(&obj->mutex_state) == 0) {
+        ldb_metrics_sample(&obj->metrics.lock_state, 0);
+        return;
+    }
 
-        flock(dat_fd, LOCK_UN);
+    uint64_t t0 = ldb_metrics_now(obj);
+    pthread_mutex_lock(&obj->mutex_state);
+    ldb_metrics_time(obj, &obj->metrics.lock_state, t0);
+}
 
-        if (fclose(obj->dat_fp) != 0)
-            ret = LDB_ERR_WRITE_DAT;
+// Locks the files in read (write = false) or write mode (wait time is sampled).
+static void ldb_lock_files(ldb_impl_t *obj, bool write)
+{
+    if (!obj->metrics_enabled) {
+        (void) (write ? pthread_rwlock_wrlock(&obj->rwlock_files) : pthread_rwlock_rdlock(&obj->rwlock_files));
+        return;
+    }
 
-        obj->dat_fp = NULL;
+    if ((write ? pthread_rwlock_trywrlock(&obj->rwlock_files) : pthread_rwlock_tryrdlock(&obj->rwlock_files)) == 0) {
+        ldb_metrics_sample(&obj->metrics.lock_files, 0);
+        return;
     }
 
-    obj->dat_end = 0;
+    uint64_t t0 = ldb_metrics_now(obj);
+    (void) (write ? pthread_rwlock_wrlock(&obj->rwlock_files) : pthread_rwlock_rdlock(&obj->rwlock_files));
+    ldb_metrics_time(obj, &obj->metrics.lock_files, t0);
+}
 
-    return ret;
+// Returns a snapshot of the journal state (lock-free, retried while the writer updates it).
+static void ldb_get_state(ldb_impl_t *obj, ldb_state_t *state)
+{
+    uint64_t seq1 = 0;
+    uint64_t seq2 = 0;
+
+    do {
+        // acquire loads keep the values read between both sequence loads
+        seq1 = LDB_ATOMIC_LOAD_ACQ(&obj->state_seq);
+        state->seqnum1 = LDB_ATOMIC_LOAD_ACQ(&obj->state.seqnum1);
+        state->timestamp1 = LDB_ATOMIC_LOAD_ACQ(&obj->state.timestamp1);
+        state->seqnum2 = LDB_ATOMIC_LOAD_ACQ(&obj->state.seqnum2);
+        state->timestamp2 = LDB_ATOMIC_LOAD_ACQ(&obj->state.timestamp2);
+        seq2 = LDB_ATOMIC_LOAD(&obj->state_seq);
+    } while ((seq1 & 1) || seq1 != seq2);
 }
 
-#define LDB_FREE(ptr) do { free(ptr); ptr = NULL; } while(0)
+// Publishes a new journal state to readers (single writer, never waits for readers).
+static void ldb_set_state(ldb_impl_t *obj, const ldb_state_t *state)
+{
+    uint64_t seq = LDB_ATOMIC_LOAD(&obj->state_seq);
+
+    // release stores make the odd sequence visible before any new value
+    LDB_ATOMIC_STORE(&obj->state_seq, seq + 1);
+    LDB_ATOMIC_STORE_REL(&obj->state.seqnum1, state->seqnum1);
+    LDB_ATOMIC_STORE_REL(&obj->state.timestamp1, state->timestamp1);
+    LDB_ATOMIC_STORE_REL(&obj->state.seqnum2, state->seqnum2);
+    LDB_ATOMIC_STORE_REL(&obj->state.timestamp2, state->timestamp2);
+    LDB_ATOMIC_STORE_REL(&obj->state_seq, seq + 2);
+}
 
-int ldb_close(ldb_impl_t *obj)
+// Removes samples not divisible by stride.
+static void ldb_sparse_compact(ldb_sparse_t *sparse)
 {
-    if (obj == NULL)
-        return LDB_OK;
+    size_t len = 0;
 
-    int ret = ldb_close_files(obj);
+    for (size_t i = 0; i < sparse->len; i++) {
+        if (sparse->samples[i].seqnum % sparse->stride == 0)
+            sparse->samples[len++] = sparse->samples[i];
+    }
 
-    ldb_reset_state(&obj->state);
+    sparse->len = len;
+}
 
-    if (obj->name) {
-        pthread_mutex_destroy(&obj->mutex_state);
-        pthread_mutex_destroy(&obj->mutex_files);
+// Appends a sample (seqnums are pushed in increasing order).
+// When budget is exhausted the stride is doubled (half samples removed).
+// On memory error the sample is skipped (sparse index is incomplete but valid).
+static void ldb_sparse_push(ldb_sparse_t *sparse, uint64_t seqnum, uint64_t timestamp)
+{
+    assert(sparse->max_len > 0);
+
+    if (seqnum % sparse->stride != 0)
+        return;
+
+    assert(sparse->len == 0 || sparse->samples[sparse->len - 1].seqnum < seqnum);
+
+    while (sparse->len >= sparse->max_len) {
+        sparse->stride *= 2;
+        ldb_sparse_compact(sparse);
+
+        if (seqnum % sparse->stride != 0)
+            return;
     }
 
-    LDB_FREE(obj->name);
-    LDB_FREE(obj->path);
-    LDB_FREE(obj->dat_path);
-    LDB_FREE(obj->idx_path);
+    if (sparse->len == sparse->capacity)
+    {
+        size_t capacity = ldb_min(ldb_max(2 * sparse->capacity, 64), sparse->max_len);
+        ldb_sample_t *samples = (ldb_sample_t *) realloc(sparse->samples, capacity * sizeof(ldb_sample_t));
 
-    return ret;
-}
+        if (samples == NULL)
+            return;
 
-#undef LDB_FREE
+        sparse->samples = samples;
+        sparse->capacity = capacity;
+    }
 
-static bool ldb_is_valid_path(const char *path)
+    sparse->samples[sparse->len].seqnum = seqnum;
+    sparse->samples[sparse->len].timestamp = timestamp;
+    sparse->len++;
+}
+
+// Removes samples outside [seqnum1, seqnum2] (after rollback or purge).
+static void ldb_sparse_trim(ldb_sparse_t *sparse, const ldb_state_t *state)
 {
-    struct stat statbuf = {0};
+    size_t first = 0;
+    size_t len = 0;
 
-    if (path == NULL)
-        return false;
+    while (first < sparse->len && sparse->samples[first].seqnum < state->seqnum1)
+        first++;
 
-    if (*path == 0)  // case cwd (current working directory)
-        return true;
+    for (size_t i = first; i < sparse->len && sparse->samples[i].seqnum <= state->seqnum2; i++)
+        sparse->samples[len++] = sparse->samples[i];
 
-    if (stat(path, &statbuf) != 0 || !S_ISDIR(statbuf.st_mode))
-        return false;
+    sparse->len = (state->seqnum1 == 0 ? 0 : len);
+}
 
-    return true;
+static void ldb_sparse_free(ldb_sparse_t *sparse)
+{
+    free(sparse->samples);
+    memset(sparse, 0x00, sizeof(ldb_sparse_t));
 }
 
-static bool ldb_is_valid_name(const char *name)
+// Narrows the search range [sn1, sn2] using the samples in between.
+// Preserves the ldb_search() invariant: entries at sn1 go left, entries at sn2 go right.
+static void ldb_sparse_narrow(const ldb_sparse_t *sparse, uint64_t timestamp, ldb_search_e mode, 
+                              uint64_t *sn1, uint64_t *ts1, uint64_t *sn2, uint64_t *ts2)
 {
-    if (!name || *name == 0)
-        return false;
+    size_t lo = 0;
+    size_t hi = sparse->len;
 
-    const char *ptr = name;
+    // samples strictly inside (sn1, sn2)
+    while (lo < hi && sparse->samples[lo].seqnum <= *sn1)
+        lo++;
 
-    while (*ptr != 0 && (isalnum(*ptr) || *ptr == '_'))
-        ptr++;
+    while (hi > lo && sparse->samples[hi - 1].seqnum >= *sn2)
+        hi--;
 
-    return (*ptr == 0 && ptr - name <= LDB_NAME_MAX_LENGTH);
+    // first sample going right in [lo, hi)
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        const ldb_sample_t *sample = &sparse->samples[mid];
+        bool left = (sample->timestamp < timestamp || (mode == LDB_SEARCH_UPPER && sample->timestamp == timestamp));
+
+        if (left) {
+            *sn1 = sample->seqnum;
+            *ts1 = sample->timestamp;
+            lo = mid + 1;
+        }
+        else {
+            *sn2 = sample->seqnum;
+            *ts2 = sample->timestamp;
+            hi = mid;
+        }
+    }
 }
 
-static char * ldb_create_filename(const char *path, const char *name, const char *ext)
+// Returns the mapping window length for a file of the given size.
+static size_t ldb_map_len(size_t size)
 {
-    if (path == NULL || name == NULL || ext == NULL || *name == 0)
-        return NULL;
+    size_t len = LDB_MMAP_MIN_LEN;
 
-    size_t len = strlen(path);
-    bool path_sep_required = (len > 0 && path[len -1] != LDB_PATH_SEPARATOR[0]);
+    while (len < 2 * size && len < SIZE_MAX / 2)
+        len *= 2;
 
-    len = len + 1 + strlen(name) + strlen(ext) + 1;
-    char *filepath = (char *) calloc(len, 1);
+    return len;
+}
 
-    if (filepath == NULL)
-        return NULL;
+static void ldb_unmap_file(ldb_map_t *map)
+{
+    assert(map);
 
-    snprintf(filepath, len, "%s%s%s%s", 
-             path,
-             (path_sep_required ? LDB_PATH_SEPARATOR : ""),
-             name,
-             ext);
+    if (map->addr != NULL)
+        munmap(map->addr, map->len);
 
-    return filepath;
+    map->addr = NULL;
+    map->len = 0;
+    map->size = 0;
 }
 
-// Create a new dat file
-// Returns error if the file already exists
-static bool ldb_create_file_dat(const char *path)
+// Maps the file in read-only mode.
+// Window covers at least twice the current file size.
+// On error return false, otherwise returns true.
+static bool ldb_map_file(ldb_map_t *map, FILE *fp)
 {
-    assert(path);
+    assert(map);
+    assert(map->addr == NULL);
 
-    if (access(path, F_OK) == 0)
-        return false;
+    struct stat statbuf = {0};
+    void *addr = NULL;
+    int fd = -1;
 
-    bool ret = true;
+    if (fp == NULL || (fd = fileno(fp)) == -1)
+        return false;
 
-    FILE *fp = fopen(path, "wx");
-    if (fp == NULL)
+    if (fstat(fd, &statbuf) != 0)
         return false;
 
-    ldb_header_dat_t header = {
-        .magic_number = LDB_DAT_MAGIC_NUMBER,
-        .format = LDB_FILE_FORMAT,
-        .padding = 0,
-        .metadata = {0}
-    };
+    size_t len = ldb_map_len((size_t) statbuf.st_size);
 
-    if (fwrite(&header, sizeof(ldb_header_dat_t), 1, fp) != 1)
-        ret = false;
+    if ((addr = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+        return false;
 
-    if (fclose(fp) != 0)
-        ret = false;
+    map->addr = (char *) addr;
+    map->len = len;
+    map->size = (size_t) statbuf.st_size;
 
-    return ret;
+    return true;
 }
 
-// Create a new idx file
-// Returns error if the file already exists
-static bool ldb_create_file_idx(const char *path)
+// Unmaps the replaced data mappings.
+// Called when no views are pinned.
+static void ldb_unmap_retired(ldb_impl_t *obj)
 {
-    assert(path);
+    assert(obj);
 
-    if (access(path, F_OK) == 0)
-        return false;
+    while (obj->retired != NULL) {
+        ldb_map_t *map = obj->retired;
+        obj->retired = map->next;
+        ldb_unmap_file(map);
+        free(map);
+    }
+}
 
-    bool ret = true;
+// Waits until there are no pinned views.
+// Called and returns with rwlock_files locked in write mode.
+static void ldb_wait_views(ldb_impl_t *obj)
+{
+    assert(obj);
 
-    FILE *fp = fopen(path, "wx");
-    if (fp == NULL)
-        return false;
+    ldb_lock_state(obj);
 
-    ldb_header_idx_t header = {
-        .magic_number = LDB_IDX_MAGIC_NUMBER,
-        .format = LDB_FILE_FORMAT,
-        .padding = 0
-    };
+    while (obj->num_views > 0)
+    {
+        // views are pinned by readers, don't block them
+        pthread_rwlock_unlock(&obj->rwlock_files);
+        pthread_cond_wait(&obj->cond_views, &obj->mutex_state);
+        pthread_mutex_unlock(&obj->mutex_state);
 
-    if (fwrite(&header, sizeof(ldb_header_idx_t), 1, fp) != 1)
-        ret = false;
+        ldb_lock_files(obj, true);
+        ldb_lock_state(obj);
+    }
 
-    if (fclose(fp) != 0)
-        ret = false;
+    pthread_mutex_unlock(&obj->mutex_state);
+}
 
-    return ret;
+static void ldb_unmap_files(ldb_impl_t *obj)
+{
+    assert(obj);
+
+    ldb_unmap_file(&obj->dat_map);
+    ldb_unmap_file(&obj->idx_map);
+    ldb_unmap_retired(obj);
 }
 
-// Returns file size preserving current file position
-// Returns 0 on error
-static size_t ldb_get_file_size(FILE *fp)
+// Maps files according to obj->mmap_mode.
+static int ldb_map_files(ldb_impl_t *obj)
 {
-    if (fp == NULL)
-        return 0;
+    assert(obj);
 
-    long pos = ftell(fp);
-    if (pos < 0)
-        return 0;
+    ldb_unmap_files(obj);
 
-    if (fseek(fp, 0, SEEK_END) != 0)
-        return 0;
+    if ((obj->mmap_mode & LDB_MMAP_IDX) && !ldb_map_file(&obj->idx_map, obj->idx_fp))
+        return LDB_ERR_OPEN_IDX;
 
-    long len = ftell(fp);
+    if ((obj->mmap_mode & LDB_MMAP_DAT) && !ldb_map_file(&obj->dat_map, obj->dat_fp)) {
+        ldb_unmap_files(obj);
+        return LDB_ERR_OPEN_DAT;
+    }
 
-    if (fseek(fp, pos, SEEK_SET) != 0)
-        return 0;
+    return LDB_OK;
+}
 
-    return (size_t)(len < 0 ? 0 : len);
+// Read len bytes at pos.
+// Content is copied from the mapping when possible, otherwise pread() is used.
+// Mapped pages beyond the file end raise SIGBUS, reads crossing the mapped 
+// file content (e.g. padded headers of the last record) use pread().
+static ssize_t ldb_pread(int fd, const ldb_map_t *map, void *buf, size_t len, size_t pos)
+{
+    if (map != NULL && map->addr != NULL && pos + len <= map->len && pos + len <= LDB_ATOMIC_LOAD(&map->size)) {
+        memcpy(buf, map->addr + pos, len);
+        return (ssize_t) len;
+    }
+
+    return pread(fd, buf, len, (off_t) pos);
 }
 
-// Set zero's from pos until the end of the file.
-// At return file position is set at pos.
-// On error return false, otherwise returns true.
-static bool ldb_zeroize(FILE *fp, size_t pos)
+// Returns the position in the idx file for a given seqnum.
+static size_t ldb_get_pos_idx(uint32_t format, const ldb_state_t *state, uint64_t seqnum)
 {
-    assert(fp);
-    assert(!feof(fp));
-    assert(!ferror(fp));
+    assert(state);
+    assert(state->seqnum1 <= seqnum);
 
-    bool ret = false;
-    const char buf[BUFSIZ] = {0};
-    size_t max_pos = ldb_get_file_size(fp);
+    size_t diff = (state->seqnum1 == 0 ? 0 : seqnum - state->seqnum1);
 
-    if (max_pos < pos)
-        return false;
+    if (format == LDB_IDX_FORMAT_WIDE)
+        return sizeof(ldb_header_idx_t) + diff * sizeof(ldb_record_idx_t);
 
-    if (fseek(fp, (long) pos, SEEK_SET) != 0)
-        return false;
+    size_t slot = diff % LDB_IDX_BLOCK_RECORDS;
+    size_t pos = sizeof(ldb_header_idx_t) + (diff / LDB_IDX_BLOCK_RECORDS) * LDB_IDX_BLOCK_LEN;
 
-    if (max_pos == pos)
-        return true;
+    return (slot == 0 ? pos : pos + sizeof(ldb_record_idx_t) + (slot - 1) * sizeof(uint64_t));
+}
 
-    for (size_t cur_pos = pos; cur_pos < max_pos; cur_pos += sizeof(buf))
-        if (fwrite(buf, ldb_min(max_pos - cur_pos, sizeof(buf)), 1, fp) != 1)
-            goto LDB_ZEROIZE_END;
+// Returns the length of the seqnum record in the idx file.
+static size_t ldb_get_len_idx(uint32_t format, const ldb_state_t *state, uint64_t seqnum)
+{
+    assert(state);
+    assert(state->seqnum1 <= seqnum);
 
-    fflush(fp);
+    if (format == LDB_IDX_FORMAT_WIDE || state->seqnum1 == 0 || (seqnum - state->seqnum1) % LDB_IDX_BLOCK_RECORDS == 0)
+        return sizeof(ldb_record_idx_t);
 
-    if (fseek(fp, (long) pos, SEEK_SET) != 0)
-        return false;
+    return sizeof(uint64_t);
+}
 
-    ret = true;
+// Returns the idx file position after the last record.
+static size_t ldb_get_end_idx(uint32_t format, const ldb_state_t *state)
+{
+    assert(state);
 
-LDB_ZEROIZE_END:
-    assert(!feof(fp) && !ferror(fp));
-    return ret;
+    if (state->seqnum1 == 0)
+        return sizeof(ldb_header_idx_t);
+
+    return ldb_get_pos_idx(format, state, state->seqnum2) + ldb_get_len_idx(format, state, state->seqnum2);
 }
 
-// Copy file1 content in range [pos0,pos1] to file2 at pos2.
-// Preserve current file positions.
-// Flush destination file.
-// On error return false, otherwise returns true.
-static bool ldb_copy_file(FILE *fp1, size_t pos0, size_t pos1, FILE *fp2, size_t pos2)
+static int ldb_close_files(ldb_impl_t *obj)
 {
-    assert(fp1);
-    assert(!feof(fp1));
-    assert(!ferror(fp1));
-    assert(fp2);
-    assert(!feof(fp2));
-    assert(!ferror(fp2));
-    assert(pos0 <= pos1);
+    if (!obj)
+        return LDB_OK;
 
-    bool ret = false;
-    char buf[BUFSIZ] = {0};
-    long orig1 = ftell(fp1);
-    long orig2 = ftell(fp2);
-    size_t len1 = ldb_get_file_size(fp1);
-    size_t len2 = ldb_get_file_size(fp2);
+    int ret = LDB_OK;
 
-    if (orig1 < 0 || orig2 < 0)
-        return false;
+    ldb_unmap_files(obj);
 
-    if (pos0 > pos1 || pos1 > len1 || pos2 > len2)
-        return false;
+    if (obj->idx_fp != NULL)
+    {
+        int idx_fd = fileno(obj->idx_fp);
 
-    if (pos0 == pos1)
-        return true;
+        flock(idx_fd, LOCK_UN);
 
-    if (fseek(fp1, (long) pos0, SEEK_SET) != 0)
-        goto LDB_COPY_FILE_END;
+        if (fclose(obj->idx_fp) != 0)
+            ret = LDB_ERR_WRITE_IDX;
 
-    if (fseek(fp2, (long) pos2, SEEK_SET) != 0)
-        goto LDB_COPY_FILE_END;
+        obj->idx_fp = NULL;
+    }
 
-    for (size_t pos = pos0; pos < pos1; pos += sizeof(buf))
-    {
-        size_t num_bytes = ldb_min(pos1 - pos, sizeof(buf));
+    if (obj->dat_fp != NULL)
+    { 
+        int dat_fd = fileno(obj->dat_fp);
 
-        if (fread(buf, 1, num_bytes, fp1) != num_bytes)
-            goto LDB_COPY_FILE_END;
+        flock(dat_fd, LOCK_UN);
 
-        if (fwrite(buf, num_bytes, 1, fp2) != 1)
-            goto LDB_COPY_FILE_END;
+        if (fclose(obj->dat_fp) != 0)
+            ret = LDB_ERR_WRITE_DAT;
+
+        obj->dat_fp = NULL;
     }
 
-    ret = true;
+    obj->dat_end = 0;
+    obj->dat_alloc = 0;
+    obj->idx_alloc = 0;
 
-LDB_COPY_FILE_END:
-    fseek(fp1, orig1, SEEK_SET);
-    fseek(fp2, orig2, SEEK_SET);
-    assert(!feof(fp1) && !ferror(fp1));
-    assert(!feof(fp2) && !ferror(fp2));
     return ret;
 }
 
-// returns the position in the idx file for a given seqnum
-static size_t ldb_get_pos_idx(ldb_state_t *state, uint64_t seqnum)
+// Stops the writer thread once all queued requests are committed and deallocates the group.
+static void ldb_group_destroy(ldb_group_t *group)
 {
-    assert(state);
-    assert(state->seqnum1 <= seqnum);
+    assert(group);
 
-    size_t diff = (state->seqnum1 == 0 ? 0 : seqnum - state->seqnum1);
-    return sizeof(ldb_header_idx_t) + diff * sizeof(ldb_record_idx_t);
+    pthread_mutex_lock(&group->mutex_queue);
+    group->stop = true;
+    pthread_cond_signal(&group->cond_submit);
+    pthread_mutex_unlock(&group->mutex_queue);
+
+    pthread_join(group->thread, NULL);
+
+    pthread_mutex_destroy(&group->mutex_write);
+    pthread_mutex_destroy(&group->mutex_queue);
+    pthread_cond_destroy(&group->cond_submit);
+    pthread_cond_destroy(&group->cond_commit);
+
+    free(group);
 }
 
-static uint32_t ldb_checksum_record(ldb_record_dat_t *record)
+static void ldb_group_stop(ldb_impl_t *obj)
 {
-    uint32_t checksum = 0;
-
-    checksum = ldb_crc32((const char *) &record->seqnum, sizeof(record->seqnum), checksum);
-    checksum = ldb_crc32((const char *) &record->timestamp, sizeof(record->timestamp), checksum);
-    checksum = ldb_crc32((const char *) &record->data_len, sizeof(record->data_len), checksum);
+    assert(obj);
 
-    // required call to complete the checksum
-    // call checksum = crc32(data, checksum)
+    if (obj->group != NULL)
+        ldb_group_destroy(obj->group);
 
-    return checksum;
+    obj->group = NULL;
 }
 
-static uint32_t ldb_checksum_entry(ldb_entry_t *entry)
+// Reads the checkpoint from the idx file header.
+// Returns a zeroed checkpoint if the idx file is missing or invalid.
+static ldb_record_idx_t ldb_read_checkpoint(const char *path)
 {
-    uint32_t checksum = 0;
+    ldb_header_idx_t header = {0};
+    ldb_record_idx_t none = {0};
+    int fd = open(path, O_RDONLY);
 
-    checksum = ldb_crc32((const char *) &entry->seqnum, sizeof(entry->seqnum), checksum);
-    checksum = ldb_crc32((const char *) &entry->timestamp, sizeof(entry->timestamp), checksum);
-    checksum = ldb_crc32((const char *) &entry->data_len, sizeof(entry->data_len), checksum);
+    if (fd == -1)
+        return none;
 
-    if (entry->data_len && entry->data)
-        checksum = ldb_crc32(entry->data, entry->data_len, checksum);
+    ssize_t rc = pread(fd, &header, sizeof(ldb_header_idx_t), 0);
 
-    return checksum;
-}
+    close(fd);
 
-// append data entry at position obj->dat_end
-// updates obj->dat_end value
-// function accessed only by thread-write
-static int ldb_append_entry_dat(ldb_impl_t *obj, ldb_state_t *state, ldb_entry_t *entry)
-{
-    assert(obj);
-    assert(state);
-    assert(entry);
-    assert(obj->dat_fp);
-    assert(!feof(obj->dat_fp));
-    assert(!ferror(obj->dat_fp));
+    if (rc != (ssize_t) sizeof(ldb_header_idx_t))
+        return none;
 
-    static const char zeros[sizeof(uintptr_t)] = {0};
+    if (header.magic_number != LDB_IDX_MAGIC_NUMBER || (header.format != LDB_IDX_FORMAT && header.format != LDB_IDX_FORMAT_WIDE))
+        return none;
 
-    if (entry->data_len != 0 && entry->data == NULL)
-        return LDB_ERR_ENTRY_DATA;
+    return header.checkpoint;
+}
 
-    if (state->seqnum2 != 0 && entry->seqnum != state->seqnum2 + 1)
-        return LDB_ERR_ENTRY_SEQNUM;
+// Writes the checkpoint in the idx file header.
+static int ldb_write_checkpoint(int idx_fd, const ldb_record_idx_t *checkpoint)
+{
+    size_t pos = sizeof(ldb_header_idx_t) - sizeof(ldb_record_idx_t);
 
-    if (entry->timestamp < state->timestamp2)
-        return LDB_ERR_ENTRY_TIMESTAMP;
+    if (pwrite(idx_fd, checkpoint, sizeof(ldb_record_idx_t), (off_t) pos) != (ssize_t) sizeof(ldb_record_idx_t))
+        return LDB_ERR_WRITE_IDX;
 
-    ldb_record_dat_t record = {
-        .seqnum = entry->seqnum,
-        .timestamp = entry->timestamp,
-        .data_len = entry->data_len,
-        .checksum = ldb_checksum_entry(entry)
-    };
+    return LDB_OK;
+}
 
-    if (fseek(obj->dat_fp, (long) obj->dat_end, SEEK_SET) != 0)
-        return LDB_ERR_WRITE_DAT;
+// Writes the idx records kept in the write-behind buffer (see ldb_set_idx_writeback()).
+// Readers are served from the buffer until the written content is marked as such.
+// Function accessed only by thread-write.
+static int ldb_flush_idx(ldb_impl_t *obj)
+{
+    ldb_writeback_t *wb = &obj->writeback;
+    size_t off = 0;
 
-    if (fwrite(&record, sizeof(ldb_record_dat_t), 1, obj->dat_fp) != 1)
-        return LDB_ERR_WRITE_DAT;
+    if (wb->len == 0)
+        return LDB_OK;
 
-    if (record.data_len)
+    while (off < wb->len)
     {
-        if (fwrite(entry->data, 1, record.data_len, obj->dat_fp) != record.data_len)
-            return LDB_ERR_WRITE_DAT;
+        ssize_t rc = pwrite(fileno(obj->idx_fp), wb->buf + off, wb->len - off, (off_t) (wb->pos + off));
 
-        size_t padding = ldb_padding(entry->data_len);
+        if (rc < 0 && errno == EINTR)
+            continue;
 
-        if (fwrite(zeros, 1, padding, obj->dat_fp) != padding)
-            return LDB_ERR_WRITE_DAT;
-    }
+        if (rc <= 0)
+            return LDB_ERR_WRITE_IDX;
 
-    if (state->seqnum1 == 0) {
-        state->seqnum1 = entry->seqnum;
-        state->timestamp1 = entry->timestamp;
+        off += (size_t) rc;
     }
 
-    state->seqnum2 = entry->seqnum;
-    state->timestamp2 = entry->timestamp;
-
-    long pos = ftell(obj->dat_fp);
-    if (pos < 0)
-        return LDB_ERR_READ_DAT;
-
-    obj->dat_end = (size_t) pos;
+    pthread_mutex_lock(&obj->mutex_idx);
+    LDB_ATOMIC_STORE_REL(&wb->pos, wb->pos + wb->len);
+    LDB_ATOMIC_STORE_REL(&wb->len, 0);
+    wb->num = 0;
+    pthread_mutex_unlock(&obj->mutex_idx);
 
     return LDB_OK;
 }
 
-static int ldb_append_record_idx(ldb_impl_t *obj, ldb_state_t *state, ldb_record_idx_t *record)
+// Removes the preallocated space beyond the files end.
+static int ldb_trim_files(ldb_impl_t *obj)
 {
-    assert(obj);
-    assert(state);
-    assert(record);
-    assert(obj->idx_fp);
-    assert(!feof(obj->idx_fp));
-    assert(!ferror(obj->idx_fp));
-
-    if (record->seqnum != state->seqnum2) {
-        return LDB_ERR;
-    }
+    if (!ldb_is_valid_obj(obj) || obj->prealloc == 0)
+        return LDB_OK;
 
-    size_t pos = ldb_get_pos_idx(state, record->seqnum);
+    size_t idx_end = ldb_get_end_idx(obj->idx_format, &obj->state);
 
-    if (fseek(obj->idx_fp, (long) pos, SEEK_SET) != 0)
-        return LDB_ERR_READ_IDX;
+    if (obj->dat_alloc > obj->dat_end && (fflush(obj->dat_fp) != 0 || ftruncate(fileno(obj->dat_fp), (off_t) obj->dat_end) != 0))
+        return LDB_ERR_WRITE_DAT;
 
-    if (fwrite(record, sizeof(ldb_record_idx_t), 1, obj->idx_fp) != 1)
+    if (obj->idx_alloc > idx_end && (fflush(obj->idx_fp) != 0 || ftruncate(fileno(obj->idx_fp), (off_t) idx_end) != 0))
         return LDB_ERR_WRITE_IDX;
 
+    obj->dat_alloc = obj->dat_end;
+    obj->idx_alloc = idx_end;
+
     return LDB_OK;
 }
 
-// Read data record at pos.
-// File position is not modified.
-static int ldb_read_record_dat(int fd, size_t pos, ldb_record_dat_t *record, bool verify_checksum)
+#define LDB_FREE(ptr) do { free(ptr); ptr = NULL; } while(0)
+
+int ldb_close(ldb_impl_t *obj)
 {
-    assert(record);
-    assert(fd > STDERR_FILENO);
+    if (obj == NULL)
+        return LDB_OK;
 
-    ssize_t rc = pread(fd, record, sizeof(ldb_record_dat_t), (off_t) pos);
+    ldb_group_stop(obj);
 
-    if (rc == -1)
-        return LDB_ERR_READ_DAT;
+    // records up to checkpoint are not verified on next open
+    if (ldb_is_valid_obj(obj) && obj->checkpoint.seqnum != 0)
+        ldb_write_checkpoint(fileno(obj->idx_fp), &obj->checkpoint);
 
-    if (rc != sizeof(ldb_record_dat_t))
-        return LDB_ERR_FMT_DAT;
+    int ret = ldb_flush_idx(obj);
+    int rc = ldb_trim_files(obj);
 
-    if (!verify_checksum || record->seqnum == 0)
-        return LDB_OK;
+    ret = (ret == LDB_OK ? rc : ret);
+    rc = ldb_close_files(obj);
+    ret = (ret == LDB_OK ? rc : ret);
 
-    uint32_t checksum = ldb_checksum_record(record);
-    size_t len = record->data_len;
+    ldb_reset_state(&obj->state);
+    ldb_sparse_free(&obj->sparse);
 
-    if (len > 0)
-    {
-        pos += sizeof(ldb_record_dat_t);
+    if (obj->name) {
+        pthread_mutex_destroy(&obj->mutex_state);
+        pthread_mutex_destroy(&obj->mutex_idx);
+        pthread_rwlock_destroy(&obj->rwlock_files);
+        pthread_cond_destroy(&obj->cond_views);
+        pthread_cond_destroy(&obj->cond_append);
 
-        char buf[BUFSIZ] = {0};
-        size_t end = pos + len;
+        for (int i = 0; i < 2; i++)
+            if (obj->notify_fd[i] > STDERR_FILENO)
+                close(obj->notify_fd[i]);
 
-        for (size_t i = pos; i < end; i += sizeof(buf))
-        {
-            size_t num_bytes = ldb_min(end - i, sizeof(buf));
+        obj->notify_fd[0] = obj->notify_fd[1] = -1;
+    }
 
-            rc = pread(fd, buf, num_bytes, (off_t) pos);
+    LDB_FREE(obj->name);
+    LDB_FREE(obj->path);
+    LDB_FREE(obj->dat_path);
+    LDB_FREE(obj->idx_path);
+    LDB_FREE(obj->zbuf);
+    LDB_FREE(obj->writeback.buf);
+    obj->zbuf_len = 0;
+    obj->writeback = (ldb_writeback_t) {0};
 
-            if (rc == -1)
-                return LDB_ERR_READ_DAT;
+    return ret;
+}
+
+#undef LDB_FREE
+
+static bool ldb_is_valid_path(const char *path)
+{
+    struct stat statbuf = {0};
+
+    if (path == NULL)
+        return false;
+
+    if (*path == 0)  // case cwd (current working directory)
+        return true;
+
+    if (stat(path, &statbuf) != 0 || !S_ISDIR(statbuf.st_mode))
+        return false;
+
+    return true;
+}
+
+static bool ldb_is_valid_name(const char *name)
+{
+    if (!name || *name == 0)
+        return false;
+
+    const char *ptr = name;
+
+    while (*ptr != 0 && (isalnum(*ptr) || *ptr == '_'))
+        ptr++;
+
+    return (*ptr == 0 && ptr - name <= LDB_NAME_MAX_LENGTH);
+}
+
+static char * ldb_create_filename(const char *path, const char *name, const char *ext)
+{
+    if (path == NULL || name == NULL || ext == NULL || *name == 0)
+        return NULL;
+
+    size_t len = strlen(path);
+    bool path_sep_required = (len > 0 && path[len -1] != LDB_PATH_SEPARATOR[0]);
+
+    len = len + 1 + strlen(name) + strlen(ext) + 1;
+    char *filepath = (char *) calloc(len, 1);
+
+    if (filepath == NULL)
+        return NULL;
+
+    snprintf(filepath, len, "%s%s%s%s", 
+             path,
+             (path_sep_required ? LDB_PATH_SEPARATOR : ""),
+             name,
+             ext);
+
+    return filepath;
+}
+
+// Create a new dat file
+// Returns error if the file already exists
+static bool ldb_create_file_dat(const char *path, uint32_t format, uint32_t codec)
+{
+    assert(path);
+
+    if (access(path, F_OK) == 0)
+        return false;
+
+    bool ret = true;
+
+    FILE *fp = fopen(path, "wx");
+    if (fp == NULL)
+        return false;
+
+    ldb_header_dat_t header = {
+        .magic_number = LDB_DAT_MAGIC_NUMBER,
+        .format = format,
+        .codec = codec,
+        .metadata = {0}
+    };
+
+    if (fwrite(&header, sizeof(ldb_header_dat_t), 1, fp) != 1)
+        ret = false;
+
+    if (fclose(fp) != 0)
+        ret = false;
+
+    return ret;
+}
+
+// Create a new idx file
+// Returns error if the file already exists
+static bool ldb_create_file_idx(const char *path)
+{
+    assert(path);
+
+    if (access(path, F_OK) == 0)
+        return false;
+
+    bool ret = true;
+
+    FILE *fp = fopen(path, "wx");
+    if (fp == NULL)
+        return false;
+
+    ldb_header_idx_t header = {
+        .magic_number = LDB_IDX_MAGIC_NUMBER,
+        .format = LDB_IDX_FORMAT,
+        .padding = 0,
+        .checkpoint = {0}
+    };
+
+    if (fwrite(&header, sizeof(ldb_header_idx_t), 1, fp) != 1)
+        ret = false;
+
+    if (fclose(fp) != 0)
+        ret = false;
+
+    return ret;
+}
+
+// Returns file size preserving current file position
+// Returns 0 on error
+static size_t ldb_get_file_size(FILE *fp)
+{
+    if (fp == NULL)
+        return 0;
+
+    long pos = ftell(fp);
+    if (pos < 0)
+        return 0;
+
+    if (fseek(fp, 0, SEEK_END) != 0)
+        return 0;
+
+    long len = ftell(fp);
+
+    if (fseek(fp, pos, SEEK_SET) != 0)
+        return 0;
+
+    return (size_t)(len < 0 ? 0 : len);
+}
+
+// Set zero's from pos until the end of the file.
+// At return file position is set at pos.
+// On error return false, otherwise returns true.
+static bool ldb_zeroize(FILE *fp, size_t pos)
+{
+    assert(fp);
+    assert(!feof(fp));
+    assert(!ferror(fp));
+
+    bool ret = false;
+    const char buf[BUFSIZ] = {0};
+    char aux[BUFSIZ];
+    size_t max_pos = ldb_get_file_size(fp);
+    int fd = fileno(fp);
+
+    if (max_pos < pos)
+        return false;
+
+    if (fseek(fp, (long) pos, SEEK_SET) != 0)
+        return false;
+
+    if (max_pos == pos)
+        return true;
+
+    for (size_t cur_pos = pos; cur_pos < max_pos; cur_pos += sizeof(buf))
+    {
+        size_t len = ldb_min(max_pos - cur_pos, sizeof(buf));
+
+        // preallocated content is already zeroed
+        if (pread(fd, aux, len, (off_t) cur_pos) == (ssize_t) len && memcmp(aux, buf, len) == 0)
+            continue;
+
+        if (fseek(fp, (long) cur_pos, SEEK_SET) != 0 || fwrite(buf, len, 1, fp) != 1)
+            goto LDB_ZEROIZE_END;
+    }
+
+    fflush(fp);
+
+    if (fseek(fp, (long) pos, SEEK_SET) != 0)
+        return false;
+
+    ret = true;
+
+LDB_ZEROIZE_END:
+    assert(!feof(fp) && !ferror(fp));
+    return ret;
+}
+
+// Removes the content from pos until the end of the file.
+// File size is preserved, removed content reads as zeros (hole).
+// Cost does not depend on the removed length (no zeros written).
+// At return file position is set at the end (no buffered content).
+// On error return false, otherwise returns true.
+static bool ldb_punch_tail(FILE *fp, size_t pos)
+{
+    assert(fp);
+
+    if (fflush(fp) != 0)
+        return false;
+
+    size_t max_pos = ldb_get_file_size(fp);
+    int fd = fileno(fp);
+
+    if (max_pos < pos)
+        return false;
+
+    if (max_pos > pos && (ftruncate(fd, (off_t) pos) != 0 || ftruncate(fd, (off_t) max_pos) != 0))
+        return false;
+
+    return (fseek(fp, 0, SEEK_END) == 0);
+}
+
+// Copy file1 content in range [pos0,pos1] to file2 at pos2.
+// Preserve current file positions.
+// Flush destination file.
+// On error return false, otherwise returns true.
+static bool ldb_copy_file(FILE *fp1, size_t pos0, size_t pos1, FILE *fp2, size_t pos2)
+{
+    assert(fp1);
+    assert(!feof(fp1));
+    assert(!ferror(fp1));
+    assert(fp2);
+    assert(!feof(fp2));
+    assert(!ferror(fp2));
+    assert(pos0 <= pos1);
+
+    bool ret = false;
+    char buf[BUFSIZ] = {0};
+    long orig1 = ftell(fp1);
+    long orig2 = ftell(fp2);
+    size_t len1 = ldb_get_file_size(fp1);
+    size_t len2 = ldb_get_file_size(fp2);
+
+    if (orig1 < 0 || orig2 < 0)
+        return false;
+
+    if (pos0 > pos1 || pos1 > len1 || pos2 > len2)
+        return false;
+
+    if (pos0 == pos1)
+        return true;
+
+    if (fseek(fp1, (long) pos0, SEEK_SET) != 0)
+        goto LDB_COPY_FILE_END;
+
+    if (fseek(fp2, (long) pos2, SEEK_SET) != 0)
+        goto LDB_COPY_FILE_END;
+
+    for (size_t pos = pos0; pos < pos1; pos += sizeof(buf))
+    {
+        size_t num_bytes = ldb_min(pos1 - pos, sizeof(buf));
+
+        if (fread(buf, 1, num_bytes, fp1) != num_bytes)
+            goto LDB_COPY_FILE_END;
+
+        if (fwrite(buf, num_bytes, 1, fp2) != 1)
+            goto LDB_COPY_FILE_END;
+    }
+
+    ret = true;
+
+LDB_COPY_FILE_END:
+    fseek(fp1, orig1, SEEK_SET);
+    fseek(fp2, orig2, SEEK_SET);
+    assert(!feof(fp1) && !ferror(fp1));
+    assert(!feof(fp2) && !ferror(fp2));
+    return ret;
+}
+
+// Returns the number of records fully contained in an idx file of len bytes.
+static size_t ldb_get_num_idx(uint32_t format, size_t len)
+{
+    if (len < sizeof(ldb_header_idx_t))
+        return 0;
+
+    len -= sizeof(ldb_header_idx_t);
+
+    if (format == LDB_IDX_FORMAT_WIDE)
+        return len / sizeof(ldb_record_idx_t);
+
+    size_t num = (len / LDB_IDX_BLOCK_LEN) * LDB_IDX_BLOCK_RECORDS;
+    size_t rem = len % LDB_IDX_BLOCK_LEN;
+
+    if (rem >= sizeof(ldb_record_idx_t))
+        num += 1 + (rem - sizeof(ldb_record_idx_t)) / sizeof(uint64_t);
+
+    return num;
+}
+
+/**
+ * Encodes consecutive idx records into buf.
+ * 
+ * Encoded content is written at ldb_get_pos_idx(records[0].seqnum). In the
+ * compact format the first record of each block is stored as is and the 
+ * remaining ones as deltas from it (see LDB_IDX_FORMAT). 
+ * 
+ * @param[in,out] block First record of the block of records[0] (compact 
+ *                format), updated when a new block starts.
+ * @param[out] buf Encoded content (min length = num * sizeof(ldb_record_idx_t)).
+ * 
+ * @return Encoded length.
+ */
+static size_t ldb_encode_idx(uint32_t format, const ldb_state_t *state, const ldb_record_idx_t *records, size_t num, ldb_record_idx_t *block, char *buf)
+{
+    assert(state);
+    assert(records);
+    assert(block);
+    assert(buf);
+
+    size_t len = 0;
+
+    for (size_t i = 0; i < num; i++)
+    {
+        const ldb_record_idx_t *record = &records[i];
+
+        if (ldb_get_len_idx(format, state, record->seqnum) == sizeof(ldb_record_idx_t)) {
+            memcpy(buf + len, record, sizeof(ldb_record_idx_t));
+            len += sizeof(ldb_record_idx_t);
+            *block = *record;
+            continue;
+        }
+
+        assert(block->seqnum < record->seqnum && record->seqnum - block->seqnum < LDB_IDX_BLOCK_RECORDS);
+        assert(block->timestamp <= record->timestamp);
+        assert(block->pos < record->pos && record->pos - block->pos < LDB_IDX_POS_MASK);
+
+        uint64_t ts = record->timestamp - block->timestamp;
+
+        if (ts > LDB_IDX_TS_UNKNOWN)
+            ts = LDB_IDX_TS_UNKNOWN;
+
+        uint64_t delta = (ts << LDB_IDX_POS_BITS) | (record->pos - block->pos);
+
+        memcpy(buf + len, &delta, sizeof(uint64_t));
+        len += sizeof(uint64_t);
+    }
+
+    return len;
+}
+
+static uint32_t ldb_checksum_record(const ldb_record_dat_t *record)
+{
+    uint32_t checksum = 0;
+
+    checksum = ldb_crc32((const char *) &record->seqnum, sizeof(record->seqnum), checksum);
+    checksum = ldb_crc32((const char *) &record->timestamp, sizeof(record->timestamp), checksum);
+    checksum = ldb_crc32((const char *) &record->data_len, sizeof(record->data_len), checksum);
+
+    // required call to complete the checksum
+    // call checksum = crc32(data, checksum)
+
+    return checksum;
+}
+
+static uint32_t ldb_checksum_entry(ldb_entry_t *entry)
+{
+    uint32_t checksum = 0;
+
+    checksum = ldb_crc32((const char *) &entry->seqnum, sizeof(entry->seqnum), checksum);
+    checksum = ldb_crc32((const char *) &entry->timestamp, sizeof(entry->timestamp), checksum);
+    checksum = ldb_crc32((const char *) &entry->data_len, sizeof(entry->data_len), checksum);
+
+    if (entry->data_len && entry->data)
+        checksum = ldb_crc32(entry->data, entry->data_len, checksum);
+
+    return checksum;
+}
+
+// Checks the record checksum using the data already read.
+static bool ldb_is_valid_checksum(const ldb_record_dat_t *record, const char *data)
+{
+    uint32_t checksum = ldb_checksum_record(record);
+    checksum = ldb_crc32(data, ldb_stored_len(record->data_len), checksum);
+    return (checksum == record->checksum);
+}
+
+// Batch framing of a record (batch format).
+typedef struct ldb_batch_t {
+    size_t back;                  // Distance from the batch header record (0 = this is the batch header)
+    uint32_t num;                 // Records in the batch (batch header only)
+    uint32_t len;                 // Bytes from the batch header record to the batch end (batch header only)
+    uint32_t checksum;            // Checksum of the batch (batch header only)
+} ldb_batch_t;
+
+/**
+ * Encodes the record header into buf (min length = LDB_HEADER_MAX).
+ * 
+ * Dense records are encoded relative to the previous record, or with 
+ * their absolute seqnum and timestamp (base record) when there is no 
+ * previous record (prev = NULL or prev->seqnum = 0).
+ * 
+ * Batch records are encoded relative to the previous record, followed by 
+ * the distance to the batch header record (back). Batch header records 
+ * (back = 0) are base records followed by the batch fields, set to zero
+ * (see ldb_set_batch_dat()).
+ * 
+ * @return Header length.
+ */
+static size_t ldb_encode_record_dat(uint32_t format, const ldb_record_dat_t *record, const ldb_record_dat_t *prev, size_t back, char *buf)
+{
+    assert(record);
+    assert(buf);
+
+    if (!ldb_is_dense(format)) {
+        memcpy(buf, record, sizeof(ldb_record_dat_t));
+        return sizeof(ldb_record_dat_t);
+    }
+
+    bool base = (format == LDB_FILE_FORMAT_BATCH ? back == 0 : (prev == NULL || prev->seqnum == 0));
+    uint64_t tag = ((uint64_t) ldb_stored_len(record->data_len) << 3) | LDB_DENSE_VALID;
+    size_t len = 0;
+
+    if (base)
+        tag |= LDB_DENSE_BASE;
+
+    if (record->data_len & LDB_DATA_COMPRESSED)
+        tag |= LDB_DENSE_COMPRESSED;
+
+    len += ldb_put_varint(buf + len, tag);
+
+    if (base) {
+        len += ldb_put_varint(buf + len, record->seqnum);
+        len += ldb_put_varint(buf + len, record->timestamp);
+    }
+    else {
+        assert(record->seqnum == prev->seqnum + 1);
+        assert(record->timestamp >= prev->timestamp);
+        len += ldb_put_varint(buf + len, record->timestamp - prev->timestamp);
+    }
+
+    if (format != LDB_FILE_FORMAT_BATCH) {
+        memcpy(buf + len, &record->checksum, sizeof(uint32_t));
+        return len + sizeof(uint32_t);
+    }
+
+    if (!base)
+        return len + ldb_put_varint(buf + len, back);
+
+    memset(buf + len, 0x00, LDB_BATCH_FIELDS_LEN);
+
+    return len + LDB_BATCH_FIELDS_LEN;
+}
+
+// Sets the batch fields of an encoded batch header record.
+static void ldb_set_batch_dat(char *header, size_t header_len, uint32_t num, uint32_t len, uint32_t checksum)
+{
+    assert(header_len > LDB_BATCH_FIELDS_LEN && header_len <= LDB_HEADER_MAX);
+
+    char *ptr = header + header_len - LDB_BATCH_FIELDS_LEN;
+
+    memcpy(ptr, &num, sizeof(uint32_t));
+    memcpy(ptr + sizeof(uint32_t), &len, sizeof(uint32_t));
+    memcpy(ptr + 2 * sizeof(uint32_t), &checksum, sizeof(uint32_t));
+}
+
+/**
+ * Decodes the record header at buf.
+ * 
+ * Seqnum and timestamp of dense records (other than base ones) are implied 
+ * by the idx record of this record (idx) or else by the previous record 
+ * (prev). Record is zeroed (seqnum = 0) when buf contains no record 
+ * (zeroed content) or values can not be implied.
+ * 
+ * Batch records have no checksum (record->checksum = 0), batch header 
+ * records have the checksum of the batch.
+ * 
+ * @param[in] len Number of bytes available in buf.
+ * @param[out] batch Batch framing (batch format, can be NULL).
+ * 
+ * @return Header length, or 0 if the header is incomplete (or invalid when
+ *         len >= LDB_HEADER_MAX).
+ */
+static size_t ldb_decode_header_dat(uint32_t format, const char *buf, size_t len, const ldb_record_dat_t *prev, 
+                                    const ldb_record_idx_t *idx, ldb_record_dat_t *record, ldb_batch_t *batch)
+{
+    assert(buf);
+    assert(record);
+
+    if (!ldb_is_dense(format))
+    {
+        if (len < sizeof(ldb_record_dat_t))
+            return 0;
+
+        memcpy(record, buf, sizeof(ldb_record_dat_t));
+        return sizeof(ldb_record_dat_t);
+    }
+
+    ldb_record_dat_t aux = {0};
+    ldb_batch_t frame = {0};
+    uint64_t tag = 0;
+    uint64_t value = 0;
+    size_t pos = 0;
+    size_t n = 0;
+
+    if ((pos = ldb_get_varint(buf, len, &tag)) == 0)
+        return 0;
+
+    if ((tag & LDB_DENSE_VALID) == 0 || (tag >> 3) > ldb_stored_len(UINT32_MAX)) {
+        memset(record, 0x00, sizeof(ldb_record_dat_t));
+        return pos;
+    }
+
+    aux.data_len = (uint32_t) (tag >> 3) | ((tag & LDB_DENSE_COMPRESSED) ? LDB_DATA_COMPRESSED : 0);
+
+    if (tag & LDB_DENSE_BASE)
+    {
+        if ((n = ldb_get_varint(buf + pos, len - pos, &value)) == 0)
+            return 0;
+
+        aux.seqnum = value;
+        pos += n;
+
+        if ((n = ldb_get_varint(buf + pos, len - pos, &value)) == 0)
+            return 0;
+
+        aux.timestamp = value;
+        pos += n;
+    }
+    else
+    {
+        if ((n = ldb_get_varint(buf + pos, len - pos, &value)) == 0)
+            return 0;
+
+        pos += n;
+
+        if (idx != NULL) {
+            aux.seqnum = idx->seqnum;
+            aux.timestamp = idx->timestamp;
+        }
+        else if (prev != NULL && prev->seqnum != 0) {
+            aux.seqnum = prev->seqnum + 1;
+            aux.timestamp = prev->timestamp + value;
+        }
+    }
+
+    if (format != LDB_FILE_FORMAT_BATCH)
+    {
+        if (pos + sizeof(uint32_t) > len)
+            return 0;
+
+        memcpy(&aux.checksum, buf + pos, sizeof(uint32_t));
+        pos += sizeof(uint32_t);
+    }
+    else if (tag & LDB_DENSE_BASE)
+    {
+        if (pos + LDB_BATCH_FIELDS_LEN > len)
+            return 0;
+
+        memcpy(&frame.num, buf + pos, sizeof(uint32_t));
+        memcpy(&frame.len, buf + pos + sizeof(uint32_t), sizeof(uint32_t));
+        memcpy(&frame.checksum, buf + pos + 2 * sizeof(uint32_t), sizeof(uint32_t));
+        aux.checksum = frame.checksum;
+        pos += LDB_BATCH_FIELDS_LEN;
+
+        // a batch contains at least its header record
+        if (frame.num == 0 || frame.len < ldb_record_len(format, pos, aux.data_len))
+            aux.seqnum = 0;
+    }
+    else
+    {
+        if ((n = ldb_get_varint(buf + pos, len - pos, &value)) == 0)
+            return 0;
+
+        frame.back = (size_t) value;
+        pos += n;
+
+        if (frame.back == 0)
+            aux.seqnum = 0;
+    }
+
+    if (aux.seqnum == 0) {
+        memset(&aux, 0x00, sizeof(ldb_record_dat_t));
+        memset(&frame, 0x00, sizeof(ldb_batch_t));
+    }
+
+    *record = aux;
+
+    if (batch != NULL)
+        *batch = frame;
+
+    return pos;
+}
+
+static size_t ldb_decode_record_dat(uint32_t format, const char *buf, size_t len, const ldb_record_dat_t *prev, const ldb_record_idx_t *idx, ldb_record_dat_t *record)
+{
+    return ldb_decode_header_dat(format, buf, len, prev, idx, record, NULL);
+}
+
+// Appends a LZ4 sequence (literals followed by a match) to dst.
+// match_len = 0 means last sequence (literals only).
+// Returns false if dst is exhausted.
+static bool ldb_lz_sequence(unsigned char *dst, size_t dst_len, size_t *pos, 
+                            const unsigned char *literals, size_t literals_len, 
+                            size_t offset, size_t match_len)
+{
+    size_t match_code = (match_len ? match_len - LDB_LZ_MIN_MATCH : 0);
+    size_t n = *pos;
+
+    // token + lengths + literals + offset (upper bound)
+    if (n + 1 + literals_len / 255 + 1 + literals_len + 2 + match_code / 255 + 1 > dst_len)
+        return false;
+
+    unsigned char *token = &dst[n++];
+
+    *token = (unsigned char) (ldb_min(literals_len, 15) << 4);
+
+    if (literals_len >= 15) {
+        size_t rem = literals_len - 15;
+        for (; rem >= 255; rem -= 255)
+            dst[n++] = 255;
+        dst[n++] = (unsigned char) rem;
+    }
+
+    memcpy(dst + n, literals, literals_len);
+    n += literals_len;
+
+    if (match_len)
+    {
+        *token |= (unsigned char) ldb_min(match_code, 15);
+
+        dst[n++] = (unsigned char) (offset & 0xFF);
+        dst[n++] = (unsigned char) (offset >> 8);
+
+        if (match_code >= 15) {
+            size_t rem = match_code - 15;
+            for (; rem >= 255; rem -= 255)
+                dst[n++] = 255;
+            dst[n++] = (unsigned char) rem;
+        }
+    }
+
+    *pos = n;
+    return true;
+}
+
+// Compresses src using the LZ4 block format (greedy match finder).
+// Returns the compressed length or 0 if it exceeds dst_len.
+static size_t ldb_lz_compress(const char *src, size_t len, char *dst, size_t dst_len)
+{
+    const unsigned char *in = (const unsigned char *) src;
+    unsigned char *out = (unsigned char *) dst;
+    uint32_t table[1 << LDB_LZ_HASH_BITS] = {0};
+    size_t anchor = 0;
+    size_t pos = 0;
+    size_t n = 0;
+
+    while (len > LDB_LZ_MF_LIMIT && pos < len - LDB_LZ_MF_LIMIT)
+    {
+        uint32_t seq = 0;
+        memcpy(&seq, in + pos, sizeof(seq));
+
+        uint32_t hash = (seq * 2654435761u) >> (32 - LDB_LZ_HASH_BITS);
+        size_t ref = table[hash];
+        uint32_t aux = 0;
+
+        table[hash] = (uint32_t) pos;
+
+        if (ref < pos && pos - ref <= LDB_LZ_MAX_OFFSET)
+            memcpy(&aux, in + ref, sizeof(aux));
+
+        // step grows on incompressible content
+        if (ref >= pos || pos - ref > LDB_LZ_MAX_OFFSET || aux != seq) {
+            pos += 1 + ((pos - anchor) >> 6);
+            continue;
+        }
+
+        // last literals are never matched
+        size_t match_len = LDB_LZ_MIN_MATCH;
+        size_t match_max = len - LDB_LZ_LAST_LITERALS - pos;
+
+        while (match_len < match_max && in[ref + match_len] == in[pos + match_len])
+            match_len++;
+
+        if (!ldb_lz_sequence(out, dst_len, &n, in + anchor, pos - anchor, pos - ref, match_len))
+            return 0;
+
+        pos += match_len;
+        anchor = pos;
+    }
+
+    if (!ldb_lz_sequence(out, dst_len, &n, in + anchor, len - anchor, 0, 0))
+        return 0;
+
+    return n;
+}
+
+// Decompresses a LZ4 block.
+// Returns false if content is malformed or does not expand to dst_len bytes.
+static bool ldb_lz_decompress(const char *src, size_t len, char *dst, size_t dst_len)
+{
+    const unsigned char *in = (const unsigned char *) src;
+    unsigned char *out = (unsigned char *) dst;
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < len)
+    {
+        unsigned char token = in[ip++];
+        size_t literals_len = token >> 4;
+        size_t match_len = token & 15;
+        unsigned char byte = 255;
+
+        if (literals_len == 15) {
+            while (byte == 255 && ip < len)
+                literals_len += (byte = in[ip++]);
+            if (byte == 255)
+                return false;
+        }
+
+        if (literals_len > len - ip || literals_len > dst_len - op)
+            return false;
+
+        memcpy(out + op, in + ip, literals_len);
+        ip += literals_len;
+        op += literals_len;
+
+        // last sequence
+        if (ip == len)
+            break;
+
+        if (len - ip < 2)
+            return false;
+
+        size_t offset = (size_t) in[ip] | ((size_t) in[ip + 1] << 8);
+        ip += 2;
+
+        if (offset == 0 || offset > op)
+            return false;
+
+        if (match_len == 15) {
+            byte = 255;
+            while (byte == 255 && ip < len)
+                match_len += (byte = in[ip++]);
+            if (byte == 255)
+                return false;
+        }
+
+        match_len += LDB_LZ_MIN_MATCH;
+
+        if (match_len > dst_len - op)
+            return false;
+
+        // byte copy (match can overlap itself)
+        for (size_t i = 0; i < match_len; i++, op++)
+            out[op] = out[op - offset];
+    }
+
+    return (op == dst_len);
+}
+
+// Compresses entry data into dst (uint32_t raw length + LZ4 block).
+// Returns the stored length or 0 if compression does not reduce the size.
+static size_t ldb_compress_entry(const ldb_entry_t *entry, char *dst)
+{
+    uint32_t raw_len = entry->data_len;
+
+    if (raw_len < LDB_COMPRESS_MIN_LEN)
+        return 0;
+
+    size_t len = ldb_lz_compress(entry->data, raw_len, dst + sizeof(uint32_t), raw_len - sizeof(uint32_t) - 1);
+
+    if (len == 0)
+        return 0;
+
+    memcpy(dst, &raw_len, sizeof(uint32_t));
+
+    return sizeof(uint32_t) + len;
+}
+
+// Checks that entry can be appended after state.
+static int ldb_validate_entry(const ldb_state_t *state, const ldb_entry_t *entry)
+{
+    assert(state);
+    assert(entry);
+
+    if (entry->data_len != 0 && entry->data == NULL)
+        return LDB_ERR_ENTRY_DATA;
+
+    if (entry->data_len & LDB_DATA_COMPRESSED)
+        return LDB_ERR_ENTRY_DATA;
+
+    if (state->seqnum2 != 0 && entry->seqnum != state->seqnum2 + 1)
+        return LDB_ERR_ENTRY_SEQNUM;
+
+    if (entry->timestamp < state->timestamp2)
+        return LDB_ERR_ENTRY_TIMESTAMP;
+
+    return LDB_OK;
+}
+
+// Allocates the file space up to end plus extent bytes when end exceeds the allocated length.
+// Preallocation is advisory (on error alloc is unchanged and writes extend the file).
+static void ldb_prealloc(int fd, size_t *alloc, size_t end, size_t extent)
+{
+    if (extent == 0 || end <= *alloc)
+        return;
+
+    if (posix_fallocate(fd, (off_t) *alloc, (off_t) (end + extent - *alloc)) == 0)
+        *alloc = end + extent;
+}
+
+// Allocates again the space in [end, alloc) removed by ldb_punch_tail() (preallocation enabled).
+static void ldb_realloc_tail(int fd, size_t end, size_t alloc, size_t extent)
+{
+    if (extent > 0 && end < alloc)
+        (void) posix_fallocate(fd, (off_t) end, (off_t) (alloc - end));
+}
+
+// Writes the content described by iov at pos.
+// Partial writes are resumed (iov is modified).
+static bool ldb_writev(int fd, struct iovec *iov, int iovcnt, size_t pos)
+{
+    assert(iov);
+
+    if (lseek(fd, (off_t) pos, SEEK_SET) == (off_t) -1)
+        return false;
+
+    while (iovcnt > 0)
+    {
+        ssize_t rc = writev(fd, iov, iovcnt);
+
+        if (rc < 0 && errno == EINTR)
+            continue;
+
+        if (rc <= 0)
+            return false;
+
+        size_t len = (size_t) rc;
+
+        while (iovcnt > 0 && len >= iov->iov_len) {
+            len -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+
+        if (iovcnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + len;
+            iov->iov_len -= len;
+        }
+    }
+
+    return true;
+}
+
+// Writes the encoded idx records of num entries at pos.
+// Records are kept in the write-behind buffer when enabled. The buffer is
+// written when it reaches max_entries (on the next call, so that a failed
+// write does not leave records of unwritten entries in the buffer).
+// Function accessed only by thread-write.
+static int ldb_write_idx(ldb_impl_t *obj, char *buf, size_t len, size_t pos, size_t num)
+{
+    ldb_writeback_t *wb = &obj->writeback;
+    int idx_fd = fileno(obj->idx_fp);
+    int ret = LDB_OK;
+
+    if (wb->max_entries == 0)
+    {
+        struct iovec iov[1] = {{ buf, len }};
+
+        ldb_prealloc(idx_fd, &obj->idx_alloc, pos + len, obj->prealloc);
+
+        return (ldb_writev(idx_fd, iov, 1, pos) ? LDB_OK : LDB_ERR_WRITE_IDX);
+    }
+
+    if (wb->num >= wb->max_entries && (ret = ldb_flush_idx(obj)) != LDB_OK)
+        return ret;
+
+    assert(wb->len == 0 || pos == wb->pos + wb->len);
+    assert(wb->len + len <= wb->capacity);
+
+    ldb_prealloc(idx_fd, &obj->idx_alloc, pos + len, obj->prealloc);
+
+    pthread_mutex_lock(&obj->mutex_idx);
+    if (wb->len == 0)
+        LDB_ATOMIC_STORE_REL(&wb->pos, pos);
+    memcpy(wb->buf + wb->len, buf, len);
+    LDB_ATOMIC_STORE_REL(&wb->len, wb->len + len);
+    wb->num += num;
+    pthread_mutex_unlock(&obj->mutex_idx);
+
+    return LDB_OK;
+}
+
+/**
+ * Computes the checksum of the dat content [pos, end).
+ * Content located in [buf_pos, buf_pos + buf_len) is taken from buf (can 
+ * be NULL), the rest is read from file.
+ * 
+ * @return Error code (LDB_ERR_FMT_DAT = content beyond end of file).
+ */
+static int ldb_crc32_dat(int fd, const ldb_map_t *map, size_t pos, size_t end, const char *buf, size_t buf_pos, size_t buf_len, uint32_t *checksum)
+{
+    char aux[BUFSIZ];
+
+    while (pos < end)
+    {
+        size_t num_bytes = end - pos;
+
+        if (buf != NULL && buf_pos <= pos && pos < buf_pos + buf_len)
+        {
+            num_bytes = ldb_min(num_bytes, buf_pos + buf_len - pos);
+            *checksum = ldb_crc32(buf + (pos - buf_pos), num_bytes, *checksum);
+        }
+        else
+        {
+            num_bytes = ldb_min(num_bytes, sizeof(aux));
+
+            if (buf != NULL && pos < buf_pos)
+                num_bytes = ldb_min(num_bytes, buf_pos - pos);
+
+            ssize_t rc = ldb_pread(fd, map, aux, num_bytes, pos);
+
+            if (rc == -1)
+                return LDB_ERR_READ_DAT;
+
+            if (rc != (ssize_t) num_bytes)
+                return LDB_ERR_FMT_DAT;
+
+            *checksum = ldb_crc32(aux, num_bytes, *checksum);
+        }
+
+        pos += num_bytes;
+    }
+
+    return LDB_OK;
+}
+
+/**
+ * Reads the batch header record at pos (batch format).
+ * Checksum covers the batch except the checksum field.
+ * 
+ * @param[out] record Batch header record.
+ * @param[out] batch Batch fields.
+ * @param[out] header_len Length of the batch header record header.
+ * @param[in] verify Verify the batch checksum (see ldb_crc32_dat() for buf).
+ * 
+ * @return Error code (LDB_ERR_FMT_DAT = not a batch header).
+ */
+static int ldb_read_batch_dat(int fd, const ldb_map_t *map, size_t pos, const char *buf, size_t buf_pos, size_t buf_len,
+                              ldb_record_dat_t *record, ldb_batch_t *batch, size_t *header_len, bool verify)
+{
+    char header[LDB_HEADER_MAX];
+    uint32_t checksum = 0;
+    int ret = LDB_OK;
+    ssize_t rc = ldb_pread(fd, map, header, sizeof(header), pos);
+
+    if (rc == -1)
+        return LDB_ERR_READ_DAT;
+
+    *header_len = ldb_decode_header_dat(LDB_FILE_FORMAT_BATCH, header, (size_t) rc, NULL, NULL, record, batch);
+
+    if (*header_len == 0 || record->seqnum == 0 || batch->back != 0)
+        return LDB_ERR_FMT_DAT;
+
+    if (!verify)
+        return LDB_OK;
+
+    checksum = ldb_crc32(header, *header_len - sizeof(uint32_t), checksum);
+
+    if ((ret = ldb_crc32_dat(fd, map, pos + *header_len, pos + batch->len, buf, buf_pos, buf_len, &checksum)) != LDB_OK)
+        return ret;
+
+    return (checksum == batch->checksum ? LDB_OK : LDB_ERR_CHECKSUM);
+}
+
+// Verifies the checksum of the batch starting at pos (see ldb_read_batch_dat()).
+static int ldb_check_batch_dat(int fd, const ldb_map_t *map, size_t pos, const char *buf, size_t buf_pos, size_t buf_len)
+{
+    ldb_record_dat_t record = {0};
+    ldb_batch_t batch = {0};
+    size_t header_len = 0;
+
+    return ldb_read_batch_dat(fd, map, pos, buf, buf_pos, buf_len, &record, &batch, &header_len, true);
+}
+
+// Verifies the batch of the record at pos, unless it is the last verified one (batch_pos).
+// Returns LDB_OK or LDB_ERR_CHECKSUM.
+static int ldb_check_batch_record(int fd, const ldb_map_t *map, size_t pos, size_t back, size_t *batch_pos, 
+                                  const char *buf, size_t buf_pos, size_t buf_len)
+{
+    if (back > pos - sizeof(ldb_header_dat_t))
+        return LDB_ERR_CHECKSUM;
+
+    if (pos - back == *batch_pos)
+        return LDB_OK;
+
+    *batch_pos = pos - back;
+
+    return (ldb_check_batch_dat(fd, map, *batch_pos, buf, buf_pos, buf_len) == LDB_OK ? LDB_OK : LDB_ERR_CHECKSUM);
+}
+
+/**
+ * Read data record at pos.
+ * File position is not modified.
+ * 
+ * @param[in] idx Idx record of the record at pos (implied values of dense
+ *                records), NULL if unknown (base or fixed records only).
+ * @param[out] len Bytes used by the record in the dat file (can be NULL).
+ */
+static int ldb_read_record_dat(int fd, const ldb_map_t *map, uint32_t format, size_t pos, const ldb_record_idx_t *idx, ldb_record_dat_t *record, size_t *len, bool verify_checksum)
+{
+    assert(record);
+    assert(fd > STDERR_FILENO);
+
+    char header[LDB_HEADER_MAX];
+    ldb_batch_t batch = {0};
+    size_t header_len = 0;
+    ssize_t rc = ldb_pread(fd, map, header, (ldb_is_dense(format) ? sizeof(header) : sizeof(ldb_record_dat_t)), pos);
+
+    if (rc == -1)
+        return LDB_ERR_READ_DAT;
+
+    if ((header_len = ldb_decode_header_dat(format, header, (size_t) rc, NULL, idx, record, &batch)) == 0)
+        return LDB_ERR_FMT_DAT;
+
+    if (len != NULL)
+        *len = ldb_record_len(format, header_len, record->data_len);
+
+    if (!verify_checksum || record->seqnum == 0)
+        return LDB_OK;
+
+    // batch records are verified with their batch
+    if (format == LDB_FILE_FORMAT_BATCH)
+    {
+        if (batch.back > pos - sizeof(ldb_header_dat_t))
+            return LDB_ERR_FMT_DAT;
+
+        return ldb_check_batch_dat(fd, map, pos - batch.back, NULL, 0, 0);
+    }
+
+    uint32_t checksum = ldb_checksum_record(record);
+    size_t data_len = ldb_stored_len(record->data_len);
+
+    if (data_len > 0)
+    {
+        pos += header_len;
+
+        char buf[BUFSIZ] = {0};
+        size_t end = pos + data_len;
+
+        for (size_t i = pos; i < end; i += sizeof(buf))
+        {
+            size_t num_bytes = ldb_min(end - i, sizeof(buf));
+
+            rc = ldb_pread(fd, map, buf, num_bytes, pos);
+
+            if (rc == -1)
+                return LDB_ERR_READ_DAT;
+
+            if (rc != (ssize_t) num_bytes)
+                return LDB_ERR_FMT_DAT;
+
+            pos += num_bytes;
+
+            checksum = ldb_crc32(buf, num_bytes, checksum);
+        }
+    }
+
+    if (checksum != record->checksum)
+        return LDB_ERR_CHECKSUM;
+
+    return LDB_OK;
+}
+
+// Reads the timestamp of a dense record walking the dat records from the 
+// first record of its idx block (dense timestamps are deltas).
+static int ldb_walk_timestamp_dat(ldb_impl_t *obj, const ldb_record_idx_t *block, ldb_record_idx_t *record)
+{
+    int dat_fd = fileno(obj->dat_fp);
+    ldb_record_dat_t prev = {0};
+    ldb_record_dat_t aux = {0};
+    char header[LDB_HEADER_MAX];
+    size_t pos = block->pos;
+    size_t len = 0;
+    ssize_t rc = 0;
+    int ret = LDB_OK;
+
+    if ((ret = ldb_read_record_dat(dat_fd, &obj->dat_map, obj->format, pos, block, &prev, &len, false)) != LDB_OK)
+        return ret;
+
+    while (prev.seqnum != 0 && prev.seqnum < record->seqnum)
+    {
+        pos += len;
+
+        if ((rc = ldb_pread(dat_fd, &obj->dat_map, header, sizeof(header), pos)) == -1)
+            return LDB_ERR_READ_DAT;
+
+        size_t header_len = ldb_decode_record_dat(obj->format, header, (size_t) rc, &prev, NULL, &aux);
+
+        if (header_len == 0)
+            return LDB_ERR_FMT_IDX;
+
+        len = ldb_record_len(obj->format, header_len, aux.data_len);
+        prev = aux;
+    }
+
+    if (prev.seqnum != record->seqnum || pos != record->pos)
+        return LDB_ERR_FMT_IDX;
+
+    record->timestamp = prev.timestamp;
+
+    return LDB_OK;
+}
+
+// Decodes a compact idx delta (record->seqnum set).
+// Timestamps not encoded in the delta are read from the dat record.
+static int ldb_decode_idx(ldb_impl_t *obj, const ldb_record_idx_t *block, uint64_t delta, ldb_record_idx_t *record)
+{
+    ldb_record_dat_t record_dat = {0};
+    uint64_t ts = delta >> LDB_IDX_POS_BITS;
+    int ret = LDB_OK;
+
+    record->pos = block->pos + (delta & LDB_IDX_POS_MASK);
+    record->timestamp = block->timestamp + ts;
+
+    if (ts != LDB_IDX_TS_UNKNOWN)
+        return LDB_OK;
+
+    if (ldb_is_dense(obj->format))
+        return ldb_walk_timestamp_dat(obj, block, record);
+
+    if ((ret = ldb_read_record_dat(fileno(obj->dat_fp), &obj->dat_map, obj->format, record->pos, NULL, &record_dat, NULL, false)) != LDB_OK)
+        return ret;
+
+    if (record_dat.seqnum != record->seqnum)
+        return LDB_ERR_FMT_IDX;
+
+    record->timestamp = record_dat.timestamp;
+
+    return LDB_OK;
+}
+
+// Reads len bytes of the idx file at pos.
+// Content kept in the write-behind buffer is copied from it, the rest is read from the file.
+// Returns less bytes than requested when the end of the indexed content is reached.
+static ssize_t ldb_pread_idx(ldb_impl_t *obj, void *buf, size_t len, size_t pos)
+{
+    ldb_writeback_t *wb = &obj->writeback;
+    int idx_fd = fileno(obj->idx_fp);
+    size_t head = len;
+    size_t tail = 0;
+
+    // content already written (write-behind disabled or flushed)
+    if (LDB_ATOMIC_LOAD_ACQ(&wb->len) == 0 || pos + len <= LDB_ATOMIC_LOAD_ACQ(&wb->pos))
+        return ldb_pread(idx_fd, &obj->idx_map, buf, len, pos);
+
+    pthread_mutex_lock(&obj->mutex_idx);
+
+    head = (pos < wb->pos ? ldb_min(len, wb->pos - pos) : 0);
+
+    if (head < len && pos + head < wb->pos + wb->len) {
+        size_t off = pos + head - wb->pos;
+        tail = ldb_min(len - head, wb->len - off);
+        memcpy((char *) buf + head, wb->buf + off, tail);
+    }
+
+    pthread_mutex_unlock(&obj->mutex_idx);
+
+    if (head == 0)
+        return (ssize_t) tail;
+
+    ssize_t rc = ldb_pread(idx_fd, &obj->idx_map, buf, head, pos);
+
+    return (rc == (ssize_t) head ? (ssize_t) (head + tail) : rc);
+}
+
+// Reads the first record of the block containing seqnum (compact format).
+// Cached block is reused when it matches.
+static int ldb_read_block_idx(ldb_impl_t *obj, uint64_t seqnum1, uint64_t seqnum, ldb_record_idx_t *block)
+{
+    ldb_state_t state = { .seqnum1 = seqnum1 };
+    uint64_t first = seqnum - (seqnum - seqnum1) % LDB_IDX_BLOCK_RECORDS;
+    size_t pos = ldb_get_pos_idx(obj->idx_format, &state, first);
+
+    if (block->seqnum == first)
+        return LDB_OK;
+
+    if (ldb_pread_idx(obj, block, sizeof(ldb_record_idx_t), pos) != (ssize_t) sizeof(ldb_record_idx_t)) {
+        memset(block, 0x00, sizeof(ldb_record_idx_t));
+        return LDB_ERR_READ_IDX;
+    }
+
+    if (block->seqnum != first) {
+        memset(block, 0x00, sizeof(ldb_record_idx_t));
+        return LDB_ERR;
+    }
+
+    return LDB_OK;
+}
+
+/**
+ * Reads the idx record of seqnum.
+ * 
+ * @param[in] seqnum1 First seqnum of the idx file.
+ * @param[in,out] block First record of the last block read (compact format).
+ *                Avoids reading it again (NULL = not cached).
+ * 
+ * @return LDB_OK, LDB_ERR if record is empty or invalid, or a read error.
+ */
+static int ldb_read_idx(ldb_impl_t *obj, uint64_t seqnum1, uint64_t seqnum, ldb_record_idx_t *record, ldb_record_idx_t *block)
+{
+    assert(obj);
+    assert(record);
+    assert(seqnum1 <= seqnum);
+
+    int ret = LDB_OK;
+    int idx_fd = fileno(obj->idx_fp);
+    ldb_state_t state = { .seqnum1 = seqnum1 };
+    ldb_record_idx_t aux = {0};
+    uint64_t delta = 0;
+    size_t pos = ldb_get_pos_idx(obj->idx_format, &state, seqnum);
+
+    assert(idx_fd > STDERR_FILENO);
+
+    if (ldb_get_len_idx(obj->idx_format, &state, seqnum) == sizeof(ldb_record_idx_t))
+    {
+        if (ldb_pread_idx(obj, record, sizeof(ldb_record_idx_t), pos) != (ssize_t) sizeof(ldb_record_idx_t))
+            return LDB_ERR_READ_IDX;
+
+        if (record->seqnum != seqnum)
+            return LDB_ERR;
+
+        if (block != NULL && obj->idx_format != LDB_IDX_FORMAT_WIDE)
+            *block = *record;
+
+        return LDB_OK;
+    }
+
+    if (block == NULL)
+        block = &aux;
+
+    if ((ret = ldb_read_block_idx(obj, seqnum1, seqnum, block)) != LDB_OK)
+        return ret;
+
+    if (ldb_pread_idx(obj, &delta, sizeof(uint64_t), pos) != (ssize_t) sizeof(uint64_t))
+        return LDB_ERR_READ_IDX;
+
+    if (delta == 0)
+        return LDB_ERR;
+
+    record->seqnum = seqnum;
+
+    return ldb_decode_idx(obj, block, delta, record);
+}
+
+/**
+ * Reads consecutive idx records starting at seqnum.
+ * 
+ * Reads at most one block (compact format) or num records (wide format).
+ * Stops at the first empty record. Wide records are not validated.
+ * 
+ * @param[in] seqnum1 First seqnum of the idx file.
+ * @param[out] records Read records (min length = num).
+ * @param[in] num Maximum number of records to read.
+ * @param[out] count Number of read records (0 = no more records).
+ * @param[in,out] block First record of the last block read.
+ * 
+ * @return LDB_OK, LDB_ERR_FMT_IDX if a block is invalid, or a read error.
+ */
+static int ldb_read_records_idx(ldb_impl_t *obj, uint64_t seqnum1, uint64_t seqnum, ldb_record_idx_t *records, size_t num, size_t *count, ldb_record_idx_t *block)
+{
+    assert(obj);
+    assert(records);
+    assert(count);
+    assert(block);
+
+    int ret = LDB_OK;
+    ldb_state_t state = { .seqnum1 = seqnum1 };
+    uint64_t deltas[LDB_IDX_BLOCK_RECORDS - 1];
+    size_t pos = ldb_get_pos_idx(obj->idx_format, &state, seqnum);
+    size_t slot = (size_t) ((seqnum - seqnum1) % LDB_IDX_BLOCK_RECORDS);
+    ssize_t rc = 0;
+    size_t n = 0;
+
+    *count = 0;
+
+    if (num == 0)
+        return LDB_OK;
+
+    if (obj->idx_format == LDB_IDX_FORMAT_WIDE)
+    {
+        if ((rc = ldb_pread_idx(obj, records, num * sizeof(ldb_record_idx_t), pos)) < 0)
+            return LDB_ERR_READ_IDX;
+
+        num = (size_t) rc / sizeof(ldb_record_idx_t);
+
+        while (*count < num && records[*count].seqnum != 0)
+            (*count)++;
+
+        return LDB_OK;
+    }
+
+    if (slot == 0)
+    {
+        if ((rc = ldb_pread_idx(obj, block, sizeof(ldb_record_idx_t), pos)) < 0)
+            return LDB_ERR_READ_IDX;
+
+        if (rc != (ssize_t) sizeof(ldb_record_idx_t) || block->seqnum == 0) {
+            memset(block, 0x00, sizeof(ldb_record_idx_t));
+            return LDB_OK;
+        }
+
+        if (block->seqnum != seqnum) {
+            memset(block, 0x00, sizeof(ldb_record_idx_t));
+            return LDB_ERR_FMT_IDX;
+        }
+
+        records[0] = *block;
+        *count = 1;
+        pos += sizeof(ldb_record_idx_t);
+        slot++;
+    }
+    else
+    {
+        ret = ldb_read_block_idx(obj, seqnum1, seqnum, block);
+
+        if (ret == LDB_ERR)
+            return LDB_ERR_FMT_IDX;
+
+        if (ret != LDB_OK)
+            return ret;
+    }
+
+    n = ldb_min(num - *count, LDB_IDX_BLOCK_RECORDS - slot);
+
+    if ((rc = ldb_pread_idx(obj, deltas, n * sizeof(uint64_t), pos)) < 0)
+        return LDB_ERR_READ_IDX;
+
+    n = (size_t) rc / sizeof(uint64_t);
+
+    for (size_t i = 0; i < n && deltas[i] != 0; i++)
+    {
+        ldb_record_idx_t *record = &records[*count];
+
+        record->seqnum = block->seqnum + slot + i;
+
+        if ((ret = ldb_decode_idx(obj, block, deltas[i], record)) != LDB_OK)
+            return (ret == LDB_ERR_READ_DAT ? ret : LDB_ERR_FMT_IDX);
+
+        (*count)++;
+    }
+
+    return LDB_OK;
+}
+
+// Read idx record of seqnum.
+// File position is not modified.
+static int ldb_read_record_idx(ldb_impl_t *obj, const ldb_state_t *state, uint64_t seqnum, ldb_record_idx_t *record)
+{
+    assert(obj);
+    assert(state);
+    assert(record);
+
+    if (state->seqnum1 == 0 || seqnum < state->seqnum1 || state->seqnum2 < seqnum)
+        return LDB_ERR;
+
+    if (seqnum == state->seqnum1) {
+        record->seqnum = state->seqnum1;
+        record->timestamp = state->timestamp1;
+        record->pos = sizeof(ldb_header_dat_t);
+        return LDB_OK;
+    }
+
+    return ldb_read_idx(obj, state->seqnum1, seqnum, record, NULL);
+}
+
+// Loads in obj->idx_block the first record of the seqnum block (compact format).
+// Function accessed only by thread-write.
+static int ldb_load_block_idx(ldb_impl_t *obj, const ldb_state_t *state, uint64_t seqnum)
+{
+    if (ldb_get_len_idx(obj->idx_format, state, seqnum) == sizeof(ldb_record_idx_t))
+        return LDB_OK;
+
+    int ret = ldb_read_block_idx(obj, state->seqnum1, seqnum, &obj->idx_block);
+
+    return (ret == LDB_ERR ? LDB_ERR_FMT_IDX : ret);
+}
+
+static int ldb_append_record_idx(ldb_impl_t *obj, ldb_state_t *state, ldb_record_idx_t *record)
+{
+    assert(obj);
+    assert(state);
+    assert(record);
+    assert(obj->idx_fp);
+    assert(!feof(obj->idx_fp));
+    assert(!ferror(obj->idx_fp));
+
+    if (record->seqnum != state->seqnum2) {
+        return LDB_ERR;
+    }
+
+    char buf[sizeof(ldb_record_idx_t)];
+    size_t pos = ldb_get_pos_idx(obj->idx_format, state, record->seqnum);
+    size_t len = 0;
+    int ret = LDB_OK;
+
+    if ((ret = ldb_load_block_idx(obj, state, record->seqnum)) != LDB_OK)
+        return ret;
+
+    len = ldb_encode_idx(obj->idx_format, state, record, 1, &obj->idx_block, buf);
+
+    if (fseek(obj->idx_fp, (long) pos, SEEK_SET) != 0)
+        return LDB_ERR_READ_IDX;
+
+    if (fwrite(buf, len, 1, obj->idx_fp) != 1)
+        return LDB_ERR_WRITE_IDX;
+
+    return LDB_OK;
+}
+
+// Verifies checksums of a range of records contained in the scan buffer.
+typedef struct ldb_verify_t {
+    int fd;                       // Dat file descriptor
+    uint32_t format;              // Dat file format
+    const char *buf;              // Scan buffer
+    size_t len;                   // Scan buffer length
+    size_t base;                  // File position of buf[0]
+    const ldb_record_idx_t *records; // Records to verify
+    size_t num;                   // Number of records to verify
+    size_t failed;                // Index of the first invalid record (num if none)
+    pthread_t thread;             // Worker thread
+    bool running;                 // Thread created (otherwise run inline)
+} ldb_verify_t;
+
+static void * ldb_verify_run(void *args)
+{
+    ldb_verify_t *part = (ldb_verify_t *) args;
+
+    part->failed = part->num;
+
+    for (size_t i = 0; i < part->num; i++)
+    {
+        size_t off = part->records[i].pos - part->base;
+        ldb_record_dat_t record = {0};
+        ldb_batch_t batch = {0};
+        size_t header_len = ldb_decode_header_dat(part->format, part->buf + off, part->len - off, NULL, &part->records[i], &record, &batch);
+
+        if (header_len == 0) {
+            part->failed = i;
+            break;
+        }
+
+        // batches are fully contained in buf (see ldb_scan_next)
+        if (part->format == LDB_FILE_FORMAT_BATCH)
+        {
+            if (batch.back == 0 && ldb_check_batch_dat(part->fd, NULL, part->records[i].pos, part->buf, part->base, part->len) != LDB_OK) {
+                part->failed = i;
+                break;
+            }
+
+            continue;
+        }
+
+        if (!ldb_is_valid_checksum(&record, part->buf + off + header_len)) {
+            part->failed = i;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static size_t ldb_num_cpus(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long num = sysconf(_SC_NPROCESSORS_ONLN);
+    return (num > 0 ? (size_t) num : 1);
+#else
+    return 1;
+#endif
+}
+
+/**
+ * Sequential reader of the dat file.
+ * 
+ * Reads the dat file in large chunks and parses the records from the
+ * chunk buffer. Checksums of records located at or after verify_pos are
+ * computed by up to LDB_SCAN_THREADS threads (chunk split by bytes).
+ * Records larger than the chunk are verified one by one using pread().
+ * 
+ * Scan ends at end of file or at the first zero (rolled back) or
+ * truncated record. Then next is the position to zeroize.
+ */
+typedef struct ldb_scan_t {
+    int fd;                       // Dat file descriptor
+    uint32_t format;              // Dat file format
+    ldb_record_dat_t prev;        // Last parsed record (implied values of dense records)
+    size_t batch_end;             // End of the current batch (batch format, 0 = unknown)
+    char *buf;                    // Chunk buffer (LDB_SCAN_CHUNK bytes)
+    size_t end;                   // Dat file length
+    size_t next;                  // Position of the next record to parse
+    size_t verify_pos;            // Records at or after this position are verified
+    size_t num_threads;           // Threads used to verify checksums
+    bool eof;                     // No more records
+    ldb_record_idx_t *records;    // Records parsed from the current chunk
+    size_t num;                   // Number of records parsed from the current chunk
+    size_t capacity;              // Allocated records
+} ldb_scan_t;
+
+// prev is the record preceding pos.
+static int ldb_scan_init(ldb_scan_t *scan, int fd, uint32_t format, const ldb_record_dat_t *prev, size_t pos, size_t end, size_t verify_pos)
+{
+    assert(scan);
+    assert(prev);
+
+    memset(scan, 0x00, sizeof(ldb_scan_t));
+
+    scan->fd = fd;
+    scan->format = format;
+    scan->prev = *prev;
+    scan->end = end;
+    scan->next = pos;
+    scan->verify_pos = verify_pos;
+    scan->num_threads = ldb_min(ldb_num_cpus(), LDB_SCAN_THREADS);
+    scan->eof = (pos >= end);
+    scan->capacity = LDB_SCAN_CHUNK / ldb_min_record_len(format);
+
+    scan->buf = (char *) malloc(LDB_SCAN_CHUNK);
+    scan->records = (ldb_record_idx_t *) malloc(scan->capacity * sizeof(ldb_record_idx_t));
+
+    if (!scan->buf || !scan->records)
+        return LDB_ERR_MEM;
+
+    posix_fadvise(fd, (off_t) pos, 0, POSIX_FADV_SEQUENTIAL);
+
+    return LDB_OK;
+}
+
+static void ldb_scan_free(ldb_scan_t *scan)
+{
+    free(scan->buf);
+    free(scan->records);
+    scan->buf = NULL;
+    scan->records = NULL;
+}
+
+// Verifies scan->records[0, scan->num) contained in buf.
+// Returns the index of the first invalid record (scan->num if none).
+static size_t ldb_scan_verify(ldb_scan_t *scan, size_t base)
+{
+    ldb_verify_t parts[LDB_SCAN_THREADS] = {{0}};
+    size_t num_parts = 0;
+    size_t num_threads = 0;
+    size_t first = 0;
+    size_t bytes = 0;
+
+    // skip already verified records
+    while (first < scan->num && scan->records[first].pos < scan->verify_pos)
+        first++;
+
+    if (first == scan->num)
+        return scan->num;
+
+    // batches are verified from their header record
+    if (scan->format == LDB_FILE_FORMAT_BATCH)
+    {
+        size_t off = scan->records[first].pos - base;
+        ldb_record_dat_t record = {0};
+        ldb_batch_t batch = {0};
+
+        ldb_decode_header_dat(scan->format, scan->buf + off, scan->next - scan->records[first].pos, NULL, &scan->records[first], &record, &batch);
+
+        size_t batch_pos = scan->records[first].pos - batch.back;
+
+        while (first > 0 && scan->records[first - 1].pos >= batch_pos)
+            first--;
+    }
+
+    // small chunks are not worth a thread
+    bytes = scan->next - scan->records[first].pos;
+    num_threads = (bytes < LDB_SCAN_CHUNK / 8 ? 1 : scan->num_threads);
+
+    // split records in parts of similar size
+    for (size_t start = first; start < scan->num; num_parts++)
+    {
+        size_t end = start + 1;
+
+        if (num_parts + 1 == num_threads)
+            end = scan->num;
+
+        while (end < scan->num && scan->records[end].pos - scan->records[start].pos < bytes / num_threads)
+            end++;
+
+        parts[num_parts].fd = scan->fd;
+        parts[num_parts].format = scan->format;
+        parts[num_parts].buf = scan->buf;
+        parts[num_parts].len = scan->next - base;
+        parts[num_parts].base = base;
+        parts[num_parts].records = scan->records + start;
+        parts[num_parts].num = end - start;
+
+        start = end;
+    }
+
+    for (size_t i = 1; i < num_parts; i++)
+        parts[i].running = (pthread_create(&parts[i].thread, NULL, ldb_verify_run, &parts[i]) == 0);
+
+    for (size_t i = 0; i < num_parts; i++)
+    {
+        if (parts[i].running)
+            pthread_join(parts[i].thread, NULL);
+        else
+            ldb_verify_run(&parts[i]);
+    }
+
+    for (size_t i = 0, offset = first; i < num_parts; offset += parts[i].num, i++)
+        if (parts[i].failed < parts[i].num)
+            return offset + parts[i].failed;
+
+    return scan->num;
+}
+
+// Checks the batch framing of the record at pos (batch format).
+// Batches are parsed entirely from one chunk. When the scan starts in the
+// middle of a batch, the batch is verified here (content read from file).
+// buf contains the avail chunk bytes from pos.
+static int ldb_scan_batch(ldb_scan_t *scan, size_t pos, const ldb_batch_t *batch, const char *buf, size_t avail)
+{
+    if (batch->back == 0)
+    {
+        // case batch header not following the previous batch, or truncated batch
+        if (pos < scan->batch_end || pos + batch->len > scan->end)
+            return LDB_ERR_FMT_DAT;
+
+        scan->batch_end = pos + batch->len;
+        return LDB_OK;
+    }
+
+    // case record out of the current batch (rolled back tail)
+    if (scan->batch_end != 0)
+        return (pos < scan->batch_end ? LDB_OK : LDB_ERR_FMT_DAT);
+
+    if (batch->back > pos - sizeof(ldb_header_dat_t))
+        return LDB_ERR_FMT_DAT;
+
+    ldb_record_dat_t record = {0};
+    ldb_batch_t frame = {0};
+    size_t batch_pos = pos - batch->back;
+    size_t header_len = 0;
+    int ret = ldb_read_batch_dat(scan->fd, NULL, batch_pos, NULL, 0, 0, &record, &frame, &header_len, false);
+
+    if (ret != LDB_OK)
+        return ret;
+
+    if (pos >= batch_pos + frame.len || batch_pos + frame.len > scan->end)
+        return LDB_ERR_FMT_DAT;
+
+    scan->batch_end = batch_pos + frame.len;
+
+    if (scan->batch_end <= scan->verify_pos)
+        return LDB_OK;
+
+    ret = ldb_check_batch_dat(scan->fd, NULL, batch_pos, buf, pos, avail);
+
+    return (ret == LDB_ERR_FMT_DAT ? LDB_ERR_CHECKSUM : ret);
+}
+
+/**
+ * Parses the records of the next chunk into scan->records.
+ * 
+ * @return LDB_OK (scan->num = 0 means end of scan),
+ *         LDB_ERR_CHECKSUM (scan->num valid records before the invalid one),
+ *         or another error code.
+ */
+static int ldb_scan_next(ldb_scan_t *scan)
+{
+    assert(scan);
+
+    size_t base = scan->next;
+    size_t len = ldb_min(LDB_SCAN_CHUNK, scan->end - ldb_min(base, scan->end));
+    size_t off = 0;
+    ssize_t rc = 0;
+
+    scan->num = 0;
+
+    if (scan->eof)
+        return LDB_OK;
+
+    // read chunk
+    while (off < len)
+    {
+        rc = pread(scan->fd, scan->buf + off, len - off, (off_t) (base + off));
+
+        if (rc == -1 && errno == EINTR)
+            continue;
+
+        if (rc == -1)
+            return LDB_ERR_READ_DAT;
+
+        if (rc == 0)
+            break;
+
+        off += (size_t) rc;
+    }
+
+    len = off;
+    off = 0;
+
+    // prefetch next chunk while current one is processed
+    if (base + len < scan->end)
+        posix_fadvise(scan->fd, (off_t) (base + len), LDB_SCAN_CHUNK, POSIX_FADV_WILLNEED);
+
+    // parse records
+    while (off < len && scan->num < scan->capacity)
+    {
+        ldb_record_dat_t record = {0};
+        ldb_batch_t batch = {0};
+        size_t header_len = ldb_decode_header_dat(scan->format, scan->buf + off, len - off, &scan->prev, NULL, &record, &batch);
+
+        // case header not fully contained in chunk
+        if (header_len == 0 && len - off < LDB_HEADER_MAX && base + len < scan->end)
+            break;
+
+        // case zero (rolled back), invalid or truncated header
+        if (header_len == 0 || record.seqnum == 0) {
+            scan->eof = true;
+            break;
+        }
+
+        if (scan->format == LDB_FILE_FORMAT_BATCH)
+        {
+            // case batch not fully contained in chunk (parsed from the next one)
+            if (batch.back == 0 && off > 0 && off + batch.len > len && base + off + batch.len <= scan->end)
+                break;
+
+            int ret = ldb_scan_batch(scan, base + off, &batch, scan->buf + off, len - off);
+
+            if (ret == LDB_ERR_FMT_DAT) {
+                scan->eof = true;
+                break;
+            }
+
+            if (ret == LDB_ERR_CHECKSUM) {
+                scan->next = base + off;
+                scan->eof = true;
+                return ret;
+            }
+
+            if (ret != LDB_OK)
+                return ret;
+        }
+
+        size_t rec_len = ldb_record_len(scan->format, header_len, record.data_len);
+
+        // case truncated record
+        if (base + off + rec_len > scan->end) {
+            scan->eof = true;
+            break;
+        }
+
+        // case record not fully contained in chunk
+        if (off + rec_len > len)
+        {
+            if (off > 0)
+                break;
+
+            // record larger than chunk
+            ldb_record_idx_t aux = { .seqnum = record.seqnum, .timestamp = record.timestamp, .pos = base };
+            int ret = ldb_read_record_dat(scan->fd, NULL, scan->format, base, &aux, &record, NULL, (base >= scan->verify_pos));
+
+            if (ret == LDB_ERR_FMT_DAT) {
+                scan->eof = true;
+                break;
+            }
+
+            if (ret != LDB_OK)
+                return ret;
+
+            scan->records[0] = aux;
+            scan->num = 1;
+            scan->next = base + rec_len;
+            scan->prev = record;
+            return LDB_OK;
+        }
+
+        scan->records[scan->num].seqnum = record.seqnum;
+        scan->records[scan->num].timestamp = record.timestamp;
+        scan->records[scan->num].pos = base + off;
+        scan->num++;
+        scan->prev = record;
+
+        off += rec_len;
+    }
+
+    scan->next = base + off;
+
+    if (scan->next + ldb_min_record_len(scan->format) > scan->end)
+        scan->eof = true;
+
+    size_t num_valid = ldb_scan_verify(scan, base);
+
+    if (num_valid < scan->num) {
+        scan->num = num_valid;
+        scan->next = scan->records[num_valid].pos;
+        scan->eof = true;
+        return LDB_ERR_CHECKSUM;
+    }
+
+    return LDB_OK;
+}
+
+#define exit_function(errnum) do { ret = errnum; goto LDB_OPEN_FILE_DAT_ERR; } while(0)
+
+/**
+ * pre-conditions:
+ *   - obj->dat_fp == NULL
+ *   - obj->idx_fp == NULL
+ *
+ * post-conditions (OK)
+ *   - obj->dat_fp = set
+ *   - obj->format = set
+ *   - obj->first_seqnum = set (0 if no data)
+ *   - obj->first_timestamp = set
+ *   - obj->dat_end = sizeof(ldb_header_dat_t)
+ *   - obj->checkpoint = last verified record (0 if not checked)
+ *   - dat file position = at end
+ * 
+ * post-conditions (KO)
+ *   - dat files closed
+ */
+static int ldb_open_file_dat(ldb_impl_t *obj, bool check)
+{
+    assert(obj);
+    assert(obj->dat_fp == NULL);
+    assert(obj->idx_fp == NULL);
+
+    int ret = LDB_OK;
+    int dat_fd = -1;
+    ldb_header_dat_t header = {0};
+    ldb_record_dat_t record = {0};
+    ldb_record_dat_t aux = {0};
+    ldb_record_idx_t checkpoint = {0};
+    ldb_scan_t scan = {0};
+    size_t rec_len = 0;
+    size_t pos = 0;
+    size_t len = 0;
+
+    ldb_reset_state(&obj->state);
+    obj->dat_end = sizeof(ldb_header_dat_t);
+    memset(&obj->checkpoint, 0x00, sizeof(ldb_record_idx_t));
+
+    obj->dat_fp = fopen(obj->dat_path, "r+");
+
+    if (obj->dat_fp == NULL)
+        return LDB_ERR_OPEN_DAT;
+
+    if ((dat_fd = fileno(obj->dat_fp)) == -1)
+        return LDB_ERR_OPEN_DAT;
+
+    if (flock(dat_fd, LOCK_EX | LOCK_NB) == -1)
+        return LDB_ERR_LOCK;
+
+    len = ldb_get_file_size(obj->dat_fp);
+
+    if (pread(dat_fd, &header, sizeof(ldb_header_dat_t), 0) != (ssize_t) sizeof(ldb_header_dat_t))
+        exit_function(LDB_ERR_FMT_DAT);
+
+    pos += sizeof(ldb_header_dat_t);
+
+    if (header.magic_number != LDB_DAT_MAGIC_NUMBER) 
+        exit_function(LDB_ERR_FMT_DAT);
+
+    if (header.format != LDB_FILE_FORMAT && !ldb_is_dense(header.format))
+        exit_function(LDB_ERR_FMT_DAT);
+
+    // unknown codec (compressed records can not be read)
+    if (header.codec > LDB_CODEC_LZ4)
+        exit_function(LDB_ERR_FMT_DAT);
+
+    obj->format = header.format;
+
+    if (pos == len)
+        goto LDB_OPEN_FILE_DAT_END;
+
+    if (pos + ldb_min_record_len(obj->format) > len)
+        goto LDB_OPEN_FILE_DAT_ZEROIZE;
+
+    // read first entry
+    ret = ldb_read_record_dat(dat_fd, NULL, obj->format, pos, NULL, &record, &rec_len, true);
+
+    if (ret == LDB_ERR_FMT_DAT)
+        goto LDB_OPEN_FILE_DAT_ZEROIZE;
+
+    if (ret != LDB_OK)
+        exit_function(ret);
+
+    if (record.seqnum == 0)
+        goto LDB_OPEN_FILE_DAT_ZEROIZE;
+
+    pos += rec_len;
+
+    obj->state.seqnum1 = record.seqnum;
+    obj->state.timestamp1 = record.timestamp;
+
+    if (!check)
+        goto LDB_OPEN_FILE_DAT_END;
+
+    obj->state.seqnum2 = record.seqnum;
+    obj->state.timestamp2 = record.timestamp;
+    obj->checkpoint = (ldb_record_idx_t){ .seqnum = record.seqnum, .timestamp = record.timestamp, .pos = sizeof(ldb_header_dat_t) };
+
+    // resume after the checkpoint (records verified on a previous session)
+    checkpoint = ldb_read_checkpoint(obj->idx_path);
+
+    if (checkpoint.seqnum > obj->state.seqnum1 && checkpoint.timestamp >= obj->state.timestamp1 &&
+        checkpoint.pos > sizeof(ldb_header_dat_t) && checkpoint.pos + ldb_min_record_len(obj->format) <= len &&
+        ldb_read_record_dat(dat_fd, NULL, obj->format, checkpoint.pos, &checkpoint, &aux, &rec_len, false) == LDB_OK &&
+        aux.seqnum == checkpoint.seqnum && aux.timestamp == checkpoint.timestamp)
+    {
+        if (checkpoint.pos + rec_len <= len)
+        {
+            pos = checkpoint.pos + rec_len;
+            obj->state.seqnum2 = checkpoint.seqnum;
+            obj->state.timestamp2 = checkpoint.timestamp;
+            obj->checkpoint = checkpoint;
+            record = aux;
+        }
+    }
+
+    if ((ret = ldb_scan_init(&scan, dat_fd, obj->format, &record, pos, len, pos)) != LDB_OK) {
+        ldb_scan_free(&scan);
+        exit_function(ret);
+    }
+
+    while ((ret = ldb_scan_next(&scan)) == LDB_OK && scan.num > 0)
+    {
+        for (size_t i = 0; i < scan.num && ret == LDB_OK; i++)
+        {
+            if (scan.records[i].seqnum != obj->state.seqnum2 + 1 || scan.records[i].timestamp < obj->state.timestamp2)
+                ret = LDB_ERR_FMT_DAT;
+
+            obj->state.seqnum2 = scan.records[i].seqnum;
+            obj->state.timestamp2 = scan.records[i].timestamp;
+            obj->checkpoint = scan.records[i];
+        }
+
+        if (ret != LDB_OK)
+            break;
+    }
+
+    pos = scan.next;
+    ldb_scan_free(&scan);
+
+    if (ret != LDB_OK)
+        exit_function(ret);
+
+    // case record removed (rollback) or truncated
+    if (pos < len)
+        goto LDB_OPEN_FILE_DAT_ZEROIZE;
+
+    goto LDB_OPEN_FILE_DAT_END;
+
+LDB_OPEN_FILE_DAT_ZEROIZE:
+    if (!ldb_zeroize(obj->dat_fp, pos))
+        exit_function(LDB_ERR_WRITE_DAT);
+
+LDB_OPEN_FILE_DAT_END:
+    if (fseek(obj->dat_fp, 0, SEEK_END) == -1)
+        exit_function(LDB_ERR_WRITE_DAT);
+
+    return LDB_OK;
+
+LDB_OPEN_FILE_DAT_ERR:
+    ldb_close_files(obj);
+    ldb_reset_state(&obj->state);
+    return ret;
+}
+
+#undef exit_function
+#define exit_function(errnum) do { ret = errnum; goto LDB_OPEN_FILE_IDX_ERR; } while(0)
+
+/**
+ * pre-conditions:
+ *   - obj->dat_fp = set
+ *   - obj->idx_fp == NULL
+ *   - obj->first_seqnum = set (0 if no data)
+ *   - obj->first_timestamp = set
+ *   - obj->format = set
+ *
+ * post-conditions (OK)
+ *   - obj->dat_fp = set
+ *   - obj->idx_fp = set
+ *   - obj->first_seqnum = set (0 if no data)
+ *   - obj->first_timestamp = set
+ *   - obj->last_seqnum = set (0 if no data)
+ *   - obj->last_timestamp = set
+ *   - obj->dat_end = set
+ *   - idx file position = at end
+ * 
+ * post-conditions (KO)
+ *   - idx files closed
+ */
+static int ldb_open_file_idx(ldb_impl_t *obj, bool check)
+{
+    assert(obj);
+    assert(obj->idx_fp == NULL);
+    assert(obj->dat_fp != NULL);
+    assert(!ferror(obj->dat_fp) && !feof(obj->dat_fp));
+
+    int ret = LDB_OK;
+    int dat_fd = -1;
+    int idx_fd = -1;
+    ldb_header_idx_t header = {0};
+    ldb_record_idx_t record_0 = {0};
+    ldb_record_idx_t record_n = {0};
+    ldb_record_dat_t record_dat = {0};
+    ldb_record_idx_t checkpoint = {0};
+    ldb_scan_t scan = {0};
+    uint64_t trusted = 0;
+    size_t rec_len = 0;
+    size_t pos = 0;
+    size_t len = 0;
+
+    if ((dat_fd = fileno(obj->dat_fp)) == -1)
+        return LDB_ERR_OPEN_DAT;
+
+    obj->idx_fp = fopen(obj->idx_path, "r+");
+
+    if (obj->idx_fp == NULL)
+        return LDB_ERR_OPEN_IDX;
+
+    if ((idx_fd = fileno(obj->idx_fp)) == -1)
+        return LDB_ERR_OPEN_IDX;
+
+    if (flock(idx_fd, LOCK_EX | LOCK_NB) == -1)
+        return LDB_ERR_LOCK;
+
+    len = ldb_get_file_size(obj->idx_fp);
+
+    if (fseek(obj->idx_fp, 0, SEEK_END) == -1)
+        exit_function(LDB_ERR_OPEN_IDX);
+
+    if (pread(idx_fd, &header, sizeof(ldb_header_idx_t), 0) != (ssize_t) sizeof(ldb_header_idx_t))
+        exit_function(LDB_ERR_FMT_IDX);
+
+    pos += sizeof(ldb_header_idx_t);
+
+    if (header.magic_number != LDB_IDX_MAGIC_NUMBER)
+        exit_function(LDB_ERR_FMT_IDX);
+
+    if (header.format != LDB_IDX_FORMAT && header.format != LDB_IDX_FORMAT_WIDE)
+        exit_function(LDB_ERR_FMT_IDX);
+
+    obj->idx_format = header.format;
+    memset(&obj->idx_block, 0x00, sizeof(ldb_record_idx_t));
+
+    if (pos + sizeof(ldb_record_idx_t) <= len)
+    {
+        // read first entry
+        if (pread(idx_fd, &record_0, sizeof(ldb_record_idx_t), (off_t) pos) != (ssize_t) sizeof(ldb_record_idx_t)) 
+            exit_function(LDB_ERR_READ_IDX);
+
+        pos += sizeof(ldb_record_idx_t);
+
+        if (record_0.seqnum != obj->state.seqnum1)
+            exit_function(LDB_ERR_FMT_IDX);
+
+        if (record_0.timestamp != obj->state.timestamp1)
+            exit_function(LDB_ERR_FMT_IDX);
+
+        if (record_0.seqnum != 0 && record_0.pos != sizeof(ldb_header_dat_t))
+            exit_function(LDB_ERR_FMT_IDX);
+    }
+
+    record_n = record_0;
+    checkpoint = header.checkpoint;
+
+    // checkpoint is trusted if it matches the idx and dat records
+    if (record_0.seqnum != 0 && checkpoint.seqnum >= record_0.seqnum &&
+        checkpoint.seqnum - record_0.seqnum < ldb_get_num_idx(obj->idx_format, len))
+    {
+        ldb_record_idx_t aux = {0};
+
+        if (ldb_read_idx(obj, record_0.seqnum, checkpoint.seqnum, &aux, NULL) == LDB_OK &&
+            aux.seqnum == checkpoint.seqnum && aux.timestamp == checkpoint.timestamp && aux.pos == checkpoint.pos &&
+            ldb_read_record_dat(dat_fd, NULL, obj->format, checkpoint.pos, &checkpoint, &record_dat, NULL, false) == LDB_OK &&
+            record_dat.seqnum == checkpoint.seqnum && record_dat.timestamp == checkpoint.timestamp)
+        {
+            trusted = checkpoint.seqnum;
+
+            if (obj->checkpoint.seqnum < trusted)
+                obj->checkpoint = checkpoint;
+        }
+    }
+
+    // read last record distinct than 0
+    if (record_0.seqnum == 0)
+    {
+        // do nothing
+    }
+    else if (check)
+    {
+        ldb_record_idx_t records[LDB_IDX_BLOCK_RECORDS];
+        ldb_record_idx_t block = record_0;
+        size_t num = 0;
+
+        do
+        {
+            ret = ldb_read_records_idx(obj, record_0.seqnum, record_n.seqnum + 1, records, LDB_IDX_BLOCK_RECORDS, &num, &block);
+
+            if (ret != LDB_OK)
+                exit_function(ret);
+
+            for (size_t i = 0; i < num; i++)
+            {
+                ldb_record_idx_t *aux = &records[i];
+
+                if (aux->seqnum != record_n.seqnum + 1 || aux->timestamp < record_n.timestamp || aux->pos < record_n.pos + ldb_min_record_len(obj->format))
+                    exit_function(LDB_ERR_FMT_IDX);
+
+                // records up to the checkpoint were checked on a previous session
+                if (aux->seqnum > trusted)
+                {
+                    bool verify = (aux->seqnum > obj->checkpoint.seqnum);
+
+                    if (ldb_read_record_dat(dat_fd, NULL, obj->format, aux->pos, aux, &record_dat, NULL, verify) != LDB_OK)
+                        exit_function(LDB_ERR_FMT_IDX);
+
+                    if (aux->seqnum != record_dat.seqnum || aux->timestamp != record_dat.timestamp)
+                        exit_function(LDB_ERR_FMT_IDX);
+                }
+
+                record_n = *aux;
+            }
+        }
+        while (num > 0);
+
+        pos = ldb_get_pos_idx(obj->idx_format, &obj->state, record_n.seqnum) + ldb_get_len_idx(obj->idx_format, &obj->state, record_n.seqnum);
+    }
+    else
+    {
+        // search last valid position
+        uint64_t seqnum = record_0.seqnum + ldb_get_num_idx(obj->idx_format, len);
+
+        // move backwards until last record distinct than 0 (not rolled back)
+        while (--seqnum > record_0.seqnum)
+        {
+            ret = ldb_read_idx(obj, record_0.seqnum, seqnum, &record_n, NULL);
+
+            if (ret == LDB_OK)
+                break;
+
+            // empty or invalid record
+            if (ret != LDB_ERR)
+                exit_function(LDB_ERR_FMT_IDX);
+        }
+
+        ret = LDB_OK;
+
+        if (seqnum == record_0.seqnum)
+            record_n = record_0;
+
+        pos = ldb_get_pos_idx(obj->idx_format, &obj->state, record_n.seqnum) + ldb_get_len_idx(obj->idx_format, &obj->state, record_n.seqnum);
+    }
+
+    // at this point pos is just after the last record distinct than 0
+    if (!ldb_zeroize(obj->idx_fp, pos))
+        exit_function(LDB_ERR_WRITE_IDX);
+
+    // case idx with no records
+    if (record_0.seqnum == 0)
+    {
+        // adding first dat record (if any)
+        if (obj->state.seqnum1 != 0)
+        {
+            record_0.seqnum = obj->state.seqnum1;
+            record_0.timestamp = obj->state.timestamp1;
+            record_0.pos = sizeof(ldb_header_dat_t);
+
+            obj->state.seqnum2 = obj->state.seqnum1;
+            obj->state.timestamp2 = obj->state.timestamp1;
+
+            if ((ret = ldb_append_record_idx(obj, &obj->state, &record_0)) != LDB_OK)
+                exit_function(ret);
+
+            record_n = record_0;
+        }
+    }
+    else
+    {
+        // check record_n content
+        size_t diff = record_n.seqnum - record_0.seqnum;
+
+        if (record_n.seqnum < record_0.seqnum || record_n.timestamp < record_0.timestamp)
+            exit_function(LDB_ERR_FMT_IDX);
+
+
+        if (record_n.pos < sizeof(ldb_header_dat_t) + diff * ldb_min_record_len(obj->format))
+            exit_function(LDB_ERR_FMT_IDX);
+
+        obj->state.seqnum2 = record_n.seqnum;
+        obj->state.timestamp2 = record_n.timestamp;
+    }
+
+    // case no data
+    if (obj->state.seqnum1 == 0) {
+        obj->dat_end = sizeof(ldb_header_dat_t);
+        goto LDB_OPEN_FILE_IDX_END;
+    }
+
+    // read last record (dat)
+    pos = record_n.pos;
+    len = ldb_get_file_size(obj->dat_fp);
+
+    if (ldb_read_record_dat(dat_fd, NULL, obj->format, pos, &record_n, &record_dat, &rec_len, true) != LDB_OK)
+        exit_function(LDB_ERR_FMT_IDX);
+
+    if (record_dat.seqnum != record_n.seqnum || record_dat.timestamp != record_n.timestamp)
+        exit_function(LDB_ERR_FMT_IDX);
+
+    pos += rec_len;
+
+    obj->dat_end = pos;
+
+    // add unflushed dat records (if any)
+    if ((ret = ldb_scan_init(&scan, dat_fd, obj->format, &record_dat, pos, len, ldb_max(pos, obj->checkpoint.pos + 1))) != LDB_OK) {
+        ldb_scan_free(&scan);
+        exit_function(ret);
+    }
+
+    while ((ret = ldb_scan_next(&scan)) == LDB_OK && scan.num > 0)
+    {
+        for (size_t i = 0; i < scan.num && ret == LDB_OK; i++)
+        {
+            record_n = scan.records[i];
+
+            if (record_n.seqnum != obj->state.seqnum2 + 1 || record_n.timestamp < obj->state.timestamp2) {
+                ret = LDB_ERR_FMT_DAT;
+                break;
+            }
+
+            obj->state.seqnum2 = record_n.seqnum;
+            obj->state.timestamp2 = record_n.timestamp;
+            obj->dat_end = (i + 1 < scan.num ? scan.records[i + 1].pos : scan.next);
+
+            ret = ldb_append_record_idx(obj, &obj->state, &record_n);
+        }
+
+        if (ret != LDB_OK)
+            break;
+    }
+
+    pos = scan.next;
+    ldb_scan_free(&scan);
+
+    if (ret != LDB_OK)
+        exit_function(ret);
+
+    assert(obj->dat_end == pos);
+
+    if (fflush(obj->idx_fp) != 0)
+        exit_function(LDB_ERR_WRITE_IDX);
+
+    if (!ldb_zeroize(obj->dat_fp, pos))
+        exit_function(LDB_ERR_WRITE_DAT);
+
+LDB_OPEN_FILE_IDX_END:
+    // checkpoint is invalid until ldb_close()
+    if (header.checkpoint.seqnum != 0)
+    {
+        memset(&checkpoint, 0x00, sizeof(ldb_record_idx_t));
+
+        if (ldb_write_checkpoint(idx_fd, &checkpoint) != LDB_OK || fdatasync(idx_fd) == -1)
+            exit_function(LDB_ERR_WRITE_IDX);
+    }
+
+    if (fseek(obj->idx_fp, 0, SEEK_END) == -1)
+        exit_function(LDB_ERR_WRITE_DAT);
+
+    // space beyond the ends can be preallocated (zeroed)
+    obj->dat_alloc = ldb_get_file_size(obj->dat_fp);
+    obj->idx_alloc = ldb_get_file_size(obj->idx_fp);
+
+    return LDB_OK;
+
+LDB_OPEN_FILE_IDX_ERR:
+    if (obj->idx_fp != NULL) fclose(obj->idx_fp);
+    obj->idx_fp = NULL;
+    return ret;
+}
+
+#undef exit_function
+
+const char * ldb_version(void)
+{
+    static char version_str[32] = {0};
+
+    if (version_str[0] == 0) {
+        snprintf(version_str, sizeof(version_str), "%d.%d.%d", 
+                LDB_VERSION_MAJOR, LDB_VERSION_MINOR, LDB_VERSION_PATCH);
+    }
+
+    return version_str;
+}
+
+#define exit_function(errnum) do { ret = errnum; goto LDB_OPEN_ERR; } while(0)
+
+// Opens the journal without validating path and name.
+// Used by segmented journals (segment names contain a dot).
+static int ldb_open_journal(ldb_impl_t *obj, const char *path, const char *name, bool check)
+{
+    assert(obj);
+    assert(path);
+    assert(name);
+
+    int ret = LDB_OK;
+    pthread_condattr_t condattr;
+
+    memset(obj, 0x00, sizeof(ldb_impl_t));
+
+    obj->notify_fd[0] = -1;
+    obj->notify_fd[1] = -1;
+    obj->name = strdup(name);
+    obj->path = strdup(path);
+    obj->dat_path = ldb_create_filename(path, name, LDB_EXT_DAT);
+    obj->idx_path = ldb_create_filename(path, name, LDB_EXT_IDX);
+
+    if (!obj->name || !obj->path || !obj->dat_path || !obj->idx_path)
+        exit_function(LDB_ERR_MEM);
+
+    obj->force_fsync = false;
+    obj->verify_checksum = false;
+    obj->mmap_mode = LDB_MMAP_NONE;
+    obj->dat_end = sizeof(ldb_header_dat_t);
+    pthread_mutex_init(&obj->mutex_state, NULL);
+    pthread_mutex_init(&obj->mutex_idx, NULL);
+    pthread_rwlock_init(&obj->rwlock_files, NULL);
+    pthread_cond_init(&obj->cond_views, NULL);
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&obj->cond_append, &condattr);
+    pthread_condattr_destroy(&condattr);
+
+    // case dat file not exist
+    if (access(obj->dat_path, F_OK) != 0)
+    {
+        remove(obj->idx_path);
+
+        if (!ldb_create_file_dat(obj->dat_path, LDB_FILE_FORMAT, LDB_CODEC_NONE))
+            exit_function(LDB_ERR_OPEN_DAT);
+    }
+
+    // case idx file not exist
+    if (access(obj->idx_path, F_OK) != 0)
+    {
+        if (!ldb_create_file_idx(obj->idx_path))
+            exit_function(LDB_ERR_OPEN_IDX);
+    }
+
+    // open data file
+    if ((ret = ldb_open_file_dat(obj, check)) != LDB_OK)
+        exit_function(ret);
+
+    // open index file
+    ret = ldb_open_file_idx(obj, check);
+    switch(ret)
+    {
+        case LDB_OK:
+            break;
+        case LDB_ERR_OPEN_IDX:
+        case LDB_ERR_READ_IDX:
+        case LDB_ERR_WRITE_IDX:
+        case LDB_ERR_FMT_IDX:
+            // try to rebuild the index file
+            remove(obj->idx_path);
+            if (!ldb_create_file_idx(obj->idx_path))
+                exit_function(LDB_ERR_OPEN_IDX);
+            if ((ret = ldb_open_file_idx(obj, true)) != LDB_OK)
+                exit_function(ret);
+            break;
+        default:
+            exit_function(ret);
+    }
+
+    assert(!feof(obj->dat_fp));
+    assert(!feof(obj->idx_fp));
+    assert(!ferror(obj->dat_fp));
+    assert(!ferror(obj->idx_fp));
+
+    return LDB_OK;
+
+LDB_OPEN_ERR:
+    ldb_close(obj);
+    return ret;
+}
+
+int ldb_open(ldb_impl_t *obj, const char *path, const char *name, bool check)
+{
+    if (path == NULL || name == NULL || obj == NULL)
+        return LDB_ERR_ARG;
+
+    if (!ldb_is_valid_path(path))
+        return LDB_ERR_PATH;
+
+    if (!ldb_is_valid_name(name))
+        return  LDB_ERR_NAME;
+
+    return ldb_open_journal(obj, path, name, check);
+}
+
+#undef exit_function
+
+// Remaps files when the written content exceeds the mapping window.
+// This is rare (window doubles) and readers are blocked only during the remap.
+// On error mapping is disabled and reads fallback to pread().
+static void ldb_grow_maps(ldb_impl_t *obj, ldb_state_t *state)
+{
+    assert(obj);
+    assert(state);
+
+    size_t idx_end = ldb_get_pos_idx(obj->idx_format, state, state->seqnum2) + ldb_get_len_idx(obj->idx_format, state, state->seqnum2);
+    bool grow_idx = (obj->idx_map.addr != NULL && idx_end > obj->idx_map.len);
+    bool grow_dat = (obj->dat_map.addr != NULL && obj->dat_end > obj->dat_map.len);
+
+    // new content is in the files (remapped files get their current size)
+    if (obj->idx_map.addr != NULL && idx_end > obj->idx_map.size)
+        LDB_ATOMIC_STORE(&obj->idx_map.size, idx_end);
+
+    if (obj->dat_map.addr != NULL && obj->dat_end > obj->dat_map.size)
+        LDB_ATOMIC_STORE(&obj->dat_map.size, obj->dat_end);
+
+    if (!grow_idx && !grow_dat)
+        return;
+
+    ldb_lock_files(obj, true);
+
+    if (grow_idx) {
+        ldb_unmap_file(&obj->idx_map);
+        ldb_map_file(&obj->idx_map, obj->idx_fp);
+    }
+
+    if (grow_dat)
+    {
+        bool remap = true;
+
+        ldb_lock_state(obj);
+
+        if (obj->num_views == 0) {
+            ldb_unmap_file(&obj->dat_map);
+        }
+        else {
+            // pinned views point to the current mapping, keep it until release
+            ldb_map_t *old = (ldb_map_t *) malloc(sizeof(ldb_map_t));
+
+            if (old == NULL) {
+                remap = false; // retried on next append
+            }
+            else {
+                *old = obj->dat_map;
+                old->next = obj->retired;
+                obj->retired = old;
+                obj->dat_map = (ldb_map_t){0};
+            }
+        }
+
+        pthread_mutex_unlock(&obj->mutex_state);
+
+        if (remap)
+            ldb_map_file(&obj->dat_map, obj->dat_fp);
+    }
+
+    pthread_rwlock_unlock(&obj->rwlock_files);
+}
+
+// Writes entries to files without flushing them.
+// Entries are written in chunks (one writev per file and chunk).
+// State and obj->dat_end are updated with the written entries (state not published).
+// function accessed only by thread-write
+static int ldb_write_entries(ldb_impl_t *obj, ldb_state_t *state, ldb_entry_t *entries, size_t len, size_t *num)
+{
+    assert(obj);
+    assert(state);
+    assert(entries);
+    assert(num);
+    assert(obj->dat_fp);
+    assert(obj->idx_fp);
+
+    static const char zeros[sizeof(uintptr_t)] = {0};
+
+    ldb_record_dat_t records_dat[LDB_IOV_ENTRIES];
+    ldb_record_idx_t records_idx[LDB_IOV_ENTRIES];
+    char headers[LDB_IOV_ENTRIES][LDB_HEADER_MAX];
+    char idx_buf[LDB_IOV_ENTRIES * sizeof(ldb_record_idx_t)];
+    struct iovec iov_dat[3 * LDB_IOV_ENTRIES];
+    int dat_fd = fileno(obj->dat_fp);
+    uint64_t t0 = ldb_metrics_now(obj);
+    int ret = LDB_OK;
+
+    *num = 0;
+
+    while (*num < len && ret == LDB_OK)
+    {
+        ldb_state_t state_new = *state;
+        size_t dat_end = obj->dat_end;
+        size_t idx_pos = 0;
+        size_t idx_len = 0;
+        int iovcnt = 0;
+        size_t n = 0;
+        char *zptr = NULL;
+
+        // compressed payloads are smaller than entries data
+        if (obj->codec != LDB_CODEC_NONE)
+        {
+            size_t zlen = 0;
+
+            for (n = 0; n < LDB_IOV_ENTRIES && *num + n < len; n++)
+                zlen += entries[*num + n].data_len;
+
+            if (zlen > obj->zbuf_len)
+            {
+                char *aux = (char *) realloc(obj->zbuf, zlen);
+
+                if (aux != NULL) {
+                    obj->zbuf = aux;
+                    obj->zbuf_len = zlen;
+                }
+            }
+
+            // stored uncompressed if no memory
+            zptr = (zlen <= obj->zbuf_len ? obj->zbuf : NULL);
+        }
+
+        for (n = 0; n < LDB_IOV_ENTRIES && *num + n < len; n++)
+        {
+            ldb_entry_t *entry = &entries[*num + n];
+
+            // batches fit in a scan chunk (except single-entry ones)
+            if (obj->format == LDB_FILE_FORMAT_BATCH && n > 0 && 
+                dat_end - obj->dat_end + LDB_HEADER_MAX + entry->data_len > LDB_SCAN_CHUNK)
+                break;
+
+            if (entry->seqnum == 0)
+                entry->seqnum = state_new.seqnum2 + 1;
+
+            if (entry->timestamp == 0) 
+                entry->timestamp = ldb_max(ldb_get_millis(), state_new.timestamp2);
+
+            if ((ret = ldb_validate_entry(&state_new, entry)) != LDB_OK)
+                break;
+
+            void *data = entry->data;
+            size_t data_len = entry->data_len;
+            size_t compressed_len = (zptr ? ldb_compress_entry(entry, zptr) : 0);
+
+            if (compressed_len > 0) {
+                data = zptr;
+                data_len = compressed_len;
+                zptr += compressed_len;
+            }
+
+            size_t padding = (data_len ? ldb_padding_dat(obj->format, data_len) : 0);
+            size_t header_len = 0;
+
+            records_dat[n] = (ldb_record_dat_t) {
+                .seqnum = entry->seqnum,
+                .timestamp = entry->timestamp,
+                .data_len = (compressed_len > 0 ? (uint32_t) compressed_len | LDB_DATA_COMPRESSED : entry->data_len),
+                .checksum = 0
+            };
+
+            // checksum covers the stored content (batch checksum computed below)
+            if (obj->format == LDB_FILE_FORMAT_BATCH)
+                records_dat[n].checksum = 0;
+            else if (compressed_len > 0)
+                records_dat[n].checksum = ldb_crc32(data, data_len, ldb_checksum_record(&records_dat[n]));
+            else
+                records_dat[n].checksum = ldb_checksum_entry(entry);
+
+            records_idx[n] = (ldb_record_idx_t) {
+                .seqnum = entry->seqnum,
+                .timestamp = entry->timestamp,
+                .pos = dat_end
+            };
+
+            // dense header relative to the previous record
+            ldb_record_dat_t prev = { .seqnum = state_new.seqnum2, .timestamp = state_new.timestamp2 };
+            header_len = ldb_encode_record_dat(obj->format, &records_dat[n], &prev, dat_end - obj->dat_end, headers[n]);
+
+            iov_dat[iovcnt++] = (struct iovec) { headers[n], header_len };
+
+            if (data_len)
+                iov_dat[iovcnt++] = (struct iovec) { data, data_len };
+
+            if (padding)
+                iov_dat[iovcnt++] = (struct iovec) { (void *) zeros, padding };
+
+            dat_end += header_len + data_len + padding;
+
+            if (state_new.seqnum1 == 0) {
+                state_new.seqnum1 = entry->seqnum;
+                state_new.timestamp1 = entry->timestamp;
+            }
+
+            state_new.seqnum2 = entry->seqnum;
+            state_new.timestamp2 = entry->timestamp;
+        }
+
+        if (n == 0)
+            break;
+
+        // entries of the chunk are framed as a batch (checksum field excluded)
+        if (obj->format == LDB_FILE_FORMAT_BATCH)
+        {
+            uint32_t batch_len = (uint32_t) (dat_end - obj->dat_end);
+            uint32_t checksum = 0;
+
+            ldb_set_batch_dat(headers[0], iov_dat[0].iov_len, (uint32_t) n, batch_len, 0);
+            checksum = ldb_crc32(headers[0], iov_dat[0].iov_len - sizeof(uint32_t), checksum);
+
+            for (int i = 1; i < iovcnt; i++)
+                checksum = ldb_crc32((const char *) iov_dat[i].iov_base, iov_dat[i].iov_len, checksum);
+
+            ldb_set_batch_dat(headers[0], iov_dat[0].iov_len, (uint32_t) n, batch_len, checksum);
+        }
+
+        ldb_prealloc(dat_fd, &obj->dat_alloc, dat_end, obj->prealloc);
+
+        if (!ldb_writev(dat_fd, iov_dat, iovcnt, obj->dat_end)) {
+            ret = LDB_ERR_WRITE_DAT;
+            break;
+        }
+
+        if ((ret = ldb_load_block_idx(obj, &state_new, records_idx[0].seqnum)) != LDB_OK)
+            break;
+
+        idx_pos = ldb_get_pos_idx(obj->idx_format, &state_new, records_idx[0].seqnum);
+        idx_len = ldb_encode_idx(obj->idx_format, &state_new, records_idx, n, &obj->idx_block, idx_buf);
+
+        if ((ret = ldb_write_idx(obj, idx_buf, idx_len, idx_pos, n)) != LDB_OK)
+            break;
+
+        ldb_metrics_add(obj, &obj->metrics.bytes_written, (dat_end - obj->dat_end) + idx_len);
+        ldb_metrics_add(obj, &obj->metrics.entries_written, n);
+
+        *state = state_new;
+        obj->dat_end = dat_end;
+        *num += n;
+
+        // samples are not visible until state is published
+        if (obj->sparse.max_len > 0)
+        {
+            ldb_lock_state(obj);
+            for (size_t i = 0; i < n; i++)
+                ldb_sparse_push(&obj->sparse, records_idx[i].seqnum, records_idx[i].timestamp);
+            pthread_mutex_unlock(&obj->mutex_state);
+        }
+    }
+
+    ldb_metrics_time(obj, &obj->metrics.append_write, t0);
+
+    return ret;
+}
+
+// Writes entries whose data is contiguous in buf (see ldb_append_buf()).
+// Entries are framed in chunks on the stack (one ldb_write_entries() call per chunk).
+static int ldb_write_buf(ldb_impl_t *obj, ldb_state_t *state, uint64_t seqnum, const uint64_t *timestamps, 
+                         const uint32_t *lengths, size_t len, const char *buf, size_t *num)
+{
+    assert(lengths);
+    assert(num);
+
+    ldb_entry_t entries[LDB_IOV_ENTRIES];
+    size_t off = 0;
+    int ret = LDB_OK;
+
+    *num = 0;
+
+    while (*num < len && ret == LDB_OK)
+    {
+        size_t n = ldb_min(len - *num, LDB_IOV_ENTRIES);
+        size_t count = 0;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            entries[i].seqnum = (seqnum == 0 ? 0 : seqnum + *num + i);
+            entries[i].timestamp = (timestamps == NULL ? 0 : timestamps[*num + i]);
+            entries[i].data_len = lengths[*num + i];
+            entries[i].data = (buf == NULL ? NULL : (void *) (buf + off));
+            off += lengths[*num + i];
+        }
+
+        ret = ldb_write_entries(obj, state, entries, n, &count);
+        *num += count;
+    }
+
+    return ret;
+}
+
+static int ldb_write_request(ldb_impl_t *obj, ldb_state_t *state, ldb_request_t *request)
+{
+    if (request->lengths != NULL)
+        return ldb_write_buf(obj, state, request->seqnum, request->timestamps, request->lengths, request->len, request->buf, &request->num);
+
+    return ldb_write_entries(obj, state, request->entries, request->len, &request->num);
+}
+
+// Flushes the written entries to the files (no fsync).
+static int ldb_flush_files(ldb_impl_t *obj)
+{
+    assert(obj);
+
+    int ret = LDB_OK;
+    uint64_t t0 = ldb_metrics_now(obj);
+
+    if (fflush(obj->dat_fp) != 0)
+        ret = LDB_ERR_WRITE_DAT;
+
+    if (fflush(obj->idx_fp) != 0)
+        ret = (ret == LDB_OK ? LDB_ERR_WRITE_IDX : ret);
+
+    ldb_metrics_time(obj, &obj->metrics.append_flush, t0);
+
+    return ret;
+}
+
+// Syncs the data file (idx file is rebuilt from it if needed).
+static int ldb_sync_files(ldb_impl_t *obj)
+{
+    assert(obj);
+
+    int ret = LDB_OK;
+    uint64_t t0 = ldb_metrics_now(obj);
+
+    if (fdatasync(fileno(obj->dat_fp)) == -1)
+        ret = LDB_ERR_WRITE_DAT;
+
+    ldb_metrics_time(obj, &obj->metrics.append_fsync, t0);
+
+    return ret;
+}
+
+// Makes the flushed entries visible to readers.
+static void ldb_publish_state(ldb_impl_t *obj, ldb_state_t *state)
+{
+    assert(obj);
+    assert(state);
+
+    int notify_fd = -1;
+
+    // mapping covers the new entries before they are visible
+    ldb_grow_maps(obj, state);
+
+    ldb_lock_state(obj);
+    ldb_set_state(obj, state);
+    notify_fd = obj->notify_fd[1];
+    pthread_cond_broadcast(&obj->cond_append);
+    pthread_mutex_unlock(&obj->mutex_state);
+
+    // a full pipe already has pending notifications
+    if (notify_fd != -1)
+        (void) !write(notify_fd, "", 1);
+}
+
+// Flushes written entries and publishes the new state.
+static int ldb_flush_entries(ldb_impl_t *obj, ldb_state_t *state)
+{
+    assert(obj);
+    assert(state);
+
+    int ret = ldb_flush_files(obj);
+
+    if (obj->force_fsync) {
+        int rc = ldb_sync_files(obj);
+        ret = (ret == LDB_OK ? rc : ret);
+    }
+
+    ldb_publish_state(obj, state);
+
+    return ret;
+}
+
+// Queues the request and waits until the writer thread commits it.
+static int ldb_group_submit(ldb_group_t *group, ldb_request_t *request, size_t *num)
+{
+    assert(group);
+    assert(request);
+
+    size_t len = request->len;
+
+    request->num = 0;
+    request->ret = LDB_OK;
+    request->done = false;
+    request->next = NULL;
+
+    pthread_mutex_lock(&group->mutex_queue);
+
+    // bounded queue (oversized requests are accepted when queue is empty)
+    while (group->queue_len > 0 && group->queue_len + len > group->queue_max)
+        pthread_cond_wait(&group->cond_commit, &group->mutex_queue);
+
+    if (group->tail == NULL)
+        group->head = request;
+    else
+        group->tail->next = request;
+
+    group->tail = request;
+    group->queue_len += len;
+
+    pthread_cond_signal(&group->cond_submit);
+
+    while (!request->done)
+        pthread_cond_wait(&group->cond_commit, &group->mutex_queue);
+
+    pthread_mutex_unlock(&group->mutex_queue);
+
+    if (num != NULL)
+        *num = request->num;
+
+    return request->ret;
+}
+
+// Writes all requests of the batch and commits them with a single flush (and fdatasync).
+static void ldb_group_commit(void *arg, ldb_request_t *batch)
+{
+    ldb_impl_t *obj = (ldb_impl_t *) arg;
+
+    assert(obj);
+    assert(obj->group);
+
+    ldb_state_t state;
+    bool written = false;
+    int ret = LDB_OK;
+
+    pthread_mutex_lock(&obj->group->mutex_write);
+
+    // files closed by a failed purge
+    if (!ldb_is_valid_obj(obj)) {
+        for (ldb_request_t *request = batch; request != NULL; request = request->next)
+            request->ret = LDB_ERR;
+        pthread_mutex_unlock(&obj->group->mutex_write);
+        return;
+    }
+
+    ldb_get_state(obj, &state);
+
+    // requests are independent (a failed request doesn't abort the batch)
+    for (ldb_request_t *request = batch; request != NULL; request = request->next) {
+        request->ret = ldb_write_request(obj, &state, request);
+        written |= (request->num > 0);
+    }
+
+    if (written)
+        ret = ldb_flush_entries(obj, &state);
+
+    pthread_mutex_unlock(&obj->group->mutex_write);
+
+    for (ldb_request_t *request = batch; request != NULL; request = request->next) {
+        if (request->num > 0 && request->ret == LDB_OK)
+            request->ret = ret;
+    }
+}
+
+static void * ldb_group_run(void *args)
+{
+    ldb_group_t *group = (ldb_group_t *) args;
+    ldb_request_t *batch = NULL;
+
+    pthread_mutex_lock(&group->mutex_queue);
+
+    while (true)
+    {
+        while (group->head == NULL && !group->stop)
+            pthread_cond_wait(&group->cond_submit, &group->mutex_queue);
+
+        if (group->head == NULL)
+            break;
+
+        batch = group->head;
+        group->head = NULL;
+        group->tail = NULL;
+        group->queue_len = 0;
+
+        // room for new requests while the batch is written
+        pthread_cond_broadcast(&group->cond_commit);
+        pthread_mutex_unlock(&group->mutex_queue);
+
+        group->commit(group->arg, batch);
+
+        pthread_mutex_lock(&group->mutex_queue);
+
+        // requests live in the submitters stack, don't access them once done
+        while (batch != NULL) {
+            ldb_request_t *next = batch->next;
+            batch->done = true;
+            batch = next;
+        }
+
+        pthread_cond_broadcast(&group->cond_commit);
+    }
+
+    pthread_mutex_unlock(&group->mutex_queue);
+
+    return NULL;
+}
+
+// Starts a writer thread committing batches with the given function. Returns NULL on error.
+static ldb_group_t * ldb_group_create(size_t queue_max, void (*commit)(void *, ldb_request_t *), void *arg)
+{
+    ldb_group_t *group = (ldb_group_t *) calloc(1, sizeof(ldb_group_t));
+
+    if (group == NULL)
+        return NULL;
+
+    group->queue_max = queue_max;
+    group->commit = commit;
+    group->arg = arg;
+    pthread_mutex_init(&group->mutex_write, NULL);
+    pthread_mutex_init(&group->mutex_queue, NULL);
+    pthread_cond_init(&group->cond_submit, NULL);
+    pthread_cond_init(&group->cond_commit, NULL);
+
+    if (pthread_create(&group->thread, NULL, ldb_group_run, group) != 0) {
+        pthread_mutex_destroy(&group->mutex_write);
+        pthread_mutex_destroy(&group->mutex_queue);
+        pthread_cond_destroy(&group->cond_submit);
+        pthread_cond_destroy(&group->cond_commit);
+        free(group);
+        return NULL;
+    }
+
+    return group;
+}
+
+// Serializes destructive writes (rollback, purge) with the writer thread.
+static void ldb_lock_writer(ldb_impl_t *obj) {
+    if (obj->group != NULL)
+        pthread_mutex_lock(&obj->group->mutex_write);
+}
+
+static void ldb_unlock_writer(ldb_impl_t *obj) {
+    if (obj->group != NULL)
+        pthread_mutex_unlock(&obj->group->mutex_write);
+}
+
+int ldb_append(ldb_impl_t *obj, ldb_entry_t *entries, size_t len, size_t *num)
+{
+    if (num != NULL)
+        *num = 0;
+
+    if (!obj || !entries)
+        return LDB_ERR_ARG;
+
+    if (!ldb_is_valid_obj(obj))
+        return LDB_ERR;
+
+    if (len == 0)
+        return LDB_OK;
+
+    if (obj->group != NULL) {
+        ldb_request_t request = { .entries = entries, .len = len };
+        return ldb_group_submit(obj->group, &request, num);
+    }
+
+    size_t count = 0;
+    int ret = LDB_OK;
+    int rc = LDB_OK;
+    ldb_state_t state;
+
+    ldb_get_state(obj, &state);
+
+    ret = ldb_write_entries(obj, &state, entries, len, &count);
+
+    if (num != NULL)
+        *num = count;
+
+    if (count == 0)
+        return ret;
+
+    rc = ldb_flush_entries(obj, &state);
+
+    return (ret == LDB_OK ? rc : ret);
+}
+
+int ldb_append_buf(ldb_impl_t *obj, uint64_t seqnum, const uint64_t *timestamps, const uint32_t *lengths, size_t len, const char *buf, size_t *num)
+{
+    if (num != NULL)
+        *num = 0;
+
+    if (!obj || !lengths)
+        return LDB_ERR_ARG;
+
+    if (!ldb_is_valid_obj(obj))
+        return LDB_ERR;
+
+    if (len == 0)
+        return LDB_OK;
+
+    if (obj->group != NULL) {
+        ldb_request_t request = { .lengths = lengths, .timestamps = timestamps, .buf = buf, .seqnum = seqnum, .len = len };
+        return ldb_group_submit(obj->group, &request, num);
+    }
+
+    size_t count = 0;
+    int ret = LDB_OK;
+    int rc = LDB_OK;
+    ldb_state_t state;
+
+    ldb_get_state(obj, &state);
+
+    ret = ldb_write_buf(obj, &state, seqnum, timestamps, lengths, len, buf, &count);
+
+    if (num != NULL)
+        *num = count;
+
+    if (count == 0)
+        return ret;
+
+    rc = ldb_flush_entries(obj, &state);
+
+    return (ret == LDB_OK ? rc : ret);
+}
+
+/**
+ * Expands the compressed entries read by ldb_read().
+ * 
+ * The read content (used bytes) is moved to the end of the buffer and 
+ * entries are written from the beginning (aligned). ldb_read() only keeps
+ * the entries that, once expanded, end before their source content. 
+ * Remaining entries are discarded on decompression error.
+ * 
+ * @param[in,out] num Number of read entries (entries[num] can be the 
+ *                truncated or corrupted entry).
+ * @param[in] ret Read result (LDB_OK or LDB_ERR_CHECKSUM).
+ * 
+ * @return LDB_ERR_CHECKSUM if a read entry can not be decompressed or is 
+ *         the corrupted one, LDB_OK otherwise.
+ */
+static int ldb_expand_entries(uint32_t format, char *buf, size_t buf_len, size_t used, ldb_entry_t *entries, size_t len, size_t *num, int ret)
+{
+    size_t delta = buf_len - used;
+    size_t off = delta;
+    size_t pos = 0;
+    size_t i = 0;
+
+    memmove(buf + delta, buf, used);
+
+    // records are consecutive from the beginning of the read content
+    for (i = 0; i < *num; i++)
+    {
+        char *src = (char *) entries[i].data + delta;
+        size_t data_len = entries[i].data_len;
+        ldb_record_idx_t hint = { .seqnum = entries[i].seqnum, .timestamp = entries[i].timestamp };
+        ldb_record_dat_t record = {0};
+        size_t header_len = ldb_decode_record_dat(format, buf + off, buf_len - off, NULL, &hint, &record);
+
+        assert(header_len > 0 && buf + off + header_len == src);
+
+        off += ldb_record_len(format, header_len, record.data_len);
+
+        if (record.data_len & LDB_DATA_COMPRESSED)
+        {
+            size_t stored_len = ldb_stored_len(record.data_len);
+
+            if (stored_len < sizeof(uint32_t)) {
+                ret = LDB_ERR_CHECKSUM;
+                break;
+            }
+
+            src += sizeof(uint32_t);
+
+            assert(pos + data_len + ldb_padding(data_len) <= (size_t) (src - buf));
+
+            if (!ldb_lz_decompress(src, stored_len - sizeof(uint32_t), buf + pos, data_len)) {
+                ret = LDB_ERR_CHECKSUM;
+                break;
+            }
+        }
+        else {
+            memmove(buf + pos, src, data_len);
+        }
+
+        entries[i].data = buf + pos;
+        pos += data_len + ldb_padding(data_len);
+    }
+
+    // corrupted or truncated entry
+    if (i < len)
+        entries[i].data = NULL;
+
+    for (size_t j = i + 1; j <= *num && j < len; j++)
+        memset(&entries[j], 0x00, sizeof(ldb_entry_t));
+
+    *num = i;
+
+    return ret;
+}
+
+#define exit_function(errnum) do { ret = errnum; goto LDB_READ_ENTRIES_END; } while(0)
+
+// Reads entries from seqnum (see ldb_read()). Called with rwlock_files held (R mode).
+static int ldb_read_entries(ldb_impl_t *obj, const ldb_state_t *state, uint64_t seqnum, ldb_entry_t *entries, size_t len, char *buf, size_t buf_len, size_t *num)
+{
+    int ret = LDB_ERR;
+    int dat_fd = fileno(obj->dat_fp);
+    uint64_t read_pos = 0;
+    uint64_t read_bytes = 0;
+    ldb_record_idx_t record_idx = {0};
+    ldb_record_idx_t record_aux = {0};
+    ldb_record_dat_t record_dat = {0};
+    ldb_record_dat_t prev = {0};
+    ldb_batch_t batch = {0};
+    size_t batch_pos = 0;
+    size_t header_len = 0;
+    size_t rec_len = 0;
+    size_t padding = 0;
+    size_t data_len = 0;
+    ssize_t bytes = 0;
+    ssize_t read_len = 0;
+    uint64_t seq = 0;
+    size_t idx = 0;
+    char *base = buf;
+    bool compressed = false;
+    size_t used = 0;
+    size_t expand_pos = 0;
+    size_t expand_gap = 0;
+    uint64_t t0 = 0;
+
+    if (seqnum == 0 || seqnum < state->seqnum1 || seqnum > state->seqnum2)
+        exit_function(LDB_ERR_NOT_FOUND);
+
+    t0 = ldb_metrics_now(obj);
+
+    if ((ret = ldb_read_record_idx(obj, state, seqnum, &record_idx)) != LDB_OK)
+        exit_function(ret);
+
+    read_pos = record_idx.pos;
+
+    if (seqnum + len <= state->seqnum2)
+    {
+        if ((ret = ldb_read_record_idx(obj, state, seqnum + len, &record_aux)) != LDB_OK)
+            exit_function(ret);
+
+        assert(record_aux.pos > read_pos);
+        read_bytes = ldb_min(record_aux.pos - read_pos, buf_len);
+    }
+    else if (obj->dat_map.addr != NULL)
+    {
+        // mapped content can not be read beyond the last record
+        if ((ret = ldb_read_record_idx(obj, state, state->seqnum2, &record_aux)) != LDB_OK)
+            exit_function(ret);
+
+        if ((ret = ldb_read_record_dat(dat_fd, &obj->dat_map, obj->format, record_aux.pos, &record_aux, &record_dat, &rec_len, false)) != LDB_OK)
+            exit_function(ret);
+
+        read_bytes = record_aux.pos + rec_len;
+        read_bytes = ldb_min(read_bytes - read_pos, buf_len);
+    }
+    else
+    {
+        read_bytes = buf_len;
+    }
+
+    ldb_metrics_time(obj, &obj->metrics.read_idx, t0);
+
+    t0 = ldb_metrics_now(obj);
+    bytes = ldb_pread(dat_fd, &obj->dat_map, buf, read_bytes, read_pos);
+    read_len = bytes;
+    ldb_metrics_time(obj, &obj->metrics.read_dat, t0);
+    ldb_metrics_add(obj, &obj->metrics.bytes_read, (bytes > 0 ? (uint64_t) bytes : 0));
+
+    if (bytes < (ssize_t) ldb_min_record_len(obj->format))
+        exit_function(LDB_ERR_READ_DAT);
+
+    seq = seqnum - 1;
+
+    while (idx < len && seq < state->seqnum2)
+    {
+        size_t pos = read_pos + (size_t) (buf - base);
+
+        // first record values are taken from the idx (dense records are relative)
+        header_len = ldb_decode_header_dat(obj->format, buf, (size_t) bytes, &prev, (idx == 0 ? &record_idx : NULL), &record_dat, &batch);
+
+        if (header_len == 0 && (size_t) bytes >= LDB_HEADER_MAX) {
+            ret = LDB_ERR_CHECKSUM;
+            break;
+        }
+
+        if (header_len == 0)
+        {
+            // In this skewed case (buffer overflow and read() ending in the 
+            // middle of a record), we invalidate the previous entry (that 
+            // was succesfully read). This avoid us from doing an additional
+            // reading and allows us to notify the caller that the buffer
+            // is too small.
+
+            if (idx > 0) {
+                entries[idx - 1].data = NULL;
+                idx--;
+            }
+            break;
+        }
+
+        if (record_dat.seqnum != seq + 1) {
+            ret = LDB_ERR_CHECKSUM;
+            break;
+        }
+
+        data_len = ldb_stored_len(record_dat.data_len);
+
+        entries[idx].seqnum = record_dat.seqnum;
+        entries[idx].timestamp = record_dat.timestamp;
+        entries[idx].data_len = (uint32_t) data_len;
+        entries[idx].data = buf + header_len;
+
+        assert(ldb_is_dense(obj->format) || ((uintptr_t) entries[idx].data) % sizeof(uintptr_t) == 0);
+
+        buf += header_len;
+        bytes -= (ssize_t) header_len;
+
+        // compressed data starts with the uncompressed length
+        if (record_dat.data_len & LDB_DATA_COMPRESSED) {
+            compressed = true;
+            if (bytes >= (ssize_t) sizeof(uint32_t))
+                memcpy(&entries[idx].data_len, buf, sizeof(uint32_t));
+        }
+
+        if (bytes < (ssize_t) data_len) {
+            entries[idx].data = NULL;
+            break;
+        }
+
+        // batches are verified once (content not in buf is read from file)
+        if (obj->verify_checksum && obj->format == LDB_FILE_FORMAT_BATCH) {
+            if ((ret = ldb_check_batch_record(dat_fd, &obj->dat_map, pos, batch.back, &batch_pos, base, read_pos, (size_t) read_len)) != LDB_OK)
+                break;
+        }
+        else if (obj->verify_checksum && !ldb_is_valid_checksum(&record_dat, entries[idx].data)) {
+            ret = LDB_ERR_CHECKSUM;
+            break;
+        }
+
+        buf += data_len;
+        bytes -= (ssize_t) data_len;
+
+        padding = ldb_min(ldb_padding_dat(obj->format, data_len), (size_t) bytes);
+
+        buf += padding;
+        bytes -= (ssize_t) padding;
+
+        // expanded entries are written before their source content (see ldb_expand_entries)
+        data_len = entries[idx].data_len;
+        data_len += ldb_padding(data_len);
+
+        if (record_dat.data_len & LDB_DATA_COMPRESSED) {
+            size_t src = (size_t) ((char *) entries[idx].data - base) + sizeof(uint32_t);
+            if (expand_pos + data_len > src)
+                expand_gap = ldb_max(expand_gap, expand_pos + data_len - src);
+        }
+
+        if (expand_gap > buf_len - (size_t) (buf - base)) {
+            entries[idx].data = NULL;
+            break;
+        }
+
+        expand_pos += data_len;
+        used = (size_t) (buf - base);
+        seq = record_dat.seqnum;
+        prev = record_dat;
+        idx++;
+    }
+
+    if (compressed)
+        ret = ldb_expand_entries(obj->format, base, buf_len, used, entries, len, &idx, ret);
+
+    if (num != NULL)
+        *num = idx;
+
+    ldb_metrics_add(obj, &obj->metrics.entries_read, idx);
+
+    ret = (ret == LDB_ERR_CHECKSUM ? ret : LDB_OK);
+
+LDB_READ_ENTRIES_END:
+    return ret;
+}
+
+#undef exit_function
+
+int ldb_read(ldb_journal_t *obj, uint64_t seqnum, ldb_entry_t *entries, size_t len, char *buf, size_t buf_len, size_t *num)
+{
+    if (num != NULL)
+        *num = 0;
+
+    if (!obj || !entries || len == 0 || !buf || buf_len < sizeof(ldb_record_dat_t))
+        return LDB_ERR_ARG;
+
+    for (size_t i = 0; i < len; i++) {
+        entries[i].seqnum = 0;
+        entries[i].timestamp = 0;
+        entries[i].data_len = 0;
+        entries[i].data = NULL;
+    }
+
+    ldb_lock_files(obj, false);
+
+    int ret = LDB_ERR;
+    ldb_state_t state = {0};
+
+    if (ldb_is_valid_obj(obj)) {
+        ldb_get_state(obj, &state);
+        ret = ldb_read_entries(obj, &state, seqnum, entries, len, buf, buf_len, num);
+    }
+
+    pthread_rwlock_unlock(&obj->rwlock_files);
+    return ret;
+}
+
+static int ldb_cmp_range(const void *a, const void *b)
+{
+    uint64_t seqnum1 = ((const ldb_range_t *) a)->seqnum;
+    uint64_t seqnum2 = ((const ldb_range_t *) b)->seqnum;
+    return (seqnum1 > seqnum2) - (seqnum1 < seqnum2);
+}
+
+// Sorts the ranges, clips them to the journal content and merges the overlapping or adjacent ones.
+// Returns the number of resulting ranges.
+static size_t ldb_merge_ranges(ldb_range_t *ranges, size_t n, const ldb_state_t *state)
+{
+    size_t count = 0;
+
+    qsort(ranges, n, sizeof(ldb_range_t), ldb_cmp_range);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        uint64_t seqnum1 = ldb_max(ranges[i].seqnum, state->seqnum1);
+        uint64_t seqnum2 = ranges[i].seqnum + ldb_min(ranges[i].len, UINT64_MAX - ranges[i].seqnum) - 1;
+
+        seqnum2 = ldb_min(seqnum2, state->seqnum2);
+
+        if (ranges[i].len == 0 || state->seqnum1 == 0 || seqnum1 > seqnum2)
+            continue;
+
+        if (count > 0 && seqnum1 <= ranges[count - 1].seqnum + ranges[count - 1].len) {
+            uint64_t last = ranges[count - 1].seqnum + ranges[count - 1].len - 1;
+            ranges[count - 1].len += (size_t) (seqnum2 > last ? seqnum2 - last : 0);
+            continue;
+        }
+
+        ranges[count].seqnum = seqnum1;
+        ranges[count].len = (size_t) (seqnum2 - seqnum1 + 1);
+        count++;
+    }
+
+    return count;
+}
+
+int ldb_read_multi(ldb_journal_t *obj, const ldb_range_t *ranges, size_t n, ldb_entry_t *entries, size_t len, char *buf, size_t buf_len, size_t *num)
+{
+    if (num != NULL)
+        *num = 0;
+
+    if (!obj || (!ranges && n > 0) || !entries || len == 0 || !buf || buf_len < sizeof(ldb_record_dat_t))
+        return LDB_ERR_ARG;
+
+    for (size_t i = 0; i < len; i++)
+        entries[i] = (ldb_entry_t){0};
+
+    if (n == 0)
+        return LDB_OK;
+
+    ldb_range_t *merged = (ldb_range_t *) malloc(n * sizeof(ldb_range_t));
+
+    if (merged == NULL)
+        return LDB_ERR_MEM;
+
+    memcpy(merged, ranges, n * sizeof(ldb_range_t));
+
+    ldb_lock_files(obj, false);
+
+    int ret = LDB_ERR;
+    ldb_state_t state = {0};
+    size_t count = 0;
+    size_t off = 0;
+
+    if (!ldb_is_valid_obj(obj))
+        goto LDB_READ_MULTI_END;
+
+    // one state for all ranges (ranges are read in file order)
+    ldb_get_state(obj, &state);
+    n = ldb_merge_ranges(merged, n, &state);
+    ret = LDB_OK;
+
+    for (size_t i = 0; i < n && count < len && ret == LDB_OK; i++)
+    {
+        size_t k = 0;
+        size_t m = ldb_min(merged[i].len, len - count);
+
+        if (buf_len - off < sizeof(ldb_record_dat_t)) {
+            entries[count].seqnum = merged[i].seqnum;
+            break;
+        }
+
+        ret = ldb_read_entries(obj, &state, merged[i].seqnum, entries + count, m, buf + off, buf_len - off, &k);
+
+        if (k > 0) {
+            const ldb_entry_t *last = &entries[count + k - 1];
+            off = (size_t) ((const char *) last->data - buf) + last->data_len;
+            off += ldb_padding(off);
+            off = ldb_min(off, buf_len);
+        }
+
+        count += k;
+
+        // buffer exhausted (entries[count] filled by ldb_read_entries)
+        if (k < m)
+            break;
+    }
+
+LDB_READ_MULTI_END:
+    pthread_rwlock_unlock(&obj->rwlock_files);
+    free(merged);
+
+    if (num != NULL)
+        *num = count;
+
+    return ret;
+}
+
+#undef exit_function
+#define exit_function(errnum) do { ret = errnum; goto LDB_READ_VIEW_END; } while(0)
+
+int ldb_read_view(ldb_journal_t *obj, uint64_t seqnum, ldb_entry_t *entries, size_t len, size_t *num)
+{
+    if (num != NULL)
+        *num = 0;
+
+    if (!obj || !entries || len == 0)
+        return LDB_ERR_ARG;
+
+    for (size_t i = 0; i < len; i++) {
+        entries[i].seqnum = 0;
+        entries[i].timestamp = 0;
+        entries[i].data_len = 0;
+        entries[i].data = NULL;
+    }
+
+    ldb_lock_files(obj, false);
+
+    int ret = LDB_ERR;
+    ldb_state_t state = {0};
+    ldb_record_idx_t record_idx = {0};
+    ldb_record_dat_t record_dat = {0};
+    ldb_batch_t batch = {0};
+    size_t batch_pos = 0;
+    size_t pos = 0;
+    size_t idx = 0;
+
+    if (!ldb_is_valid_obj(obj) || obj->dat_map.addr == NULL)
+        exit_function(LDB_ERR);
+
+
+    ldb_get_state(obj, &state);
+
+    if (seqnum == 0 || seqnum < state.seqnum1 || seqnum > state.seqnum2)
+        exit_function(LDB_ERR_NOT_FOUND);
+
+    if ((ret = ldb_read_record_idx(obj, &state, seqnum, &record_idx)) != LDB_OK)
+        exit_function(ret);
+
+    pos = record_idx.pos;
+
+    while (idx < len && seqnum + idx <= state.seqnum2)
+    {
+        if (pos >= obj->dat_map.len)
+            break;
+
+        // first record values are taken from the idx (dense records are relative)
+        size_t header_len = ldb_decode_header_dat(obj->format, obj->dat_map.addr + pos, obj->dat_map.len - pos, &record_dat, (idx == 0 ? &record_idx : NULL), &record_dat, &batch);
+
+        if (header_len == 0 || pos + header_len + ldb_stored_len(record_dat.data_len) > obj->dat_map.len)
+            break;
+
+        // compressed content can not be viewed (use ldb_read)
+        if (record_dat.data_len & LDB_DATA_COMPRESSED) {
+            ret = (idx == 0 ? LDB_ERR_ENTRY_DATA : LDB_OK);
+            break;
+        }
+
+        assert(record_dat.seqnum == seqnum + idx);
+
+        entries[idx].seqnum = record_dat.seqnum;
+        entries[idx].timestamp = record_dat.timestamp;
+        entries[idx].data_len = record_dat.data_len;
+        entries[idx].data = obj->dat_map.addr + pos + header_len;
+
+        if (obj->verify_checksum && obj->format == LDB_FILE_FORMAT_BATCH) {
+            if ((ret = ldb_check_batch_record(fileno(obj->dat_fp), &obj->dat_map, pos, batch.back, &batch_pos, obj->dat_map.addr, 0, obj->dat_map.len)) != LDB_OK)
+                break;
+        }
+        else if (obj->verify_checksum && !ldb_is_valid_checksum(&record_dat, entries[idx].data)) {
+            ret = LDB_ERR_CHECKSUM;
+            break;
+        }
+
+        pos += ldb_record_len(obj->format, header_len, record_dat.data_len);
+        idx++;
+    }
+
+    // pinned before releasing the file lock
+    if (idx > 0) {
+        ldb_lock_state(obj);
+        obj->num_views++;
+        pthread_mutex_unlock(&obj->mutex_state);
+    }
+
+    if (num != NULL)
+        *num = idx;
+
+    ldb_metrics_add(obj, &obj->metrics.entries_read, idx);
+
+    if (ret == LDB_ERR_ENTRY_DATA)
+        exit_function(ret);
+
+    ret = (ret == LDB_ERR_CHECKSUM ? ret : LDB_OK);
+
+LDB_READ_VIEW_END:
+    pthread_rwlock_unlock(&obj->rwlock_files);
+    return ret;
+}
+
+int ldb_release_view(ldb_journal_t *obj)
+{
+    if (!obj)
+        return LDB_ERR_ARG;
+
+    int ret = LDB_OK;
+
+    ldb_lock_state(obj);
+
+    if (obj->num_views == 0) {
+        ret = LDB_ERR;
+    }
+    else if (--obj->num_views == 0) {
+        ldb_unmap_retired(obj);
+        pthread_cond_broadcast(&obj->cond_views);
+    }
+
+    pthread_mutex_unlock(&obj->mutex_state);
+
+    return ret;
+}
+
+// Writes the dat content [pos, end) to fd (at its current offset).
+// Returns LDB_ERR on write error.
+static int ldb_send_dat(ldb_impl_t *obj, int fd, size_t pos, size_t end, size_t *bytes)
+{
+    int dat_fd = fileno(obj->dat_fp);
+    char buf[BUFSIZ];
+
+#ifdef LDB_SENDFILE
+    while (pos < end)
+    {
+        off_t off = (off_t) pos;
+        ssize_t rc = sendfile(fd, dat_fd, &off, end - pos);
+
+        if (rc == -1 && errno == EINTR)
+            continue;
+
+        // fd not supported (copied below)
+        if (rc == -1 && (errno == EINVAL || errno == ENOSYS))
+            break;
+
+        if (rc <= 0)
+            return (rc == 0 ? LDB_ERR_READ_DAT : LDB_ERR);
+
+        pos += (size_t) rc;
+        *bytes += (size_t) rc;
+    }
+#endif
+
+    while (pos < end)
+    {
+        ssize_t rc = ldb_pread(dat_fd, &obj->dat_map, buf, ldb_min(end - pos, sizeof(buf)), pos);
+
+        if (rc <= 0)
+            return LDB_ERR_READ_DAT;
+
+        for (ssize_t off = 0; off < rc; )
+        {
+            ssize_t wc = write(fd, buf + off, (size_t) (rc - off));
+
+            if (wc == -1 && errno == EINTR)
+                continue;
+
+            if (wc <= 0)
+                return LDB_ERR;
+
+            off += wc;
+            *bytes += (size_t) wc;
+        }
+
+        pos += (size_t) rc;
+    }
+
+    return LDB_OK;
+}
+
+// Copies len bytes from fd (at its current offset) to the dat file at pos.
+// Returns LDB_ERR on read error, LDB_ERR_FMT_DAT if fd ends before len bytes.
+static int ldb_recv_dat(ldb_impl_t *obj, int fd, size_t pos, size_t len)
+{
+    int dat_fd = fileno(obj->dat_fp);
+    size_t end = pos + len;
+    char buf[BUFSIZ];
+
+#ifdef LDB_SENDFILE
+    struct stat st;
+
+    // kernel copy requires a regular source file
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        if (lseek(dat_fd, (off_t) pos, SEEK_SET) == (off_t) -1)
+            return LDB_ERR_WRITE_DAT;
+
+        while (pos < end)
+        {
+            ssize_t rc = sendfile(dat_fd, fd, NULL, end - pos);
+
+            if (rc == -1 && errno == EINTR)
+                continue;
+
+            if (rc == -1 && (errno == EINVAL || errno == ENOSYS))
+                break;
+
+            if (rc <= 0)
+                return (rc == 0 ? LDB_ERR_FMT_DAT : LDB_ERR_WRITE_DAT);
+
+            pos += (size_t) rc;
+        }
+    }
+#endif
+
+    while (pos < end)
+    {
+        ssize_t rc = read(fd, buf, ldb_min(end - pos, sizeof(buf)));
+
+        if (rc == -1 && errno == EINTR)
+            continue;
+
+        if (rc < 0)
+            return LDB_ERR;
+
+        if (rc == 0)
+            return LDB_ERR_FMT_DAT;
+
+        struct iovec iov[1] = {{ buf, (size_t) rc }};
+
+        if (!ldb_writev(dat_fd, iov, 1, pos))
+            return LDB_ERR_WRITE_DAT;
+
+        pos += (size_t) rc;
+    }
+
+    return LDB_OK;
+}
+
+// Reads the batch header of the record idx (batch format).
+static int ldb_read_batch_record(ldb_impl_t *obj, const ldb_record_idx_t *idx, size_t *batch_pos, ldb_record_dat_t *record, ldb_batch_t *batch)
+{
+    int dat_fd = fileno(obj->dat_fp);
+    char header[LDB_HEADER_MAX];
+    size_t header_len = 0;
+    ssize_t rc = ldb_pread(dat_fd, &obj->dat_map, header, sizeof(header), idx->pos);
+
+    if (rc == -1)
+        return LDB_ERR_READ_DAT;
+
+    if (ldb_decode_header_dat(obj->format, header, (size_t) rc, NULL, idx, record, batch) == 0 || record->seqnum == 0)
+        return LDB_ERR_FMT_DAT;
+
+    if (batch->back > idx->pos - sizeof(ldb_header_dat_t))
+        return LDB_ERR_FMT_DAT;
+
+    *batch_pos = idx->pos - batch->back;
+
+    return ldb_read_batch_dat(dat_fd, &obj->dat_map, *batch_pos, NULL, 0, 0, record, batch, &header_len, false);
+}
+
+#undef exit_function
+#define exit_function(errnum) do { ret = errnum; goto LDB_SHIP_END; } while(0)
+
+int ldb_ship(ldb_journal_t *obj, uint64_t seqnum, size_t len, int fd, size_t *num, size_t *bytes)
+{
+    if (num != NULL)
+        *num = 0;
+
+    if (bytes != NULL)
+        *bytes = 0;
+
+    if (!obj || fd < 0)
+        return LDB_ERR_ARG;
+
+    ldb_lock_files(obj, false);
+
+    int ret = LDB_ERR;
+    ldb_state_t state = {0};
+    ldb_record_idx_t idx1 = {0};
+    ldb_record_idx_t idx2 = {0};
+    ldb_record_dat_t record = {0};
+    uint64_t seqnum2 = 0;
+    size_t count = 0;
+    size_t pos = 0;
+    size_t end = 0;
+
+    if (!ldb_is_valid_obj(obj))
+        exit_function(LDB_ERR);
+
+    ldb_get_state(obj, &state);
+
+    if (seqnum == 0 || seqnum < state.seqnum1 || seqnum > state.seqnum2)
+        exit_function(LDB_ERR_NOT_FOUND);
+
+    if (len == 0)
+        exit_function(LDB_OK);
+
+    seqnum2 = (len > state.seqnum2 - seqnum ? state.seqnum2 : seqnum + len - 1);
+
+    if ((ret = ldb_read_record_idx(obj, &state, seqnum, &idx1)) != LDB_OK)
+        exit_function(ret);
+
+    if ((ret = ldb_read_record_idx(obj, &state, seqnum2, &idx2)) != LDB_OK)
+        exit_function(ret);
+
+    if (obj->format == LDB_FILE_FORMAT_BATCH)
+    {
+        ldb_batch_t batch = {0};
+        size_t batch_pos = 0;
+
+        // batches can not be split (members refer to their batch header)
+        if ((ret = ldb_read_batch_record(obj, &idx1, &batch_pos, &record, &batch)) != LDB_OK)
+            exit_function(ret);
+
+        seqnum = record.seqnum;
+        pos = batch_pos;
+
+        if ((ret = ldb_read_batch_record(obj, &idx2, &batch_pos, &record, &batch)) != LDB_OK)
+            exit_function(ret);
+
+        seqnum2 = record.seqnum + batch.num - 1;
+        end = batch_pos + batch.len;
+    }
+    else
+    {
+        size_t rec_len = 0;
+
+        if ((ret = ldb_read_record_dat(fileno(obj->dat_fp), &obj->dat_map, obj->format, idx2.pos, &idx2, &record, &rec_len, false)) != LDB_OK)
+            exit_function(ret);
+
+        pos = idx1.pos;
+        end = idx2.pos + rec_len;
+    }
+
+    if (seqnum2 > state.seqnum2 || end < pos)
+        exit_function(LDB_ERR_FMT_DAT);
+
+    if ((ret = ldb_send_dat(obj, fd, pos, end, &count)) != LDB_OK)
+        exit_function(ret);
+
+    if (num != NULL)
+        *num = (size_t) (seqnum2 - seqnum + 1);
+
+    ldb_metrics_add(obj, &obj->metrics.entries_read, seqnum2 - seqnum + 1);
+    ldb_metrics_add(obj, &obj->metrics.bytes_read, count);
+
+LDB_SHIP_END:
+    if (bytes != NULL)
+        *bytes = count;
+
+    pthread_rwlock_unlock(&obj->rwlock_files);
+    return ret;
+}
+
+#undef exit_function
+#define exit_function(errnum) do { ret = errnum; goto LDB_INGEST_END; } while(0)
+
+int ldb_ingest(ldb_journal_t *obj, int fd, size_t len, size_t *num)
+{
+    if (num != NULL)
+        *num = 0;
+
+    if (!obj || fd < 0)
+        return LDB_ERR_ARG;
+
+    if (!ldb_is_valid_obj(obj))
+        return LDB_ERR;
+
+    if (len == 0)
+        return LDB_OK;
+
+    ldb_lock_writer(obj);
+
+    int ret = LDB_OK;
+    int dat_fd = fileno(obj->dat_fp);
+    int idx_fd = fileno(obj->idx_fp);
+    uint64_t t0 = ldb_metrics_now(obj);
+    ldb_record_idx_t idx_block = obj->idx_block;
+    ldb_record_dat_t prev = {0};
+    ldb_scan_t scan = {0};
+    ldb_state_t state0 = {0};
+    ldb_state_t state = {0};
+    size_t pos = obj->dat_end;
+    size_t count = 0;
+
+    ldb_get_state(obj, &state0);
+    state = state0;
+
+    // idx records are written directly (not kept in the write-behind buffer)
+    if ((ret = ldb_flush_idx(obj)) != LDB_OK)
+        exit_function(ret);
+
+    // content is not visible until indexed and published
+    ldb_prealloc(dat_fd, &obj->dat_alloc, pos + len, obj->prealloc);
+
+    if ((ret = ldb_recv_dat(obj, fd, pos, len)) != LDB_OK)
+        exit_function(ret);
+
+    // dense records are relative to the last entry of the journal
+    prev.seqnum = state.seqnum2;
+    prev.timestamp = state.timestamp2;
+
+    if ((ret = ldb_scan_init(&scan, dat_fd, obj->format, &prev, pos, pos + len, pos)) != LDB_OK)
+        exit_function(ret);
+
+    // content starts with a batch header (batch format)
+    scan.batch_end = pos;
+
+    while ((ret = ldb_scan_next(&scan)) == LDB_OK && scan.num > 0)
+    {
+        for (size_t i = 0; i < scan.num; i++)
+        {
+            const ldb_record_idx_t *record = &scan.records[i];
+
+            if (state.seqnum2 != 0 && (record->seqnum != state.seqnum2 + 1 || record->timestamp < state.timestamp2))
+                exit_function(LDB_ERR_FMT_DAT);
+
+            if (state.seqnum1 == 0) {
+                state.seqnum1 = record->seqnum;
+                state.timestamp1 = record->timestamp;
+            }
+
+            state.seqnum2 = record->seqnum;
+            state.timestamp2 = record->timestamp;
+        }
+
+        // indexed in chunks (one writev per chunk)
+        for (size_t i = 0; i < scan.num; i += LDB_IOV_ENTRIES)
+        {
+            char idx_buf[LDB_IOV_ENTRIES * sizeof(ldb_record_idx_t)];
+            struct iovec iov_idx[1];
+            size_t n = ldb_min(scan.num - i, LDB_IOV_ENTRIES);
+            ldb_state_t state_new = state;
+
+            state_new.seqnum2 = scan.records[i + n - 1].seqnum;
+
+            if ((ret = ldb_load_block_idx(obj, &state_new, scan.records[i].seqnum)) != LDB_OK)
+                exit_function(ret);
+
+            size_t idx_pos = ldb_get_pos_idx(obj->idx_format, &state_new, scan.records[i].seqnum);
+            iov_idx[0] = (struct iovec) { idx_buf, ldb_encode_idx(obj->idx_format, &state_new, scan.records + i, n, &obj->idx_block, idx_buf) };
+
+            ldb_prealloc(idx_fd, &obj->idx_alloc, idx_pos + iov_idx[0].iov_len, obj->prealloc);
+
+            if (!ldb_writev(idx_fd, iov_idx, 1, idx_pos))
+                exit_function(LDB_ERR_WRITE_IDX);
+
+            ldb_metrics_add(obj, &obj->metrics.bytes_written, iov_idx[0].iov_len);
+        }
+
+        if (obj->sparse.max_len > 0)
+        {
+            ldb_lock_state(obj);
+            for (size_t i = 0; i < scan.num; i++)
+                ldb_sparse_push(&obj->sparse, scan.records[i].seqnum, scan.records[i].timestamp);
+            pthread_mutex_unlock(&obj->mutex_state);
+        }
+
+        count += scan.num;
+    }
+
+    if (ret != LDB_OK)
+        exit_function(ret);
+
+    // records fill the content (no truncated or zeroed tail)
+    if (count == 0 || scan.next != pos + len)
+        exit_function(LDB_ERR_FMT_DAT);
+
+    obj->dat_end = pos + len;
+
+    ldb_metrics_add(obj, &obj->metrics.bytes_written, len);
+    ldb_metrics_add(obj, &obj->metrics.entries_written, count);
+
+    ret = ldb_flush_entries(obj, &state);
+
+    if (num != NULL)
+        *num = count;
+
+LDB_INGEST_END:
+    ldb_scan_free(&scan);
+
+    // removes the rejected content
+    if (obj->dat_end == pos)
+    {
+        if (obj->sparse.max_len > 0) {
+            ldb_lock_state(obj);
+            ldb_sparse_trim(&obj->sparse, &state0);
+            pthread_mutex_unlock(&obj->mutex_state);
+        }
+
+        obj->idx_block = idx_block;
+        ldb_punch_tail(obj->dat_fp, pos);
+        ldb_punch_tail(obj->idx_fp, ldb_get_end_idx(obj->idx_format, &state0));
+    }
+
+    ldb_metrics_time(obj, &obj->metrics.append_write, t0);
+    ldb_unlock_writer(obj);
+    return ret;
+}
+
+int ldb_wait(ldb_journal_t *obj, uint64_t seqnum, long timeout_ms)
+{
+    if (!obj)
+        return LDB_ERR_ARG;
+
+    if (!ldb_is_valid_obj(obj))
+        return LDB_ERR;
+
+    int ret = LDB_OK;
+    struct timespec deadline = {0};
+
+    if (timeout_ms > 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    ldb_lock_state(obj);
+
+    while (LDB_ATOMIC_LOAD(&obj->state.seqnum2) == 0 || LDB_ATOMIC_LOAD(&obj->state.seqnum2) < seqnum)
+    {
+        if (timeout_ms == 0) {
+            ret = LDB_ERR_NOT_FOUND;
+            break;
+        }
+
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&obj->cond_append, &obj->mutex_state);
+            continue;
+        }
+
+        if (pthread_cond_timedwait(&obj->cond_append, &obj->mutex_state, &deadline) == ETIMEDOUT) {
+            uint64_t seqnum2 = LDB_ATOMIC_LOAD(&obj->state.seqnum2);
+            ret = (seqnum2 == 0 || seqnum2 < seqnum ? LDB_ERR_NOT_FOUND : LDB_OK);
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&obj->mutex_state);
+
+    return ret;
+}
+
+int ldb_get_notify_fd(ldb_journal_t *obj)
+{
+    if (!obj)
+        return LDB_ERR_ARG;
+
+    if (!ldb_is_valid_obj(obj))
+        return LDB_ERR;
+
+    int ret = LDB_OK;
+    int fds[2] = {-1, -1};
+
+    ldb_lock_state(obj);
+
+    if (obj->notify_fd[0] != -1) {
+        ret = obj->notify_fd[0];
+        goto LDB_GET_NOTIFY_FD_END;
+    }
+
+    if (pipe(fds) != 0) {
+        ret = LDB_ERR;
+        goto LDB_GET_NOTIFY_FD_END;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        int flags = fcntl(fds[i], F_GETFL);
+
+        if (flags == -1 || fcntl(fds[i], F_SETFL, flags | O_NONBLOCK) == -1 || fcntl(fds[i], F_SETFD, FD_CLOEXEC) == -1) {
+            close(fds[0]);
+            close(fds[1]);
+            ret = LDB_ERR;
+            goto LDB_GET_NOTIFY_FD_END;
+        }
+    }
+
+    obj->notify_fd[0] = fds[0];
+    obj->notify_fd[1] = fds[1];
+    ret = fds[0];
+
+LDB_GET_NOTIFY_FD_END:
+    pthread_mutex_unlock(&obj->mutex_state);
+    return ret;
+}
+
+#undef exit_function
+#define exit_function(errnum) do { ret = errnum; goto LDB_STATS_END; } while(0)
+
+int ldb_stats(ldb_impl_t *obj, uint64_t seqnum1, uint64_t seqnum2, ldb_stats_t *stats)
+{
+    if (!obj || seqnum2 < seqnum1 || !stats)
+        return LDB_ERR_ARG;
+
+    memset(stats, 0x00, sizeof(ldb_stats_t));
+
+    ldb_lock_files(obj, false);
+
+    int ret = LDB_ERR;
+    int dat_fd = -1;
+    ldb_state_t state;
+    ldb_record_idx_t record1 = {0};
+    ldb_record_idx_t record2 = {0};
+    ldb_record_dat_t record_dat = {0};
+    size_t rec_len = 0;
+
+    if (!ldb_is_valid_obj(obj))
+        exit_function(LDB_ERR);
+
+    dat_fd = fileno(obj->dat_fp);
+
+    ldb_get_state(obj, &state);
+
+    if (state.seqnum1 == 0 || seqnum2 < state.seqnum1 || state.seqnum2 < seqnum1)
+        exit_function(LDB_OK);
+
+    seqnum1 = ldb_clamp(seqnum1, state.seqnum1, state.seqnum2);
+    seqnum2 = ldb_clamp(seqnum2, state.seqnum1, state.seqnum2);
+
+    if ((ret = ldb_read_record_idx(obj, &state, seqnum1, &record1)) != LDB_OK)
+        exit_function(ret);
+
+    if ((ret = ldb_read_record_idx(obj, &state, seqnum2, &record2)) != LDB_OK)
+        exit_function(ret);
+
+    if (record2.pos < record1.pos + (record2.seqnum - record1.seqnum) * ldb_min_record_len(obj->format))
+        exit_function(LDB_ERR);
+
+    if ((ret = ldb_read_record_dat(dat_fd, &obj->dat_map, obj->format, record2.pos, &record2, &record_dat, &rec_len, false)) != LDB_OK)
+        exit_function(ret);
+
+    if (record_dat.seqnum != seqnum2)
+        exit_function(LDB_ERR);
+
+    stats->min_seqnum = record1.seqnum;
+    stats->min_timestamp = record1.timestamp;
+    stats->max_seqnum = record2.seqnum;
+    stats->max_timestamp = record2.timestamp;
+    stats->num_entries = seqnum2 - seqnum1 + 1;
+    stats->index_size = ldb_get_pos_idx(obj->idx_format, &state, seqnum2) + ldb_get_len_idx(obj->idx_format, &state, seqnum2) - ldb_get_pos_idx(obj->idx_format, &state, seqnum1);
+    stats->data_size = record2.pos - record1.pos + rec_len;
+
+    ret = LDB_OK;
+
+LDB_STATS_END:
+    pthread_rwlock_unlock(&obj->rwlock_files);
+    return ret;
+}
+
+#undef exit_function
+#define exit_function(errnum) do { ret = errnum; goto LDB_SEARCH_END; } while(0)
+
+int ldb_search(ldb_impl_t *obj, uint64_t timestamp, ldb_search_e mode, uint64_t *seqnum)
+{
+    if (!obj || !seqnum || (mode != LDB_SEARCH_LOWER && mode != LDB_SEARCH_UPPER))
+        return LDB_ERR_ARG;
+
+    *seqnum = 0;
+
+    uint64_t t0 = ldb_metrics_now(obj);
+
+    ldb_lock_files(obj, false);
+
+    int ret = LDB_ERR;
+    ldb_state_t state;
+    ldb_record_idx_t record = {0};
+    ldb_record_idx_t block = {0};
+    uint64_t sn1 = 0;
+    uint64_t sn2 = 0;
+    uint64_t ts1 = 0;
+    uint64_t ts2 = 0;
+
+    if (!ldb_is_valid_obj(obj))
+        exit_function(LDB_ERR);
+
+    ldb_get_state(obj, &state);
+
+    if (state.seqnum1 == 0)
+        exit_function(LDB_ERR_NOT_FOUND);
+
+    if (mode == LDB_SEARCH_LOWER && state.timestamp2 < timestamp)
+        exit_function(LDB_ERR_NOT_FOUND);
+
+    if (mode == LDB_SEARCH_UPPER && state.timestamp2 <= timestamp)
+        exit_function(LDB_ERR_NOT_FOUND);
+
+    if (mode == LDB_SEARCH_LOWER && timestamp <= state.timestamp1) {
+        *seqnum = state.seqnum1;
+        exit_function(LDB_OK);
+    }
+
+    if (mode == LDB_SEARCH_UPPER && timestamp < state.timestamp1) {
+        *seqnum = state.seqnum1;
+        exit_function(LDB_OK);
+    }
+
+    sn1 = state.seqnum1;
+    sn2 = state.seqnum2;
+    ts1 = state.timestamp1;
+    ts2 = state.timestamp2;
+
+    assert(ts1 <= timestamp && timestamp <= ts2);
+
+    // narrows the range in memory before touching the idx file
+    if (obj->sparse.max_len > 0) {
+        ldb_lock_state(obj);
+        ldb_sparse_narrow(&obj->sparse, timestamp, mode, &sn1, &ts1, &sn2, &ts2);
+        pthread_mutex_unlock(&obj->mutex_state);
+    }
+
+    while (sn1 + 1 < sn2 && ts1 != ts2)
+    {
+        uint64_t sn = (sn1 + sn2) / 2;
+
+        // compact format: probes block starts first (one read each)
+        if (obj->idx_format != LDB_IDX_FORMAT_WIDE)
+        {
+            uint64_t first = sn - (sn - state.seqnum1) % LDB_IDX_BLOCK_RECORDS;
+
+            if (first > sn1)
+                sn = first;
+            else if (first + LDB_IDX_BLOCK_RECORDS < sn2)
+                sn = first + LDB_IDX_BLOCK_RECORDS;
+        }
+
+        if ((ret = ldb_read_idx(obj, state.seqnum1, sn, &record, &block)) != LDB_OK)
+            exit_function(ret);
+
+        ldb_metrics_add(obj, &obj->metrics.search_probes, 1);
+
+        uint64_t ts = record.timestamp;
+
+        if (ts < timestamp) {
+            sn1 = sn;
+            ts1 = ts;
+        }
+        else if (timestamp < ts || mode == LDB_SEARCH_LOWER) {
+            sn2 = sn;
+            ts2 = ts;
+        }
+        else {
+            sn1 = sn;
+            ts1 = ts;
+        }
+    }
+
+    *seqnum = sn2;
+
+    ret = LDB_OK;
+
+LDB_SEARCH_END:
+    pthread_rwlock_unlock(&obj->rwlock_files);
+    ldb_metrics_time(obj, &obj->metrics.search, t0);
+    return ret;
+}
+
+// Ends the batch containing the record at pos just before it (batch format).
+// The batch header record is rewritten in place, records beyond the new batch end are invalid.
+static int ldb_cut_batch_dat(ldb_impl_t *obj, size_t pos, const ldb_record_idx_t *idx)
+{
+    int dat_fd = fileno(obj->dat_fp);
+    char header[LDB_HEADER_MAX];
+    ldb_record_dat_t record = {0};
+    ldb_batch_t batch = {0};
+    size_t header_len = 0;
+    uint32_t checksum = 0;
+    int ret = LDB_OK;
+    ssize_t rc = ldb_pread(dat_fd, &obj->dat_map, header, sizeof(header), pos);
+
+    if (rc == -1)
+        return LDB_ERR_READ_DAT;
+
+    if (ldb_decode_header_dat(obj->format, header, (size_t) rc, NULL, idx, &record, &batch) == 0 || record.seqnum == 0)
+        return LDB_ERR_FMT_DAT;
+
+    // batch starts at pos (removed as a whole)
+    if (batch.back == 0)
+        return LDB_OK;
+
+    if (batch.back > pos - sizeof(ldb_header_dat_t))
+        return LDB_ERR_FMT_DAT;
+
+    size_t lead_pos = pos - batch.back;
+
+    if ((ret = ldb_read_batch_dat(dat_fd, &obj->dat_map, lead_pos, NULL, 0, 0, &record, &batch, &header_len, false)) != LDB_OK)
+        return ret;
+
+    if (ldb_pread(dat_fd, &obj->dat_map, header, header_len, lead_pos) != (ssize_t) header_len)
+        return LDB_ERR_READ_DAT;
+
+    uint32_t num = (uint32_t) (idx->seqnum - record.seqnum);
+    uint32_t len = (uint32_t) (pos - lead_pos);
+
+    ldb_set_batch_dat(header, header_len, num, len, 0);
+    checksum = ldb_crc32(header, header_len - sizeof(uint32_t), checksum);
+
+    if ((ret = ldb_crc32_dat(dat_fd, &obj->dat_map, lead_pos + header_len, pos, NULL, 0, 0, &checksum)) != LDB_OK)
+        return ret;
+
+    ldb_set_batch_dat(header, header_len, num, len, checksum);
+
+    char *fields = header + header_len - LDB_BATCH_FIELDS_LEN;
+
+    if (pwrite(dat_fd, fields, LDB_BATCH_FIELDS_LEN, (off_t) (lead_pos + header_len - LDB_BATCH_FIELDS_LEN)) != LDB_BATCH_FIELDS_LEN)
+        return LDB_ERR_WRITE_DAT;
+
+    return LDB_OK;
+}
+
+#undef exit_function
+#define exit_function(errnum) do { ret = errnum; goto LDB_ROLLBACK_END; } while(0)
+
+long ldb_rollback(ldb_impl_t *obj, uint64_t seqnum)
+{
+    if (!obj)
+        return LDB_ERR_ARG;
+
+    uint64_t t0 = ldb_metrics_now(obj);
+
+    ldb_lock_writer(obj);
+    ldb_lock_files(obj, true);
+    ldb_wait_views(obj);
+
+    long ret = LDB_ERR;
+    long removed_entries = 0;
+    ldb_record_idx_t record_idx = {0};
+    size_t dat_end_new = sizeof(ldb_header_dat_t);
+    uint64_t last_timestamp_new = 0;
+    ldb_state_t state = {0};
+
+    if (!ldb_is_valid_obj(obj))
+        exit_function(LDB_ERR);
+
+    // removed records can be in the write-behind buffer
+    if ((ret = ldb_flush_idx(obj)) != LDB_OK)
+        exit_function(ret);
+
+    // case nothing to rollback
+    if (obj->state.seqnum2 <= seqnum)
+        exit_function(0);
+
+    removed_entries = (long) obj->state.seqnum2 - (long) ldb_max(seqnum, obj->state.seqnum1 - 1);
+
+    if (seqnum >= obj->state.seqnum1)
+    {
+        if ((ret = ldb_read_record_idx(obj, &obj->state, seqnum, &record_idx)) != LDB_OK)
+            exit_function(ret);
+
+        last_timestamp_new = record_idx.timestamp;
+
+        if ((ret = ldb_read_record_idx(obj, &obj->state, seqnum + 1, &record_idx)) != LDB_OK)
+            exit_function(ret);
+
+        dat_end_new = record_idx.pos;
+
+        // shortened batch is rewritten before removing its tail
+        if (obj->format == LDB_FILE_FORMAT_BATCH && (ret = ldb_cut_batch_dat(obj, dat_end_new, &record_idx)) != LDB_OK)
+            exit_function(ret);
+
+        // new last record becomes the checkpoint
+        if (obj->checkpoint.seqnum > seqnum && ldb_read_record_idx(obj, &obj->state, seqnum, &obj->checkpoint) != LDB_OK)
+            memset(&obj->checkpoint, 0x00, sizeof(ldb_record_idx_t));
+    }
+    else {
+        memset(&obj->checkpoint, 0x00, sizeof(ldb_record_idx_t));
+    }
+
+    memset(&obj->idx_block, 0x00, sizeof(ldb_record_idx_t));
+
+    // remove data first (on crash the idx beyond the dat end is rebuilt)
+    if (!ldb_punch_tail(obj->dat_fp, dat_end_new))
+        exit_function(LDB_ERR_WRITE_DAT);
+
+    if (obj->force_fsync && fdatasync(fileno(obj->dat_fp)) == -1)
+        exit_function(LDB_ERR_WRITE_DAT);
+
+    // update status
+    state = obj->state;
+
+    if (seqnum < state.seqnum1) {
+        ldb_reset_state(&state);
+        obj->dat_end = sizeof(ldb_header_dat_t);
+    }
+    else {
+        state.seqnum2 = seqnum;
+        state.timestamp2 = last_timestamp_new;
+        obj->dat_end = dat_end_new;
+    }
+
+    ldb_set_state(obj, &state);
+
+    obj->epoch++;
+
+    ldb_lock_state(obj);
+    ldb_sparse_trim(&obj->sparse, &obj->state);
+    pthread_mutex_unlock(&obj->mutex_state);
+
+    // remove index entries
+    if (!ldb_punch_tail(obj->idx_fp, ldb_get_end_idx(obj->idx_format, &obj->state)))
+        exit_function(LDB_ERR_WRITE_IDX);
+
+    // removed space is allocated again
+    ldb_realloc_tail(fileno(obj->dat_fp), obj->dat_end, obj->dat_alloc, obj->prealloc);
+    ldb_realloc_tail(fileno(obj->idx_fp), ldb_get_end_idx(obj->idx_format, &obj->state), obj->idx_alloc, obj->prealloc);
+
+    ret = removed_entries;
+
+LDB_ROLLBACK_END:
+    ldb_metrics_time(obj, &obj->metrics.rollback, t0);
+    pthread_rwlock_unlock(&obj->rwlock_files);
+    ldb_unlock_writer(obj);
+    return ret;
+}
+
+// Encodes the records in src (from record first to the batch end) as a new batch.
+// Returns the new batch length (0 on error), offsets of the records in dst.
+static size_t ldb_reframe_batch_dat(const char *src, size_t len, const ldb_record_dat_t *first, size_t num, char *dst, size_t *offsets)
+{
+    ldb_record_idx_t hint = { .seqnum = first->seqnum, .timestamp = first->timestamp };
+    ldb_record_dat_t record = {0};
+    ldb_record_dat_t prev = {0};
+    size_t src_pos = 0;
+    size_t dst_pos = 0;
+    size_t first_len = 0;
+    uint32_t checksum = 0;
+
+    for (size_t i = 0; i < num; i++)
+    {
+        size_t header_len = ldb_decode_record_dat(LDB_FILE_FORMAT_BATCH, src + src_pos, len - src_pos, &prev, (i == 0 ? &hint : NULL), &record);
+        size_t data_len = ldb_stored_len(record.data_len);
+
+        if (header_len == 0 || record.seqnum == 0 || src_pos + header_len + data_len > len)
+            return 0;
+
+        offsets[i] = dst_pos;
+        src_pos += header_len;
+        header_len = ldb_encode_record_dat(LDB_FILE_FORMAT_BATCH, &record, &prev, dst_pos, dst + dst_pos);
+        dst_pos += header_len;
+
+        if (i == 0)
+            first_len = header_len;
+
+        memcpy(dst + dst_pos, src + src_pos, data_len);
+        src_pos += data_len;
+        dst_pos += data_len;
+        prev = record;
+    }
+
+    if (src_pos != len)
+        return 0;
+
+    ldb_set_batch_dat(dst, first_len, (uint32_t) num, (uint32_t) dst_pos, 0);
+    checksum = ldb_crc32(dst, first_len - sizeof(uint32_t), checksum);
+    checksum = ldb_crc32(dst + first_len, dst_pos - first_len, checksum);
+    ldb_set_batch_dat(dst, first_len, (uint32_t) num, (uint32_t) dst_pos, checksum);
+
+    return dst_pos;
+}
+
+/**
+ * Computes the head of the purged dat file (batch format).
+ * 
+ * When the new first record starts a batch the content is copied as is 
+ * (num_heads = 0). Otherwise the remaining records of its batch are 
+ * re-encoded as a new batch (head, allocated) because batch records 
+ * refer to the batch header record.
+ * 
+ * @param[out] head Re-encoded records (allocated if num_heads > 0).
+ * @param[out] offsets Offsets in head of the re-encoded records (allocated if num_heads > 0).
+ * @param[out] copy_pos Position of the content copied after head.
+ */
+static int ldb_purge_batch(ldb_impl_t *obj, const ldb_record_idx_t *first, char **head, size_t *head_len, 
+                           size_t **offsets, size_t *num_heads, size_t *copy_pos)
+{
+    int dat_fd = fileno(obj->dat_fp);
+    ldb_record_dat_t record = {0};
+    ldb_batch_t batch = {0};
+    char header[LDB_HEADER_MAX];
+    size_t header_len = 0;
+    ssize_t rc = ldb_pread(dat_fd, &obj->dat_map, header, sizeof(header), first->pos);
+    int ret = LDB_OK;
+
+    if (rc == -1)
+        return LDB_ERR_READ_DAT;
+
+    if (ldb_decode_header_dat(obj->format, header, (size_t) rc, NULL, first, &record, &batch) == 0 || record.seqnum == 0)
+        return LDB_ERR_FMT_DAT;
+
+    *head_len = 0;
+    *num_heads = 0;
+    *copy_pos = first->pos;
+
+    if (batch.back == 0)
+        return LDB_OK;
+
+    size_t batch_pos = first->pos - batch.back;
+    ldb_record_dat_t lead = {0};
+    ldb_batch_t frame = {0};
+
+    if ((ret = ldb_read_batch_dat(dat_fd, &obj->dat_map, batch_pos, NULL, 0, 0, &lead, &frame, &header_len, false)) != LDB_OK)
+        return ret;
+
+    size_t len = batch_pos + frame.len - first->pos;
+    size_t num = (size_t) (lead.seqnum + frame.num - first->seqnum);
+    char *src = (char *) malloc(len);
+    char *dst = (char *) malloc(len + LDB_HEADER_MAX + 2 * num);
+    size_t *pos = (size_t *) malloc(num * sizeof(size_t));
+
+    if (!src || !dst || !pos)
+        ret = LDB_ERR_MEM;
+    else if (ldb_pread(dat_fd, &obj->dat_map, src, len, first->pos) != (ssize_t) len)
+        ret = LDB_ERR_READ_DAT;
+    else if ((*head_len = ldb_reframe_batch_dat(src, len, &record, num, dst, pos)) == 0)
+        ret = LDB_ERR_FMT_DAT;
+
+    free(src);
+
+    if (ret != LDB_OK) {
+        free(dst);
+        free(pos);
+        return ret;
+    }
+
+    *head = dst;
+    *offsets = pos;
+    *num_heads = num;
+    *copy_pos = batch_pos + frame.len;
+
+    return LDB_OK;
+}
+
+#undef exit_function
+#define exit_function(errnum) do { ret = errnum; goto LDB_PURGE_COPY_ERR; } while(0)
+
+// Writes to tmp files the content of the journal starting at seqnum.
+// Index records are copied from the current idx file shifting positions.
+// Called with rwlock_files held in read mode (readers are not blocked).
+// On error tmp files are removed.
+static int ldb_purge_copy(ldb_impl_t *obj, uint64_t seqnum, const char *tmp_dat_path, const char *tmp_idx_path)
+{
+    assert(obj);
+    assert(tmp_dat_path);
+    assert(tmp_idx_path);
+
+    int ret = LDB_OK;
+    ldb_state_t state = obj->state;
+    ldb_header_dat_t header_dat = {0};
+    ldb_header_idx_t header_idx = {0};
+    ldb_record_idx_t record_idx = {0};
+    ldb_record_dat_t record_dat = {0};
+    ldb_record_idx_t records[LDB_IDX_BLOCK_RECORDS];
+    size_t max_records = sizeof(records) / sizeof(records[0]);
+    char buf[sizeof(records)];
+    ldb_record_idx_t block = {0};
+    ldb_record_idx_t block_tmp = {0};
+    ldb_state_t state_tmp = {0};
+    FILE *tmp_dat_fp = NULL;
+    FILE *tmp_idx_fp = NULL;
+    int dat_fd = fileno(obj->dat_fp);
+    int idx_fd = fileno(obj->idx_fp);
+    char header[LDB_HEADER_MAX];
+    char *head = header;
+    size_t head_len = 0;
+    size_t head_offset[1] = {0};
+    size_t *offsets = head_offset;
+    size_t num_heads = 0;
+    size_t copy_pos = 0;
+    size_t rec_len = 0;
+
+    assert(state.seqnum1 < seqnum && seqnum <= state.seqnum2);
+
+    if (pread(dat_fd, &header_dat, sizeof(ldb_header_dat_t), 0) != (ssize_t) sizeof(ldb_header_dat_t))
+        return LDB_ERR_READ_DAT;
+
+    if (pread(idx_fd, &header_idx, sizeof(ldb_header_idx_t), 0) != (ssize_t) sizeof(ldb_header_idx_t))
+        return LDB_ERR_READ_IDX;
+
+    memset(&header_idx.checkpoint, 0x00, sizeof(ldb_record_idx_t));
+
+    if ((ret = ldb_read_record_idx(obj, &state, seqnum, &record_idx)) != LDB_OK)
+        return ret;
+
+    if ((ret = ldb_read_record_dat(dat_fd, &obj->dat_map, obj->format, record_idx.pos, &record_idx, &record_dat, &rec_len, true)) != LDB_OK)
+        return ret;
+
+    if (record_dat.seqnum != seqnum)
+        return LDB_ERR_FMT_IDX;
+
+    if (obj->format == LDB_FILE_FORMAT_BATCH)
+    {
+        // batch records starting the file are re-encoded as a batch
+        if ((ret = ldb_purge_batch(obj, &record_idx, &head, &head_len, &offsets, &num_heads, &copy_pos)) != LDB_OK)
+            return ret;
+    }
+    else
+    {
+        // first record is re-encoded (dense records are relative to the previous one)
+        copy_pos = record_idx.pos + rec_len - ldb_record_len(obj->format, 0, record_dat.data_len);
+        head_len = ldb_encode_record_dat(obj->format, &record_dat, NULL, 0, header);
+        num_heads = 1;
+    }
+
+    if ((tmp_dat_fp = fopen(tmp_dat_path, "w")) == NULL)
+        exit_function(LDB_ERR_TMP_FILE);
+
+    if ((tmp_idx_fp = fopen(tmp_idx_path, "w")) == NULL)
+        exit_function(LDB_ERR_TMP_FILE);
+
+    if (fwrite(&header_dat, sizeof(ldb_header_dat_t), 1, tmp_dat_fp) != 1)
+        exit_function(LDB_ERR_TMP_FILE);
+
+    if (head_len > 0 && fwrite(head, head_len, 1, tmp_dat_fp) != 1)
+        exit_function(LDB_ERR_TMP_FILE);
+
+    if (!ldb_copy_file(obj->dat_fp, copy_pos, obj->dat_end, tmp_dat_fp, sizeof(ldb_header_dat_t) + head_len))
+        exit_function(LDB_ERR_TMP_FILE);
+
+    if (fwrite(&header_idx, sizeof(ldb_header_idx_t), 1, tmp_idx_fp) != 1)
+        exit_function(LDB_ERR_TMP_FILE);
+
+    // copy idx records [seqnum, seqnum2] by blocks (re-encoded from the new first record)
+    state_tmp.seqnum1 = seqnum;
+
+    while (seqnum <= state.seqnum2)
+    {
+        size_t num = ldb_min(state.seqnum2 - seqnum + 1, max_records);
+        size_t len = 0;
+
+        if ((ret = ldb_read_records_idx(obj, state.seqnum1, seqnum, records, num, &num, &block)) != LDB_OK)
+            exit_function(ret);
+
+        if (num == 0)
+            exit_function(LDB_ERR_FMT_IDX);
+
+        for (size_t i = 0; i < num; i++)
+        {
+            size_t k = (size_t) (records[i].seqnum - record_idx.seqnum);
+
+            if (records[i].seqnum != seqnum + i || (k >= num_heads && records[i].pos < copy_pos))
+                exit_function(LDB_ERR_FMT_IDX);
+
+            if (k < num_heads)
+                records[i].pos = sizeof(ldb_header_dat_t) + offsets[k];
+            else
+                records[i].pos = records[i].pos - copy_pos + sizeof(ldb_header_dat_t) + head_len;
+        }
+
+        len = ldb_encode_idx(obj->idx_format, &state_tmp, records, num, &block_tmp, buf);
+
+        if (fwrite(buf, len, 1, tmp_idx_fp) != 1)
+            exit_function(LDB_ERR_TMP_FILE);
+
+        seqnum += num;
+    }
+
+    if (obj->force_fsync)
+    {
+        if (fflush(tmp_dat_fp) != 0 || fdatasync(fileno(tmp_dat_fp)) != 0)
+            exit_function(LDB_ERR_TMP_FILE);
+
+        if (fflush(tmp_idx_fp) != 0 || fdatasync(fileno(tmp_idx_fp)) != 0)
+            exit_function(LDB_ERR_TMP_FILE);
+    }
+
+    ret = fclose(tmp_dat_fp);
+    tmp_dat_fp = NULL;
+
+    if (ret != 0)
+        exit_function(LDB_ERR_TMP_FILE);
+
+    ret = fclose(tmp_idx_fp);
+    tmp_idx_fp = NULL;
+
+    if (ret != 0)
+        exit_function(LDB_ERR_TMP_FILE);
+
+    if (head != header) free(head);
+    if (offsets != head_offset) free(offsets);
+
+    return LDB_OK;
+
+LDB_PURGE_COPY_ERR:
+    if (tmp_dat_fp != NULL) fclose(tmp_dat_fp);
+    if (tmp_idx_fp != NULL) fclose(tmp_idx_fp);
+    if (head != header) free(head);
+    if (offsets != head_offset) free(offsets);
+    remove(tmp_dat_path);
+    remove(tmp_idx_path);
+    return ret;
+}
+
+#undef exit_function
+#define exit_function(errnum) do { ret = errnum; goto LDB_PURGE_ERR; } while(0)
+
+/**
+ * Purge is done in two phases:
+ *   - copy: the remaining content is written to tmp files with rwlock_files
+ *     held in read mode. Readers continue using the current files.
+ *   - swap: tmp files replace the current ones with rwlock_files held in
+ *     write mode. Readers are blocked only during this phase.
+ * The writer lock is held across both phases (no appends meanwhile).
+ */
+long ldb_purge(ldb_impl_t *obj, uint64_t seqnum)
+{
+    if (!obj)
+        return LDB_ERR_ARG;
+
+    uint64_t t0 = ldb_metrics_now(obj);
+
+    ldb_lock_writer(obj);
+    ldb_lock_files(obj, false);
+
+    int ret = LDB_ERR;
+    long removed_entries = 0;
+    uint64_t checkpoint = obj->checkpoint.seqnum;
+    char *tmp_dat_path = NULL;
+    char *tmp_idx_path = NULL;
+
+    if (!ldb_is_valid_obj(obj)) {
+        pthread_rwlock_unlock(&obj->rwlock_files);
+        ldb_unlock_writer(obj);
+        return LDB_ERR;
+    }
+
+    // purged files are copied from the idx file
+    if ((ret = ldb_flush_idx(obj)) != LDB_OK) {
+        pthread_rwlock_unlock(&obj->rwlock_files);
+        ldb_unlock_writer(obj);
+        return ret;
+    }
+
+    // case no entries to purge
+    if (seqnum <= obj->state.seqnum1 || obj->state.seqnum1 == 0) {
+        pthread_rwlock_unlock(&obj->rwlock_files);
+        ldb_unlock_writer(obj);
+        return 0;
+    }
+
+    // case purge all entries
+    if (obj->state.seqnum2 < seqnum)
+    {
+        removed_entries = (long) obj->state.seqnum2 - (long) obj->state.seqnum1 + 1;
+
+        pthread_rwlock_unlock(&obj->rwlock_files);
+        ldb_lock_files(obj, true);
+        ldb_wait_views(obj);
+        obj->epoch++;
+
+        ldb_close_files(obj);
+        ldb_set_state(obj, &(ldb_state_t){0});
+
+        remove(obj->dat_path);
+        remove(obj->idx_path);
+
+        // content is removed, format and codec are preserved
+        if (!ldb_create_file_dat(obj->dat_path, obj->format, (uint32_t) obj->codec))
+            exit_function(LDB_ERR_OPEN_DAT);
+
+        if (!ldb_create_file_idx(obj->idx_path))
+            exit_function(LDB_ERR_OPEN_IDX);
+
+        goto LDB_PURGE_REOPEN;
+    }
+
+    // case purge some entries
+
+    removed_entries = (long) seqnum - (long) obj->state.seqnum1;
+
+    tmp_dat_path = ldb_create_filename(obj->path, obj->name, LDB_EXT_TMP_DAT);
+    tmp_idx_path = ldb_create_filename(obj->path, obj->name, LDB_EXT_TMP_IDX);
+
+    if (!tmp_dat_path || !tmp_idx_path) {
+        ret = LDB_ERR_MEM;
+        goto LDB_PURGE_COPY_END;
+    }
+
+    // copy phase (journal untouched on error)
+    if ((ret = ldb_purge_copy(obj, seqnum, tmp_dat_path, tmp_idx_path)) != LDB_OK)
+        goto LDB_PURGE_COPY_END;
+
+    // swap phase
+    pthread_rwlock_unlock(&obj->rwlock_files);
+    ldb_lock_files(obj, true);
+    ldb_wait_views(obj);
+    obj->epoch++;
+
+    if ((ret = ldb_close_files(obj)) != LDB_OK)
+        exit_function(ret);
+
+    ldb_set_state(obj, &(ldb_state_t){0});
+
+    // on crash between renames the idx is rebuilt on open
+    if (rename(tmp_dat_path, obj->dat_path) != 0)
+        exit_function(LDB_ERR_TMP_FILE);
+
+    if (rename(tmp_idx_path, obj->idx_path) != 0)
+        exit_function(LDB_ERR_TMP_FILE);
+
+    free(tmp_dat_path);
+    free(tmp_idx_path);
+    tmp_dat_path = NULL;
+    tmp_idx_path = NULL;
+
+LDB_PURGE_REOPEN:
+    if ((ret = ldb_open_file_dat(obj, false)) != LDB_OK)
+        exit_function(ret);
+
+    if ((ret = ldb_open_file_idx(obj, false)) != LDB_OK)
+        exit_function(ret);
+
+    if ((ret = ldb_map_files(obj)) != LDB_OK)
+        exit_function(ret);
+
+    // preserved checkpoint (position shifted)
+    if (checkpoint >= obj->state.seqnum1 && checkpoint <= obj->state.seqnum2 &&
+        ldb_read_record_idx(obj, &obj->state, checkpoint, &obj->checkpoint) != LDB_OK)
+        memset(&obj->checkpoint, 0x00, sizeof(ldb_record_idx_t));
+
+    ldb_lock_state(obj);
+    ldb_sparse_trim(&obj->sparse, &obj->state);
+    pthread_mutex_unlock(&obj->mutex_state);
+
+    ldb_metrics_time(obj, &obj->metrics.purge, t0);
+
+    pthread_rwlock_unlock(&obj->rwlock_files);
+    ldb_unlock_writer(obj);
+
+    return removed_entries;
+
+LDB_PURGE_COPY_END:
+    free(tmp_dat_path);
+    free(tmp_idx_path);
+    pthread_rwlock_unlock(&obj->rwlock_files);
+    ldb_unlock_writer(obj);
+    return ret;
+
+LDB_PURGE_ERR:
+    if (tmp_dat_path) remove(tmp_dat_path);
+    if (tmp_idx_path) remove(tmp_idx_path);
+    free(tmp_dat_path);
+    free(tmp_idx_path);
+    ldb_close_files(obj);
+    ldb_set_state(obj, &(ldb_state_t){0});
+    pthread_rwlock_unlock(&obj->rwlock_files);
+    ldb_unlock_writer(obj);
+    return ret;
+}
+
+#undef exit_function
+
+ldb_journal_t * ldb_alloc(void) {
+    return (ldb_journal_t *) calloc(1, sizeof(ldb_impl_t));
+}
+
+void ldb_free(ldb_journal_t *obj) {
+    free(obj);
+}
+
+int ldb_set_fsync(ldb_journal_t *obj, bool fsync) {
+    if (!obj)
+        return LDB_ERR_ARG;
+
+    ldb_impl_t *impl = (ldb_impl_t *)obj;
+    impl->force_fsync = fsync;
+
+    return LDB_OK;
+}
+
+int ldb_set_verify(ldb_journal_t *obj, bool verify) {
+    if (!obj)
+        return LDB_ERR_ARG;
+
+    ldb_impl_t *impl = (ldb_impl_t *)obj;
+    impl->verify_checksum = verify;
+
+    return LDB_OK;
+}
+
+int ldb_set_prealloc(ldb_journal_t *obj, size_t bytes)
+{
+    if (!obj)
+        return LDB_ERR_ARG;
+
+    if (!ldb_is_valid_obj(obj))
+        return LDB_ERR;
+
+    ldb_lock_writer(obj);
+    obj->prealloc = bytes;
+    ldb_unlock_writer(obj);
+
+    return LDB_OK;
+}
+
+int ldb_set_metrics(ldb_journal_t *obj, bool enable)
+{
+    if (!obj)
+        return LDB_ERR_ARG;
+
+    if (!ldb_is_valid_obj(obj))
+        return LDB_ERR;
+
+    ldb_lock_writer(obj);
+    obj->metrics_enabled = enable;
+    ldb_unlock_writer(obj);
+
+    return LDB_OK;
+}
+
+int ldb_get_metrics(ldb_journal_t *obj, ldb_metrics_t *metrics)
+{
+    if (!obj || !metrics)
+        return LDB_ERR_ARG;
+
+    // struct contains only uint64_t fields
+    const uint64_t *src = (const uint64_t *) &obj->metrics;
+    uint64_t *dst = (uint64_t *) metrics;
+
+    for (size_t i = 0; i < sizeof(ldb_metrics_t) / sizeof(uint64_t); i++)
+        dst[i] = LDB_ATOMIC_LOAD(&src[i]);
+
+    return LDB_OK;
+}
+
+int ldb_set_sparse_index(ldb_journal_t *obj, size_t max_bytes)
+{
+    if (!obj)
+        return LDB_ERR_ARG;
+
+    if (max_bytes != 0 && max_bytes < sizeof(ldb_sample_t))
+        return LDB_ERR_ARG;
+
+    if (!ldb_is_valid_obj(obj))
+        return LDB_ERR;
+
+    ldb_lock_writer(obj);
+    ldb_lock_files(obj, false);
+
+    int ret = LDB_OK;
+    ldb_sparse_t sparse = {0};
+    ldb_record_idx_t record = {0};
+    ldb_state_t state = obj->state;
+
+    sparse.max_len = max_bytes / sizeof(ldb_sample_t);
+    sparse.stride = LDB_SPARSE_STRIDE;
+
+    // built from the idx file (one read per sample)
+    if (sparse.max_len > 0 && state.seqnum1 != 0)
+    {
+        uint64_t seqnum = state.seqnum1 + (sparse.stride - state.seqnum1 % sparse.stride) % sparse.stride;
+
+        while (seqnum <= state.seqnum2)
+        {
+            if ((ret = ldb_read_record_idx(obj, &state, seqnum, &record)) != LDB_OK)
+                break;
+
+            ldb_sparse_push(&sparse, record.seqnum, record.timestamp);
+
+            // stride can grow while pushing
+            seqnum += sparse.stride - seqnum % sparse.stride;
+        }
+    }
+
+    if (ret == LDB_OK) {
+        ldb_lock_state(obj);
+        ldb_sparse_free(&obj->sparse);
+        obj->sparse = sparse;
+        pthread_mutex_unlock(&obj->mutex_state);
+    }
+    else {
+        ldb_sparse_free(&sparse);
+    }
+
+    pthread_rwlock_unlock(&obj->rwlock_files);
+    ldb_unlock_writer(obj);
+
+    return ret;
+}
+
+int ldb_set_idx_writeback(ldb_journal_t *obj, size_t max_entries)
+{
+    if (!obj)
+        return LDB_ERR_ARG;
+
+    if (max_entries > SIZE_MAX / sizeof(ldb_record_idx_t) - LDB_IOV_ENTRIES)
+        return LDB_ERR_ARG;
+
+    if (!ldb_is_valid_obj(obj))
+        return LDB_ERR;
+
+    ldb_lock_writer(obj);
+    ldb_lock_files(obj, true);
+
+    ldb_writeback_t *wb = &obj->writeback;
+    size_t capacity = (max_entries == 0 ? 0 : (max_entries + LDB_IOV_ENTRIES) * sizeof(ldb_record_idx_t));
+    char *buf = NULL;
+    int ret = ldb_flush_idx(obj);
+
+    // a chunk is appended to the buffer when it holds less than max_entries
+    if (ret == LDB_OK && capacity > 0 && (buf = (char *) malloc(capacity)) == NULL)
+        ret = LDB_ERR_MEM;
+
+    if (ret == LDB_OK) {
+        pthread_mutex_lock(&obj->mutex_idx);
+        free(wb->buf);
+        wb->buf = buf;
+        wb->capacity = capacity;
+        wb->max_entries = max_entries;
+        pthread_mutex_unlock(&obj->mutex_idx);
+    }
+
+    pthread_rwlock_unlock(&obj->rwlock_files);
+    ldb_unlock_writer(obj);
+
+    return ret;
+}
+
+int ldb_set_group_commit(ldb_journal_t *obj, size_t queue_max)
+{
+    if (!obj)
+        return LDB_ERR_ARG;
+
+    if (!ldb_is_valid_obj(obj))
+        return LDB_ERR;
+
+    if (queue_max == 0) {
+        ldb_group_stop(obj);
+        return LDB_OK;
+    }
+
+    if (obj->group != NULL) {
+        pthread_mutex_lock(&obj->group->mutex_queue);
+        obj->group->queue_max = queue_max;
+        pthread_cond_broadcast(&obj->group->cond_commit);
+        pthread_mutex_unlock(&obj->group->mutex_queue);
+        return LDB_OK;
+    }
+
+    if ((obj->group = ldb_group_create(queue_max, ldb_group_commit, obj)) == NULL)
+        return LDB_ERR;
+
+    return LDB_OK;
+}
+
+int ldb_set_mmap(ldb_journal_t *obj, int mode)
+{
+    if (!obj || mode < LDB_MMAP_NONE || mode > LDB_MMAP_ALL)
+        return LDB_ERR_ARG;
+
+    if (!ldb_is_valid_obj(obj))
+        return LDB_ERR;
+
+    ldb_lock_files(obj, true);
+    ldb_wait_views(obj);
+
+    obj->mmap_mode = mode;
+    int ret = ldb_map_files(obj);
+
+    if (ret != LDB_OK)
+        obj->mmap_mode = LDB_MMAP_NONE;
+
+    pthread_rwlock_unlock(&obj->rwlock_files);
+
+    return ret;
+}
+
+int ldb_set_compression(ldb_journal_t *obj, int codec)
+{
+    if (!obj || codec < LDB_CODEC_NONE || codec > LDB_CODEC_LZ4)
+        return LDB_ERR_ARG;
+
+    if (!ldb_is_valid_obj(obj))
+        return LDB_ERR;
+
+    ldb_lock_writer(obj);
+
+    int ret = LDB_OK;
+    int dat_fd = fileno(obj->dat_fp);
+    off_t pos = offsetof(ldb_header_dat_t, codec);
+    uint32_t header_codec = LDB_CODEC_NONE;
+
+    if (pread(dat_fd, &header_codec, sizeof(uint32_t), pos) != (ssize_t) sizeof(uint32_t))
+        ret = LDB_ERR_READ_DAT;
+
+    // declared in the header before writing any compressed record
+    if (ret == LDB_OK && codec != LDB_CODEC_NONE && header_codec != (uint32_t) codec)
+    {
+        header_codec = (uint32_t) codec;
+
+        if (pwrite(dat_fd, &header_codec, sizeof(uint32_t), pos) != (ssize_t) sizeof(uint32_t))
+            ret = LDB_ERR_WRITE_DAT;
+        else if (fdatasync(dat_fd) != 0)
+            ret = LDB_ERR_WRITE_DAT;
+    }
+
+    if (ret == LDB_OK)
+        obj->codec = codec;
+
+    ldb_unlock_writer(obj);
+
+    return ret;
+}
+
+int ldb_set_format(ldb_journal_t *obj, int format)
+{
+    if (!obj || format < LDB_FORMAT_FIXED || format > LDB_FORMAT_BATCH)
+        return LDB_ERR_ARG;
+
+    if (!ldb_is_valid_obj(obj))
+        return LDB_ERR;
+
+    ldb_lock_writer(obj);
+
+    int ret = LDB_OK;
+    int dat_fd = fileno(obj->dat_fp);
+    off_t pos = offsetof(ldb_header_dat_t, format);
+    uint32_t header_format = LDB_FILE_FORMAT;
 
-            if (rc != (ssize_t) num_bytes)
-                return LDB_ERR_FMT_DAT;
+    if (format == LDB_FORMAT_DENSE)
+        header_format = LDB_FILE_FORMAT_DENSE;
+    else if (format == LDB_FORMAT_BATCH)
+        header_format = LDB_FILE_FORMAT_BATCH;
 
-            pos += num_bytes;
+    if (header_format == obj->format)
+        goto LDB_SET_FORMAT_END;
 
-            checksum = ldb_crc32(buf, num_bytes, checksum);
-        }
+    // existing records can not be reinterpreted
+    if (obj->dat_end > sizeof(ldb_header_dat_t)) {
+        ret = LDB_ERR;
+        goto LDB_SET_FORMAT_END;
     }
 
-    if (checksum != record->checksum)
-        return LDB_ERR_CHECKSUM;
+    ldb_lock_files(obj, true);
 
-    return LDB_OK;
+    if (pwrite(dat_fd, &header_format, sizeof(uint32_t), pos) != (ssize_t) sizeof(uint32_t))
+        ret = LDB_ERR_WRITE_DAT;
+    else if (fdatasync(dat_fd) != 0)
+        ret = LDB_ERR_WRITE_DAT;
+    else
+        obj->format = header_format;
+
+    pthread_rwlock_unlock(&obj->rwlock_files);
+
+LDB_SET_FORMAT_END:
+    ldb_unlock_writer(obj);
+
+    return ret;
 }
 
-// Read idx record at pos.
-// File position is not modified.
-static int ldb_read_record_idx(int fd, ldb_state_t *state, uint64_t seqnum, ldb_record_idx_t *record)
+int ldb_set_meta(ldb_journal_t *obj, const char *meta, size_t len)
 {
-    assert(state);
-    assert(record);
-    assert(fd > STDERR_FILENO);
+    static const char zero[LDB_METADATA_LEN] = {0};
 
-    if (state->seqnum1 == 0 || seqnum < state->seqnum1 || state->seqnum2 < seqnum)
+    if (!obj || !meta || len > LDB_METADATA_LEN)
+        return LDB_ERR_ARG;
+
+    if (!ldb_is_valid_obj(obj))
         return LDB_ERR;
 
-    if (seqnum == state->seqnum1) {
-        record->seqnum = state->seqnum1;
-        record->timestamp = state->timestamp1;
-        record->pos = sizeof(ldb_header_dat_t);
-        return LDB_OK;
+    int dat_fd = fileno(obj->dat_fp);
+    off_t pos = offsetof(ldb_header_dat_t, metadata);
+
+    if (pwrite(dat_fd, meta, len, pos) != (ssize_t) len)
+        return LDB_ERR_WRITE_DAT;
+
+    if (len < LDB_METADATA_LEN)
+    {
+        pos += (off_t) len;
+        len = LDB_METADATA_LEN - len;
+
+        if (pwrite(dat_fd, zero, len, pos) != (ssize_t) len)
+            return LDB_ERR_WRITE_DAT;
     }
 
-    size_t pos = ldb_get_pos_idx(state, seqnum);
+    return LDB_OK;
+}
 
-    if (pread(fd, record, sizeof(ldb_record_idx_t), (off_t) pos) != (ssize_t) sizeof(ldb_record_idx_t))
-        return LDB_ERR_READ_IDX;
+int ldb_get_meta(ldb_journal_t *obj, char *meta, size_t len)
+{
+    if (!obj || !meta || len > LDB_METADATA_LEN)
+        return LDB_ERR_ARG;
 
-    if (record->seqnum != seqnum)
+    if (!ldb_is_valid_obj(obj))
         return LDB_ERR;
 
+    int dat_fd = fileno(obj->dat_fp);
+    off_t pos = offsetof(ldb_header_dat_t, metadata);
+
+    if (pread(dat_fd, meta, len, pos) != (ssize_t) len)
+        return LDB_ERR_READ_DAT;
+
     return LDB_OK;
 }
 
-#define exit_function(errnum) do { ret = errnum; goto LDB_OPEN_FILE_DAT_ERR; } while(0)
+/* ---------------------------------------------------------------------- */
+/* Segmented journal                                                      */
+/* ---------------------------------------------------------------------- */
 
-/**
- * pre-conditions:
- *   - obj->dat_fp == NULL
- *   - obj->idx_fp == NULL
- *
- * post-conditions (OK)
- *   - obj->dat_fp = set
- *   - obj->format = set
- *   - obj->first_seqnum = set (0 if no data)
- *   - obj->first_timestamp = set
- *   - obj->dat_end = sizeof(ldb_header_dat_t)
- *   - dat file position = at end
- * 
- * post-conditions (KO)
- *   - dat files closed
- */
-static int ldb_open_file_dat(ldb_impl_t *obj, bool check)
+#define LDB_SEG_ID_DIGITS       6
+#define LDB_SEG_ID_MAX          999999
+
+typedef struct ldb_segment_t {
+    uint32_t id;                  // Segment identifier (file suffix).
+    ldb_impl_t *journal;          // Segment journal.
+} ldb_segment_t;
+
+typedef struct ldb_segments_impl_t
 {
-    assert(obj);
-    assert(obj->dat_fp == NULL);
-    assert(obj->idx_fp == NULL);
+    // Fixed data (unchanged)
+    char *name;                   // Journal name
+    char *path;                   // Directory where files are located
+    size_t max_bytes;             // Roll when data file reaches this size (0 = no limit)
+    size_t max_entries;           // Roll when segment reaches this number of entries (0 = no limit)
+    bool force_fsync;             // Force fsync after flush (applied to all segments)
 
-    int ret = LDB_OK;
-    int dat_fd = -1;
-    ldb_header_dat_t header = {0};
-    ldb_record_dat_t record = {0};
-    size_t pos = 0;
-    size_t len = 0;
+    // Shared data (accessed by both threads)
+    pthread_rwlock_t rwlock_segments; // Readers (R) route across segments, writer (W) adds or removes segments
+    ldb_segment_t *segments;      // Segments sorted by id (and seqnum)
+    size_t num_segments;          // Number of segments (at least 1 when open)
+    size_t capacity;              // Allocated segments
 
-    ldb_reset_state(&obj->state);
-    obj->dat_end = sizeof(ldb_header_dat_t);
+} ldb_segments_impl_t;
 
-    obj->dat_fp = fopen(obj->dat_path, "r+");
+static bool ldb_seg_is_valid_obj(ldb_segments_impl_t *obj) {
+    return (obj != NULL && obj->name != NULL && obj->num_segments > 0);
+}
 
-    if (obj->dat_fp == NULL)
-        return LDB_ERR_OPEN_DAT;
+// Segment name is 'name.nnnnnn'.
+static char * ldb_seg_create_name(const char *name, uint32_t id)
+{
+    size_t len = strlen(name) + 1 + LDB_SEG_ID_DIGITS + 1;
+    char *str = (char *) calloc(len, 1);
 
-    if ((dat_fd = fileno(obj->dat_fp)) == -1)
-        return LDB_ERR_OPEN_DAT;
+    if (str != NULL)
+        snprintf(str, len, "%s.%0*u", name, LDB_SEG_ID_DIGITS, (unsigned) id);
 
-    if (flock(dat_fd, LOCK_EX | LOCK_NB) == -1)
-        return LDB_ERR_LOCK;
+    return str;
+}
 
-    len = ldb_get_file_size(obj->dat_fp);
+// Returns the segment id if filename is 'name.nnnnnn.dat', 0 otherwise.
+static uint32_t ldb_seg_parse_filename(const char *filename, const char *name)
+{
+    size_t len = strlen(name);
+    const char *ptr = filename + len;
+    uint32_t id = 0;
 
-    if (pread(dat_fd, &header, sizeof(ldb_header_dat_t), 0) != (ssize_t) sizeof(ldb_header_dat_t))
-        exit_function(LDB_ERR_FMT_DAT);
+    if (strncmp(filename, name, len) != 0 || *ptr != '.')
+        return 0;
 
-    pos += sizeof(ldb_header_dat_t);
+    ptr++;
 
-    if (header.magic_number != LDB_DAT_MAGIC_NUMBER) 
-        exit_function(LDB_ERR_FMT_DAT);
+    for (int i = 0; i < LDB_SEG_ID_DIGITS; i++, ptr++) {
+        if (!isdigit((unsigned char) *ptr))
+            return 0;
+        id = 10 * id + (uint32_t)(*ptr - '0');
+    }
 
-    if (header.format != LDB_FILE_FORMAT)
-        exit_function(LDB_ERR_FMT_DAT);
+    return (strcmp(ptr, LDB_EXT_DAT) == 0 ? id : 0);
+}
 
-    obj->format = header.format;
+static int ldb_seg_cmp_id(const void *a, const void *b)
+{
+    uint32_t id1 = ((const ldb_segment_t *) a)->id;
+    uint32_t id2 = ((const ldb_segment_t *) b)->id;
+    return (id1 > id2) - (id1 < id2);
+}
 
-    if (pos == len)
-        goto LDB_OPEN_FILE_DAT_END;
+// Opens (creating it if not exists) the segment with the given id.
+static int ldb_seg_open_segment(ldb_segments_impl_t *obj, uint32_t id, bool check, ldb_segment_t *segment)
+{
+    int ret = LDB_OK;
+    char *name = NULL;
 
-    if (pos + sizeof(ldb_record_dat_t) > len)
-        goto LDB_OPEN_FILE_DAT_ZEROIZE;
+    segment->id = id;
+    segment->journal = NULL;
 
-    // read first entry
-    ret = ldb_read_record_dat(dat_fd, pos, &record, true);
+    if (id == 0 || id > LDB_SEG_ID_MAX)
+        return LDB_ERR;
 
-    if (ret == LDB_ERR_FMT_DAT)
-        goto LDB_OPEN_FILE_DAT_ZEROIZE;
+    if ((name = ldb_seg_create_name(obj->name, id)) == NULL)
+        return LDB_ERR_MEM;
 
-    if (ret != LDB_OK)
-        exit_function(ret);
+    if ((segment->journal = ldb_alloc()) == NULL) {
+        free(name);
+        return LDB_ERR_MEM;
+    }
 
-    if (record.seqnum == 0)
-        goto LDB_OPEN_FILE_DAT_ZEROIZE;
+    if ((ret = ldb_open_journal(segment->journal, obj->path, name, check)) != LDB_OK) {
+        ldb_free(segment->journal);
+        segment->journal = NULL;
+    }
+    else {
+        segment->journal->force_fsync = obj->force_fsync;
+    }
 
-    pos += sizeof(ldb_record_dat_t) + record.data_len + ldb_padding(record.data_len);
+    free(name);
+    return ret;
+}
 
-    obj->state.seqnum1 = record.seqnum;
-    obj->state.timestamp1 = record.timestamp;
+// Closes the segment and removes its files.
+static void ldb_seg_remove_segment(ldb_segment_t *segment)
+{
+    char *dat_path = segment->journal->dat_path;
+    char *idx_path = segment->journal->idx_path;
 
-    if (!check)
-        goto LDB_OPEN_FILE_DAT_END;
+    // paths are released on close
+    segment->journal->dat_path = NULL;
+    segment->journal->idx_path = NULL;
 
-    obj->state.seqnum2 = record.seqnum;
-    obj->state.timestamp2 = record.timestamp;
+    ldb_close(segment->journal);
+    ldb_free(segment->journal);
+    segment->journal = NULL;
+
+    remove(idx_path);
+    remove(dat_path);
+    free(idx_path);
+    free(dat_path);
+}
 
-    while (pos + sizeof(ldb_record_dat_t) <= len)
+// Appends an empty segment (next id).
+static int ldb_seg_roll(ldb_segments_impl_t *obj)
+{
+    ldb_segment_t segment = {0};
+    uint32_t id = obj->segments[obj->num_segments - 1].id + 1;
+    int ret = LDB_OK;
+
+    if (obj->num_segments == obj->capacity)
     {
-        ret = ldb_read_record_dat(dat_fd, pos, &record, true);
+        size_t capacity = 2 * obj->capacity;
+        ldb_segment_t *segments = NULL;
+
+        pthread_rwlock_wrlock(&obj->rwlock_segments);
+        segments = (ldb_segment_t *) realloc(obj->segments, capacity * sizeof(ldb_segment_t));
+        if (segments != NULL) {
+            obj->segments = segments;
+            obj->capacity = capacity;
+        }
+        pthread_rwlock_unlock(&obj->rwlock_segments);
 
-        if (ret == LDB_ERR_FMT_DAT)
-            goto LDB_OPEN_FILE_DAT_ZEROIZE;
+        if (segments == NULL)
+            return LDB_ERR_MEM;
+    }
 
-        if (ret != LDB_OK)
-            exit_function(ret);
+    // segment is not visible until it is listed
+    if ((ret = ldb_seg_open_segment(obj, id, false, &segment)) != LDB_OK)
+        return ret;
 
-        // case record removed (rollback)
-        if (record.seqnum == 0)
-            goto LDB_OPEN_FILE_DAT_ZEROIZE;
+    pthread_rwlock_wrlock(&obj->rwlock_segments);
+    obj->segments[obj->num_segments++] = segment;
+    pthread_rwlock_unlock(&obj->rwlock_segments);
 
-        if (record.seqnum != obj->state.seqnum2 + 1) 
-            exit_function(LDB_ERR_FMT_DAT);
+    return LDB_OK;
+}
 
-        if (record.timestamp < obj->state.timestamp2)
-            exit_function(LDB_ERR_FMT_DAT);
+// Returns the first segment having seqnum2 >= seqnum (or the last one).
+// Called with rwlock_segments locked.
+static size_t ldb_seg_find(ldb_segments_impl_t *obj, uint64_t seqnum)
+{
+    size_t lo = 0;
+    size_t hi = obj->num_segments - 1;
+    ldb_state_t state;
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
 
-        pos += sizeof(ldb_record_dat_t) + record.data_len + ldb_padding(record.data_len);
+        ldb_get_state(obj->segments[mid].journal, &state);
 
-        obj->state.seqnum2 = record.seqnum;
-        obj->state.timestamp2 = record.timestamp;
+        // empty segments are the last ones
+        if (state.seqnum2 == 0 || seqnum <= state.seqnum2)
+            hi = mid;
+        else
+            lo = mid + 1;
     }
 
-    goto LDB_OPEN_FILE_DAT_END;
+    return lo;
+}
 
-LDB_OPEN_FILE_DAT_ZEROIZE:
-    if (!ldb_zeroize(obj->dat_fp, pos))
-        exit_function(LDB_ERR_WRITE_DAT);
+// Returns the first segment having an entry at the right of timestamp (or the last one).
+// Called with rwlock_segments locked.
+static size_t ldb_seg_find_timestamp(ldb_segments_impl_t *obj, uint64_t timestamp, ldb_search_e mode)
+{
+    size_t lo = 0;
+    size_t hi = obj->num_segments - 1;
+    ldb_state_t state;
 
-LDB_OPEN_FILE_DAT_END:
-    if (fseek(obj->dat_fp, 0, SEEK_END) == -1)
-        exit_function(LDB_ERR_WRITE_DAT);
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
 
-    return LDB_OK;
+        ldb_get_state(obj->segments[mid].journal, &state);
 
-LDB_OPEN_FILE_DAT_ERR:
-    ldb_close_files(obj);
-    ldb_reset_state(&obj->state);
-    return ret;
+        bool right = (state.seqnum2 == 0 || timestamp < state.timestamp2 || 
+                     (mode == LDB_SEARCH_LOWER && timestamp == state.timestamp2));
+
+        if (right)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return lo;
 }
 
-#undef exit_function
-#define exit_function(errnum) do { ret = errnum; goto LDB_OPEN_FILE_IDX_ERR; } while(0)
+ldb_segments_t * ldb_seg_alloc(void) {
+    return (ldb_segments_t *) calloc(1, sizeof(ldb_segments_impl_t));
+}
 
-/**
- * pre-conditions:
- *   - obj->dat_fp = set
- *   - obj->idx_fp == NULL
- *   - obj->first_seqnum = set (0 if no data)
- *   - obj->first_timestamp = set
- *   - obj->format = set
- *
- * post-conditions (OK)
- *   - obj->dat_fp = set
- *   - obj->idx_fp = set
- *   - obj->first_seqnum = set (0 if no data)
- *   - obj->first_timestamp = set
- *   - obj->last_seqnum = set (0 if no data)
- *   - obj->last_timestamp = set
- *   - obj->dat_end = set
- *   - idx file position = at end
- * 
- * post-conditions (KO)
- *   - idx files closed
- */
-static int ldb_open_file_idx(ldb_impl_t *obj, bool check)
+void ldb_seg_free(ldb_segments_t *obj) {
+    free(obj);
+}
+
+int ldb_seg_close(ldb_segments_impl_t *obj)
 {
-    assert(obj);
-    assert(obj->idx_fp == NULL);
-    assert(obj->dat_fp != NULL);
-    assert(!ferror(obj->dat_fp) && !feof(obj->dat_fp));
+    if (obj == NULL)
+        return LDB_OK;
 
     int ret = LDB_OK;
-    int dat_fd = -1;
-    int idx_fd = -1;
-    ldb_header_idx_t header = {0};
-    ldb_record_idx_t record_0 = {0};
-    ldb_record_idx_t record_n = {0};
-    ldb_record_dat_t record_dat = {0};
-    size_t pos = 0;
-    size_t len = 0;
 
-    if ((dat_fd = fileno(obj->dat_fp)) == -1)
-        return LDB_ERR_OPEN_DAT;
+    for (size_t i = 0; i < obj->num_segments; i++) {
+        int rc = ldb_close(obj->segments[i].journal);
+        ret = (ret == LDB_OK ? rc : ret);
+        ldb_free(obj->segments[i].journal);
+    }
 
-    obj->idx_fp = fopen(obj->idx_path, "r+");
+    if (obj->name)
+        pthread_rwlock_destroy(&obj->rwlock_segments);
 
-    if (obj->idx_fp == NULL)
-        return LDB_ERR_OPEN_IDX;
+    free(obj->segments);
+    free(obj->name);
+    free(obj->path);
+    memset(obj, 0x00, sizeof(ldb_segments_impl_t));
 
-    if ((idx_fd = fileno(obj->idx_fp)) == -1)
-        return LDB_ERR_OPEN_IDX;
+    return ret;
+}
 
-    if (flock(idx_fd, LOCK_EX | LOCK_NB) == -1)
-        return LDB_ERR_LOCK;
+#define exit_function(errnum) do { ret = errnum; goto LDB_SEG_OPEN_ERR; } while(0)
 
-    len = ldb_get_file_size(obj->idx_fp);
+int ldb_seg_open(ldb_segments_impl_t *obj, const char *path, const char *name, bool check, size_t max_bytes, size_t max_entries)
+{
+    if (path == NULL || name == NULL || obj == NULL || (max_bytes == 0 && max_entries == 0))
+        return LDB_ERR_ARG;
 
-    if (fseek(obj->idx_fp, 0, SEEK_END) == -1)
-        exit_function(LDB_ERR_OPEN_IDX);
+    if (!ldb_is_valid_path(path))
+        return LDB_ERR_PATH;
+
+    if (!ldb_is_valid_name(name))
+        return  LDB_ERR_NAME;
+
+    int ret = LDB_OK;
+    DIR *dir = NULL;
+    struct dirent *dirent = NULL;
+    ldb_state_t state1 = {0};
+    ldb_state_t state2 = {0};
+    size_t num = 0;
+
+    memset(obj, 0x00, sizeof(ldb_segments_impl_t));
+
+    obj->name = strdup(name);
+    obj->path = strdup(path);
+    obj->max_bytes = max_bytes;
+    obj->max_entries = max_entries;
+    obj->force_fsync = false;
+    obj->capacity = 16;
+    obj->segments = (ldb_segment_t *) calloc(obj->capacity, sizeof(ldb_segment_t));
+    pthread_rwlock_init(&obj->rwlock_segments, NULL);
+
+    if (!obj->name || !obj->path || !obj->segments)
+        exit_function(LDB_ERR_MEM);
+
+    // collecting existing segments
+    if ((dir = opendir(*path == 0 ? "." : path)) == NULL)
+        exit_function(LDB_ERR_PATH);
+
+    while ((dirent = readdir(dir)) != NULL)
+    {
+        uint32_t id = ldb_seg_parse_filename(dirent->d_name, name);
+
+        if (id == 0)
+            continue;
 
-    if (pread(idx_fd, &header, sizeof(ldb_header_idx_t), 0) != (ssize_t) sizeof(ldb_header_idx_t))
-        exit_function(LDB_ERR_FMT_IDX);
+        if (num == obj->capacity) {
+            ldb_segment_t *segments = (ldb_segment_t *) realloc(obj->segments, 2 * obj->capacity * sizeof(ldb_segment_t));
+            if (segments == NULL)
+                exit_function(LDB_ERR_MEM);
+            obj->segments = segments;
+            obj->capacity *= 2;
+        }
 
-    pos += sizeof(ldb_header_idx_t);
+        obj->segments[num].id = id;
+        obj->segments[num].journal = NULL;
+        num++;
+    }
 
-    if (header.magic_number != LDB_IDX_MAGIC_NUMBER)
-        exit_function(LDB_ERR_FMT_IDX);
+    closedir(dir);
+    dir = NULL;
 
-    if (header.format != LDB_FILE_FORMAT)
-        exit_function(LDB_ERR_FMT_IDX);
+    if (num == 0)
+        obj->segments[num++].id = 1;
 
-    if (header.format != obj->format)
-        exit_function(LDB_ERR_FMT_IDX);
+    qsort(obj->segments, num, sizeof(ldb_segment_t), ldb_seg_cmp_id);
 
-    if (pos + sizeof(ldb_record_idx_t) <= len)
+    for (size_t i = 0; i < num; i++)
     {
-        // read first entry
-        if (pread(idx_fd, &record_0, sizeof(ldb_record_idx_t), (off_t) pos) != (ssize_t) sizeof(ldb_record_idx_t)) 
-            exit_function(LDB_ERR_READ_IDX);
+        if ((ret = ldb_seg_open_segment(obj, obj->segments[i].id, check, &obj->segments[obj->num_segments])) != LDB_OK)
+            exit_function(ret);
 
-        pos += sizeof(ldb_record_idx_t);
+        obj->num_segments++;
 
-        if (record_0.seqnum != obj->state.seqnum1)
-            exit_function(LDB_ERR_FMT_IDX);
+        ldb_get_state(obj->segments[obj->num_segments - 1].journal, &state2);
 
-        if (record_0.timestamp != obj->state.timestamp1)
-            exit_function(LDB_ERR_FMT_IDX);
+        // empty segments (rolled but not written) are removed, except the last one
+        if (state2.seqnum1 == 0 && i + 1 < num) {
+            ldb_seg_remove_segment(&obj->segments[--obj->num_segments]);
+            continue;
+        }
 
-        if (record_0.seqnum != 0 && record_0.pos != sizeof(ldb_header_dat_t))
-            exit_function(LDB_ERR_FMT_IDX);
-    }
+        if (state2.seqnum1 == 0)
+            break;
 
-    record_n = record_0;
+        if (state1.seqnum2 != 0 && (state2.seqnum1 != state1.seqnum2 + 1 || state2.timestamp1 < state1.timestamp2))
+            exit_function(LDB_ERR_FMT_DAT);
 
-    // read last record distinct than 0
-    if (record_0.seqnum == 0)
-    {
-        // do nothing
+        state1 = state2;
     }
-    else if (check)
-    {
-        ldb_record_idx_t aux = {0};
 
-        while (pos + sizeof(ldb_record_idx_t) <= len)
-        {
-            if (pread(idx_fd, &aux, sizeof(ldb_record_idx_t), (off_t) pos) != (ssize_t) sizeof(ldb_record_idx_t)) 
-                exit_function(LDB_ERR_READ_IDX);
+    return LDB_OK;
 
-            if (aux.seqnum == 0)
-                break;
+LDB_SEG_OPEN_ERR:
+    if (dir != NULL) closedir(dir);
+    ldb_seg_close(obj);
+    return ret;
+}
 
-            pos += sizeof(ldb_record_idx_t);
+#undef exit_function
 
-            if (aux.seqnum != record_n.seqnum + 1 || aux.timestamp < record_n.timestamp || aux.pos < record_n.pos + sizeof(ldb_record_dat_t))
-                exit_function(LDB_ERR_FMT_IDX);
+int ldb_seg_set_fsync(ldb_segments_impl_t *obj, bool fsync)
+{
+    if (!obj)
+        return LDB_ERR_ARG;
 
-            if (ldb_read_record_dat(dat_fd, aux.pos, &record_dat, true) != LDB_OK)
-                exit_function(LDB_ERR_FMT_IDX);
+    obj->force_fsync = fsync;
 
-            if (aux.seqnum != record_dat.seqnum || aux.timestamp != record_dat.timestamp)
-                exit_function(LDB_ERR_FMT_IDX);
+    for (size_t i = 0; i < obj->num_segments; i++)
+        ldb_set_fsync(obj->segments[i].journal, fsync);
 
-            record_n = aux;
-        }
-    }
-    else
-    {
-        // search last valid position
-        long rem = ((long) len - (long) sizeof(ldb_header_idx_t)) % (int) sizeof(ldb_record_idx_t);
+    return LDB_OK;
+}
 
-        pos = len - (size_t)(rem);
+int ldb_seg_append(ldb_segments_impl_t *obj, ldb_entry_t *entries, size_t len, size_t *num)
+{
+    if (num != NULL)
+        *num = 0;
 
-        // move backwards until last record distinct than 0 (not rolled back)
-        while (pos > sizeof(ldb_header_idx_t))
-        {
-            off_t new_pos = (off_t)(pos - sizeof(ldb_record_idx_t));
+    if (!obj || !entries)
+        return LDB_ERR_ARG;
+
+    if (!ldb_seg_is_valid_obj(obj))
+        return LDB_ERR;
 
-            if (pread(idx_fd, &record_n, sizeof(ldb_record_idx_t), new_pos) != (ssize_t) sizeof(ldb_record_idx_t)) 
-                exit_function(LDB_ERR_READ_IDX);
+    int ret = LDB_OK;
+    size_t total = 0;
 
-            if (record_n.seqnum != 0)
+    while (total < len)
+    {
+        ldb_impl_t *journal = obj->segments[obj->num_segments - 1].journal;
+        ldb_state_t state = journal->state;
+        size_t count = (state.seqnum1 == 0 ? 0 : state.seqnum2 - state.seqnum1 + 1);
+        size_t n = len - total;
+        size_t k = 0;
+
+        if (count > 0 && ((obj->max_entries && count >= obj->max_entries) || (obj->max_bytes && journal->dat_end >= obj->max_bytes))) {
+            if ((ret = ldb_seg_roll(obj)) != LDB_OK)
                 break;
-
-            pos -= sizeof(ldb_record_idx_t);
+            continue;
         }
-    }
 
-    // at this point pos is just after the last record distinct than 0
-    if (!ldb_zeroize(obj->idx_fp, pos))
-        exit_function(LDB_ERR_WRITE_IDX);
+        if (obj->max_entries)
+            n = ldb_min(n, obj->max_entries - count);
 
-    // case idx with no records
-    if (record_0.seqnum == 0)
-    {
-        // adding first dat record (if any)
-        if (obj->state.seqnum1 != 0)
+        // first entry of a new segment follows the previous segment
+        if (count == 0 && obj->num_segments > 1)
         {
-            record_0.seqnum = obj->state.seqnum1;
-            record_0.timestamp = obj->state.timestamp1;
-            record_0.pos = sizeof(ldb_header_dat_t);
+            ldb_state_t prev = obj->segments[obj->num_segments - 2].journal->state;
+            ldb_entry_t *entry = &entries[total];
 
-            obj->state.seqnum2 = obj->state.seqnum1;
-            obj->state.timestamp2 = obj->state.timestamp1;
+            if (entry->seqnum == 0)
+                entry->seqnum = prev.seqnum2 + 1;
 
-            if ((ret = ldb_append_record_idx(obj, &obj->state, &record_0)) != LDB_OK)
-                exit_function(ret);
+            if (entry->timestamp == 0) 
+                entry->timestamp = ldb_max(ldb_get_millis(), prev.timestamp2);
 
-            record_n = record_0;
+            if (entry->seqnum != prev.seqnum2 + 1) {
+                ret = LDB_ERR_ENTRY_SEQNUM;
+                break;
+            }
+
+            if (entry->timestamp < prev.timestamp2) {
+                ret = LDB_ERR_ENTRY_TIMESTAMP;
+                break;
+            }
         }
+
+        ret = ldb_append(journal, entries + total, n, &k);
+        total += k;
+
+        if (ret != LDB_OK)
+            break;
     }
-    else
-    {
-        // check record_n content
-        size_t diff = record_n.seqnum - record_0.seqnum;
 
-        if (record_n.seqnum < record_0.seqnum || record_n.timestamp < record_0.timestamp)
-            exit_function(LDB_ERR_FMT_IDX);
+    if (num != NULL)
+        *num = total;
 
-        if (pos != sizeof(ldb_header_idx_t) + (diff + 1) * sizeof(ldb_record_idx_t))
-            exit_function(LDB_ERR_FMT_IDX);
+    return ret;
+}
 
-        if (record_n.pos < sizeof(ldb_header_dat_t) + diff * sizeof(ldb_record_dat_t))
-            exit_function(LDB_ERR_FMT_IDX);
+int ldb_seg_read(ldb_segments_impl_t *obj, uint64_t seqnum, ldb_entry_t *entries, size_t len, char *buf, size_t buf_len, size_t *num)
+{
+    if (num != NULL)
+        *num = 0;
 
-        obj->state.seqnum2 = record_n.seqnum;
-        obj->state.timestamp2 = record_n.timestamp;
-    }
+    if (!obj || !entries || len == 0 || !buf || buf_len < sizeof(ldb_record_dat_t))
+        return LDB_ERR_ARG;
 
-    // case no data
-    if (obj->state.seqnum1 == 0) {
-        obj->dat_end = sizeof(ldb_header_dat_t);
-        goto LDB_OPEN_FILE_IDX_END;
-    }
+    pthread_rwlock_rdlock(&obj->rwlock_segments);
 
-    // read last record (dat)
-    pos = record_n.pos;
-    len = ldb_get_file_size(obj->dat_fp);
+    int ret = LDB_OK;
+    size_t total = 0;
+    size_t n = 0;
 
-    if (ldb_read_record_dat(dat_fd, pos, &record_dat, true) != LDB_OK)
-        exit_function(LDB_ERR_FMT_IDX);
+    if (!ldb_seg_is_valid_obj(obj)) {
+        pthread_rwlock_unlock(&obj->rwlock_segments);
+        return LDB_ERR;
+    }
 
-    if (record_dat.seqnum != record_n.seqnum || record_dat.timestamp != record_n.timestamp)
-        exit_function(LDB_ERR_FMT_IDX);
+    for (size_t i = ldb_seg_find(obj, seqnum); i < obj->num_segments; i++)
+    {
+        ret = ldb_read(obj->segments[i].journal, seqnum, entries + total, len - total, buf, buf_len, &n);
 
-    pos += sizeof(ldb_record_dat_t) + record_dat.data_len + ldb_padding(record_dat.data_len);
+        // not found in the next segment means end of journal
+        if (ret == LDB_ERR_NOT_FOUND && total > 0)
+            ret = LDB_OK;
 
-    obj->dat_end = pos;
+        if (ret != LDB_OK || n == 0)
+            break;
 
-    // add unflushed dat records (if any)
-    while (pos + sizeof(ldb_record_dat_t) <= len)
-    {
-        ret = ldb_read_record_dat(dat_fd, pos, &record_dat, true);
+        total += n;
 
-        if (ret == LDB_ERR_FMT_DAT)
-            break; // zeroize
+        // done or buffer exhausted
+        if (total == len || entries[total].seqnum != 0)
+            break;
 
-        if (ret != LDB_OK)
-            exit_function(ret);
+        // remaining buffer after the last entry (aligned)
+        const ldb_entry_t *last = &entries[total - 1];
+        size_t used = (size_t)((char *) last->data - buf) + last->data_len + ldb_padding(last->data_len);
+
+        seqnum = last->seqnum + 1;
+        buf += used;
+        buf_len -= used;
+
+        if (buf_len < sizeof(ldb_record_dat_t)) {
+            // signals that buffer is exhausted (see ldb_read)
+            if (i + 1 < obj->num_segments) {
+                ldb_state_t state;
+                ldb_get_state(obj->segments[i + 1].journal, &state);
+                entries[total].seqnum = (state.seqnum1 == seqnum ? seqnum : 0);
+            }
+            break;
+        }
+    }
 
-        if (record_dat.seqnum == 0)
-            break; // zeroize
+    pthread_rwlock_unlock(&obj->rwlock_segments);
 
-        if (record_dat.seqnum != obj->state.seqnum2 + 1 || record_dat.timestamp < obj->state.timestamp2)
-            exit_function(LDB_ERR_FMT_DAT);
+    if (num != NULL)
+        *num = total;
 
-        record_n.seqnum = record_dat.seqnum;
-        record_n.timestamp = record_dat.timestamp;
-        record_n.pos = pos;
+    return ret;
+}
 
-        size_t rec_len = sizeof(ldb_record_dat_t) + record_dat.data_len + ldb_padding(record_dat.data_len);
-        if (pos + rec_len > len)
-            break; // zeroize
+int ldb_seg_stats(ldb_segments_impl_t *obj, uint64_t seqnum1, uint64_t seqnum2, ldb_stats_t *stats)
+{
+    if (!obj || seqnum2 < seqnum1 || !stats)
+        return LDB_ERR_ARG;
 
-        pos += rec_len;
+    memset(stats, 0x00, sizeof(ldb_stats_t));
 
-        obj->state.seqnum2 = record_dat.seqnum;
-        obj->state.timestamp2 = record_dat.timestamp;
-        obj->dat_end = pos;
+    pthread_rwlock_rdlock(&obj->rwlock_segments);
 
-        if ((ret = ldb_append_record_idx(obj, &obj->state, &record_n)) != LDB_OK)
-            exit_function(ret);
+    int ret = LDB_OK;
+    ldb_stats_t aux = {0};
 
-        assert(obj->dat_end == pos);
+    if (!ldb_seg_is_valid_obj(obj)) {
+        pthread_rwlock_unlock(&obj->rwlock_segments);
+        return LDB_ERR;
     }
 
-    if (fflush(obj->idx_fp) != 0)
-        exit_function(LDB_ERR_WRITE_IDX);
+    for (size_t i = ldb_seg_find(obj, seqnum1); i < obj->num_segments; i++)
+    {
+        if ((ret = ldb_stats(obj->segments[i].journal, seqnum1, seqnum2, &aux)) != LDB_OK)
+            break;
 
-    if (!ldb_zeroize(obj->dat_fp, pos))
-        exit_function(LDB_ERR_WRITE_DAT);
+        if (aux.num_entries == 0)
+            break;
 
-LDB_OPEN_FILE_IDX_END:
-    if (fseek(obj->idx_fp, 0, SEEK_END) == -1)
-        exit_function(LDB_ERR_WRITE_DAT);
-    return LDB_OK;
+        if (stats->num_entries == 0) {
+            stats->min_seqnum = aux.min_seqnum;
+            stats->min_timestamp = aux.min_timestamp;
+        }
+
+        stats->max_seqnum = aux.max_seqnum;
+        stats->max_timestamp = aux.max_timestamp;
+        stats->num_entries += aux.num_entries;
+        stats->data_size += aux.data_size;
+        stats->index_size += aux.index_size;
+    }
+
+    pthread_rwlock_unlock(&obj->rwlock_segments);
 
-LDB_OPEN_FILE_IDX_ERR:
-    if (obj->idx_fp != NULL) fclose(obj->idx_fp);
-    obj->idx_fp = NULL;
     return ret;
 }
 
-#undef exit_function
-
-const char * ldb_version(void)
+int ldb_seg_search(ldb_segments_impl_t *obj, uint64_t timestamp, ldb_search_e mode, uint64_t *seqnum)
 {
-    static char version_str[32] = {0};
+    if (!obj || !seqnum || (mode != LDB_SEARCH_LOWER && mode != LDB_SEARCH_UPPER))
+        return LDB_ERR_ARG;
 
-    if (version_str[0] == 0) {
-        snprintf(version_str, sizeof(version_str), "%d.%d.%d", 
-                LDB_VERSION_MAJOR, LDB_VERSION_MINOR, LDB_VERSION_PATCH);
+    *seqnum = 0;
+
+    pthread_rwlock_rdlock(&obj->rwlock_segments);
+
+    int ret = LDB_ERR;
+
+    if (ldb_seg_is_valid_obj(obj)) {
+        size_t i = ldb_seg_find_timestamp(obj, timestamp, mode);
+        ret = ldb_search(obj->segments[i].journal, timestamp, mode, seqnum);
     }
 
-    return version_str;
-}
+    pthread_rwlock_unlock(&obj->rwlock_segments);
 
-#define exit_function(errnum) do { ret = errnum; goto LDB_OPEN_ERR; } while(0)
+    return ret;
+}
 
-int ldb_open(ldb_impl_t *obj, const char *path, const char *name, bool check)
+long ldb_seg_rollback(ldb_segments_impl_t *obj, uint64_t seqnum)
 {
-    if (path == NULL || name == NULL || obj == NULL)
+    if (!obj)
         return LDB_ERR_ARG;
 
-    if (!ldb_is_valid_path(path))
-        return LDB_ERR_PATH;
-
-    if (!ldb_is_valid_name(name))
-        return  LDB_ERR_NAME;
+    if (!ldb_seg_is_valid_obj(obj))
+        return LDB_ERR;
 
-    int ret = LDB_OK;
+    long ret = 0;
+    long removed = 0;
+    ldb_state_t state;
 
-    memset(obj, 0x00, sizeof(ldb_impl_t));
+    // whole segments removed (first segment is preserved)
+    while (obj->num_segments > 1)
+    {
+        ldb_segment_t *segment = &obj->segments[obj->num_segments - 1];
 
-    obj->name = strdup(name);
-    obj->path = strdup(path);
-    obj->dat_path = ldb_create_filename(path, name, LDB_EXT_DAT);
-    obj->idx_path = ldb_create_filename(path, name, LDB_EXT_IDX);
+        ldb_get_state(segment->journal, &state);
 
-    if (!obj->name || !obj->path || !obj->dat_path || !obj->idx_path)
-        exit_function(LDB_ERR_MEM);
+        if (state.seqnum1 != 0 && state.seqnum1 <= seqnum)
+            break;
 
-    obj->force_fsync = false;
-    obj->dat_end = sizeof(ldb_header_dat_t);
-    pthread_mutex_init(&obj->mutex_state, NULL);
-    pthread_mutex_init(&obj->mutex_files, NULL);
+        removed += (state.seqnum1 == 0 ? 0 : (long)(state.seqnum2 - state.seqnum1 + 1));
 
-    // case dat file not exist
-    if (access(obj->dat_path, F_OK) != 0)
-    {
-        remove(obj->idx_path);
+        pthread_rwlock_wrlock(&obj->rwlock_segments);
+        obj->num_segments--;
+        pthread_rwlock_unlock(&obj->rwlock_segments);
 
-        if (!ldb_create_file_dat(obj->dat_path))
-            exit_function(LDB_ERR_OPEN_DAT);
+        ldb_seg_remove_segment(segment);
     }
 
-    // case idx file not exist
-    if (access(obj->idx_path, F_OK) != 0)
-    {
-        if (!ldb_create_file_idx(obj->idx_path))
-            exit_function(LDB_ERR_OPEN_IDX);
-    }
+    ret = ldb_rollback(obj->segments[obj->num_segments - 1].journal, seqnum);
 
-    // open data file
-    if ((ret = ldb_open_file_dat(obj, check)) != LDB_OK)
-        exit_function(ret);
+    return (ret < 0 ? ret : ret + removed);
+}
 
-    // open index file
-    ret = ldb_open_file_idx(obj, check);
-    switch(ret)
+long ldb_seg_purge(ldb_segments_impl_t *obj, uint64_t seqnum)
+{
+    if (!obj)
+        return LDB_ERR_ARG;
+
+    if (!ldb_seg_is_valid_obj(obj))
+        return LDB_ERR;
+
+    long ret = 0;
+    long removed = 0;
+    size_t num = 0;
+    ldb_state_t state;
+
+    // whole segments removed (last segment is preserved)
+    while (num + 1 < obj->num_segments)
     {
-        case LDB_OK:
-            break;
-        case LDB_ERR_OPEN_IDX:
-        case LDB_ERR_READ_IDX:
-        case LDB_ERR_WRITE_IDX:
-        case LDB_ERR_FMT_IDX:
-            // try to rebuild the index file
-            remove(obj->idx_path);
-            if (!ldb_create_file_idx(obj->idx_path))
-                exit_function(LDB_ERR_OPEN_IDX);
-            if ((ret = ldb_open_file_idx(obj, true)) != LDB_OK)
-                exit_function(ret);
+        ldb_get_state(obj->segments[num].journal, &state);
+
+        if (state.seqnum1 == 0 || seqnum <= state.seqnum2)
             break;
-        default:
-            exit_function(ret);
+
+        removed += (long)(state.seqnum2 - state.seqnum1 + 1);
+        num++;
     }
 
-    assert(!feof(obj->dat_fp));
-    assert(!feof(obj->idx_fp));
-    assert(!ferror(obj->dat_fp));
-    assert(!ferror(obj->idx_fp));
+    if (num > 0)
+    {
+        ldb_segment_t *segments = (ldb_segment_t *) malloc(num * sizeof(ldb_segment_t));
 
-    return LDB_OK;
+        if (segments == NULL)
+            return LDB_ERR_MEM;
+
+        pthread_rwlock_wrlock(&obj->rwlock_segments);
+        memcpy(segments, obj->segments, num * sizeof(ldb_segment_t));
+        memmove(obj->segments, obj->segments + num, (obj->num_segments - num) * sizeof(ldb_segment_t));
+        obj->num_segments -= num;
+        pthread_rwlock_unlock(&obj->rwlock_segments);
+
+        // files removed without blocking readers
+        for (size_t i = 0; i < num; i++)
+            ldb_seg_remove_segment(&segments[i]);
+
+        free(segments);
+    }
+
+    // at most one partial segment
+    pthread_rwlock_rdlock(&obj->rwlock_segments);
+    ret = ldb_purge(obj->segments[0].journal, seqnum);
+    pthread_rwlock_unlock(&obj->rwlock_segments);
 
-LDB_OPEN_ERR:
-    ldb_close(obj);
-    return ret;
+    return (ret < 0 ? ret : ret + removed);
 }
 
-#undef exit_function
+/* ---------------------------------------------------------------------- */
+/* Cursor                                                                 */
+/* ---------------------------------------------------------------------- */
 
-int ldb_append(ldb_impl_t *obj, ldb_entry_t *entries, size_t len, size_t *num)
+#define LDB_CURSOR_BUFSIZE      (256 * 1024)
+
+typedef struct ldb_cursor_impl_t
 {
-    if (num != NULL)
-        *num = 0;
+    ldb_impl_t *journal;          // Journal being read (NULL means closed)
+    uint64_t seqnum;              // Next seqnum to return (0 = first available)
+    uint64_t epoch;               // Journal epoch when buffer was filled
+    char *buf;                    // Readahead buffer (dat file content)
+    size_t buf_len;               // Allocated buffer length
+    size_t buf_size;              // Bytes read into buffer
+    size_t buf_pos;               // Dat file position of buf[0]
+    size_t offset;                // Buffer offset of the next record
+    uint64_t buf_seqnum2;         // Last published seqnum when buffer was filled (0 = buffer empty)
+    ldb_record_dat_t prev;        // Last returned record (implied values of dense records)
+    size_t batch_pos;             // Position of the last verified batch (0 = none)
+    char *out;                    // Decompressed data of the last returned entry
+    size_t out_len;               // Allocated out length
+} ldb_cursor_impl_t;
+
+ldb_cursor_t * ldb_cursor_alloc(void) {
+    return (ldb_cursor_t *) calloc(1, sizeof(ldb_cursor_impl_t));
+}
 
-    if (!obj || !entries)
+void ldb_cursor_free(ldb_cursor_t *cursor) {
+    free(cursor);
+}
+
+int ldb_cursor_open(ldb_cursor_impl_t *cursor, ldb_journal_t *obj, uint64_t seqnum)
+{
+    if (!cursor || !obj)
         return LDB_ERR_ARG;
 
     if (!ldb_is_valid_obj(obj))
         return LDB_ERR;
 
-    if (len == 0)
-        return LDB_OK;
+    memset(cursor, 0x00, sizeof(ldb_cursor_impl_t));
+
+    cursor->buf = (char *) malloc(LDB_CURSOR_BUFSIZE);
+
+    if (cursor->buf == NULL)
+        return LDB_ERR_MEM;
+
+    cursor->journal = obj;
+    cursor->seqnum = seqnum;
+    cursor->buf_len = LDB_CURSOR_BUFSIZE;
+
+    return LDB_OK;
+}
+
+int ldb_cursor_open_timestamp(ldb_cursor_impl_t *cursor, ldb_journal_t *obj, uint64_t timestamp, ldb_search_e mode)
+{
+    if (!cursor || !obj)
+        return LDB_ERR_ARG;
 
-    size_t i;
     int ret = LDB_OK;
-    ldb_state_t state;
+    uint64_t seqnum = 0;
 
-    pthread_mutex_lock(&obj->mutex_state);
-    state = obj->state;
-    pthread_mutex_unlock(&obj->mutex_state);
+    if ((ret = ldb_search(obj, timestamp, mode, &seqnum)) != LDB_OK)
+        return ret;
+
+    return ldb_cursor_open(cursor, obj, seqnum);
+}
+
+int ldb_cursor_close(ldb_cursor_impl_t *cursor)
+{
+    if (!cursor)
+        return LDB_OK;
+
+    free(cursor->buf);
+    free(cursor->out);
+    memset(cursor, 0x00, sizeof(ldb_cursor_impl_t));
+
+    return LDB_OK;
+}
+
+// Fills the buffer starting at pos (record seqnum).
+// idx is the idx record at pos (NULL = record following cursor->prev).
+// Buffer is grown when the record does not fit.
+static int ldb_cursor_fill(ldb_cursor_impl_t *cursor, size_t pos, const ldb_record_idx_t *idx, const ldb_state_t *state)
+{
+    ldb_impl_t *obj = cursor->journal;
+    int dat_fd = fileno(obj->dat_fp);
+    ldb_record_dat_t record = {0};
+    size_t header_len = 0;
+    ssize_t rc = 0;
 
-    for (i = 0; i < len; i++)
+    cursor->buf_seqnum2 = 0;
+
+    while (true)
     {
-        if (entries[i].seqnum == 0)
-            entries[i].seqnum = state.seqnum2 + 1;
+        uint64_t t0 = ldb_metrics_now(obj);
 
-        if (entries[i].timestamp == 0) 
-            entries[i].timestamp = ldb_max(ldb_get_millis(), state.timestamp2);
+        rc = ldb_pread(dat_fd, &obj->dat_map, cursor->buf, cursor->buf_len, pos);
 
-        ldb_record_idx_t record_idx = {
-            .seqnum = entries[i].seqnum,
-            .timestamp = entries[i].timestamp,
-            .pos = obj->dat_end
-        };
+        if (rc == -1)
+            return LDB_ERR_READ_DAT;
 
-        if ((ret = ldb_append_entry_dat(obj, &state, &entries[i])) != LDB_OK)
-            break;
+        ldb_metrics_time(obj, &obj->metrics.read_dat, t0);
+        ldb_metrics_add(obj, &obj->metrics.bytes_read, (uint64_t) rc);
 
-        if ((ret = ldb_append_record_idx(obj, &state, &record_idx)) != LDB_OK)
-            break;
+        if ((header_len = ldb_decode_record_dat(obj->format, cursor->buf, (size_t) rc, &cursor->prev, idx, &record)) == 0)
+            return LDB_ERR_FMT_DAT;
 
-        if (num != NULL)
-            (*num)++;
-    }
+        if (record.seqnum != cursor->seqnum)
+            return LDB_ERR_FMT_DAT;
 
-    if (i == 0)
-        return ret;
+        size_t rec_len = ldb_record_len(obj->format, header_len, record.data_len);
 
-    if (fflush(obj->dat_fp) != 0)
-        ret = (ret == LDB_OK ? LDB_ERR_WRITE_DAT : ret);
+        if (rec_len <= (size_t) rc)
+            break;
 
-    if (fflush(obj->idx_fp) != 0)
-        ret = (ret == LDB_OK ? LDB_ERR_WRITE_IDX : ret);
+        if (rec_len <= cursor->buf_len)
+            return LDB_ERR_FMT_DAT;
 
-    if (obj->force_fsync && fdatasync(fileno(obj->dat_fp)) == -1)
-        ret = (ret == LDB_OK ? LDB_ERR_WRITE_DAT : ret);
+        // oversized record
+        char *aux = (char *) realloc(cursor->buf, rec_len);
 
-    pthread_mutex_lock(&obj->mutex_state);
-    obj->state = state;
-    pthread_mutex_unlock(&obj->mutex_state);
+        if (aux == NULL)
+            return LDB_ERR_MEM;
 
-    return ret;
+        cursor->buf = aux;
+        cursor->buf_len = rec_len;
+    }
+
+    cursor->buf_size = (size_t) rc;
+    cursor->buf_pos = pos;
+    cursor->offset = 0;
+    cursor->epoch = obj->epoch;
+    cursor->buf_seqnum2 = state->seqnum2;
+
+    return LDB_OK;
 }
 
-#define exit_function(errnum) do { ret = errnum; goto LDB_READ_END; } while(0)
+#define exit_function(errnum) do { ret = errnum; goto LDB_CURSOR_NEXT_END; } while(0)
 
-int ldb_read(ldb_journal_t *obj, uint64_t seqnum, ldb_entry_t *entries, size_t len, char *buf, size_t buf_len, size_t *num)
+int ldb_cursor_next(ldb_cursor_impl_t *cursor, ldb_entry_t *entry)
 {
-    if (num != NULL)
-        *num = 0;
-
-    if (!obj || !entries || len == 0 || !buf || buf_len < sizeof(ldb_record_dat_t))
+    if (!cursor || !entry)
         return LDB_ERR_ARG;
 
-    for (size_t i = 0; i < len; i++) {
-        entries[i].seqnum = 0;
-        entries[i].timestamp = 0;
-        entries[i].data_len = 0;
-        entries[i].data = NULL;
-    }
-
-    pthread_mutex_lock(&obj->mutex_files);
+    if (!cursor->journal)
+        return LDB_ERR;
 
-    int ret = LDB_ERR;
-    int dat_fd = -1;
-    int idx_fd = -1;
-    uint64_t read_pos = 0;
-    uint64_t read_bytes = 0;
+    ldb_impl_t *obj = cursor->journal;
+    int ret = LDB_OK;
     ldb_state_t state = {0};
+    ldb_record_dat_t record = {0};
     ldb_record_idx_t record_idx = {0};
-    const ldb_record_dat_t *record_dat_ptr = NULL;
-    size_t padding = 0;
-    ssize_t bytes = 0;
-    uint64_t seq = 0;
-    size_t idx = 0;
+    ldb_batch_t batch = {0};
+    const ldb_record_idx_t *hint = NULL;
+    size_t header_len = 0;
+    size_t rec_len = 0;
+    size_t pos = 0;
+    const char *ptr = NULL;
+
+    memset(entry, 0x00, sizeof(ldb_entry_t));
+
+    ldb_lock_files(obj, false);
 
     if (!ldb_is_valid_obj(obj))
         exit_function(LDB_ERR);
 
-    dat_fd = fileno(obj->dat_fp);
-    idx_fd = fileno(obj->idx_fp);
+    ldb_get_state(obj, &state);
 
-    pthread_mutex_lock(&obj->mutex_state);
-    state = obj->state;
-    pthread_mutex_unlock(&obj->mutex_state);
+    if (cursor->seqnum == 0)
+        cursor->seqnum = state.seqnum1;
 
-    if (seqnum == 0 || seqnum < state.seqnum1 || seqnum > state.seqnum2)
+    if (state.seqnum1 == 0 || cursor->seqnum < state.seqnum1 || state.seqnum2 < cursor->seqnum)
         exit_function(LDB_ERR_NOT_FOUND);
 
-    if ((ret = ldb_read_record_idx(idx_fd, &state, seqnum, &record_idx)) != LDB_OK)
-        exit_function(ret);
-
-    read_pos = record_idx.pos;
-
-    if (seqnum + len <= state.seqnum2)
-    {
-        if ((ret = ldb_read_record_idx(idx_fd, &state, seqnum + len, &record_idx)) != LDB_OK)
-            exit_function(ret);
-
-        assert(record_idx.pos > read_pos);
-        read_bytes = ldb_min(record_idx.pos - read_pos, buf_len);
+    // buffer invalidated by rollback or purge
+    if (cursor->epoch != obj->epoch) {
+        cursor->buf_seqnum2 = 0;
+        cursor->batch_pos = 0;
     }
+
+    // content beyond buf_seqnum2 can be incomplete
+    if (cursor->buf_seqnum2 < cursor->seqnum || cursor->offset >= cursor->buf_size)
+        cursor->buf_seqnum2 = 0;
     else
     {
-        read_bytes = buf_len;
-    }
-
-    bytes = pread(dat_fd, buf, read_bytes, (off_t) read_pos);
-
-    if (bytes < (ssize_t) sizeof(ldb_record_dat_t))
-        return LDB_ERR_READ_DAT;
+        header_len = ldb_decode_header_dat(obj->format, cursor->buf + cursor->offset, cursor->buf_size - cursor->offset, &cursor->prev, NULL, &record, &batch);
+        rec_len = ldb_record_len(obj->format, header_len, record.data_len);
 
-    seq = seqnum - 1;
+        if (header_len == 0 || record.seqnum != cursor->seqnum || cursor->offset + rec_len > cursor->buf_size)
+            cursor->buf_seqnum2 = 0;
+    }
 
-    while (idx < len && seq < state.seqnum2)
+    if (cursor->buf_seqnum2 == 0)
     {
-        if (bytes < (ssize_t) sizeof(ldb_record_dat_t))
+        pos = cursor->buf_pos + cursor->offset;
+
+        // position unknown (first read or content changed)
+        if (cursor->buf_pos == 0 || cursor->epoch != obj->epoch)
         {
-            // In this skewed case (buffer overflow and read() ending in the 
-            // middle of a record), we invalidate the previous entry (that 
-            // was succesfully read). This avoid us from doing an additional
-            // reading and allows us to notify the caller that the buffer
-            // is too small.
+            if ((ret = ldb_read_record_idx(obj, &state, cursor->seqnum, &record_idx)) != LDB_OK)
+                exit_function(ret);
 
-            assert(idx > 0);
-            entries[idx - 1].data = NULL;
-            idx--;
-            break;
+            pos = record_idx.pos;
+            hint = &record_idx;
         }
 
-        record_dat_ptr = (ldb_record_dat_t *) buf;
+        if ((ret = ldb_cursor_fill(cursor, pos, hint, &state)) != LDB_OK) {
+            cursor->buf_pos = 0;
+            exit_function(ret);
+        }
 
-        assert(seq + 1 == record_dat_ptr->seqnum);
+        header_len = ldb_decode_header_dat(obj->format, cursor->buf, cursor->buf_size, &cursor->prev, hint, &record, &batch);
+        rec_len = ldb_record_len(obj->format, header_len, record.data_len);
+    }
 
-        entries[idx].seqnum = record_dat_ptr->seqnum;
-        entries[idx].timestamp = record_dat_ptr->timestamp;
-        entries[idx].data_len = record_dat_ptr->data_len;
-        entries[idx].data = buf + sizeof(ldb_record_dat_t);
+    ptr = cursor->buf + cursor->offset;
+    pos = cursor->buf_pos + cursor->offset;
 
-        assert(((uintptr_t) entries[idx].data) % sizeof(uintptr_t) == 0);
+    entry->seqnum = record.seqnum;
+    entry->timestamp = record.timestamp;
+    entry->data_len = (uint32_t) ldb_stored_len(record.data_len);
+    entry->data = (void *) (ptr + header_len);
 
-        buf += sizeof(ldb_record_dat_t);
-        bytes -= (ssize_t) sizeof(ldb_record_dat_t);
+    cursor->offset += rec_len;
+    cursor->seqnum++;
+    cursor->prev = record;
 
-        if (bytes < (ssize_t) record_dat_ptr->data_len) {
-            entries[idx].data = NULL;
-            break;
-        }
+    if (obj->verify_checksum && obj->format == LDB_FILE_FORMAT_BATCH) {
+        if ((ret = ldb_check_batch_record(fileno(obj->dat_fp), &obj->dat_map, pos, batch.back, &cursor->batch_pos, cursor->buf, cursor->buf_pos, cursor->buf_size)) != LDB_OK)
+            exit_function(ret);
+    }
+    else if (obj->verify_checksum && !ldb_is_valid_checksum(&record, ptr + header_len))
+        exit_function(LDB_ERR_CHECKSUM);
 
-        buf += record_dat_ptr->data_len;
-        bytes -= record_dat_ptr->data_len;
+    if (record.data_len & LDB_DATA_COMPRESSED)
+    {
+        size_t stored_len = ldb_stored_len(record.data_len);
+        uint32_t data_len = 0;
 
-        padding = ldb_min(ldb_padding(record_dat_ptr->data_len), (size_t) bytes);
+        if (stored_len < sizeof(uint32_t))
+            exit_function(LDB_ERR_CHECKSUM);
 
-        buf += padding;
-        bytes -= (ssize_t) padding;
+        memcpy(&data_len, entry->data, sizeof(uint32_t));
 
-        seq = record_dat_ptr->seqnum;
-        idx++;
-    }
+        if (data_len > cursor->out_len)
+        {
+            char *aux = (char *) realloc(cursor->out, data_len);
 
-    if (num != NULL)
-        *num = idx;
+            if (aux == NULL)
+                exit_function(LDB_ERR_MEM);
 
-    // TODO: validate checksum?
+            cursor->out = aux;
+            cursor->out_len = data_len;
+        }
 
-    ret = LDB_OK;
+        if (!ldb_lz_decompress((const char *) entry->data + sizeof(uint32_t), stored_len - sizeof(uint32_t), cursor->out, data_len))
+            exit_function(LDB_ERR_CHECKSUM);
 
-LDB_READ_END:
-    pthread_mutex_unlock(&obj->mutex_files);
+        entry->data_len = data_len;
+        entry->data = cursor->out;
+    }
+
+LDB_CURSOR_NEXT_END:
+    pthread_rwlock_unlock(&obj->rwlock_files);
     return ret;
 }
 
 #undef exit_function
-#define exit_function(errnum) do { ret = errnum; goto LDB_STATS_END; } while(0)
 
-int ldb_stats(ldb_impl_t *obj, uint64_t seqnum1, uint64_t seqnum2, ldb_stats_t *stats)
+int ldb_scan_time(ldb_journal_t *obj, uint64_t timestamp1, uint64_t timestamp2, ldb_scan_cb callback, void *ctx, size_t *num)
 {
-    if (!obj || seqnum2 < seqnum1 || !stats)
+    if (num != NULL)
+        *num = 0;
+
+    if (!obj || !callback || timestamp1 > timestamp2)
         return LDB_ERR_ARG;
 
-    memset(stats, 0x00, sizeof(ldb_stats_t));
+    ldb_cursor_impl_t cursor = {0};
+    ldb_entry_t entry = {0};
+    uint64_t seqnum = 0;
+    size_t count = 0;
+    int ret = LDB_OK;
 
-    pthread_mutex_lock(&obj->mutex_files);
+    // lower bound only, scan ends at the first entry after timestamp2
+    if ((ret = ldb_search(obj, timestamp1, LDB_SEARCH_LOWER, &seqnum)) != LDB_OK)
+        return (ret == LDB_ERR_NOT_FOUND ? LDB_OK : ret);
 
-    int ret = LDB_ERR;
-    int dat_fd = -1;
-    int idx_fd = -1;
-    ldb_state_t state;
-    ldb_record_idx_t record1 = {0};
-    ldb_record_idx_t record2 = {0};
-    ldb_record_dat_t record_dat = {0};
+    if ((ret = ldb_cursor_open(&cursor, obj, seqnum)) != LDB_OK)
+        return ret;
 
-    if (!ldb_is_valid_obj(obj))
-        exit_function(LDB_ERR);
+    while ((ret = ldb_cursor_next(&cursor, &entry)) == LDB_OK)
+    {
+        if (entry.timestamp > timestamp2)
+            break;
 
-    dat_fd = fileno(obj->dat_fp);
-    idx_fd = fileno(obj->idx_fp);
+        count++;
 
-    pthread_mutex_lock(&obj->mutex_state);
-    state = obj->state;
-    pthread_mutex_unlock(&obj->mutex_state);
+        if (!callback(ctx, &entry))
+            break;
+    }
 
-    if (state.seqnum1 == 0 || seqnum2 < state.seqnum1 || state.seqnum2 < seqnum1)
-        exit_function(LDB_OK);
+    ldb_cursor_close(&cursor);
 
-    seqnum1 = ldb_clamp(seqnum1, state.seqnum1, state.seqnum2);
-    seqnum2 = ldb_clamp(seqnum2, state.seqnum1, state.seqnum2);
+    if (num != NULL)
+        *num = count;
 
-    if ((ret = ldb_read_record_idx(idx_fd, &state, seqnum1, &record1)) != LDB_OK)
-        exit_function(ret);
+    return (ret == LDB_ERR_NOT_FOUND ? LDB_OK : ret);
+}
 
-    if ((ret = ldb_read_record_idx(idx_fd, &state, seqnum2, &record2)) != LDB_OK)
-        exit_function(ret);
+/* ---------------------------------------------------------------------- */
+/* Asynchronous reads                                                     */
+/* ---------------------------------------------------------------------- */
+
+typedef struct ldb_async_request_t {
+    ldb_impl_t *journal;          // Journal to read
+    uint64_t seqnum;              // Initial sequence number
+    ldb_entry_t *entries;         // Entries to fill (owned by the submitter)
+    size_t len;                   // Number of entries
+    char *buf;                    // Buffer to fill (owned by the submitter)
+    size_t buf_len;               // Buffer length
+    ldb_read_cb callback;         // Called when read is done
+    void *ctx;                    // Callback argument
+    struct ldb_async_request_t *next; // Next request in queue
+} ldb_async_request_t;
+
+typedef struct ldb_async_impl_t
+{
+    pthread_t *threads;           // Worker threads
+    size_t num_threads;           // Number of worker threads (0 = closed)
+    pthread_mutex_t mutex;        // Protects queue values
+    pthread_cond_t cond;          // Signaled when a request is queued or pool is closed
+    ldb_async_request_t *head;    // First queued request
+    ldb_async_request_t *tail;    // Last queued request
+    size_t queue_len;             // Number of queued requests
+    bool stop;                    // Workers end once queue is empty
+} ldb_async_impl_t;
+
+ldb_async_t * ldb_async_alloc(void) {
+    return (ldb_async_t *) calloc(1, sizeof(ldb_async_impl_t));
+}
 
-    if (record2.pos < record1.pos + (record2.seqnum - record1.seqnum) * sizeof(ldb_record_dat_t))
-        exit_function(LDB_ERR);
+void ldb_async_free(ldb_async_t *pool) {
+    free(pool);
+}
 
-    if ((ret = ldb_read_record_dat(dat_fd, record2.pos, &record_dat, false)) != LDB_OK)
-        exit_function(ret);
+static void * ldb_async_run(void *args)
+{
+    ldb_async_impl_t *pool = (ldb_async_impl_t *) args;
 
-    if (record_dat.seqnum != seqnum2)
-        exit_function(LDB_ERR);
+    pthread_mutex_lock(&pool->mutex);
 
-    stats->min_seqnum = record1.seqnum;
-    stats->min_timestamp = record1.timestamp;
-    stats->max_seqnum = record2.seqnum;
-    stats->max_timestamp = record2.timestamp;
-    stats->num_entries = seqnum2 - seqnum1 + 1;
-    stats->index_size = sizeof(ldb_record_idx_t) * stats->num_entries;
-    stats->data_size = record2.pos - record1.pos + sizeof(ldb_record_dat_t) + record_dat.data_len + ldb_padding(record_dat.data_len);
+    while (true)
+    {
+        while (!pool->head && !pool->stop)
+            pthread_cond_wait(&pool->cond, &pool->mutex);
 
-    ret = LDB_OK;
+        if (!pool->head)
+            break;
 
-LDB_STATS_END:
-    pthread_mutex_unlock(&obj->mutex_files);
-    return ret;
-}
+        ldb_async_request_t *request = pool->head;
 
-#undef exit_function
-#define exit_function(errnum) do { ret = errnum; goto LDB_SEARCH_END; } while(0)
+        pool->head = request->next;
+        pool->tail = (pool->head ? pool->tail : NULL);
+        pool->queue_len--;
 
-int ldb_search(ldb_impl_t *obj, uint64_t timestamp, ldb_search_e mode, uint64_t *seqnum)
-{
-    if (!obj || !seqnum || (mode != LDB_SEARCH_LOWER && mode != LDB_SEARCH_UPPER))
-        return LDB_ERR_ARG;
+        pthread_mutex_unlock(&pool->mutex);
 
-    *seqnum = 0;
+        size_t num = 0;
+        int ret = ldb_read(request->journal, request->seqnum, request->entries, request->len, request->buf, request->buf_len, &num);
 
-    pthread_mutex_lock(&obj->mutex_files);
+        request->callback(request->ctx, ret, num);
+        free(request);
 
-    int ret = LDB_ERR;
-    ldb_state_t state;
-    ldb_record_idx_t record = {0};
-    uint64_t sn1 = 0;
-    uint64_t sn2 = 0;
-    uint64_t ts1 = 0;
-    uint64_t ts2 = 0;
-    int idx_fd = -1;
+        pthread_mutex_lock(&pool->mutex);
+    }
 
-    if (!ldb_is_valid_obj(obj))
-        exit_function(LDB_ERR);
+    pthread_mutex_unlock(&pool->mutex);
 
-    idx_fd = fileno(obj->idx_fp);
+    return NULL;
+}
 
-    pthread_mutex_lock(&obj->mutex_state);
-    state = obj->state;
-    pthread_mutex_unlock(&obj->mutex_state);
+int ldb_async_close(ldb_async_impl_t *pool)
+{
+    if (!pool)
+        return LDB_OK;
 
-    if (state.seqnum1 == 0)
-        exit_function(LDB_ERR_NOT_FOUND);
+    if (pool->num_threads == 0)
+        return LDB_OK;
 
-    if (mode == LDB_SEARCH_LOWER && state.timestamp2 < timestamp)
-        exit_function(LDB_ERR_NOT_FOUND);
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
 
-    if (mode == LDB_SEARCH_UPPER && state.timestamp2 <= timestamp)
-        exit_function(LDB_ERR_NOT_FOUND);
+    for (size_t i = 0; i < pool->num_threads; i++)
+        pthread_join(pool->threads[i], NULL);
 
-    if (mode == LDB_SEARCH_LOWER && timestamp <= state.timestamp1) {
-        *seqnum = state.seqnum1;
-        exit_function(LDB_OK);
-    }
+    assert(pool->head == NULL);
 
-    if (mode == LDB_SEARCH_UPPER && timestamp < state.timestamp1) {
-        *seqnum = state.seqnum1;
-        exit_function(LDB_OK);
-    }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->cond);
+    free(pool->threads);
+    memset(pool, 0x00, sizeof(ldb_async_impl_t));
 
-    sn1 = state.seqnum1;
-    sn2 = state.seqnum2;
-    ts1 = state.timestamp1;
-    ts2 = state.timestamp2;
+    return LDB_OK;
+}
 
-    assert(ts1 <= timestamp && timestamp <= ts2);
+int ldb_async_open(ldb_async_impl_t *pool, size_t num_threads)
+{
+    if (!pool || num_threads == 0)
+        return LDB_ERR_ARG;
 
-    while (sn1 + 1 < sn2 && ts1 != ts2)
-    {
-        uint64_t sn = (sn1 + sn2) / 2;
+    memset(pool, 0x00, sizeof(ldb_async_impl_t));
 
-        if ((ret = ldb_read_record_idx(idx_fd, &state, sn, &record)) != LDB_OK)
-            exit_function(ret);
+    pool->threads = (pthread_t *) calloc(num_threads, sizeof(pthread_t));
 
-        uint64_t ts = record.timestamp;
+    if (pool->threads == NULL)
+        return LDB_ERR_MEM;
 
-        if (ts < timestamp) {
-            sn1 = sn;
-            ts1 = ts;
-        }
-        else if (timestamp < ts || mode == LDB_SEARCH_LOWER) {
-            sn2 = sn;
-            ts2 = ts;
-        }
-        else {
-            sn1 = sn;
-            ts1 = ts;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    for (size_t i = 0; i < num_threads; i++)
+    {
+        if (pthread_create(&pool->threads[i], NULL, ldb_async_run, pool) != 0) {
+            ldb_async_close(pool);
+            return LDB_ERR;
         }
+
+        pool->num_threads++;
+    }
+
+    return LDB_OK;
+}
+
+int ldb_read_async(ldb_async_impl_t *pool, ldb_journal_t *obj, uint64_t seqnum, ldb_entry_t *entries, size_t len, 
+                   char *buf, size_t buf_len, ldb_read_cb callback, void *ctx)
+{
+    if (!pool || !obj || !entries || len == 0 || !buf || buf_len < sizeof(ldb_record_dat_t) || !callback)
+        return LDB_ERR_ARG;
+
+    if (pool->num_threads == 0)
+        return LDB_ERR;
+
+    ldb_async_request_t *request = (ldb_async_request_t *) malloc(sizeof(ldb_async_request_t));
+
+    if (request == NULL)
+        return LDB_ERR_MEM;
+
+    *request = (ldb_async_request_t){
+        .journal = obj,
+        .seqnum = seqnum,
+        .entries = entries,
+        .len = len,
+        .buf = buf,
+        .buf_len = buf_len,
+        .callback = callback,
+        .ctx = ctx,
+        .next = NULL
+    };
+
+    pthread_mutex_lock(&pool->mutex);
+
+    if (pool->stop) {
+        pthread_mutex_unlock(&pool->mutex);
+        free(request);
+        return LDB_ERR;
     }
 
-    *seqnum = sn2;
+    if (pool->tail)
+        pool->tail->next = request;
+    else
+        pool->head = request;
 
-    ret = LDB_OK;
+    pool->tail = request;
+    pool->queue_len++;
 
-LDB_SEARCH_END:
-    pthread_mutex_unlock(&obj->mutex_files);
-    return ret;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    return LDB_OK;
 }
 
-#undef exit_function
-#define exit_function(errnum) do { ret = errnum; goto LDB_ROLLBACK_END; } while(0)
+/* ---------------------------------------------------------------------- */
+/* Journal manager                                                        */
+/* ---------------------------------------------------------------------- */
 
-long ldb_rollback(ldb_impl_t *obj, uint64_t seqnum)
+typedef struct ldb_mgr_journal_t {
+    char *name;                   // Journal name
+    ldb_impl_t *journal;          // Opened journal (NULL = closed)
+    size_t refs;                  // Number of users (acquisitions and pending appends)
+    uint64_t last_use;            // Last acquisition (LRU order)
+    ldb_state_t state;            // State being written (writer thread, current batch)
+    bool written;                 // Entries written in the current batch (writer thread)
+    struct ldb_mgr_journal_t *next; // Next journal written in the current batch (writer thread)
+} ldb_mgr_journal_t;
+
+typedef struct ldb_manager_impl_t
 {
-    if (!obj)
-        return LDB_ERR_ARG;
+    // Fixed data (unchanged)
+    char *path;                   // Directory where files are located
+    size_t max_open;              // Maximum number of opened journals (journals in use are not closed)
+    bool force_fsync;             // Force fsync after flush (applied by the writer thread)
+
+    // Shared data (accessed by all threads)
+    pthread_mutex_t mutex_journals; // Protects journals table and journal opening/closing
+    ldb_mgr_journal_t **journals; // Known journals sorted by name
+    size_t num_journals;          // Number of known journals
+    size_t capacity;              // Allocated journals
+    size_t num_open;              // Number of opened journals
+    uint64_t clock;               // Acquisitions counter
+    ldb_group_t *group;           // Writer thread and queue (NULL means closed)
+
+} ldb_manager_impl_t;
+
+ldb_manager_t * ldb_mgr_alloc(void) {
+    return (ldb_manager_t *) calloc(1, sizeof(ldb_manager_impl_t));
+}
 
-    pthread_mutex_lock(&obj->mutex_files);
+void ldb_mgr_free(ldb_manager_t *obj) {
+    free(obj);
+}
 
-    long ret = LDB_ERR;
-    long removed_entries = 0;
-    ldb_record_idx_t record_idx = {0};
-    size_t dat_end_new = sizeof(ldb_header_dat_t);
-    uint64_t last_timestamp_new = 0;
-    uint64_t csn = 0;
-    int idx_fd = -1;
+// Returns the position of the journal in the table (or its insertion point).
+static size_t ldb_mgr_find(ldb_manager_impl_t *obj, const char *name, bool *found)
+{
+    size_t lo = 0;
+    size_t hi = obj->num_journals;
 
-    if (!ldb_is_valid_obj(obj))
-        exit_function(LDB_ERR);
+    *found = false;
 
-    idx_fd = fileno(obj->idx_fp);
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(obj->journals[mid]->name, name);
 
-    // case nothing to rollback
-    if (obj->state.seqnum2 <= seqnum)
-        exit_function(0);
+        if (cmp == 0) {
+            *found = true;
+            return mid;
+        }
 
-    removed_entries = (long) obj->state.seqnum2 - (long) ldb_max(seqnum, obj->state.seqnum1 - 1);
-    csn = obj->state.seqnum2;
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
 
-    if (seqnum >= obj->state.seqnum1)
+    return lo;
+}
+
+// Closes the least recently used idle journals until max_open journals are opened.
+static void ldb_mgr_evict(ldb_manager_impl_t *obj, size_t max_open)
+{
+    while (obj->num_open > max_open)
     {
-        if ((ret = ldb_read_record_idx(idx_fd, &obj->state, seqnum, &record_idx)) != LDB_OK)
-            exit_function(ret);
+        ldb_mgr_journal_t *lru = NULL;
 
-        last_timestamp_new = record_idx.timestamp;
+        for (size_t i = 0; i < obj->num_journals; i++) {
+            ldb_mgr_journal_t *item = obj->journals[i];
+            if (item->journal != NULL && item->refs == 0 && (lru == NULL || item->last_use < lru->last_use))
+                lru = item;
+        }
 
-        if ((ret = ldb_read_record_idx(idx_fd, &obj->state, seqnum + 1, &record_idx)) != LDB_OK)
-            exit_function(ret);
+        // all opened journals are in use
+        if (lru == NULL)
+            return;
 
-        dat_end_new = record_idx.pos;
+        ldb_close(lru->journal);
+        ldb_free(lru->journal);
+        lru->journal = NULL;
+        obj->num_open--;
     }
+}
 
-    memset(&record_idx, 0x00, sizeof(ldb_record_idx_t));
+// Returns the named journal opened and referenced (created if it doesn't exist).
+static int ldb_mgr_get(ldb_manager_impl_t *obj, const char *name, ldb_mgr_journal_t **item)
+{
+    ldb_mgr_journal_t *ret_item = NULL;
+    bool found = false;
+    int ret = LDB_OK;
+
+    *item = NULL;
+
+    pthread_mutex_lock(&obj->mutex_journals);
 
-    // set index entries to 0 (from top to down)
-    while (seqnum < csn && obj->state.seqnum1 <= csn)
+    size_t pos = ldb_mgr_find(obj, name, &found);
+
+    if (!found)
     {
-        size_t pos = ldb_get_pos_idx(&obj->state, csn);
+        if (obj->num_journals == obj->capacity)
+        {
+            size_t capacity = (obj->capacity == 0 ? 16 : 2 * obj->capacity);
+            ldb_mgr_journal_t **journals = (ldb_mgr_journal_t **) realloc(obj->journals, capacity * sizeof(ldb_mgr_journal_t *));
 
-        if (fseek(obj->idx_fp, (long) pos, SEEK_SET) != 0)
-            exit_function(LDB_ERR_READ_IDX);
+            if (journals == NULL) {
+                pthread_mutex_unlock(&obj->mutex_journals);
+                return LDB_ERR_MEM;
+            }
 
-        if (fwrite(&record_idx, sizeof(ldb_record_idx_t), 1, obj->idx_fp) != 1)
-            exit_function(LDB_ERR_WRITE_IDX);
+            obj->journals = journals;
+            obj->capacity = capacity;
+        }
 
-        csn--;
-    }
+        ret_item = (ldb_mgr_journal_t *) calloc(1, sizeof(ldb_mgr_journal_t));
 
-    if (fflush(obj->idx_fp) != 0)
-        exit_function(LDB_ERR_WRITE_IDX);
+        if (ret_item == NULL || (ret_item->name = strdup(name)) == NULL) {
+            free(ret_item);
+            pthread_mutex_unlock(&obj->mutex_journals);
+            return LDB_ERR_MEM;
+        }
 
-    // update status
-    if (seqnum < obj->state.seqnum1) {
-        obj->state.seqnum1 = 0;
-        obj->state.timestamp1 = 0;
-        obj->state.seqnum2 = 0;
-        obj->state.timestamp2 = 0;
-        obj->dat_end = sizeof(ldb_header_dat_t);
+        memmove(obj->journals + pos + 1, obj->journals + pos, (obj->num_journals - pos) * sizeof(ldb_mgr_journal_t *));
+        obj->journals[pos] = ret_item;
+        obj->num_journals++;
     }
-    else {
-        obj->state.seqnum2 = seqnum;
-        obj->state.timestamp2 = last_timestamp_new;
-        obj->dat_end = dat_end_new;
+
+    ret_item = obj->journals[pos];
+
+    // files closed by a failed purge
+    if (ret_item->journal != NULL && ret_item->refs == 0 && !ldb_is_valid_obj(ret_item->journal)) {
+        ldb_close(ret_item->journal);
+        ldb_free(ret_item->journal);
+        ret_item->journal = NULL;
+        obj->num_open--;
     }
 
-    // set data entries to 0 (from down to top)
-    if (!ldb_zeroize(obj->dat_fp, dat_end_new))
-        exit_function(LDB_ERR_WRITE_DAT);
+    if (ret_item->journal == NULL)
+    {
+        ldb_mgr_evict(obj, obj->max_open - 1);
 
-    if (fflush(obj->dat_fp) != 0)
-        exit_function(LDB_ERR_WRITE_DAT);
+        if ((ret_item->journal = ldb_alloc()) == NULL) {
+            pthread_mutex_unlock(&obj->mutex_journals);
+            return LDB_ERR_MEM;
+        }
 
-    if (obj->force_fsync && fdatasync(fileno(obj->dat_fp)) == -1)
-        exit_function(LDB_ERR_WRITE_DAT);
+        if ((ret = ldb_open(ret_item->journal, obj->path, name, false)) != LDB_OK) {
+            ldb_free(ret_item->journal);
+            ret_item->journal = NULL;
+            pthread_mutex_unlock(&obj->mutex_journals);
+            return ret;
+        }
 
-    ret = removed_entries;
+        obj->num_open++;
+    }
 
-LDB_ROLLBACK_END:
-    pthread_mutex_unlock(&obj->mutex_files);
-    return ret;
+    ret_item->refs++;
+    ret_item->last_use = ++obj->clock;
+    *item = ret_item;
+
+    pthread_mutex_unlock(&obj->mutex_journals);
+
+    return LDB_OK;
 }
 
-#undef exit_function
-#define exit_function(errnum) do { ret = errnum; goto LDB_PURGE_ERR; } while(0)
+static void ldb_mgr_put(ldb_manager_impl_t *obj, ldb_mgr_journal_t *item)
+{
+    pthread_mutex_lock(&obj->mutex_journals);
+    assert(item->refs > 0);
+    item->refs--;
+    ldb_mgr_evict(obj, obj->max_open);
+    pthread_mutex_unlock(&obj->mutex_journals);
+}
 
-long ldb_purge(ldb_impl_t *obj, uint64_t seqnum)
+/**
+ * Writes the batch and commits it.
+ * 
+ * Entries are written to their journal in queue order. Then each written 
+ * journal is flushed, fdatasync'ed once (fsync mode), and its new state is 
+ * published. Entries are visible only when they are durable.
+ */
+static void ldb_mgr_commit(void *arg, ldb_request_t *batch)
 {
-    if (!obj)
-        return LDB_ERR_ARG;
+    ldb_manager_impl_t *obj = (ldb_manager_impl_t *) arg;
+    ldb_mgr_journal_t *written = NULL;
 
-    pthread_mutex_lock(&obj->mutex_files);
+    assert(obj);
 
-    int ret = LDB_ERR;
-    long removed_entries = 0;
-    ldb_header_dat_t header_dat = {0};
-    ldb_record_idx_t record_idx = {0};
-    ldb_record_dat_t record_dat = {0};
-    char *tmp_path = NULL;
-    FILE *tmp_fp = NULL;
-    int dat_fd = -1;
-    int idx_fd = -1;
-    size_t pos = 0;
+    pthread_mutex_lock(&obj->group->mutex_write);
 
-    if (!ldb_is_valid_obj(obj))
-        exit_function(LDB_ERR);
+    for (ldb_request_t *request = batch; request != NULL; request = request->next)
+    {
+        ldb_mgr_journal_t *item = (ldb_mgr_journal_t *) request->target;
 
-    // case no entries to purge
-    if (seqnum <= obj->state.seqnum1 || obj->state.seqnum1 == 0) {
-        pthread_mutex_unlock(&obj->mutex_files);
-        return 0;
-    }
+        // files closed by a failed purge
+        if (!ldb_is_valid_obj(item->journal)) {
+            request->ret = LDB_ERR;
+            continue;
+        }
 
-    dat_fd = fileno(obj->dat_fp);
-    idx_fd = fileno(obj->idx_fp);
+        // first request of the journal in this batch
+        if (!item->written) {
+            ldb_get_state(item->journal, &item->state);
+            item->written = true;
+            item->next = written;
+            written = item;
+        }
 
-    // case purge all entries
-    if (obj->state.seqnum2 < seqnum)
-    {
-        removed_entries = (long) obj->state.seqnum2 - (long) obj->state.seqnum1 + 1;
+        request->ret = ldb_write_request(item->journal, &item->state, request);
+    }
 
-        ldb_close_files(obj);
-        ldb_reset_state(&obj->state);
+    // flushes and syncs are done journal by journal (no write interleaved)
+    for (ldb_mgr_journal_t *item = written; item != NULL; item = item->next)
+    {
+        int ret = ldb_flush_files(item->journal);
 
-        remove(obj->dat_path);
-        remove(obj->idx_path);
+        if (obj->force_fsync) {
+            int rc = ldb_sync_files(item->journal);
+            ret = (ret == LDB_OK ? rc : ret);
+        }
 
-        if (!ldb_create_file_dat(obj->dat_path))
-            exit_function(LDB_ERR_OPEN_DAT);
+        for (ldb_request_t *request = batch; request != NULL; request = request->next) {
+            if (request->target == item && request->num > 0 && request->ret == LDB_OK)
+                request->ret = ret;
+        }
+    }
 
-        if (!ldb_create_file_idx(obj->idx_path))
-            exit_function(LDB_ERR_OPEN_IDX);
+    for (ldb_mgr_journal_t *item = written; item != NULL; item = item->next) {
+        ldb_publish_state(item->journal, &item->state);
+        item->written = false;
+    }
 
-        if ((ret = ldb_open_file_dat(obj, false)) != LDB_OK)
-            exit_function(ret);
+    pthread_mutex_unlock(&obj->group->mutex_write);
+}
 
-        if ((ret = ldb_open_file_idx(obj, false)) != LDB_OK)
-            exit_function(ret);
+int ldb_mgr_close(ldb_manager_impl_t *obj)
+{
+    if (obj == NULL)
+        return LDB_OK;
 
-        pthread_mutex_unlock(&obj->mutex_files);
+    int ret = LDB_OK;
 
-        return removed_entries;
-    }
+    if (obj->group != NULL)
+        ldb_group_destroy(obj->group);
 
-    // case purge some entries
+    for (size_t i = 0; i < obj->num_journals; i++)
+    {
+        ldb_mgr_journal_t *item = obj->journals[i];
 
-    removed_entries = (long) seqnum - (long) obj->state.seqnum1;
+        if (item->journal != NULL) {
+            int rc = ldb_close(item->journal);
+            ret = (ret == LDB_OK ? rc : ret);
+            ldb_free(item->journal);
+        }
 
-    if (pread(dat_fd, &header_dat, sizeof(ldb_header_dat_t), 0) != (ssize_t) sizeof(ldb_header_dat_t))
-        exit_function(LDB_ERR_READ_DAT);
+        free(item->name);
+        free(item);
+    }
 
-    if ((ret = ldb_read_record_idx(idx_fd, &obj->state, seqnum, &record_idx)) != LDB_OK)
-        exit_function(ret);
+    if (obj->path)
+        pthread_mutex_destroy(&obj->mutex_journals);
 
-    pos = record_idx.pos;
+    free(obj->journals);
+    free(obj->path);
+    memset(obj, 0x00, sizeof(ldb_manager_impl_t));
 
-    if ((ret = ldb_read_record_dat(dat_fd, pos, &record_dat, true)) != LDB_OK)
-        exit_function(ret);
+    return ret;
+}
 
-    if (record_dat.seqnum != seqnum)
-        exit_function(LDB_ERR_FMT_IDX);
+int ldb_mgr_open(ldb_manager_impl_t *obj, const char *path, size_t max_open, size_t queue_max)
+{
+    if (obj == NULL || path == NULL || max_open == 0 || queue_max == 0)
+        return LDB_ERR_ARG;
 
-    if ((tmp_path = ldb_create_filename(obj->path, obj->name, LDB_EXT_TMP)) == NULL)
-        exit_function(LDB_ERR_MEM);
+    if (!ldb_is_valid_path(path))
+        return LDB_ERR_PATH;
 
-    if ((tmp_fp = fopen(tmp_path, "w")) == NULL)
-        exit_function(LDB_ERR_TMP_FILE);
+    memset(obj, 0x00, sizeof(ldb_manager_impl_t));
 
-    if (fwrite(&header_dat, sizeof(ldb_header_dat_t), 1, tmp_fp) != 1)
-        exit_function(LDB_ERR_TMP_FILE);
+    if ((obj->path = strdup(path)) == NULL)
+        return LDB_ERR_MEM;
 
-    if (!ldb_copy_file(obj->dat_fp, pos, obj->dat_end, tmp_fp, sizeof(ldb_header_dat_t)))
-        exit_function(LDB_ERR_TMP_FILE);
+    obj->max_open = max_open;
+    pthread_mutex_init(&obj->mutex_journals, NULL);
 
-    if (fclose(tmp_fp) != 0)
-        exit_function(LDB_ERR_TMP_FILE);
+    if ((obj->group = ldb_group_create(queue_max, ldb_mgr_commit, obj)) == NULL) {
+        ldb_mgr_close(obj);
+        return LDB_ERR;
+    }
 
-    tmp_fp = NULL;
+    return LDB_OK;
+}
 
-    if ((ret = ldb_close_files(obj)) != LDB_OK)
-        exit_function(ret);
+int ldb_mgr_set_fsync(ldb_manager_impl_t *obj, bool fsync)
+{
+    if (!obj)
+        return LDB_ERR_ARG;
 
-    ldb_reset_state(&obj->state);
+    if (!obj->group)
+        return LDB_ERR;
 
-    remove(obj->idx_path);
+    pthread_mutex_lock(&obj->group->mutex_write);
+    obj->force_fsync = fsync;
+    pthread_mutex_unlock(&obj->group->mutex_write);
 
-    if (rename(tmp_path, obj->dat_path) != 0)
-        exit_function(LDB_ERR_TMP_FILE);
+    return LDB_OK;
+}
 
-    free(tmp_path);
-    tmp_path = NULL;
+int ldb_mgr_acquire(ldb_manager_impl_t *obj, const char *name, ldb_journal_t **journal)
+{
+    if (journal != NULL)
+        *journal = NULL;
 
-    if (!ldb_create_file_idx(obj->idx_path))
-        exit_function(LDB_ERR_OPEN_IDX);
+    if (!obj || !name || !journal)
+        return LDB_ERR_ARG;
 
-    if ((ret = ldb_open_file_dat(obj, false)) != LDB_OK)
-        exit_function(ret);
+    if (!obj->group)
+        return LDB_ERR;
 
-    if ((ret = ldb_open_file_idx(obj, false)) != LDB_OK)
-        exit_function(ret);
+    if (!ldb_is_valid_name(name))
+        return LDB_ERR_NAME;
 
-    pthread_mutex_unlock(&obj->mutex_files);
+    ldb_mgr_journal_t *item = NULL;
+    int ret = ldb_mgr_get(obj, name, &item);
 
-    return removed_entries;
+    if (ret == LDB_OK)
+        *journal = item->journal;
 
-LDB_PURGE_ERR:
-    free(tmp_path);
-    if (tmp_fp != NULL) fclose(tmp_fp);
-    ldb_close_files(obj);
-    ldb_reset_state(&obj->state);
-    pthread_mutex_unlock(&obj->mutex_files);
     return ret;
 }
 
-#undef exit_function
+int ldb_mgr_release(ldb_manager_impl_t *obj, ldb_journal_t *journal)
+{
+    if (!obj || !journal)
+        return LDB_ERR_ARG;
 
-ldb_journal_t * ldb_alloc(void) {
-    return (ldb_journal_t *) calloc(1, sizeof(ldb_impl_t));
-}
+    if (!obj->group)
+        return LDB_ERR;
 
-void ldb_free(ldb_journal_t *obj) {
-    free(obj);
-}
+    bool found = false;
 
-int ldb_set_fsync(ldb_journal_t *obj, bool fsync) {
-    if (!obj)
+    pthread_mutex_lock(&obj->mutex_journals);
+
+    size_t pos = ldb_mgr_find(obj, journal->name, &found);
+
+    if (!found || obj->journals[pos]->journal != journal || obj->journals[pos]->refs == 0) {
+        pthread_mutex_unlock(&obj->mutex_journals);
         return LDB_ERR_ARG;
+    }
 
-    ldb_impl_t *impl = (ldb_impl_t *)obj;
-    impl->force_fsync = fsync;
+    obj->journals[pos]->refs--;
+    ldb_mgr_evict(obj, obj->max_open);
+
+    pthread_mutex_unlock(&obj->mutex_journals);
 
     return LDB_OK;
 }
 
-int ldb_set_meta(ldb_journal_t *obj, const char *meta, size_t len)
+int ldb_mgr_append(ldb_manager_impl_t *obj, const char *name, ldb_entry_t *entries, size_t len, size_t *num)
 {
-    static const char zero[LDB_METADATA_LEN] = {0};
+    if (num != NULL)
+        *num = 0;
 
-    if (!obj || !meta || len > LDB_METADATA_LEN)
+    if (!obj || !name || !entries)
         return LDB_ERR_ARG;
 
-    if (!ldb_is_valid_obj(obj))
+    if (!obj->group)
         return LDB_ERR;
 
-    int dat_fd = fileno(obj->dat_fp);
-    off_t pos = offsetof(ldb_header_dat_t, metadata);
+    if (!ldb_is_valid_name(name))
+        return LDB_ERR_NAME;
 
-    if (pwrite(dat_fd, meta, len, pos) != (ssize_t) len)
-        return LDB_ERR_WRITE_DAT;
+    if (len == 0)
+        return LDB_OK;
 
-    if (len < LDB_METADATA_LEN)
-    {
-        pos += (off_t) len;
-        len = LDB_METADATA_LEN - len;
+    ldb_mgr_journal_t *item = NULL;
+    int ret = ldb_mgr_get(obj, name, &item);
 
-        if (pwrite(dat_fd, zero, len, pos) != (ssize_t) len)
-            return LDB_ERR_WRITE_DAT;
-    }
+    if (ret != LDB_OK)
+        return ret;
 
-    return LDB_OK;
+    ldb_request_t request = { .target = item, .entries = entries, .len = len };
+    ret = ldb_group_submit(obj->group, &request, num);
+
+    ldb_mgr_put(obj, item);
+
+    return ret;
 }
 
-int ldb_get_meta(ldb_journal_t *obj, char *meta, size_t len)
+// Rollback (remove_head = false) or purge (remove_head = true) serialized with the writer thread.
+static long ldb_mgr_remove(ldb_manager_impl_t *obj, const char *name, uint64_t seqnum, bool remove_head)
 {
-    if (!obj || !meta || len > LDB_METADATA_LEN)
+    if (!obj || !name)
         return LDB_ERR_ARG;
 
-    if (!ldb_is_valid_obj(obj))
+    if (!obj->group)
         return LDB_ERR;
 
-    int dat_fd = fileno(obj->dat_fp);
-    off_t pos = offsetof(ldb_header_dat_t, metadata);
+    if (!ldb_is_valid_name(name))
+        return LDB_ERR_NAME;
 
-    if (pread(dat_fd, meta, len, pos) != (ssize_t) len)
-        return LDB_ERR_READ_DAT;
+    ldb_mgr_journal_t *item = NULL;
+    long ret = ldb_mgr_get(obj, name, &item);
 
-    return LDB_OK;
+    if (ret != LDB_OK)
+        return ret;
+
+    pthread_mutex_lock(&obj->group->mutex_write);
+    ret = (remove_head ? ldb_purge(item->journal, seqnum) : ldb_rollback(item->journal, seqnum));
+    pthread_mutex_unlock(&obj->group->mutex_write);
+
+    ldb_mgr_put(obj, item);
+
+    return ret;
+}
+
+long ldb_mgr_rollback(ldb_manager_impl_t *obj, const char *name, uint64_t seqnum) {
+    return ldb_mgr_remove(obj, name, seqnum, false);
+}
+
+long ldb_mgr_purge(ldb_manager_impl_t *obj, const char *name, uint64_t seqnum) {
+    return ldb_mgr_remove(obj, name, seqnum, true);
 }
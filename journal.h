@@ -99,23 +99,26 @@ SOFTWARE.
  * File write ops are done with [dat|idx]_fp.
  * File read ops are done with [dat|idx]_fd.
  * 
- * We use 2 mutex:
+ * We use 2 locks:
  *   - data mutex: Ensures data integrity ([first|last]_[seqnum|timestamp])
  *                 Reduced scope (variables update)
- *   - file mutex: Ensures no reads are done during destructive writes
- *                 Extended scope (function execution)
+ *   - file rwlock: Ensures no reads are done during destructive writes
+ *                  Extended scope (function execution)
+ *                  Shared by readers (R), exclusive for writers (W)
  * 
  *                             File     Data
- * Thread        Function      Mutex    Mutex   Notes
+ * Thread        Function      Lock     Mutex   Notes
  * -------------------------------------------------------------------
- *               ┌ open()         -       -     Initialize mutexes, create FILEs used to write and fds used to read
+ *               ┌ open()         -       -     Initialize locks, create FILEs used to write and fds used to read
  *               ├ append()       -       W     dat and idx files flushed at the end. State updated after flush.
+ *               │                              Group commit: called from any thread, written by the writer thread.
  * thread-write: ┼ rollback()     W       W     
- *               ├ purge()        W       W     
- *               └ close()        -       -     Destroy mutexes, close files
+ *               ├ purge()       R/W      W     Copy done with R lock, files swapped with W lock.
+ *               └ close()        -       -     Destroy locks, close files
  *               ┌ stats()        R       R     
  * thread-read:  ┼ read()         R       R     
- *               └ search()       R       R     
+ *               ├ search()       R       R     
+ *               └ wait()         -       W     Waits on a condition signaled when state is updated.
  */
 
 #define LDB_VERSION_MAJOR          1
@@ -145,6 +148,7 @@ SOFTWARE.
 #define LDB_ERR_LOCK             -20
 
 #define LDB_METADATA_LEN          64
+#define LDB_METRICS_BUCKETS       32
 
 #ifdef __cplusplus
 extern "C" {
@@ -152,12 +156,34 @@ extern "C" {
 
 struct ldb_impl_t;
 typedef struct ldb_impl_t ldb_journal_t;
+typedef struct ldb_segments_impl_t ldb_segments_t;
+typedef struct ldb_cursor_impl_t ldb_cursor_t;
+typedef struct ldb_async_impl_t ldb_async_t;
+typedef struct ldb_manager_impl_t ldb_manager_t;
 
 typedef enum ldb_search_e {
     LDB_SEARCH_LOWER,             // Search for the first entry with a timestamp not less than the value.
     LDB_SEARCH_UPPER              // Search for the first entry with a timestamp greater than the value.
 } ldb_search_e;
 
+typedef enum ldb_mmap_e {
+    LDB_MMAP_NONE = 0,            // Files are read using pread() (default).
+    LDB_MMAP_IDX = 1,             // Index file is memory-mapped.
+    LDB_MMAP_DAT = 2,             // Data file is memory-mapped.
+    LDB_MMAP_ALL = 3              // Index and data files are memory-mapped.
+} ldb_mmap_e;
+
+typedef enum ldb_codec_e {
+    LDB_CODEC_NONE = 0,           // Entries are stored uncompressed (default).
+    LDB_CODEC_LZ4 = 1             // Entries are compressed using the LZ4 block format.
+} ldb_codec_e;
+
+typedef enum ldb_format_e {
+    LDB_FORMAT_FIXED = 0,         // 24-byte record headers, data aligned to 8 bytes (default).
+    LDB_FORMAT_DENSE = 1,         // Variable-length record headers, data not aligned.
+    LDB_FORMAT_BATCH = 2          // Dense records framed by append batch (one checksum per batch).
+} ldb_format_e;
+
 typedef struct ldb_entry_t {
     uint64_t seqnum;              // Sequence number (0 = system assigned).
     uint64_t timestamp;           // Timestamp (0 = system assigned).
@@ -165,6 +191,11 @@ typedef struct ldb_entry_t {
     void *data;                   // Pointer to data.
 } ldb_entry_t;
 
+typedef struct ldb_range_t {
+    uint64_t seqnum;              // First sequence number.
+    size_t len;                   // Number of entries.
+} ldb_range_t;
+
 typedef struct ldb_stats_t {
     uint64_t min_seqnum;          // Minimum sequence number.
     uint64_t max_seqnum;          // Maximum sequence number.
@@ -175,6 +206,31 @@ typedef struct ldb_stats_t {
     size_t index_size;            // Size of index (in bytes).
 } ldb_stats_t;
 
+typedef struct ldb_histogram_t {
+    uint64_t count;               // Number of samples.
+    uint64_t sum_ns;              // Sum of durations (in nanoseconds).
+    uint64_t max_ns;              // Maximum duration (in nanoseconds).
+    uint64_t buckets[LDB_METRICS_BUCKETS]; // Bucket i counts durations in [2^i, 2^(i+1)) ns (bucket 0 includes 0, last one is unbounded).
+} ldb_histogram_t;
+
+typedef struct ldb_metrics_t {
+    uint64_t bytes_written;       // Bytes written by append (dat and idx files).
+    uint64_t bytes_read;          // Dat bytes read by ldb_read() and cursors.
+    uint64_t entries_written;     // Number of appended entries.
+    uint64_t entries_read;        // Number of entries returned by read functions.
+    uint64_t search_probes;       // Idx records read by ldb_search().
+    ldb_histogram_t append_write; // Append, writing entries to files (per call).
+    ldb_histogram_t append_flush; // Append, flushing files.
+    ldb_histogram_t append_fsync; // Append, fdatasync (fsync mode).
+    ldb_histogram_t read_idx;     // Read, idx lookup of the first entry.
+    ldb_histogram_t read_dat;     // Read, dat content read (ldb_read() and cursors).
+    ldb_histogram_t search;       // Search duration.
+    ldb_histogram_t lock_files;   // Wait acquiring the files lock (readers and writers).
+    ldb_histogram_t lock_state;   // Wait acquiring the state mutex.
+    ldb_histogram_t purge;        // Purge duration.
+    ldb_histogram_t rollback;     // Rollback duration.
+} ldb_metrics_t;
+
 /**
  * Returns ldb library version.
  * @return Library version (semantic version, ex. 1.0.4).
@@ -211,6 +267,10 @@ void ldb_free(ldb_journal_t *obj);
  * Updates the index file if incomplete (not flushed + crash).
  * Rebuilds the index file when corrupted or not found.
  * 
+ * The dat file is read in large chunks and checksums are verified by
+ * multiple threads. When check is true, only the records written after
+ * the last clean close (checkpoint stored in the idx header) are verified.
+ * 
  * By default fsync flag is disabled. 
  * Use the function ldb_set_fsync() to set it to true.
  * 
@@ -252,6 +312,185 @@ int ldb_close(ldb_journal_t *obj);
  */
 int ldb_set_fsync(ldb_journal_t *obj, bool fsync);
 
+/**
+ * Enables or disables the checksum verification on read.
+ * 
+ * By default verification is disabled.
+ * 
+ * When enabled, ldb_read() and ldb_read_view() verify the checksum of each
+ * returned entry. Verification uses the data already read (no additional reads).
+ * 
+ * Mode is reset on ldb_open(). Call this function after opening the journal.
+ * 
+ * @param[in] obj Journal to configure.
+ * @param[in] verify Mode to set (true=enable, false=disable).
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_set_verify(ldb_journal_t *obj, bool verify);
+
+/**
+ * Sets the memory-mapped read mode for the journal.
+ * 
+ * By default mmap mode is disabled (LDB_MMAP_NONE).
+ * 
+ * When enabled, files are mapped read-only and read functions (read, stats, 
+ * search) access the index records (and the data records) with plain memory 
+ * loads instead of system calls. Mapping is grown as the journal is appended
+ * and it is remapped on purge. Content not covered by the mapping is read 
+ * using pread().
+ * 
+ * Mode is reset on ldb_open(). Call this function after opening the journal.
+ * 
+ * @param[in] obj Journal to configure.
+ * @param[in] mode Mapped files (see ldb_mmap_e).
+ * 
+ * @return Error code (0 = OK). On error, mmap mode is disabled.
+ */
+int ldb_set_mmap(ldb_journal_t *obj, int mode);
+
+/**
+ * Sets the preallocation extent of the journal files.
+ * 
+ * By default preallocation is disabled (files grow on each append).
+ * 
+ * When enabled, the space of the dat and idx files is allocated ahead of 
+ * their end (posix_fallocate) in extents of the given size. Appends fill 
+ * the allocated space, reducing fragmentation and metadata updates when 
+ * fsync mode is enabled. The unused space is removed on ldb_close(). After
+ * a crash, the zeroed space is kept and reused.
+ * 
+ * Mode is reset on ldb_open(). Call this function after opening the journal.
+ * 
+ * @param[in] obj Journal to configure.
+ * @param[in] bytes Preallocation extent in bytes (0 = disabled).
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_set_prealloc(ldb_journal_t *obj, size_t bytes);
+
+/**
+ * Sets the memory budget of the sparse timestamp index.
+ * 
+ * By default sparse index is disabled (minimal memory footprint).
+ * 
+ * The sparse index keeps in memory the timestamp of one every N entries
+ * (initially N = 128, about one idx page). ldb_search() narrows the range 
+ * using these samples before doing the binary search over the idx file. 
+ * When the budget is exhausted, N is doubled and half the samples are 
+ * released. Each sample takes 16 bytes.
+ * 
+ * The index is built from the idx file on call and maintained by append, 
+ * rollback and purge. Mode is reset on ldb_open(). Call this function after 
+ * opening the journal.
+ * 
+ * @param[in] obj Journal to configure.
+ * @param[in] max_bytes Memory budget in bytes (0 = disabled).
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_set_sparse_index(ldb_journal_t *obj, size_t max_bytes);
+
+/**
+ * Sets the number of entries whose idx records are kept in memory.
+ * 
+ * By default idx records are written on each append.
+ * 
+ * The idx file is fully derivable from the dat file. When enabled, the idx 
+ * records of the appended entries are kept in a memory buffer and written 
+ * with a single write once max_entries entries are buffered (on the next 
+ * append). Readers are served from the buffer. The buffer is also written 
+ * on rollback, purge, ingest and close.
+ * 
+ * In case of crash the buffered records are lost and the idx file is 
+ * completed from the dat file on next ldb_open(). Mode is reset on 
+ * ldb_open(). Call this function after opening the journal.
+ * 
+ * @param[in] obj Journal to configure.
+ * @param[in] max_entries Number of buffered entries (0 = disabled).
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_set_idx_writeback(ldb_journal_t *obj, size_t max_entries);
+
+/**
+ * Enables or disables the group commit mode for the journal.
+ * 
+ * By default group commit is disabled (append is single-writer).
+ * 
+ * When enabled, ldb_append() can be called concurrently from multiple threads.
+ * Calls are queued and a writer thread appends the queued entries in batches.
+ * Each batch is flushed once (and fdatasync'ed once if fsync mode is enabled).
+ * Calls return when their entries are committed (durable if fsync mode is enabled).
+ * Seqnums are assigned in queue order. 
+ * 
+ * Calls block while the queue holds queue_max entries or more (bounded queue). 
+ * A call bigger than queue_max is accepted when the queue is empty.
+ * 
+ * Mode is reset on ldb_open(). Call this function after opening the journal,
+ * when no append is in progress. Disabling it waits for the queued entries. 
+ * 
+ * @param[in] obj Journal to configure.
+ * @param[in] queue_max Maximum number of queued entries (0 = disabled).
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_set_group_commit(ldb_journal_t *obj, size_t queue_max);
+
+/**
+ * Sets the compression codec used to append entries.
+ * 
+ * By default compression is disabled (LDB_CODEC_NONE).
+ * 
+ * When enabled, the data of each appended entry is compressed (built-in 
+ * codec, no external dependencies). Entries that are small (less than 64 
+ * bytes) or that do not shrink are stored uncompressed. Each record is 
+ * flagged individually, so that compressed and uncompressed entries coexist
+ * in the same journal. Checksum covers the stored (compressed) content. The
+ * codec is declared in the dat file header on the first call enabling it.
+ * 
+ * Read functions return the uncompressed data. ldb_read() decompresses in 
+ * the caller's buffer. ldb_read_view() can not return compressed entries.
+ * 
+ * Mode is reset on ldb_open(). Call this function after opening the journal.
+ * 
+ * @param[in] obj Journal to configure.
+ * @param[in] codec Codec to use (see ldb_codec_e).
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_set_compression(ldb_journal_t *obj, int codec);
+
+/**
+ * Sets the dat file format.
+ * 
+ * By default records have a 24-byte header (LDB_FORMAT_FIXED) and data is 
+ * padded to 8 bytes.
+ * 
+ * Dense records (LDB_FORMAT_DENSE) encode the length and the timestamp 
+ * (delta from the previous entry) as varints, the seqnum is implied by 
+ * the previous entry, and data is not padded. Small entries save up to 
+ * 25 bytes each. Data returned by ldb_read() and ldb_read_view() is not
+ * aligned.
+ * 
+ * Batch records (LDB_FORMAT_BATCH) are dense records framed by append 
+ * batch: the first record of each batch holds the seqnum range and a 
+ * single checksum covering the whole batch, the remaining records hold 
+ * no checksum. Entries are checksummed once per batch on write and on 
+ * verification. Batches are written and recovered as a whole (a batch 
+ * truncated by a crash is removed on open). Reading a single entry 
+ * with checksum verification enabled reads its whole batch.
+ * 
+ * The format is stored in the dat file header and can only be changed 
+ * while the journal is empty. Call this function after opening the journal.
+ * 
+ * @param[in] obj Journal to configure.
+ * @param[in] format Format to use (see ldb_format_e).
+ * 
+ * @return Error code (0 = OK, LDB_ERR = journal not empty).
+ */
+int ldb_set_format(ldb_journal_t *obj, int format);
+
 /**
  * Access to journal metadata.
  * 
@@ -299,6 +538,9 @@ int ldb_get_meta(ldb_journal_t *obj, char *meta, size_t len);
  *   - Data file is updated and flushed.
  *   - Index file is updated but not flushed.
  * 
+ * In group commit mode (see ldb_set_group_commit()) this function is thread-safe.
+ * Entries of a failed call don't abort the other calls of the same batch.
+ * 
  * Memory pointed to by entries is not modified and can be deallocated after the function call.
  * 
  * @param[in] obj Journal to modify.
@@ -313,6 +555,32 @@ int ldb_get_meta(ldb_journal_t *obj, char *meta, size_t len);
  */
 int ldb_append(ldb_journal_t *obj, ldb_entry_t *entries, size_t len, size_t *num);
 
+/**
+ * Appends entries whose data is stored contiguously in one buffer.
+ * 
+ * Variant of ldb_append() for producers serializing entries into an arena.
+ * Entry i data is located at buf + lengths[0] + ... + lengths[i-1] and 
+ * has length lengths[i]. No entries array and no allocation are required: 
+ * entries are framed in chunks on the stack and each chunk is written 
+ * with one writev() call. Checksums and validations are those of 
+ * ldb_append().
+ * 
+ * The buffer is not modified and can be reused after the function call.
+ * In group commit mode (see ldb_set_group_commit()) this function is 
+ * thread-safe and the entries are committed as one request.
+ * 
+ * @param[in] obj Journal to modify.
+ * @param[in] seqnum Seqnum of the first entry (0 = system assigned).
+ * @param[in] timestamps Timestamps of the entries (NULL = system assigned).
+ * @param[in] lengths Data length of each entry (min length = len).
+ * @param[in] len Number of entries to append.
+ * @param[in] buf Contiguous data of the entries.
+ * @param[out] num Number of entries appended (can be NULL).
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_append_buf(ldb_journal_t *obj, uint64_t seqnum, const uint64_t *timestamps, const uint32_t *lengths, size_t len, const char *buf, size_t *num);
+
 /**
  * Reads num entries starting from seqnum (included).
  * 
@@ -322,7 +590,8 @@ int ldb_append(ldb_journal_t *obj, ldb_entry_t *entries, size_t len, size_t *num
  * (see below).
  * 
  * Returned data entries (entries[x].data) are aligned to sizeof(uintptr_t)
- * as long as buffer is aligned to sizeof(uintptr_t).
+ * as long as buffer is aligned to sizeof(uintptr_t) and the journal uses 
+ * the fixed format (see ldb_set_format()).
  * 
  * On success:
  *   - Returns LDB_OK
@@ -336,8 +605,16 @@ int ldb_append(ldb_journal_t *obj, ldb_entry_t *entries, size_t len, size_t *num
  *          If the current buffer size is great than entries[num].data_len you can
  *          call ldb_read(obj, entries[num].seqnum, entries, len - num, ...) again.
  *          Otherwise you need to reallocate the buffer with at least entries[num].data_len + 24 bytes.
+ *          Compressed entries (see ldb_set_compression()) are expanded in the buffer
+ *          and they require up to 2 * (entries[num].data_len + 24) bytes.
  *   - unused entries are signaled with seqnum = 0
  * 
+ * When checksum verification is enabled (see ldb_set_verify()), each read 
+ * record is verified against the data already in buffer. On mismatch:
+ *   - Returns LDB_ERR_CHECKSUM
+ *   - num param contains the number of valid entries read
+ *   - entries[num] contains the corrupted entry
+ * 
  * @param[in] obj Journal to use.
  * @param[in] seqnum Initial sequence number.
  * @param[out] entries Array of uninitialized entries (min length = len).
@@ -353,6 +630,199 @@ int ldb_append(ldb_journal_t *obj, ldb_entry_t *entries, size_t len, size_t *num
  */
 int ldb_read(ldb_journal_t *obj, uint64_t seqnum, ldb_entry_t *entries, size_t len, char *buf, size_t buf_len, size_t *num);
 
+/**
+ * Reads the entries of multiple seqnum ranges.
+ * 
+ * Ranges are sorted, clipped to the journal content and merged when they 
+ * overlap or are adjacent. Entries are returned in seqnum order, without
+ * duplicates. All ranges are read in file order from the same journal 
+ * state (one files lock acquisition, one idx lookup and one dat read per
+ * merged range). Requested entries that don't exist are ignored.
+ * 
+ * Entries and buffer are filled as in ldb_read(). Reading stops when len 
+ * entries are read or when buffer is exhausted. In the later case 
+ * entries[num].seqnum is the first pending entry (the remaining ranges can
+ * be read with another call).
+ * 
+ * @param[in] obj Journal to use.
+ * @param[in] ranges Ranges to read (in any order).
+ * @param[in] n Number of ranges.
+ * @param[out] entries Array of uninitialized entries (min length = len).
+ * @param[in] len Maximum number of entries to read.
+ * @param[out] buf Allocated buffer memory where data entries are copied.
+ * @param[in] buf_len Length of the buffer memory (value great than 24).
+ * @param[out] num Number of entries read (can be NULL).
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_read_multi(ldb_journal_t *obj, const ldb_range_t *ranges, size_t n, ldb_entry_t *entries, size_t len, char *buf, size_t buf_len, size_t *num);
+
+/**
+ * Reads num entries starting from seqnum (included) without copying data.
+ * 
+ * Zero-copy companion of ldb_read(). Requires the data file to be mapped
+ * (see ldb_set_mmap(), modes LDB_MMAP_DAT or LDB_MMAP_ALL). Entries point 
+ * directly to the read-only mapping of the dat file. Do not modify the 
+ * pointed content.
+ * 
+ * When num > 0, the view is pinned and entries remain valid until the 
+ * matching ldb_release_view() call. While any view is pinned, rollback(),
+ * purge() and set_mmap() wait for its release. Do not call them from a
+ * thread holding a view. Append is never blocked by views.
+ * 
+ * On success:
+ *   - Returns LDB_OK
+ *   - num param contains the number of entries read (each call with num > 0
+ *     must be followed by a ldb_release_view() call)
+ *   - unused entries are signaled with seqnum = 0
+ * 
+ * Checksum verification (see ldb_set_verify()) behaves as in ldb_read().
+ * On LDB_ERR_CHECKSUM, the valid entries (num > 0) are pinned too.
+ * 
+ * Compressed entries (see ldb_set_compression()) can not be viewed. The view
+ * ends before the first compressed entry (LDB_ERR_ENTRY_DATA if it is the 
+ * requested one). Use ldb_read() instead.
+ * 
+ * @param[in] obj Journal to use.
+ * @param[in] seqnum Initial sequence number.
+ * @param[out] entries Array of uninitialized entries (min length = len).
+ * @param[in] len Number of entries to read.
+ * @param[out] num Number of entries read (can be NULL).
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_read_view(ldb_journal_t *obj, uint64_t seqnum, ldb_entry_t *entries, size_t len, size_t *num);
+
+/**
+ * Releases a view pinned by ldb_read_view().
+ * 
+ * Entries obtained from the view can not be accessed after this call.
+ * 
+ * @param[in] obj Journal to use.
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_release_view(ldb_journal_t *obj);
+
+/**
+ * Writes the raw dat content of a seqnum range to a file descriptor.
+ * 
+ * Intended for replication. The shipped bytes are the records as stored 
+ * in the dat file (header, data and padding), without parsing or copying 
+ * them in user space (sendfile() on Linux, otherwise pread/write). They 
+ * can be appended verbatim to another journal with ldb_ingest().
+ * 
+ * Ranges are clipped to the journal content. In the batch format, the 
+ * range is extended to whole batches (num can be greater than len). In the
+ * dense format, records are relative to the previous one: the follower 
+ * must contain the entry preceding seqnum, or be empty if seqnum is the 
+ * first entry of the journal.
+ * 
+ * fd can be a file, a pipe or a socket (blocking mode). The files lock is
+ * held in read mode while shipping (as in ldb_read()).
+ * 
+ * @param[in] obj Journal to use.
+ * @param[in] seqnum Initial sequence number.
+ * @param[in] len Number of entries to ship.
+ * @param[in] fd Destination file descriptor (written at its current offset).
+ * @param[out] num Number of entries shipped (can be NULL).
+ * @param[out] bytes Number of bytes written to fd (can be NULL).
+ * 
+ * @return Error code (0 = OK, LDB_ERR_NOT_FOUND = seqnum not found, 
+ *         LDB_ERR = error writing fd).
+ */
+int ldb_ship(ldb_journal_t *obj, uint64_t seqnum, size_t len, int fd, size_t *num, size_t *bytes);
+
+/**
+ * Appends raw dat content produced by ldb_ship().
+ * 
+ * Reads len bytes from fd (at its current offset) and appends them 
+ * verbatim to the dat file (sendfile() on Linux when fd is a regular 
+ * file, otherwise read/pwrite). Content is validated in bulk before it is
+ * indexed: records must fill the len bytes, checksums must match, and 
+ * entries must follow the last entry of the journal (seqnum + 1, 
+ * non-decreasing timestamps). Both journals must have the same format.
+ * Dense records imply their seqnum from the previous entry: content not 
+ * following the last entry fails the checksum.
+ * 
+ * Import is atomic. On error nothing is appended and num is 0. 
+ * Appended entries are flushed and published as in ldb_append().
+ * 
+ * @param[in] obj Journal to modify.
+ * @param[in] fd Source file descriptor.
+ * @param[in] len Number of bytes to import.
+ * @param[out] num Number of entries appended (can be NULL).
+ * 
+ * @return Error code (0 = OK, LDB_ERR_FMT_DAT = invalid content, 
+ *         LDB_ERR_CHECKSUM = corrupted content, LDB_ERR = error reading fd).
+ */
+int ldb_ingest(ldb_journal_t *obj, int fd, size_t len, size_t *num);
+
+/**
+ * Waits until the entry with the given seqnum is available.
+ * 
+ * Appended entries are signaled after they are flushed and visible to
+ * readers. Use it to follow the head of the journal instead of polling.
+ * Returns immediately if the entry was already appended (or purged).
+ * 
+ * Do not call ldb_close() while other threads are waiting.
+ * 
+ * @param[in] obj Journal to use.
+ * @param[in] seqnum Sequence number to wait for (0 = any entry).
+ * @param[in] timeout_ms Maximum time to wait in millis (0 = no wait, negative = forever).
+ * 
+ * @return Error code (0 = OK, LDB_ERR_NOT_FOUND = timeout).
+ */
+int ldb_wait(ldb_journal_t *obj, uint64_t seqnum, long timeout_ms);
+
+/**
+ * Returns a file descriptor that becomes readable when entries are appended.
+ * 
+ * Intended for event loops (poll/epoll/select). The descriptor is the read
+ * end of a non-blocking pipe created on first call and owned by the journal 
+ * (closed by ldb_close()). Each published append writes one byte. Drain it 
+ * with read() until EAGAIN before reading the new entries.
+ * 
+ * @param[in] obj Journal to use.
+ * 
+ * @return File descriptor, or error if negative.
+ */
+int ldb_get_notify_fd(ldb_journal_t *obj);
+
+/**
+ * Enables or disables the journal metrics.
+ * 
+ * By default metrics are disabled (no overhead other than a branch).
+ * 
+ * When enabled, the library maintains counters and latency histograms of 
+ * its hot paths (append, read, search, lock waits, purge and rollback). 
+ * Histograms are log-bucketed (powers of 2 nanoseconds). Values are updated
+ * using relaxed atomic operations, two monotonic clock reads per sample.
+ * Disabling keeps the collected values.
+ * 
+ * Metrics are reset on ldb_open(). Call this function after opening the journal.
+ * 
+ * @param[in] obj Journal to configure.
+ * @param[in] enable Mode to set (true=enable, false=disable).
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_set_metrics(ldb_journal_t *obj, bool enable);
+
+/**
+ * Returns the journal metrics.
+ * 
+ * Values are cumulative since ldb_open(). Can be called concurrently with 
+ * any other function. Each value is read atomically, but the snapshot as a
+ * whole is not (counters can be slightly ahead of each other).
+ * 
+ * @param[in] obj Journal to use.
+ * @param[out] metrics Uninitialized metrics.
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_get_metrics(ldb_journal_t *obj, ldb_metrics_t *metrics);
+
 /**
  * Return statistics between seqnum1 and seqnum2 (both included).
  * 
@@ -383,8 +853,12 @@ int ldb_search(ldb_journal_t *obj, uint64_t ts, ldb_search_e mode, uint64_t *seq
  * Removes all entries greater than seqnum.
  * 
  * File operations:
- *   - Index file is updated (zeroed top-to-bottom) and flushed.
- *   - Data file is updated (zeroed bottom-to-top) and flushed.
+ *   - Data file content after the new last entry is removed (truncated
+ *     and extended to its previous size, reading as zeros) and flushed.
+ *   - Index file content after the new last entry is removed (same way).
+ * 
+ * Cost does not depend on the number of removed entries. On crash between
+ * both steps, the index is rebuilt on ldb_open().
  * 
  * @param[in] obj Journal to update.
  * @param[in] seqnum Sequence number from which records are removed (seqnum=0 removes all content).
@@ -397,15 +871,19 @@ long ldb_rollback(ldb_journal_t *obj, uint64_t seqnum);
  * Remove all entries less than seqnum.
  * 
  * This function is expensive because it recreates the dat and idx files.
+ * Readers are not blocked during the copy, only during the files swap.
+ * Appends are blocked until purge ends.
  * 
  * To prevent data loss in case of outage, we do:
- *   - A temporary data file is created.
- *   - Preserved records are copied from the dat file to the temporary file.
- *   - Temporary, dat and idx files are closed
- *   - The idx file is removed
- *   - The temporary file is renamed to dat
- *   - The dat file is opened
- *   - The idx file is rebuilt
+ *   - Temporary dat and idx files are created (readers not blocked).
+ *   - Preserved records are copied from the dat file to the temporary dat file.
+ *   - Preserved idx records are copied to the temporary idx file (positions shifted).
+ *   - Readers are blocked and the current dat and idx files are closed
+ *   - The temporary dat file is renamed to dat
+ *   - The temporary idx file is renamed to idx (rebuilt on open if missing)
+ *   - The dat and idx files are opened
+ * 
+ * On error during the copy the journal is not modified.
  * 
  * @param[in] obj Journal to update.
  * @param[in] seqnum Sequence number up to which records are removed.
@@ -414,6 +892,324 @@ long ldb_rollback(ldb_journal_t *obj, uint64_t seqnum);
  */
 long ldb_purge(ldb_journal_t *obj, uint64_t seqnum);
 
+/**
+ * Segmented journal.
+ * 
+ * A segmented journal is a sequence of journals (segments) sharing a name.
+ * Segment files are named 'name.nnnnnn.dat' and 'name.nnnnnn.idx' (nnnnnn = 
+ * 000001, 000002, ...). Entries are appended to the last segment. A new 
+ * segment is created when the last one reaches the size or count threshold.
+ * Seqnums and timestamps are preserved across segments.
+ * 
+ * Read, stats and search route across segments transparently.
+ * Purge removes whole segments (no copy) plus at most one partial segment.
+ * Rollback removes whole segments plus at most one partial segment.
+ * 
+ * Same concurrency rules than ldb_journal_t apply (one writer thread doing
+ * append, rollback and purge, multiple reader threads). Segment list is 
+ * protected by a rwlock held exclusively only while segments are added or
+ * removed.
+ * 
+ * Thresholds are checked before appending. A segment never exceeds
+ * max_entries, data file can exceed max_bytes by one append call.
+ */
+
+ldb_segments_t * ldb_seg_alloc(void);
+void ldb_seg_free(ldb_segments_t *obj);
+
+/**
+ * Opens a segmented journal.
+ * 
+ * Existing segments are opened in order (see ldb_open()). Creates the 
+ * first segment if no one exists. Empty segments (not the last) are removed.
+ * 
+ * @param[in,out] obj Uninitialized segmented journal object.
+ * @param[in] path Directory where journal files are located.
+ * @param[in] name Journal name (allowed characters: [a-ZA-Z0-9_], max length = 32).
+ * @param[in] check Check journal files (true|false).
+ * @param[in] max_bytes Data file size threshold (0 = no limit).
+ * @param[in] max_entries Entries per segment threshold (0 = no limit).
+ * 
+ * @return Error code (0 = OK). LDB_ERR_FMT_DAT if segments are not consecutive.
+ *         On error, the journal is closed properly (ldb_seg_close not required).
+ */
+int ldb_seg_open(ldb_segments_t *obj, const char *path, const char *name, bool check, size_t max_bytes, size_t max_entries);
+
+/**
+ * Segmented versions of the journal functions.
+ * 
+ * Same arguments and return codes than their ldb_journal_t counterparts.
+ * 
+ * @see ldb_close(), ldb_set_fsync(), ldb_append(), ldb_read(), ldb_stats(), 
+ *      ldb_search(), ldb_rollback(), ldb_purge()
+ */
+int ldb_seg_close(ldb_segments_t *obj);
+int ldb_seg_set_fsync(ldb_segments_t *obj, bool fsync);
+int ldb_seg_append(ldb_segments_t *obj, ldb_entry_t *entries, size_t len, size_t *num);
+int ldb_seg_read(ldb_segments_t *obj, uint64_t seqnum, ldb_entry_t *entries, size_t len, char *buf, size_t buf_len, size_t *num);
+int ldb_seg_stats(ldb_segments_t *obj, uint64_t seqnum1, uint64_t seqnum2, ldb_stats_t *stats);
+int ldb_seg_search(ldb_segments_t *obj, uint64_t timestamp, ldb_search_e mode, uint64_t *seqnum);
+long ldb_seg_rollback(ldb_segments_t *obj, uint64_t seqnum);
+long ldb_seg_purge(ldb_segments_t *obj, uint64_t seqnum);
+
+/**
+ * Cursor
+ * 
+ * Sequential reader of a journal. Entries are returned one by one from 
+ * an internal readahead buffer filled with consecutive dat file content.
+ * The idx file is consulted only on the first read and after a rollback
+ * or purge. Records larger than the buffer grow it automatically.
+ * 
+ * When the cursor reaches the last entry, ldb_cursor_next() returns 
+ * LDB_ERR_NOT_FOUND. It can be called again when new entries are appended
+ * (see ldb_wait()).
+ * 
+ * A cursor is used by one thread. Multiple cursors can read the same 
+ * journal concurrently (they behave as ldb_read() calls). Close cursors 
+ * before closing the journal.
+ */
+
+ldb_cursor_t * ldb_cursor_alloc(void);
+void ldb_cursor_free(ldb_cursor_t *cursor);
+
+/**
+ * Opens a cursor at the given seqnum.
+ * 
+ * @param[in,out] cursor Uninitialized cursor.
+ * @param[in] obj Journal to read.
+ * @param[in] seqnum First entry to return (0 = first available entry).
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_cursor_open(ldb_cursor_t *cursor, ldb_journal_t *obj, uint64_t seqnum);
+
+/**
+ * Opens a cursor at the entry found by ldb_search().
+ * 
+ * @param[in,out] cursor Uninitialized cursor.
+ * @param[in] obj Journal to read.
+ * @param[in] timestamp Timestamp to search.
+ * @param[in] mode Search mode.
+ * 
+ * @return Error code (0 = OK, LDB_ERR_NOT_FOUND = no entry matches).
+ */
+int ldb_cursor_open_timestamp(ldb_cursor_t *cursor, ldb_journal_t *obj, uint64_t timestamp, ldb_search_e mode);
+
+/**
+ * Returns the next entry.
+ * 
+ * Entry data points to the cursor buffer and it is valid until the next 
+ * call to ldb_cursor_next() or ldb_cursor_close().
+ * 
+ * On LDB_ERR_CHECKSUM (see ldb_set_verify()) the entry is filled and the 
+ * cursor moves past it.
+ * 
+ * @param[in] cursor Cursor to use.
+ * @param[out] entry Next entry.
+ * 
+ * @return Error code (0 = OK, LDB_ERR_NOT_FOUND = no more entries or next entry was purged).
+ */
+int ldb_cursor_next(ldb_cursor_t *cursor, ldb_entry_t *entry);
+
+/**
+ * Closes a cursor.
+ * 
+ * @param[in] cursor Cursor to close.
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_cursor_close(ldb_cursor_t *cursor);
+
+/**
+ * Callback called for each entry of a timestamp scan.
+ * 
+ * Entry data is valid only during the call.
+ * 
+ * @param[in] ctx Argument provided to ldb_scan_time().
+ * @param[in] entry Entry read.
+ * 
+ * @return true to continue the scan, false to stop it.
+ */
+typedef bool (*ldb_scan_cb)(void *ctx, const ldb_entry_t *entry);
+
+/**
+ * Calls the callback for each entry with a timestamp in [timestamp1, timestamp2].
+ * 
+ * The first entry is located with a single search (see ldb_search()) and
+ * the following ones are read sequentially using a cursor. The scan ends at
+ * the first entry with a timestamp greater than timestamp2 (no upper bound
+ * search), at the last entry, or when the callback returns false.
+ * 
+ * @param[in] obj Journal to use.
+ * @param[in] timestamp1 Lower timestamp (included).
+ * @param[in] timestamp2 Upper timestamp (included, greater than or equal to timestamp1).
+ * @param[in] callback Function called for each entry.
+ * @param[in] ctx Callback argument.
+ * @param[out] num Number of entries passed to the callback (can be NULL).
+ * 
+ * @return Error code (0 = OK). On LDB_ERR_CHECKSUM the corrupted entry is not
+ *         passed to the callback and the scan stops.
+ */
+int ldb_scan_time(ldb_journal_t *obj, uint64_t timestamp1, uint64_t timestamp2, ldb_scan_cb callback, void *ctx, size_t *num);
+
+/**
+ * Asynchronous reads
+ * 
+ * A pool of worker threads serves read requests submitted from any thread,
+ * for any number of journals. Each request is a ldb_read() call (idx lookups
+ * and one bulk dat read) followed by the callback. Submitters do not block.
+ * 
+ * Requests are served in submission order by the first idle worker; 
+ * callbacks of different requests can run concurrently. Entries and buffer 
+ * belong to the submitter and must remain valid until the callback is called.
+ * Journals must not be closed while they have pending requests.
+ */
+
+/**
+ * Callback called by a worker thread when an asynchronous read is done.
+ * 
+ * @param[in] ctx Argument provided on submission.
+ * @param[in] ret ldb_read() result.
+ * @param[in] num Number of entries read.
+ */
+typedef void (*ldb_read_cb)(void *ctx, int ret, size_t num);
+
+ldb_async_t * ldb_async_alloc(void);
+void ldb_async_free(ldb_async_t *pool);
+
+/**
+ * Starts the worker threads.
+ * 
+ * @param[in,out] pool Uninitialized pool.
+ * @param[in] num_threads Number of worker threads (greater than 0).
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_async_open(ldb_async_t *pool, size_t num_threads);
+
+/**
+ * Stops the worker threads once all submitted requests are served.
+ * 
+ * @param[in] pool Pool to close.
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_async_close(ldb_async_t *pool);
+
+/**
+ * Submits an asynchronous read.
+ * 
+ * Arguments are the same than ldb_read(). Results are notified to the 
+ * callback (called from a worker thread).
+ * 
+ * @param[in] pool Pool serving the request.
+ * @param[in] obj Journal to read.
+ * @param[in] seqnum Initial sequence number.
+ * @param[out] entries Array of entries (min length = len).
+ * @param[in] len Number of entries to read.
+ * @param[out] buf Buffer where data is placed.
+ * @param[in] buf_len Buffer length.
+ * @param[in] callback Function called when read is done.
+ * @param[in] ctx Callback argument.
+ * 
+ * @return Error code (0 = submitted).
+ */
+int ldb_read_async(ldb_async_t *pool, ldb_journal_t *obj, uint64_t seqnum, ldb_entry_t *entries, size_t len, 
+                   char *buf, size_t buf_len, ldb_read_cb callback, void *ctx);
+
+/**
+ * Journal manager
+ * 
+ * A manager owns the journals of a directory (ex. one journal per partition)
+ * and appends to them from a single writer thread. Appends submitted 
+ * concurrently, to any journal, are written in batches. Each journal written
+ * by a batch is flushed once and, in fsync mode, fdatasync'ed once before
+ * its new entries are published.
+ * 
+ * Journals are identified by name. They are opened on first use (created if
+ * they don't exist) with default settings (see ldb_open()). Idle journals 
+ * are closed in least recently used order to keep at most max_open journals 
+ * opened (2 file descriptors each). Journals in use (acquired or appending) 
+ * are never closed, the limit can be exceeded meanwhile.
+ * 
+ * Acquired journals can be used with the read functions (ldb_read(), 
+ * ldb_stats(), ldb_search(), cursors, ldb_wait(), etc). Appends, rollbacks 
+ * and purges must be done through the manager. Settings changed on an 
+ * acquired journal are lost when it is closed.
+ * 
+ * All functions are thread-safe.
+ */
+
+ldb_manager_t * ldb_mgr_alloc(void);
+void ldb_mgr_free(ldb_manager_t *obj);
+
+/**
+ * Opens a manager (starts the writer thread).
+ * 
+ * @param[in,out] obj Uninitialized manager.
+ * @param[in] path Directory where journal files are located.
+ * @param[in] max_open Maximum number of opened journals (greater than 0).
+ * @param[in] queue_max Maximum number of queued entries (see ldb_set_group_commit()).
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_mgr_open(ldb_manager_t *obj, const char *path, size_t max_open, size_t queue_max);
+
+/**
+ * Closes a manager.
+ * 
+ * Waits for the queued appends and closes all journals. Acquired journals
+ * must be released before.
+ * 
+ * @param[in] obj Manager to close.
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_mgr_close(ldb_manager_t *obj);
+
+/**
+ * Enables or disables the fsync mode for all journals.
+ * 
+ * @see ldb_set_fsync()
+ */
+int ldb_mgr_set_fsync(ldb_manager_t *obj, bool fsync);
+
+/**
+ * Returns an opened journal.
+ * 
+ * Journal is not closed until released.
+ * 
+ * @param[in] obj Manager to use.
+ * @param[in] name Journal name (allowed characters: [a-ZA-Z0-9_], max length = 32).
+ * @param[out] journal Opened journal.
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_mgr_acquire(ldb_manager_t *obj, const char *name, ldb_journal_t **journal);
+
+/**
+ * Releases a journal returned by ldb_mgr_acquire().
+ * 
+ * @param[in] obj Manager to use.
+ * @param[in] journal Journal to release.
+ * 
+ * @return Error code (0 = OK).
+ */
+int ldb_mgr_release(ldb_manager_t *obj, ldb_journal_t *journal);
+
+/**
+ * Manager versions of the journal functions.
+ * 
+ * Same arguments and return codes than their ldb_journal_t counterparts,
+ * applied to the named journal. Append returns when the entries are 
+ * committed (see ldb_set_group_commit()).
+ * 
+ * @see ldb_append(), ldb_rollback(), ldb_purge()
+ */
+int ldb_mgr_append(ldb_manager_t *obj, const char *name, ldb_entry_t *entries, size_t len, size_t *num);
+long ldb_mgr_rollback(ldb_manager_t *obj, const char *name, uint64_t seqnum);
+long ldb_mgr_purge(ldb_manager_t *obj, const char *name, uint64_t seqnum);
+
 #ifdef __cplusplus
 }
 
@@ -482,6 +1278,46 @@ class journal_t
         return ldb_set_fsync(m_journal, enable);
     }
 
+    int set_verify(bool enable) {
+        return ldb_set_verify(m_journal, enable);
+    }
+
+    int set_mmap(int mode) {
+        return ldb_set_mmap(m_journal, mode);
+    }
+
+    int set_metrics(bool enable) {
+        return ldb_set_metrics(m_journal, enable);
+    }
+
+    int get_metrics(ldb_metrics_t *metrics) {
+        return ldb_get_metrics(m_journal, metrics);
+    }
+
+    int set_prealloc(size_t bytes) {
+        return ldb_set_prealloc(m_journal, bytes);
+    }
+
+    int set_sparse_index(size_t max_bytes) {
+        return ldb_set_sparse_index(m_journal, max_bytes);
+    }
+
+    int set_idx_writeback(size_t max_entries) {
+        return ldb_set_idx_writeback(m_journal, max_entries);
+    }
+
+    int set_group_commit(size_t queue_max) {
+        return ldb_set_group_commit(m_journal, queue_max);
+    }
+
+    int set_compression(int codec) {
+        return ldb_set_compression(m_journal, codec);
+    }
+
+    int set_format(int format) {
+        return ldb_set_format(m_journal, format);
+    }
+
     int set_meta(const char *meta, size_t len) {
         return ldb_set_meta(m_journal, meta, len);
     }
@@ -494,10 +1330,42 @@ class journal_t
         return ldb_append(m_journal, entries, len, num);
     }
 
+    int append_buf(uint64_t seqnum, const uint64_t *timestamps, const uint32_t *lengths, size_t len, const char *buf, size_t *num) { 
+        return ldb_append_buf(m_journal, seqnum, timestamps, lengths, len, buf, num);
+    }
+
     int read(uint64_t seqnum, ldb_entry_t *entries, size_t len, char *buf, size_t buf_len, size_t *num) { 
         return ldb_read(m_journal, seqnum, entries, len, buf, buf_len, num);
     }
 
+    int read_multi(const ldb_range_t *ranges, size_t n, ldb_entry_t *entries, size_t len, char *buf, size_t buf_len, size_t *num) { 
+        return ldb_read_multi(m_journal, ranges, n, entries, len, buf, buf_len, num);
+    }
+
+    int read_view(uint64_t seqnum, ldb_entry_t *entries, size_t len, size_t *num) { 
+        return ldb_read_view(m_journal, seqnum, entries, len, num);
+    }
+
+    int release_view() { 
+        return ldb_release_view(m_journal);
+    }
+
+    int ship(uint64_t seqnum, size_t len, int fd, size_t *num, size_t *bytes) { 
+        return ldb_ship(m_journal, seqnum, len, fd, num, bytes);
+    }
+
+    int ingest(int fd, size_t len, size_t *num) { 
+        return ldb_ingest(m_journal, fd, len, num);
+    }
+
+    int wait(uint64_t seqnum, long timeout_ms) {
+        return ldb_wait(m_journal, seqnum, timeout_ms);
+    }
+
+    int get_notify_fd() {
+        return ldb_get_notify_fd(m_journal);
+    }
+
     int stats(uint64_t seqnum1, uint64_t seqnum2, ldb_stats_t *stats) {
         return ldb_stats(m_journal, seqnum1, seqnum2, stats);
     }
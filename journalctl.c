@@ -9,6 +9,8 @@
 #define DEFAULT_PATH        "."
 #define MAX_ENTRIES         128
 #define BUF_GROWTH_FACTOR   2
+#define VERIFY_MIN_ENTRIES  4096
+#define EXPORT_BUF_LEN      (4 * 1024 * 1024)
 
 #define MIN(a,b) (((a) < (b)) ? (a) : (b))
 
@@ -17,13 +19,22 @@ typedef enum mode_e {
     MODE_DETAILS,
     MODE_PURGE,
     MODE_ROLLBACK,
+    MODE_VERIFY,
+    MODE_EXPORT,
 } mode_e;
 
+typedef enum export_e {
+    EXPORT_RAW,
+    EXPORT_BINARY,
+    EXPORT_NDJSON,
+} export_e;
+
 typedef struct params_t {
     mode_e mode;
     const char *path;
     const char *name;
     bool check;
+    bool metrics;
 
     // details
     bool bulk;
@@ -37,8 +48,30 @@ typedef struct params_t {
     bool have_seq;
     uint64_t num;
     uint64_t seq;
+
+    // verify
+    uint64_t jobs;
+
+    // export
+    export_e format;
+    bool have_since;
+    bool have_until;
+    uint64_t since;
+    uint64_t until;
 } params_t;
 
+typedef struct verify_chunk_t {
+    ldb_impl_t *journal;
+    pthread_t thread;
+    bool started;
+    uint64_t seqnum1;             // First seqnum of the chunk (first of a batch in batch format)
+    uint64_t seqnum2;             // Last seqnum of the chunk
+    uint64_t num_entries;         // Verified entries
+    size_t num_bytes;             // Dat content length of the chunk
+    uint64_t error_seqnum;        // First invalid entry (0 = none)
+    int error;                    // Error found (LDB_OK = none)
+} verify_chunk_t;
+
 static void print_help(FILE *out)
 {
     fprintf(out,
@@ -46,16 +79,20 @@ static void print_help(FILE *out)
         "\n"
         "Usage:\n"
         "  %s -h\n"
-        "  %s --summary  [-p PATH] [-c] NAME\n"
-        "  %s --details  [-p PATH] [-f NUM] [-t NUM] [-b] NAME\n"
-        "  %s --purge    [-p PATH] (-n NUM | -s SEQ) NAME\n"
-        "  %s --rollback [-p PATH] (-n NUM | -s SEQ) NAME\n"
+        "  %s --summary  [-p PATH] [-c] [-m] NAME\n"
+        "  %s --details  [-p PATH] [-f NUM] [-t NUM] [-b] [-m] NAME\n"
+        "  %s --purge    [-p PATH] (-n NUM | -s SEQ) [-m] NAME\n"
+        "  %s --rollback [-p PATH] (-n NUM | -s SEQ) [-m] NAME\n"
+        "  %s --verify   [-p PATH] [-c] [-f NUM] [-t NUM] [-j NUM] [-m] NAME\n"
+        "  %s --export   [-p PATH] [-f NUM] [-t NUM] [-S TS] [-U TS] [-F FMT] NAME\n"
         "\n"
         "Options:\n"
         "      --summary           Print a summary for NAME (default mode)\n"
         "      --details           List entries in a seqnum range\n"
         "      --purge             Remove oldest entries (from start)\n"
         "      --rollback          Remove newest entries (from end)\n"
+        "      --verify            Check checksums and idx/dat consistency in parallel\n"
+        "      --export            Write entries to stdout (sequential read)\n"
         "  -h, --help              Show this help and exit\n"
         "  -p, --path=PATH         Directory containing NAME.dat/NAME.idx (default: .)\n"
         "  -c, --check             Validate journal consistency when opening\n"
@@ -64,6 +101,13 @@ static void print_help(FILE *out)
         "  -b, --bulk              Show binary payloads as hex dump\n"
         "  -n, --num=NUM           Number of entries to remove\n"
         "  -s, --seq=SEQ           New boundary (purge keeps from SEQ; rollback keeps up to SEQ)\n"
+        "  -m, --metrics           Print library metrics (counters and latencies) at exit\n"
+        "  -j, --jobs=NUM          Number of verify threads (default: number of cores)\n"
+        "  -S, --since=TS          First timestamp in millis (inclusive)\n"
+        "  -U, --until=TS          Last timestamp in millis (inclusive)\n"
+        "  -F, --format=FMT        Export format: raw (data only), binary (seqnum, timestamp\n"
+        "                          and length in host byte order, then data) or ndjson\n"
+        "                          (data in base64) (default: raw)\n"
         "\n"
         "Environment:\n"
         "  TZ                      Time zone used for displaying timestamps\n"
@@ -71,7 +115,7 @@ static void print_help(FILE *out)
         "Exit codes:\n"
         "  0  Success\n"
         "  1  Failure (invalid args, missing files, locked files, I/O errors, etc.)\n",
-        APP_NAME, APP_NAME, APP_NAME, APP_NAME, APP_NAME, APP_NAME);
+        APP_NAME, APP_NAME, APP_NAME, APP_NAME, APP_NAME, APP_NAME, APP_NAME, APP_NAME);
 }
 
 static bool parse_u64(const char *s, uint64_t *out)
@@ -159,6 +203,44 @@ static void print_hexdump(const unsigned char *p, size_t len)
     }
 }
 
+static void print_histogram(const char *name, const ldb_histogram_t *hist)
+{
+    if (hist->count == 0)
+        return;
+
+    printf("  %-13s count=%" PRIu64 ", avg=%" PRIu64 "ns, max=%" PRIu64 "ns\n",
+           name, hist->count, hist->sum_ns / hist->count, hist->max_ns);
+
+    for (int i = 0; i < LDB_METRICS_BUCKETS; i++) {
+        if (hist->buckets[i] != 0)
+            printf("    < %" PRIu64 "ns: %" PRIu64 "\n", (uint64_t) 2 << i, hist->buckets[i]);
+    }
+}
+
+static void print_metrics(const params_t *params, ldb_impl_t *journal)
+{
+    ldb_metrics_t metrics = {0};
+
+    if (!params->metrics || ldb_get_metrics(journal, &metrics) != LDB_OK)
+        return;
+
+    printf("Metrics:\n");
+    printf("  bytes_written=%" PRIu64 ", entries_written=%" PRIu64 "\n", metrics.bytes_written, metrics.entries_written);
+    printf("  bytes_read=%" PRIu64 ", entries_read=%" PRIu64 "\n", metrics.bytes_read, metrics.entries_read);
+    printf("  search_probes=%" PRIu64 "\n", metrics.search_probes);
+
+    print_histogram("append_write", &metrics.append_write);
+    print_histogram("append_flush", &metrics.append_flush);
+    print_histogram("append_fsync", &metrics.append_fsync);
+    print_histogram("read_idx", &metrics.read_idx);
+    print_histogram("read_dat", &metrics.read_dat);
+    print_histogram("search", &metrics.search);
+    print_histogram("lock_files", &metrics.lock_files);
+    print_histogram("lock_state", &metrics.lock_state);
+    print_histogram("purge", &metrics.purge);
+    print_histogram("rollback", &metrics.rollback);
+}
+
 static int cmd_summary(const params_t *params)
 {
     int rc = 0;
@@ -173,6 +255,8 @@ static int cmd_summary(const params_t *params)
         return EXIT_FAILURE;
     }
 
+    ldb_set_metrics(&journal, params->metrics);
+
     stat(journal.dat_path, &stat_dat);
     stat(journal.idx_path, &stat_idx);
 
@@ -203,6 +287,7 @@ static int cmd_summary(const params_t *params)
         printf("Number of entries: %zu\n", stats.num_entries);
     }
 
+    print_metrics(params, &journal);
     ldb_close(&journal);
 
     return EXIT_SUCCESS;
@@ -231,6 +316,8 @@ static int cmd_details(const params_t *params)
     if ((rc = ldb_open(&journal, params->path, params->name, params->check)) != LDB_OK)
         return_error("%s", ldb_strerror(rc));
 
+    ldb_set_metrics(&journal, params->metrics);
+
     if ((rc = ldb_stats(&journal, 0, UINT64_MAX, &stats)) != LDB_OK)
         return_error("%s", ldb_strerror(rc));
 
@@ -309,6 +396,8 @@ static int cmd_details(const params_t *params)
         seq = entries[num - 1].seqnum + 1;
     }
 
+    print_metrics(params, &journal);
+
     ret = EXIT_SUCCESS;
 
 EXIT_FUNC:
@@ -333,6 +422,8 @@ static int cmd_purge(const params_t *params)
     if ((rc = ldb_open(&journal, params->path, params->name, params->check)) != LDB_OK)
         return_error("%s", ldb_strerror(rc));
 
+    ldb_set_metrics(&journal, params->metrics);
+
     if ((rc = ldb_stats(&journal, 0, UINT64_MAX, &stats)) != LDB_OK)
         return_error("%s", ldb_strerror(rc));
 
@@ -348,6 +439,7 @@ static int cmd_purge(const params_t *params)
         return_error("%s", ldb_strerror((int)rc));
 
     printf("Removed entries: %d\n", rc);
+    print_metrics(params, &journal);
 
     ret = EXIT_SUCCESS;
 
@@ -372,6 +464,8 @@ static int cmd_rollback(const params_t *params)
     if ((rc = ldb_open(&journal, params->path, params->name, params->check)) != LDB_OK)
         return_error("%s", ldb_strerror(rc));
 
+    ldb_set_metrics(&journal, params->metrics);
+
     if ((rc = ldb_stats(&journal, 0, UINT64_MAX, &stats)) != LDB_OK)
         return_error("%s", ldb_strerror(rc));
 
@@ -387,6 +481,7 @@ static int cmd_rollback(const params_t *params)
         return_error("%s", ldb_strerror((int)rc));
 
     printf("Removed entries: %d\n", rc);
+    print_metrics(params, &journal);
 
     ret = EXIT_SUCCESS;
 
@@ -395,6 +490,386 @@ EXIT_FUNC:
     return ret;
 }
 
+// Scans the dat content of the chunk (checksums verified) and compares
+// every record with its idx record.
+static void * run_verify_chunk(void *arg)
+{
+    verify_chunk_t *chunk = (verify_chunk_t *) arg;
+    ldb_impl_t *journal = chunk->journal;
+    ldb_record_idx_t idx[LDB_IDX_BLOCK_RECORDS];
+    ldb_record_idx_t block = {0};
+    ldb_record_idx_t first = {0};
+    ldb_record_idx_t next = {0};
+    ldb_record_dat_t prev = {0};
+    ldb_state_t state = {0};
+    ldb_scan_t scan = {0};
+    uint64_t seqnum = chunk->seqnum1;
+    uint64_t timestamp = 0;
+    size_t idx_num = 0;
+    size_t idx_off = 0;
+    size_t end = journal->dat_end;
+    int rc = LDB_OK;
+
+    ldb_get_state(journal, &state);
+
+    if ((rc = ldb_read_record_idx(journal, &state, seqnum, &first)) != LDB_OK)
+        goto VERIFY_END;
+
+    // dense records are relative to the previous one
+    if (seqnum > state.seqnum1)
+    {
+        if ((rc = ldb_read_record_idx(journal, &state, seqnum - 1, &next)) != LDB_OK)
+            goto VERIFY_END;
+
+        prev.seqnum = next.seqnum;
+        prev.timestamp = next.timestamp;
+        timestamp = next.timestamp;
+    }
+
+    if (chunk->seqnum2 < state.seqnum2)
+    {
+        if ((rc = ldb_read_record_idx(journal, &state, chunk->seqnum2 + 1, &next)) != LDB_OK)
+            goto VERIFY_END;
+
+        end = next.pos;
+    }
+
+    if (end < first.pos) {
+        rc = LDB_ERR_FMT_IDX;
+        goto VERIFY_END;
+    }
+
+    if ((rc = ldb_scan_init(&scan, fileno(journal->dat_fp), journal->format, &prev, first.pos, end, first.pos)) != LDB_OK)
+        goto VERIFY_END;
+
+    // cores are shared by chunks, content starts with a batch header (batch format)
+    scan.num_threads = 1;
+    scan.batch_end = first.pos;
+    chunk->num_bytes = end - first.pos;
+
+    do
+    {
+        int ret = ldb_scan_next(&scan);
+
+        for (size_t i = 0; i < scan.num && rc == LDB_OK; i++)
+        {
+            const ldb_record_idx_t *record = &scan.records[i];
+
+            if (idx_off == idx_num)
+            {
+                size_t len = (size_t) MIN(LDB_IDX_BLOCK_RECORDS, chunk->seqnum2 - seqnum + 1);
+
+                if (seqnum > chunk->seqnum2)
+                    rc = LDB_ERR_FMT_DAT;
+                else if ((rc = ldb_read_records_idx(journal, state.seqnum1, seqnum, idx, len, &idx_num, &block)) == LDB_OK && idx_num == 0)
+                    rc = LDB_ERR_FMT_IDX;
+
+                idx_off = 0;
+
+                if (rc != LDB_OK)
+                    break;
+            }
+
+            if (record->seqnum != seqnum || record->timestamp < timestamp)
+                rc = LDB_ERR_FMT_DAT;
+            else if (idx[idx_off].seqnum != record->seqnum || idx[idx_off].timestamp != record->timestamp || idx[idx_off].pos != record->pos)
+                rc = LDB_ERR_FMT_IDX;
+            else {
+                timestamp = record->timestamp;
+                seqnum++;
+                idx_off++;
+            }
+        }
+
+        if (rc == LDB_OK)
+            rc = ret;
+    }
+    while (rc == LDB_OK && scan.num > 0);
+
+    // missing records (truncated or zeroed content)
+    if (rc == LDB_OK && seqnum != chunk->seqnum2 + 1)
+        rc = LDB_ERR_FMT_DAT;
+
+VERIFY_END:
+    ldb_scan_free(&scan);
+    chunk->num_entries = seqnum - chunk->seqnum1;
+    chunk->error_seqnum = (rc == LDB_OK ? 0 : seqnum);
+    chunk->error = rc;
+    return NULL;
+}
+
+// Returns the first and last seqnum of the batch containing seqnum (batch format).
+// Other formats have single-entry batches.
+static int get_batch_range(ldb_impl_t *journal, uint64_t seqnum, uint64_t *first, uint64_t *last)
+{
+    ldb_record_idx_t idx = {0};
+    ldb_record_dat_t record = {0};
+    ldb_batch_t batch = {0};
+    ldb_state_t state = {0};
+    size_t batch_pos = 0;
+    int rc = LDB_OK;
+
+    *first = *last = seqnum;
+
+    if (journal->format != LDB_FILE_FORMAT_BATCH)
+        return LDB_OK;
+
+    ldb_get_state(journal, &state);
+
+    if ((rc = ldb_read_record_idx(journal, &state, seqnum, &idx)) != LDB_OK)
+        return rc;
+
+    if ((rc = ldb_read_batch_record(journal, &idx, &batch_pos, &record, &batch)) != LDB_OK)
+        return rc;
+
+    *first = record.seqnum;
+    *last = record.seqnum + batch.num - 1;
+
+    return LDB_OK;
+}
+
+static double get_elapsed(const struct timespec *t0)
+{
+    struct timespec t1 = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    return (double) (t1.tv_sec - t0->tv_sec) + (double) (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+static int cmd_verify(const params_t *params)
+{
+    int rc = 0;
+    int ret = EXIT_FAILURE;
+    ldb_stats_t stats = {0};
+    ldb_impl_t journal = {0};
+    verify_chunk_t *chunks = NULL;
+    verify_chunk_t *error = NULL;
+    struct timespec t0 = {0};
+    uint64_t from_seq = 0UL;
+    uint64_t to_seq = 0UL;
+    uint64_t num_entries = 0UL;
+    uint64_t seqnum = 0UL;
+    size_t num_bytes = 0;
+    size_t num_threads = 0;
+    size_t num_chunks = 0;
+    double elapsed = 0.0;
+
+    if ((rc = ldb_open(&journal, params->path, params->name, params->check)) != LDB_OK)
+        return_error("%s", ldb_strerror(rc));
+
+    ldb_set_metrics(&journal, params->metrics);
+
+    if ((rc = ldb_stats(&journal, 0, UINT64_MAX, &stats)) != LDB_OK)
+        return_error("%s", ldb_strerror(rc));
+
+    if (stats.num_entries == 0) {
+        printf("(no entries)\n");
+        ldb_close(&journal);
+        return EXIT_SUCCESS;
+    }
+
+    from_seq = (params->have_from ? params->from : stats.min_seqnum);
+    to_seq = (params->have_to ? params->to : stats.max_seqnum);
+
+    if (from_seq < stats.min_seqnum)
+        from_seq = stats.min_seqnum;
+    if (to_seq > stats.max_seqnum)
+        to_seq = stats.max_seqnum;
+
+    if (from_seq > to_seq)
+        return_error("invalid range (%" PRIu64 " > %" PRIu64 ")", from_seq, to_seq);
+
+    // range extended to whole batches (batch format)
+    if ((rc = get_batch_range(&journal, from_seq, &from_seq, &seqnum)) != LDB_OK ||
+        (rc = get_batch_range(&journal, to_seq, &seqnum, &to_seq)) != LDB_OK)
+        return_error("%s", ldb_strerror(rc));
+
+    num_threads = (params->jobs > 0 ? (size_t) params->jobs : ldb_num_cpus());
+    num_threads = (size_t) MIN(num_threads, (to_seq - from_seq) / VERIFY_MIN_ENTRIES + 1);
+
+    if ((chunks = (verify_chunk_t *) calloc(num_threads, sizeof(verify_chunk_t))) == NULL)
+        return_error("%s", "out of memory");
+
+    // chunks of equal number of entries starting at a batch header
+    for (size_t i = 0; i < num_threads; i++)
+    {
+        uint64_t last = 0;
+
+        seqnum = from_seq + (to_seq - from_seq + 1) / num_threads * i;
+
+        if ((rc = get_batch_range(&journal, seqnum, &seqnum, &last)) != LDB_OK)
+            return_error("%s", ldb_strerror(rc));
+
+        if (num_chunks > 0 && seqnum <= chunks[num_chunks - 1].seqnum1)
+            continue;
+
+        if (num_chunks > 0)
+            chunks[num_chunks - 1].seqnum2 = seqnum - 1;
+
+        chunks[num_chunks++] = (verify_chunk_t) { .journal = &journal, .seqnum1 = seqnum, .seqnum2 = to_seq };
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    for (size_t i = 0; i < num_chunks; i++)
+        chunks[i].started = (pthread_create(&chunks[i].thread, NULL, run_verify_chunk, &chunks[i]) == 0);
+
+    // chunks not started are verified by this thread
+    for (size_t i = 0; i < num_chunks; i++)
+    {
+        if (chunks[i].started)
+            pthread_join(chunks[i].thread, NULL);
+        else
+            run_verify_chunk(&chunks[i]);
+
+        num_entries += chunks[i].num_entries;
+        num_bytes += chunks[i].num_bytes;
+
+        if (chunks[i].error != LDB_OK && error == NULL)
+            error = &chunks[i];
+    }
+
+    elapsed = get_elapsed(&t0);
+
+    printf("Verified entries: %" PRIu64 " (seqnums %" PRIu64 " to %" PRIu64 ")\n", num_entries, from_seq, to_seq);
+    printf("Verified bytes:   %zu\n", num_bytes);
+    printf("Threads:          %zu\n", num_chunks);
+    printf("Elapsed:          %.3f s (%.1f MB/s)\n", elapsed, (elapsed > 0 ? (double) num_bytes / elapsed / (1024 * 1024) : 0.0));
+
+    if (error != NULL)
+        return_error("seqnum %" PRIu64 ": %s", error->error_seqnum, ldb_strerror(error->error));
+
+    printf("Result:           OK\n");
+    print_metrics(params, &journal);
+
+    ret = EXIT_SUCCESS;
+
+EXIT_FUNC:
+    free(chunks);
+    ldb_close(&journal);
+    return ret;
+}
+
+static bool export_base64(const unsigned char *data, size_t len)
+{
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char out[1024];
+    size_t n = 0;
+
+    for (size_t i = 0; i < len; i += 3)
+    {
+        uint32_t v = (uint32_t) data[i] << 16;
+
+        if (i + 1 < len)
+            v |= (uint32_t) data[i + 1] << 8;
+        if (i + 2 < len)
+            v |= data[i + 2];
+
+        out[n++] = digits[(v >> 18) & 0x3F];
+        out[n++] = digits[(v >> 12) & 0x3F];
+        out[n++] = (i + 1 < len ? digits[(v >> 6) & 0x3F] : '=');
+        out[n++] = (i + 2 < len ? digits[v & 0x3F] : '=');
+
+        if (n == sizeof(out)) {
+            if (fwrite(out, 1, n, stdout) != n)
+                return false;
+            n = 0;
+        }
+    }
+
+    return (fwrite(out, 1, n, stdout) == n);
+}
+
+static bool export_entry(export_e format, const ldb_entry_t *entry)
+{
+    switch (format)
+    {
+        case EXPORT_BINARY:
+            if (fwrite(&entry->seqnum, sizeof(entry->seqnum), 1, stdout) != 1 ||
+                fwrite(&entry->timestamp, sizeof(entry->timestamp), 1, stdout) != 1 ||
+                fwrite(&entry->data_len, sizeof(entry->data_len), 1, stdout) != 1)
+                return false;
+            break;
+        case EXPORT_NDJSON:
+            if (printf("{\"seqnum\":%" PRIu64 ",\"timestamp\":%" PRIu64 ",\"data\":\"", entry->seqnum, entry->timestamp) < 0 ||
+                !export_base64((const unsigned char *) entry->data, entry->data_len) ||
+                fputs("\"}\n", stdout) == EOF)
+                return false;
+            return true;
+        default:
+            break;
+    }
+
+    return (entry->data_len == 0 || fwrite(entry->data, entry->data_len, 1, stdout) == 1);
+}
+
+static int cmd_export(const params_t *params)
+{
+    int rc = 0;
+    int ret = EXIT_FAILURE;
+    ldb_stats_t stats = {0};
+    ldb_impl_t journal = {0};
+    ldb_cursor_impl_t cursor = {0};
+    ldb_entry_t entry = {0};
+    static char buf[EXPORT_BUF_LEN];
+    uint64_t from_seq = 0UL;
+
+    if ((rc = ldb_open(&journal, params->path, params->name, params->check)) != LDB_OK)
+        return_error("%s", ldb_strerror(rc));
+
+    if ((rc = ldb_stats(&journal, 0, UINT64_MAX, &stats)) != LDB_OK)
+        return_error("%s", ldb_strerror(rc));
+
+    if (stats.num_entries == 0 || (params->have_from && params->from > stats.max_seqnum)) {
+        ldb_close(&journal);
+        return EXIT_SUCCESS;
+    }
+
+    from_seq = (params->have_from && params->from > stats.min_seqnum ? params->from : stats.min_seqnum);
+
+    // sequential reads from the cursor readahead buffer
+    if (params->have_since)
+        rc = ldb_cursor_open_timestamp(&cursor, &journal, params->since, LDB_SEARCH_LOWER);
+    else
+        rc = ldb_cursor_open(&cursor, &journal, from_seq);
+
+    if (rc == LDB_ERR_NOT_FOUND) {
+        ldb_close(&journal);
+        return EXIT_SUCCESS;
+    }
+
+    if (rc != LDB_OK)
+        return_error("%s", ldb_strerror(rc));
+
+    setvbuf(stdout, buf, _IOFBF, sizeof(buf));
+
+    while ((rc = ldb_cursor_next(&cursor, &entry)) == LDB_OK)
+    {
+        if (entry.seqnum < from_seq)
+            continue;
+
+        if ((params->have_to && entry.seqnum > params->to) || (params->have_until && entry.timestamp > params->until))
+            break;
+
+        if (!export_entry(params->format, &entry))
+            return_error("%s", "write error");
+    }
+
+    if (rc != LDB_OK && rc != LDB_ERR_NOT_FOUND)
+        return_error("seqnum %" PRIu64 ": %s", (entry.seqnum == 0 ? from_seq : entry.seqnum), ldb_strerror(rc));
+
+    if (fflush(stdout) != 0)
+        return_error("%s", "write error");
+
+    ret = EXIT_SUCCESS;
+
+EXIT_FUNC:
+    ldb_cursor_close(&cursor);
+    ldb_close(&journal);
+    return ret;
+}
+
 static bool parse_args(int argc, char **argv, params_t *params)
 {
     int opt = 0;
@@ -407,11 +882,18 @@ static bool parse_args(int argc, char **argv, params_t *params)
         {"details",  no_argument,       0, 1001},
         {"purge",    no_argument,       0, 1002},
         {"rollback", no_argument,       0, 1003},
+        {"verify",   no_argument,       0, 1004},
+        {"export",   no_argument,       0, 1005},
+        {"jobs",     required_argument, 0, 'j'},
+        {"since",    required_argument, 0, 'S'},
+        {"until",    required_argument, 0, 'U'},
+        {"format",   required_argument, 0, 'F'},
         {"from",     required_argument, 0, 'f'},
         {"to",       required_argument, 0, 't'},
         {"bulk",     no_argument,       0, 'b'},
         {"num",      required_argument, 0, 'n'},
         {"seq",      required_argument, 0, 's'},
+        {"metrics",  no_argument,       0, 'm'},
         {"old",      required_argument, 0, 'o'},
         {0, 0, 0, 0}
     };
@@ -420,7 +902,7 @@ static bool parse_args(int argc, char **argv, params_t *params)
     params->mode = MODE_SUMMARY;
     params->path = DEFAULT_PATH;
 
-    while ((opt = getopt_long(argc, argv, "hp:cf:t:bn:s:", long_opts, NULL)) != -1)
+    while ((opt = getopt_long(argc, argv, "hp:cf:t:bn:s:mj:S:U:F:", long_opts, NULL)) != -1)
     {
         switch (opt)
         {
@@ -450,6 +932,9 @@ static bool parse_args(int argc, char **argv, params_t *params)
             case 'b':
                 params->bulk = true;
                 break;
+            case 'm':
+                params->metrics = true;
+                break;
             case 'n':
                 if (!parse_u64(optarg, &params->num) || params->num == 0) {
                     fprintf(stderr, "%s: invalid --num\n", APP_NAME);
@@ -464,6 +949,38 @@ static bool parse_args(int argc, char **argv, params_t *params)
                 }
                 params->have_seq = true;
                 break;
+            case 'j':
+                if (!parse_u64(optarg, &params->jobs) || params->jobs == 0) {
+                    fprintf(stderr, "%s: invalid --jobs\n", APP_NAME);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'S':
+                if (!parse_u64(optarg, &params->since)) {
+                    fprintf(stderr, "%s: invalid --since\n", APP_NAME);
+                    exit(EXIT_FAILURE);
+                }
+                params->have_since = true;
+                break;
+            case 'U':
+                if (!parse_u64(optarg, &params->until)) {
+                    fprintf(stderr, "%s: invalid --until\n", APP_NAME);
+                    exit(EXIT_FAILURE);
+                }
+                params->have_until = true;
+                break;
+            case 'F':
+                if (strcmp(optarg, "raw") == 0)
+                    params->format = EXPORT_RAW;
+                else if (strcmp(optarg, "binary") == 0)
+                    params->format = EXPORT_BINARY;
+                else if (strcmp(optarg, "ndjson") == 0)
+                    params->format = EXPORT_NDJSON;
+                else {
+                    fprintf(stderr, "%s: invalid --format\n", APP_NAME);
+                    exit(EXIT_FAILURE);
+                }
+                break;
             case 1000:
                 params->mode = MODE_SUMMARY;
                 break;
@@ -476,6 +993,12 @@ static bool parse_args(int argc, char **argv, params_t *params)
             case 1003:
                 params->mode = MODE_ROLLBACK;
                 break;
+            case 1004:
+                params->mode = MODE_VERIFY;
+                break;
+            case 1005:
+                params->mode = MODE_EXPORT;
+                break;
             default:
                 exit(EXIT_FAILURE);
         }
@@ -526,6 +1049,10 @@ int main(int argc, char **argv)
             return cmd_purge(&params);
         case MODE_ROLLBACK:
             return cmd_rollback(&params);
+        case MODE_VERIFY:
+            return cmd_verify(&params);
+        case MODE_EXPORT:
+            return cmd_export(&params);
         default:
             break;
     }
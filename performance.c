@@ -10,13 +10,18 @@
 #include "journal.h"
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
 
 typedef struct {
     bool truncate;
     bool force_sync;
+    bool mmap;
+    bool verify;
 } params_journal_t;
 
 typedef struct {
+    size_t num_writers;
+    size_t group_commit;
     size_t bytes_per_record;
     size_t records_per_commit;
     size_t records_per_second;
@@ -41,6 +46,8 @@ typedef struct {
 } args_write_t;
 
 typedef struct {
+    size_t num_readers;
+    bool scaling;
     size_t records_per_second;
     size_t records_per_query;
     size_t max_seconds;
@@ -117,10 +124,11 @@ static int msleep(long msec)
     return res;
 }
 
-static void print_results_write(results_write_t *results)
+static void print_results_write(results_write_t *results, size_t num_writers)
 {
     double seconds = (double) results->time_ms / 1000.0;
     printf("write - result         = %s\n", ldb_strerror(results->rc));
+    printf("write - writers        = %zu\n", num_writers);
     printf("write - total time     = %.2lf seconds\n", seconds);
     printf("write - idle time      = %.2lf seconds\n", (double) results->idle_ms / 1000.0);
     printf("write - total records  = %zu\n", results->num_records);
@@ -132,10 +140,11 @@ static void print_results_write(results_write_t *results)
     printf("write - idle time (%%)  = %d%%\n", (int)(100.0 * (double) results->idle_ms / (double) results->time_ms));
 }
 
-static void print_results_read(results_read_t *results)
+static void print_results_read(results_read_t *results, size_t num_readers)
 {
     double seconds = results->time_ms / 1000.0;
     printf("read  - result         = %s\n", ldb_strerror(results->rc));
+    printf("read  - readers        = %zu\n", num_readers);
     printf("read  - total time     = %.2lf seconds\n", seconds);
     printf("read  - idle time      = %.2lf seconds\n", (double) results->idle_ms / 1000.0);
     printf("read  - total records  = %zu\n", results->num_records);
@@ -208,6 +217,50 @@ static void * run_write(void *args)
     return NULL;
 }
 
+// Aggregates the results of concurrent writers.
+// Time is the longest writer time, idle time is the average idle time.
+static void merge_results_write(results_write_t *results, const args_write_t *args, size_t num_writers)
+{
+    *results = (results_write_t){0};
+    results->rc = LDB_OK;
+
+    for (size_t i = 0; i < num_writers; i++)
+    {
+        const results_write_t *aux = &args[i].results;
+
+        results->time_ms = MAX(results->time_ms, aux->time_ms);
+        results->idle_ms += aux->idle_ms / num_writers;
+        results->num_records += aux->num_records;
+        results->num_bytes += aux->num_bytes;
+        results->num_commits += aux->num_commits;
+
+        if (aux->rc != LDB_OK)
+            results->rc = aux->rc;
+    }
+}
+
+// Aggregates the results of concurrent readers.
+// Time is the longest reader time, idle time is the average idle time.
+static void merge_results_read(results_read_t *results, const args_read_t *args, size_t num_readers)
+{
+    *results = (results_read_t){0};
+    results->rc = LDB_OK;
+
+    for (size_t i = 0; i < num_readers; i++)
+    {
+        const results_read_t *aux = &args[i].results;
+
+        results->time_ms = MAX(results->time_ms, aux->time_ms);
+        results->idle_ms += aux->idle_ms / num_readers;
+        results->num_records += aux->num_records;
+        results->num_bytes += aux->num_bytes;
+        results->num_queries += aux->num_queries;
+
+        if (aux->rc != LDB_OK)
+            results->rc = aux->rc;
+    }
+}
+
 static void * run_read(void *args)
 {
     ldb_journal_t *journal = ((args_read_t *) args)->journal;
@@ -223,6 +276,9 @@ static void * run_read(void *args)
     uint64_t seqnum = 0;
     size_t num = 0;
 
+    // rand() holds a global lock; each reader uses its own seed
+    unsigned int seed = (unsigned int) time(NULL) ^ (unsigned int)(uintptr_t) args;
+
     *results = (results_read_t){0};
     results->rc = LDB_OK;
 
@@ -246,7 +302,7 @@ static void * run_read(void *args)
                 }
             }
 
-            seqnum = stats.min_seqnum + rand() % stats.num_entries;
+            seqnum = stats.min_seqnum + rand_r(&seed) % stats.num_entries;
 
             if ((results->rc = ldb_read(journal, seqnum, entries, num_entries, buf, buf_len, &num)) != LDB_OK)
                 break;
@@ -289,6 +345,8 @@ static void help(void)
         "   -h, --help                          Display this help and quit." "\n" \
         "   -s, --force-sync                    Force sync after flush." "\n" \
         "   -a, --append                        Preserve existing journal (truncated by default)" "\n" \
+        "   -m, --mmap                          Read using memory-mapped files." "\n" \
+        "   -v, --verify                        Verify checksums on read." "\n" \
         "   --bpr, --bytes-per-record           Bytes per record (allowed suffixes: B, KB, MB, GB, TB)." "\n" \
         "   --rpc, --records-per-commit         Records per commit." "\n" \
         "   --rpq, --records-per-query          Records per query." "\n" \
@@ -300,6 +358,10 @@ static void help(void)
         "   --mbr, --max-bytes-read             Maximum number of bytes (allowed suffixes: B, KB, MB, GB, TB)." "\n" \
         "   --rpsw, --records-per-second-write  Records per second writing." "\n" \
         "   --rpsr, --records-per-second-read   Records per second reading." "\n" \
+        "   --nr, --num-readers                 Number of concurrent reader threads (default: 1)." "\n" \
+        "   --nw, --num-writers                 Number of concurrent writer threads (default: 1, requires group commit)." "\n" \
+        "   --gc, --group-commit                Group commit queue length in records (default: disabled)." "\n" \
+        "   --scaling                           Once writer ends, repeat the read test with 1, 2, 4, ..., nr readers." "\n" \
         "\n" \
         "Examples:" "\n" \
         "   # record size = 10KB" "\n" \
@@ -316,6 +378,16 @@ static void help(void)
         "   # writing 10000 records/sec for 10 seconds" "\n" \
         "   # reading 6000 records/sec for 10 seconds" "\n" \
         "   performance --msw=10 --bpr=10KB --rpsw=10000 --rpc=40 --msr=10 --rpsr=6000 --rpq=100" "\n" \
+        "\n" \
+        "   # record size = 1KB" "\n" \
+        "   # writing at full speed for 5 seconds" "\n" \
+        "   # reading at full speed for 5 seconds using 1, 2, 4, 8 and 16 readers" "\n" \
+        "   performance --bpr=1KB --msw=5 --rpc=40 --msr=5 --rpq=100 --nr=16 --scaling" "\n" \
+        "\n" \
+        "   # record size = 1KB" "\n" \
+        "   # 16 writers committing 1 record at a time for 5 seconds with fsync" "\n" \
+        "   # group commit (one fdatasync per batch of up to 256 records)" "\n" \
+        "   performance -s --bpr=1KB --msw=5 --rpc=1 --msr=5 --rpq=100 --nw=16 --gc=256" "\n" \
         "\n";
 
     printf("%s", msg);
@@ -359,11 +431,13 @@ static size_t parse_bytes(const char *str, const char *arg)
 
 static void parse_args(int argc, char *argv[], params_journal_t *params_journal, params_write_t *params_write, params_read_t *params_read)
 {
-    const char* const options1 = "has" ;
+    const char* const options1 = "hasmv" ;
     const struct option options2[] = {
         { "help",                     0,  NULL,  'h' },
         { "append",                   0,  NULL,  'a' },
         { "force-sync",               0,  NULL,  's' },
+        { "mmap",                     0,  NULL,  'm' },
+        { "verify",                   0,  NULL,  'v' },
         { "bytes-per-record",         1,  NULL,  301 },
         { "bpr",                      1,  NULL,  301 },
         { "records-per-commit",       1,  NULL,  302 },
@@ -386,15 +460,26 @@ static void parse_args(int argc, char *argv[], params_journal_t *params_journal,
         { "rpsw",                     1,  NULL,  310 },
         { "records-per-second-read",  1,  NULL,  311 },
         { "rpsr",                     1,  NULL,  311 },
+        { "num-readers",              1,  NULL,  312 },
+        { "nr",                       1,  NULL,  312 },
+        { "scaling",                  0,  NULL,  313 },
+        { "num-writers",              1,  NULL,  314 },
+        { "nw",                       1,  NULL,  314 },
+        { "group-commit",             1,  NULL,  315 },
+        { "gc",                       1,  NULL,  315 },
         { NULL,                       0,  NULL,   0  }
     };
 
     *params_journal = (params_journal_t) {
         .truncate = true,
-        .force_sync = false
+        .force_sync = false,
+        .mmap = false,
+        .verify = false
     };
 
     *params_write = (params_write_t){
+        .num_writers = 1,
+        .group_commit = 0,
         .bytes_per_record = 0,
         .records_per_commit = 0,
         .records_per_second = SIZE_MAX,
@@ -404,6 +489,8 @@ static void parse_args(int argc, char *argv[], params_journal_t *params_journal,
     };
 
     *params_read = (params_read_t){
+        .num_readers = 1,
+        .scaling = false,
         .records_per_query = 0,
         .records_per_second = SIZE_MAX,
         .max_seconds = SIZE_MAX,
@@ -432,6 +519,12 @@ static void parse_args(int argc, char *argv[], params_journal_t *params_journal,
             case 's':
                 params_journal->force_sync = true;
                 break;
+            case 'm':
+                params_journal->mmap = true;
+                break;
+            case 'v':
+                params_journal->verify = true;
+                break;
             case 301:
                 params_write->bytes_per_record = parse_bytes(optarg, "bytes-per-record");
                 break;
@@ -465,6 +558,18 @@ static void parse_args(int argc, char *argv[], params_journal_t *params_journal,
             case 311:
                 params_read->records_per_second = parse_int(optarg, "records-per-second-read");
                 break;
+            case 312:
+                params_read->num_readers = parse_int(optarg, "num-readers");
+                break;
+            case 313:
+                params_read->scaling = true;
+                break;
+            case 314:
+                params_write->num_writers = parse_int(optarg, "num-writers");
+                break;
+            case 315:
+                params_write->group_commit = parse_int(optarg, "group-commit");
+                break;
             default:
                 fprintf(stderr, "Unexpected error\n");
                 exit(EXIT_FAILURE);
@@ -505,6 +610,100 @@ static void parse_args(int argc, char *argv[], params_journal_t *params_journal,
         fprintf(stderr, "Error: records-per-query not set\n");
         exit(EXIT_FAILURE);
     }
+
+    if (params_read->num_readers == 0) {
+        fprintf(stderr, "Error: num-readers must be greater than 0\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (params_write->num_writers == 0) {
+        fprintf(stderr, "Error: num-writers must be greater than 0\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (params_write->num_writers > 1 && params_write->group_commit == 0) {
+        fprintf(stderr, "Error: num-writers greater than 1 requires group-commit\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Starts num_writers concurrent writers.
+// Write limits (records, bytes, rate) are shared between writers.
+static args_write_t * start_writers(ldb_journal_t *journal, const params_write_t *params, pthread_t *threads)
+{
+    size_t num_writers = params->num_writers;
+    args_write_t *args = calloc(num_writers, sizeof(args_write_t));
+
+    if (!args) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < num_writers; i++)
+    {
+        args[i] = (args_write_t){ .journal = journal, .params = *params };
+
+        if (params->max_records != SIZE_MAX)
+            args[i].params.max_records = MAX(params->max_records / num_writers, 1);
+        if (params->max_bytes != SIZE_MAX)
+            args[i].params.max_bytes = MAX(params->max_bytes / num_writers, 1);
+        if (params->records_per_second != SIZE_MAX)
+            args[i].params.records_per_second = MAX(params->records_per_second / num_writers, 1);
+
+        pthread_create(&threads[i], NULL, run_write, &args[i]);
+    }
+
+    return args;
+}
+
+// Runs num_readers concurrent readers and aggregates their results.
+static void run_readers(ldb_journal_t *journal, const params_read_t *params, size_t num_readers, results_read_t *results)
+{
+    pthread_t *threads = calloc(num_readers, sizeof(pthread_t));
+    args_read_t *args = calloc(num_readers, sizeof(args_read_t));
+
+    if (!threads || !args) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < num_readers; i++) {
+        args[i] = (args_read_t){ .journal = journal, .params = *params };
+        pthread_create(&threads[i], NULL, run_read, &args[i]);
+    }
+
+    for (size_t i = 0; i < num_readers; i++)
+        pthread_join(threads[i], NULL);
+
+    merge_results_read(results, args, num_readers);
+
+    free(threads);
+    free(args);
+}
+
+// Reads the (static) journal with 1, 2, 4, ..., num_readers threads.
+static void run_scaling(ldb_journal_t *journal, const params_read_t *params)
+{
+    results_read_t results = {0};
+    double base = 0.0;
+
+    printf("scaling - readers  records/second  speedup\n");
+
+    for (size_t n = 1; !interrupted; n = MIN(2 * n, params->num_readers))
+    {
+        run_readers(journal, params, n, &results);
+
+        double seconds = (double) results.time_ms / 1000.0;
+        double rate = (seconds > 0.0 ? (double) results.num_records / seconds : 0.0);
+
+        if (n == 1)
+            base = rate;
+
+        printf("scaling - %7zu  %14.2lf  %7.2lf\n", n, rate, (base > 0.0 ? rate / base : 0.0));
+
+        if (results.rc != LDB_OK || n == params->num_readers)
+            break;
+    }
 }
 
 int main(int argc, char *argv[])
@@ -520,7 +719,6 @@ int main(int argc, char *argv[])
         remove("performance.idx");
     }
 
-    srand(time(NULL));
     signal(SIGINT, signal_handler);
 
     ldb_journal_t *journal = ldb_alloc();
@@ -531,20 +729,42 @@ int main(int argc, char *argv[])
     }
 
     ldb_set_fsync(journal, params_journal.force_sync);
+    ldb_set_verify(journal, params_journal.verify);
+
+    if (params_journal.mmap && ldb_set_mmap(journal, LDB_MMAP_ALL) != LDB_OK) {
+        fprintf(stderr, "error mapping journal\n");
+        return EXIT_FAILURE;
+    }
+
+    if (params_write.group_commit > 0 && ldb_set_group_commit(journal, params_write.group_commit) != LDB_OK) {
+        fprintf(stderr, "error enabling group commit\n");
+        return EXIT_FAILURE;
+    }
+
+    pthread_t *threads_write = calloc(params_write.num_writers, sizeof(pthread_t));
+    if (!threads_write) {
+        fprintf(stderr, "Error: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    args_write_t *args_write = start_writers(journal, &params_write, threads_write);
+
+    results_read_t results_read = {0};
+    run_readers(journal, &params_read, params_read.num_readers, &results_read);
 
-    pthread_t thread_write;
-    args_write_t args_write = { .journal = journal, .params = params_write };
-    pthread_create(&thread_write, NULL, run_write, &args_write); 
+    for (size_t i = 0; i < params_write.num_writers; i++)
+        pthread_join(threads_write[i], NULL);
 
-    pthread_t thread_read;
-    args_read_t args_read = { .journal = journal, .params = params_read };
-    pthread_create(&thread_read, NULL, run_read, &args_read); 
+    results_write_t results_write = {0};
+    merge_results_write(&results_write, args_write, params_write.num_writers);
+    free(threads_write);
+    free(args_write);
 
-    pthread_join(thread_write, NULL);
-    pthread_join(thread_read, NULL);
+    print_results_write(&results_write, params_write.num_writers);
+    print_results_read(&results_read, params_read.num_readers);
 
-    print_results_write(&args_write.results);
-    print_results_read(&args_read.results);
+    if (params_read.scaling)
+        run_scaling(journal, &params_read);
 
     ldb_close(journal);
     ldb_free(journal);
@@ -1,6 +1,7 @@
 #include "acutest.h"
 #include "journal.h"
 #include "journal.c"
+#include <poll.h>
 
 void append_entries(ldb_journal_t *journal, uint64_t seqnum1, uint64_t seqnum2)
 {
@@ -29,6 +30,16 @@ void append_entries(ldb_journal_t *journal, uint64_t seqnum1, uint64_t seqnum2)
     }
 }
 
+// switches an empty journal to the legacy idx format (one full record per entry)
+void set_idx_format_wide(ldb_journal_t *journal)
+{
+    uint32_t format = LDB_IDX_FORMAT_WIDE;
+
+    TEST_ASSERT(journal->state.seqnum1 == 0);
+    TEST_ASSERT(pwrite(fileno(journal->idx_fp), &format, sizeof(format), (off_t) offsetof(ldb_header_idx_t, format)) == sizeof(format));
+    journal->idx_format = format;
+}
+
 void test_version(void)
 {
     const char *version = ldb_version();
@@ -103,6 +114,18 @@ void test_crc32(void)
     size_t checksum = ldb_crc32(str11, strlen(str11), 0);
     checksum = ldb_crc32(str12, strlen(str12), checksum);
     TEST_CHECK(checksum == 0x0D4A1185);
+
+    // all methods give identical results (any length and alignment)
+    unsigned char buf[300];
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = (unsigned char) (i * 31 + 7);
+
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t len = 0; len + offset <= sizeof(buf); len += 13) {
+            uint32_t crc = ldb_crc32_bytewise(buf + offset, len, 0xFFFFFFFF);
+            TEST_CHECK(ldb_crc32((const char *) buf + offset, len, 0) == ~crc);
+        }
+    }
 }
 
 void test_get_millis(void)
@@ -243,7 +266,7 @@ void test_open_empty(void)
     remove("test.idx");
 
     // create journal
-    ldb_create_file_dat("test.dat");
+    ldb_create_file_dat("test.dat", LDB_FILE_FORMAT, LDB_CODEC_NONE);
 
     // open empty journal
     TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
@@ -268,7 +291,7 @@ void test_open_invl_dat_header(void)
     ldb_header_dat_t header = {
         .magic_number = LDB_DAT_MAGIC_NUMBER,
         .format = LDB_FILE_FORMAT,
-        .padding = 0,
+        .codec = LDB_CODEC_NONE,
         .metadata = {0}
     };
 
@@ -290,7 +313,15 @@ void test_open_invl_dat_header(void)
     // invalid file format
     fp = fopen("test.dat", "w");
     header.magic_number = LDB_DAT_MAGIC_NUMBER;
-    header.format = LDB_FILE_FORMAT + 1;
+    header.format = LDB_FILE_FORMAT_BATCH + 1;
+    fwrite(&header, sizeof(ldb_header_dat_t), 1, fp);
+    fclose(fp);
+    TEST_CHECK(ldb_open(&journal, "", "test", false) == LDB_ERR_FMT_DAT);
+
+    // unknown codec
+    fp = fopen("test.dat", "w");
+    header.format = LDB_FILE_FORMAT;
+    header.codec = LDB_CODEC_LZ4 + 1;
     fwrite(&header, sizeof(ldb_header_dat_t), 1, fp);
     fclose(fp);
     TEST_CHECK(ldb_open(&journal, "", "test", false) == LDB_ERR_FMT_DAT);
@@ -489,6 +520,7 @@ void _test_open_rollbacked_ok(bool check)
 
     // create empty journal
     TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    set_idx_format_wide(&journal);
 
     // inserting 4 entries
     for(int i = 10; i < 14; i++)
@@ -624,6 +656,7 @@ void test_open_idx_check_fails_1(void)
 
     // create empty journal
     TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    set_idx_format_wide(&journal);
 
     // inserting 4 entries
     for(int i = 10; i < 14; i++)
@@ -668,6 +701,7 @@ void test_open_idx_check_fails_2(void)
 
     // create empty journal
     TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    set_idx_format_wide(&journal);
 
     // inserting 4 entries
     for(int i = 10; i < 14; i++)
@@ -699,6 +733,140 @@ void test_open_idx_check_fails_2(void)
     ldb_close(&journal);
 }
 
+void test_open_checkpoint(void)
+{
+    ldb_journal_t journal = {0};
+    ldb_record_idx_t record_idx = {0};
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    append_entries(&journal, 1, 1000);
+    TEST_CHECK(journal.checkpoint.seqnum == 0);
+    ldb_close(&journal);
+    TEST_CHECK(ldb_read_checkpoint("test.idx").seqnum == 0);
+
+    // checked open sets the checkpoint, stored on close
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.checkpoint.seqnum == 1000);
+    append_entries(&journal, 1001, 1100);
+    TEST_CHECK(journal.checkpoint.seqnum == 1000);
+    ldb_close(&journal);
+    TEST_CHECK(ldb_read_checkpoint("test.idx").seqnum == 1000);
+
+    // checkpoint invalidated while journal is open
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(journal.checkpoint.seqnum == 1000);
+    TEST_CHECK(ldb_read_checkpoint("test.idx").seqnum == 0);
+
+    // corrupting data of entry 500 (before checkpoint)
+    TEST_ASSERT(ldb_read_record_idx(&journal, &journal.state, 500, &record_idx) == LDB_OK);
+    TEST_ASSERT(pwrite(fileno(journal.dat_fp), "X", 1, (off_t)(record_idx.pos + sizeof(ldb_record_dat_t))) == 1);
+    ldb_close(&journal);
+
+    // only the tail after the checkpoint is verified
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum2 == 1100);
+    TEST_CHECK(journal.checkpoint.seqnum == 1100);
+
+    // rollback moves the checkpoint
+    TEST_CHECK(ldb_rollback(&journal, 900) == 200);
+    TEST_CHECK(journal.checkpoint.seqnum == 900);
+
+    // purge shifts the checkpoint position
+    TEST_CHECK(ldb_purge(&journal, 100) == 99);
+    TEST_CHECK(journal.checkpoint.seqnum == 900);
+    TEST_ASSERT(ldb_read_record_idx(&journal, &journal.state, 900, &record_idx) == LDB_OK);
+    TEST_CHECK(journal.checkpoint.pos == record_idx.pos);
+
+    // corrupting data of entry 950 (after checkpoint)
+    append_entries(&journal, 901, 1000);
+    TEST_ASSERT(ldb_read_record_idx(&journal, &journal.state, 950, &record_idx) == LDB_OK);
+    TEST_ASSERT(pwrite(fileno(journal.dat_fp), "X", 1, (off_t)(record_idx.pos + sizeof(ldb_record_dat_t))) == 1);
+    ldb_close(&journal);
+    TEST_CHECK(ldb_read_checkpoint("test.idx").seqnum == 900);
+
+    TEST_CHECK(ldb_open(&journal, "", "test", true) == LDB_ERR_CHECKSUM);
+
+    // entry 500 (before checkpoint) remains unverified
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(ldb_rollback(&journal, 949) == 51);
+    ldb_close(&journal);
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum1 == 100);
+    TEST_CHECK(journal.state.seqnum2 == 949);
+    ldb_close(&journal);
+}
+
+void test_scan_dat(void)
+{
+    static char data[1024] = {0};
+    ldb_journal_t journal = {0};
+    ldb_entry_t entries[100] = {{0}};
+    ldb_record_idx_t record_idx = {0};
+    ldb_scan_t scan = {0};
+    ldb_record_dat_t record_none = {0};
+    size_t dat_end = 0;
+    size_t total = 0;
+    size_t num = 0;
+    char *big = NULL;
+    int fd = -1;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+
+    for (uint64_t seqnum = 1; seqnum <= 20000; seqnum += 100) {
+        for (size_t i = 0; i < 100; i++)
+            entries[i] = (ldb_entry_t){ .seqnum = seqnum + i, .timestamp = 1, .data = data, .data_len = sizeof(data) - i };
+        TEST_ASSERT(ldb_append(&journal, entries, 100, &num) == LDB_OK);
+    }
+
+    // entry larger than the scan chunk
+    big = (char *) calloc(LDB_SCAN_CHUNK + 100, 1);
+    TEST_ASSERT(big != NULL);
+    entries[0] = (ldb_entry_t){ .seqnum = 20001, .timestamp = 1, .data = big, .data_len = LDB_SCAN_CHUNK + 100 };
+    TEST_ASSERT(ldb_append(&journal, entries, 1, &num) == LDB_OK);
+    append_entries(&journal, 20002, 20010);
+    dat_end = journal.dat_end;
+
+    // corrupting data of entry 12345
+    TEST_ASSERT(ldb_read_record_idx(&journal, &journal.state, 12345, &record_idx) == LDB_OK);
+    TEST_ASSERT(pwrite(fileno(journal.dat_fp), "X", 1, (off_t)(record_idx.pos + sizeof(ldb_record_dat_t))) == 1);
+    ldb_close(&journal);
+    free(big);
+
+    fd = open("test.dat", O_RDONLY);
+    TEST_ASSERT(fd != -1);
+
+    // full scan (verification starting after the corrupted entry)
+    TEST_ASSERT(ldb_scan_init(&scan, fd, LDB_FILE_FORMAT, &record_none, sizeof(ldb_header_dat_t), dat_end, record_idx.pos + 1) == LDB_OK);
+    scan.num_threads = LDB_SCAN_THREADS;
+    while (ldb_scan_next(&scan) == LDB_OK && scan.num > 0) {
+        for (size_t i = 0; i < scan.num; i++)
+            TEST_CHECK(scan.records[i].seqnum == total + i + 1);
+        total += scan.num;
+    }
+    TEST_CHECK(total == 20010);
+    TEST_CHECK(scan.next == dat_end);
+    TEST_CHECK(scan.eof);
+    ldb_scan_free(&scan);
+
+    // scan stops at the corrupted entry
+    total = 0;
+    TEST_ASSERT(ldb_scan_init(&scan, fd, LDB_FILE_FORMAT, &record_none, sizeof(ldb_header_dat_t), dat_end, 0) == LDB_OK);
+    scan.num_threads = LDB_SCAN_THREADS;
+    while (ldb_scan_next(&scan) == LDB_OK && scan.num > 0)
+        total += scan.num;
+    TEST_CHECK(total + scan.num == 12344);
+    TEST_CHECK(scan.next == record_idx.pos);
+    ldb_scan_free(&scan);
+
+    close(fd);
+}
+
 void test_append_invalid_args(void)
 {
     ldb_journal_t journal = {0};
@@ -885,6 +1053,128 @@ bool check_entry(ldb_entry_t *entry, uint64_t seqnum, const char *data)
             (entry->data == data || (entry->data != NULL && data != NULL && strcmp(entry->data, data) == 0)));
 }
 
+void test_append_multiple_chunks(void)
+{
+    ldb_journal_t journal = {0};
+    ldb_entry_t entries[150] = {{0}};
+    ldb_entry_t aux[3] = {{0}};
+    char data[150][16] = {{0}};
+    char buf[1024] = {0};
+    size_t num = 0;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    // entries span several writev() chunks (odd entries without data)
+    for (size_t i = 0; i < 150; i++) {
+        snprintf(data[i], sizeof(data[i]), "data-%d", (int) i + 1);
+        entries[i].timestamp = 1000 + i;
+        entries[i].data_len = (i % 2 ? 0 : (uint32_t) strlen(data[i]) + 1);
+        entries[i].data = (i % 2 ? NULL : data[i]);
+    }
+
+    // broken sequence in the second chunk
+    entries[100].seqnum = 999;
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(ldb_append(&journal, entries, 150, &num) == LDB_ERR_ENTRY_SEQNUM);
+    TEST_CHECK(num == 100);
+    TEST_CHECK(journal.state.seqnum2 == 100);
+
+    entries[100].seqnum = 0;
+    TEST_CHECK(ldb_append(&journal, entries + 100, 50, &num) == LDB_OK);
+    TEST_CHECK(num == 50);
+    ldb_close(&journal);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum1 == 1);
+    TEST_CHECK(journal.state.seqnum2 == 150);
+    TEST_CHECK(ldb_read(&journal, 64, aux, 3, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 3);
+    TEST_CHECK(aux[0].seqnum == 64 && aux[0].data_len == 0);
+    TEST_CHECK(check_entry(&aux[1], 65, "data-65"));
+    TEST_CHECK(aux[2].seqnum == 66 && aux[2].data_len == 0);
+    TEST_CHECK(aux[1].timestamp == 1064);
+    TEST_CHECK(ldb_read(&journal, 149, aux, 3, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 2);
+    TEST_CHECK(check_entry(&aux[0], 149, "data-149"));
+    ldb_close(&journal);
+}
+
+void test_append_buf(void)
+{
+    ldb_journal_t journal = {0};
+    ldb_entry_t entries[200] = {{0}};
+    uint64_t timestamps[150] = {0};
+    uint32_t lengths[150] = {0};
+    char arena[150 * 16] = {0};
+    char buf[8 * 1024] = {0};
+    char data[32] = {0};
+    size_t num = 0;
+    size_t off = 0;
+    bool ok = true;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+
+    // entries serialized in one arena
+    for (int i = 0; i < 150; i++) {
+        lengths[i] = (uint32_t) snprintf(arena + off, sizeof(arena) - off, "data-%d", 20 + i) + 1;
+        timestamps[i] = (uint64_t) (20 + i - (20 + i) % 10);
+        off += lengths[i];
+    }
+
+    TEST_CHECK(ldb_append_buf(NULL, 20, timestamps, lengths, 150, arena, &num) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_append_buf(&journal, 20, timestamps, NULL, 150, arena, &num) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_append_buf(&journal, 20, timestamps, lengths, 0, arena, &num) == LDB_OK);
+    TEST_CHECK(num == 0);
+    TEST_CHECK(ldb_append_buf(&journal, 20, timestamps, lengths, 1, NULL, &num) == LDB_ERR_ENTRY_DATA);
+    TEST_CHECK(num == 0);
+
+    // several writev chunks
+    TEST_CHECK(ldb_append_buf(&journal, 20, timestamps, lengths, 150, arena, &num) == LDB_OK);
+    TEST_CHECK(num == 150);
+    TEST_CHECK(journal.state.seqnum1 == 20);
+    TEST_CHECK(journal.state.seqnum2 == 169);
+    TEST_CHECK(journal.state.timestamp2 == 160);
+
+    TEST_CHECK(ldb_read(&journal, 20, entries, 200, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 150);
+    for (size_t i = 0; i < num && ok; i++) {
+        snprintf(data, sizeof(data), "data-%d", (int) (20 + i));
+        ok = check_entry(&entries[i], 20 + i, data) && entries[i].timestamp == timestamps[i];
+    }
+    TEST_CHECK(ok);
+
+    // system assigned seqnums and timestamps
+    TEST_CHECK(ldb_append_buf(&journal, 0, NULL, lengths, 3, arena, &num) == LDB_OK);
+    TEST_CHECK(num == 3);
+    TEST_CHECK(ldb_read(&journal, 170, entries, 3, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 3);
+    TEST_CHECK(check_entry(&entries[0], 170, "data-20"));
+    TEST_CHECK(check_entry(&entries[2], 172, "data-22"));
+    TEST_CHECK(entries[0].timestamp >= 160);
+
+    // broken sequence
+    TEST_CHECK(ldb_append_buf(&journal, 500, NULL, lengths, 3, arena, &num) == LDB_ERR_ENTRY_SEQNUM);
+    TEST_CHECK(num == 0);
+
+    // group commit (one request)
+    TEST_ASSERT(ldb_set_group_commit(&journal, 1000) == LDB_OK);
+    TEST_CHECK(ldb_append_buf(&journal, 173, NULL, lengths, 150, arena, &num) == LDB_OK);
+    TEST_CHECK(num == 150);
+    TEST_CHECK(journal.state.seqnum2 == 322);
+    TEST_CHECK(ldb_read(&journal, 173, entries, 200, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 150);
+    TEST_CHECK(check_entry(&entries[0], 173, "data-20"));
+    TEST_CHECK(check_entry(&entries[149], 322, "data-169"));
+    TEST_ASSERT(ldb_set_group_commit(&journal, 0) == LDB_OK);
+
+    ldb_close(&journal);
+}
+
 void test_read_invalid_args(void)
 {
     ldb_journal_t journal = {0};
@@ -999,6 +1289,217 @@ void test_read_nominal_case(void)
     ldb_close(&journal);
 }
 
+typedef struct read_worker_t {
+    ldb_journal_t *journal;
+    uint64_t seqnum1;
+    uint64_t seqnum2;
+    size_t num_errors;
+} read_worker_t;
+
+void * run_read_worker(void *args)
+{
+    read_worker_t *worker = (read_worker_t *) args;
+    ldb_entry_t entries[10] = {{0}};
+    char data[128] = {0};
+    char buf[1024] = {0};
+    size_t num = 0;
+
+    for (int i = 0; i < 200; i++)
+    {
+        uint64_t seqnum = worker->seqnum1 + (uint64_t) i % (worker->seqnum2 - worker->seqnum1);
+
+        if (ldb_read(worker->journal, seqnum, entries, 10, buf, sizeof(buf), &num) != LDB_OK || num == 0) {
+            worker->num_errors++;
+            continue;
+        }
+
+        for (size_t j = 0; j < num; j++) {
+            snprintf(data, sizeof(data), "data-%d", (int)(seqnum + j));
+            if (!check_entry(&entries[j], seqnum + j, data))
+                worker->num_errors++;
+        }
+    }
+
+    return NULL;
+}
+
+void test_read_concurrent(void)
+{
+    ldb_journal_t journal = {0};
+    pthread_t threads[4];
+    read_worker_t workers[4];
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    append_entries(&journal, 20, 314);
+
+    for (int i = 0; i < 4; i++) {
+        workers[i] = (read_worker_t){ .journal = &journal, .seqnum1 = 20, .seqnum2 = 314, .num_errors = 0 };
+        TEST_ASSERT(pthread_create(&threads[i], NULL, run_read_worker, &workers[i]) == 0);
+    }
+
+    // readers share the file lock with the writer
+    append_entries(&journal, 315, 999);
+
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        TEST_CHECK(workers[i].num_errors == 0);
+    }
+
+    ldb_close(&journal);
+}
+
+typedef struct state_worker_t {
+    ldb_journal_t *journal;
+    bool stop;
+    size_t num_reads;
+    size_t num_errors;
+} state_worker_t;
+
+void * run_state_worker(void *args)
+{
+    state_worker_t *worker = (state_worker_t *) args;
+    ldb_state_t state = {0};
+
+    while (!LDB_ATOMIC_LOAD(&worker->stop) || worker->num_reads == 0)
+    {
+        ldb_get_state(worker->journal, &state);
+        worker->num_reads++;
+
+        // torn snapshots mix values of distinct publications
+        if (state.seqnum1 != 20 || state.timestamp1 != 20 || state.seqnum2 < 20 ||
+            state.timestamp2 != state.seqnum2 - state.seqnum2 % 10)
+            worker->num_errors++;
+    }
+
+    return NULL;
+}
+
+void test_state_concurrent(void)
+{
+    ldb_journal_t journal = {0};
+    pthread_t threads[4];
+    state_worker_t workers[4];
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    append_entries(&journal, 20, 20);
+
+    for (int i = 0; i < 4; i++) {
+        workers[i] = (state_worker_t){ .journal = &journal, .stop = false, .num_reads = 0, .num_errors = 0 };
+        TEST_ASSERT(pthread_create(&threads[i], NULL, run_state_worker, &workers[i]) == 0);
+    }
+
+    // readers poll the state without locks while it is published
+    for (uint64_t seqnum = 21; seqnum < 1000; seqnum += 100) {
+        append_entries(&journal, seqnum, seqnum + 149);
+        TEST_CHECK(ldb_rollback(&journal, seqnum + 99) == 50);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        LDB_ATOMIC_STORE(&workers[i].stop, true);
+        pthread_join(threads[i], NULL);
+        TEST_CHECK(workers[i].num_reads > 0);
+        TEST_CHECK(workers[i].num_errors == 0);
+    }
+
+    TEST_CHECK(journal.state_seq % 2 == 0);
+    TEST_CHECK(journal.state.seqnum2 == 1020);
+
+    ldb_close(&journal);
+}
+
+void check_read_multi(ldb_journal_t *journal)
+{
+    ldb_range_t ranges[] = {{500, 3}, {100, 5}, {502, 4}, {990, 50}, {10, 15}, {300, 0}, {2000, 5}};
+    uint64_t expected[27] = {0};
+    ldb_entry_t entries[30] = {{0}};
+    char buf[4096] = {0};
+    char data[32] = {0};
+    size_t num = 0;
+    size_t n = 0;
+
+    for (uint64_t seqnum = 20; seqnum <= 24; seqnum++) expected[n++] = seqnum;
+    for (uint64_t seqnum = 100; seqnum <= 104; seqnum++) expected[n++] = seqnum;
+    for (uint64_t seqnum = 500; seqnum <= 505; seqnum++) expected[n++] = seqnum;
+    for (uint64_t seqnum = 990; seqnum <= 1000; seqnum++) expected[n++] = seqnum;
+
+    // sorted, clipped and merged
+    TEST_CHECK(ldb_read_multi(journal, ranges, 7, entries, 30, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 27);
+
+    for (size_t i = 0; i < num; i++) {
+        snprintf(data, sizeof(data), "data-%d", (int) expected[i]);
+        TEST_CHECK(check_entry(&entries[i], expected[i], data));
+    }
+
+    TEST_CHECK(entries[27].seqnum == 0);
+
+    // entries limit
+    TEST_CHECK(ldb_read_multi(journal, ranges, 7, entries, 7, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 7);
+    TEST_CHECK(check_entry(&entries[6], 101, "data-101"));
+
+    // buffer exhausted
+    TEST_CHECK(ldb_read_multi(journal, ranges, 7, entries, 30, buf, 200, &num) == LDB_OK);
+    TEST_CHECK(num > 0 && num < 27);
+    TEST_CHECK(entries[num].seqnum == expected[num]);
+    TEST_CHECK(entries[num].data == NULL);
+
+    for (size_t i = 0; i < num; i++) {
+        snprintf(data, sizeof(data), "data-%d", (int) expected[i]);
+        TEST_CHECK(check_entry(&entries[i], expected[i], data));
+    }
+
+    // nothing to read
+    TEST_CHECK(ldb_read_multi(journal, ranges + 5, 2, entries, 30, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 0);
+    TEST_CHECK(ldb_read_multi(journal, NULL, 0, entries, 30, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 0);
+}
+
+void test_read_multi(void)
+{
+    ldb_journal_t journal = {0};
+    ldb_range_t range = {1, 1};
+    ldb_entry_t entries[10] = {{0}};
+    char buf[1024] = {0};
+    size_t num = 0;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_CHECK(ldb_read_multi(NULL, &range, 1, entries, 10, buf, sizeof(buf), &num) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_read_multi(&journal, NULL, 1, entries, 10, buf, sizeof(buf), &num) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_read_multi(&journal, &range, 1, NULL, 10, buf, sizeof(buf), &num) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_read_multi(&journal, &range, 1, entries, 0, buf, sizeof(buf), &num) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_read_multi(&journal, &range, 1, entries, 10, NULL, sizeof(buf), &num) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_read_multi(&journal, &range, 1, entries, 10, buf, 10, &num) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_read_multi(&journal, &range, 1, entries, 10, buf, sizeof(buf), &num) == LDB_ERR);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(ldb_read_multi(&journal, &range, 1, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 0);
+    append_entries(&journal, 20, 1000);
+    check_read_multi(&journal);
+    ldb_close(&journal);
+
+    // variable-length records, compressed
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(ldb_set_format(&journal, LDB_FORMAT_DENSE) == LDB_OK);
+    TEST_CHECK(ldb_set_compression(&journal, LDB_CODEC_LZ4) == LDB_OK);
+    append_entries(&journal, 20, 1000);
+    check_read_multi(&journal);
+    ldb_close(&journal);
+}
+
 void test_stats_invalid_args(void)
 {
     ldb_journal_t journal = {0};
@@ -1037,13 +1538,13 @@ void test_stats_nominal_case(void)
     TEST_CHECK(stats.min_seqnum == 20);
     TEST_CHECK(stats.max_seqnum == 314);
     TEST_CHECK(stats.num_entries == 295);
-    TEST_CHECK(stats.index_size == 7080);
+    TEST_CHECK(stats.index_size == 2376);
 
     TEST_CHECK(ldb_stats(&journal, 100, 200, &stats) == LDB_OK);
     TEST_CHECK(stats.min_seqnum == 100);
     TEST_CHECK(stats.max_seqnum == 200);
     TEST_CHECK(stats.num_entries == 101);
-    TEST_CHECK(stats.index_size == 2424);
+    TEST_CHECK(stats.index_size == 808);
 
     ldb_close(&journal);
 }
@@ -1181,6 +1682,73 @@ void test_rollback_nominal_case(void)
     ldb_close(&journal);
 }
 
+static size_t file_size(const char *path)
+{
+    struct stat statbuf = {0};
+
+    return (stat(path, &statbuf) == 0 ? (size_t) statbuf.st_size : 0);
+}
+
+void test_rollback_tail(void)
+{
+    ldb_journal_t journal = {0};
+    ldb_entry_t entries[10] = {{0}};
+    ldb_record_idx_t record_idx = {0};
+    char buf[1024] = {0};
+    char zeros[64] = {0};
+    size_t dat_len = 0;
+    size_t idx_len = 0;
+    size_t num = 0;
+    FILE *fp = NULL;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    append_entries(&journal, 1, 20000);
+    dat_len = file_size("test.dat");
+    idx_len = file_size("test.idx");
+
+    // removed content reads as zeros, file sizes are preserved
+    TEST_CHECK(ldb_rollback(&journal, 100) == 19900);
+    TEST_CHECK(file_size("test.dat") == dat_len);
+    TEST_CHECK(file_size("test.idx") == idx_len);
+    TEST_ASSERT(pread(fileno(journal.dat_fp), buf, sizeof(zeros), (off_t) journal.dat_end) == (ssize_t) sizeof(zeros));
+    TEST_CHECK(memcmp(buf, zeros, sizeof(zeros)) == 0);
+    TEST_ASSERT(pread(fileno(journal.idx_fp), buf, sizeof(zeros), (off_t) ldb_get_end_idx(journal.idx_format, &journal.state)) == (ssize_t) sizeof(zeros));
+    TEST_CHECK(memcmp(buf, zeros, sizeof(zeros)) == 0);
+
+    TEST_CHECK(ldb_read(&journal, 95, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 6);
+    TEST_CHECK(entries[6].seqnum == 0);
+
+    append_entries(&journal, 101, 200);
+    TEST_CHECK(ldb_read(&journal, 195, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 6);
+    TEST_CHECK(check_entry(&entries[5], 200, "data-200"));
+    TEST_ASSERT(ldb_read_record_idx(&journal, &journal.state, 151, &record_idx) == LDB_OK);
+    ldb_close(&journal);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum1 == 1);
+    TEST_CHECK(journal.state.seqnum2 == 200);
+    ldb_close(&journal);
+
+    // crash after removing the dat tail (idx rebuilt)
+    fp = fopen("test.dat", "r+");
+    TEST_ASSERT(fp != NULL);
+    TEST_CHECK(ldb_punch_tail(fp, record_idx.pos));
+    fclose(fp);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum1 == 1);
+    TEST_CHECK(journal.state.seqnum2 == 150);
+    TEST_CHECK(ldb_read(&journal, 145, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 6);
+    TEST_CHECK(check_entry(&entries[5], 150, "data-150"));
+    ldb_close(&journal);
+}
+
 void test_purge_invalid_args(void)
 {
     ldb_journal_t journal = {0};
@@ -1289,17 +1857,2113 @@ void test_fsync_all(void)
     TEST_CHECK(ldb_set_fsync(NULL, true) != 0);
 }
 
-void test_flock(void)
+void test_verify_all(void)
 {
-    ldb_journal_t journal1 = {0};
-    ldb_journal_t journal2 = {0};
+    ldb_journal_t journal = {0};
+    ldb_entry_t entries[10] = {{0}};
+    ldb_record_idx_t record_idx = {0};
+    char buf[1024] = {0};
+    size_t num = 0;
 
     remove("test.dat");
     remove("test.idx");
 
-    TEST_ASSERT(ldb_open(&journal1, "", "test", false) == LDB_OK);
-    TEST_CHECK(ldb_open(&journal2, "", "test", false) == LDB_ERR_LOCK);
-    ldb_close(&journal1);
+    TEST_CHECK(ldb_set_verify(NULL, true) == LDB_ERR_ARG);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(ldb_set_verify(&journal, true) == LDB_OK);
+    append_entries(&journal, 20, 40);
+
+    TEST_CHECK(ldb_read(&journal, 20, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 10);
+
+    // corrupting data of entry 25
+    TEST_ASSERT(ldb_read_record_idx(&journal, &journal.state, 25, &record_idx) == LDB_OK);
+    TEST_ASSERT(pwrite(fileno(journal.dat_fp), "X", 1, (off_t)(record_idx.pos + sizeof(ldb_record_dat_t))) == 1);
+
+    TEST_CHECK(ldb_read(&journal, 20, entries, 10, buf, sizeof(buf), &num) == LDB_ERR_CHECKSUM);
+    TEST_CHECK(num == 5);
+    TEST_CHECK(check_entry(&entries[4], 24, "data-24"));
+    TEST_CHECK(entries[5].seqnum == 25);
+    TEST_CHECK(ldb_read(&journal, 26, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 10);
+
+    // verification on views
+    TEST_CHECK(ldb_set_mmap(&journal, LDB_MMAP_DAT) == LDB_OK);
+    TEST_CHECK(ldb_read_view(&journal, 22, entries, 10, &num) == LDB_ERR_CHECKSUM);
+    TEST_CHECK(num == 3);
+    TEST_CHECK(entries[3].seqnum == 25);
+    TEST_CHECK(ldb_release_view(&journal) == LDB_OK);
+
+    // verification disabled
+    TEST_CHECK(ldb_set_verify(&journal, false) == LDB_OK);
+    TEST_CHECK(ldb_read(&journal, 20, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 10);
+
+    ldb_close(&journal);
+}
+
+void test_sparse_index(void)
+{
+    ldb_journal_t journal = {0};
+    uint64_t seqnum1 = 0;
+    uint64_t seqnum2 = 0;
+    bool equals = true;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_CHECK(ldb_set_sparse_index(NULL, 1024) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_set_sparse_index(&journal, 1) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_set_sparse_index(&journal, 1024) == LDB_ERR);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    append_entries(&journal, 20, 5000);
+
+    // built from idx file
+    TEST_CHECK(ldb_set_sparse_index(&journal, 1024 * sizeof(ldb_sample_t)) == LDB_OK);
+    TEST_CHECK(journal.sparse.len == 5000 / LDB_SPARSE_STRIDE);
+    TEST_CHECK(journal.sparse.samples[0].seqnum == LDB_SPARSE_STRIDE);
+
+    // maintained by append, stride doubled when budget is exhausted
+    TEST_CHECK(ldb_set_sparse_index(&journal, 10 * sizeof(ldb_sample_t)) == LDB_OK);
+    append_entries(&journal, 5001, 20000);
+    TEST_CHECK(journal.sparse.len > 0 && journal.sparse.len <= 10);
+    TEST_CHECK(journal.sparse.stride > LDB_SPARSE_STRIDE);
+
+    // same results with and without sparse index
+    for (uint64_t ts = 0; ts <= 20010; ts += 7)
+    {
+        for (int mode = LDB_SEARCH_LOWER; mode <= LDB_SEARCH_UPPER; mode++)
+        {
+            journal.sparse.max_len = 0;
+            int rc1 = ldb_search(&journal, ts, (ldb_search_e) mode, &seqnum1);
+            journal.sparse.max_len = 10;
+            int rc2 = ldb_search(&journal, ts, (ldb_search_e) mode, &seqnum2);
+            equals &= (rc1 == rc2 && seqnum1 == seqnum2);
+        }
+    }
+
+    TEST_CHECK(equals);
+    TEST_CHECK(ldb_search(&journal, 25, LDB_SEARCH_LOWER, &seqnum1) == LDB_OK);
+    TEST_CHECK(seqnum1 == 30);
+    TEST_CHECK(ldb_search(&journal, 12340, LDB_SEARCH_UPPER, &seqnum1) == LDB_OK);
+    TEST_CHECK(seqnum1 == 12350);
+
+    // samples trimmed on rollback and purge
+    TEST_CHECK(ldb_rollback(&journal, 10000) == 10000);
+    TEST_CHECK(journal.sparse.samples[journal.sparse.len - 1].seqnum <= 10000);
+    TEST_CHECK(ldb_purge(&journal, 5000) == 4980);
+    TEST_CHECK(journal.sparse.samples[0].seqnum >= 5000);
+    TEST_CHECK(ldb_search(&journal, 7777, LDB_SEARCH_LOWER, &seqnum1) == LDB_OK);
+    TEST_CHECK(seqnum1 == 7780);
+
+    TEST_CHECK(ldb_set_sparse_index(&journal, 0) == LDB_OK);
+    TEST_CHECK(journal.sparse.samples == NULL);
+
+    ldb_close(&journal);
+}
+
+void test_idx_writeback(void)
+{
+    ldb_journal_t journal = {0};
+    ldb_entry_t entries[10] = {{0}};
+    char buf[1024] = {0};
+    uint64_t seqnum = 0;
+    size_t num = 0;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_CHECK(ldb_set_idx_writeback(NULL, 100) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_set_idx_writeback(&journal, SIZE_MAX) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_set_idx_writeback(&journal, 100) == LDB_ERR);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    append_entries(&journal, 20, 1000);
+
+    // idx records kept in memory
+    TEST_CHECK(ldb_set_idx_writeback(&journal, 1000) == LDB_OK);
+    append_entries(&journal, 1001, 1500);
+    TEST_CHECK(journal.writeback.num == 500);
+    TEST_CHECK(journal.writeback.pos + journal.writeback.len == ldb_get_end_idx(journal.idx_format, &journal.state));
+
+    // readers served from memory
+    TEST_CHECK(ldb_read(&journal, 1495, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 6);
+    TEST_CHECK(check_entry(&entries[5], 1500, "data-1500"));
+    TEST_CHECK(ldb_read(&journal, 995, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 10);
+    TEST_CHECK(check_entry(&entries[9], 1004, "data-1004"));
+    TEST_CHECK(ldb_search(&journal, 1234, LDB_SEARCH_LOWER, &seqnum) == LDB_OK);
+    TEST_CHECK(seqnum == 1240);
+
+    // written every max_entries entries
+    append_entries(&journal, 1501, 2100);
+    TEST_CHECK(journal.writeback.num == 100);
+
+    // written on rollback
+    TEST_CHECK(ldb_rollback(&journal, 2050) == 50);
+    TEST_CHECK(journal.writeback.len == 0);
+    append_entries(&journal, 2051, 2200);
+    TEST_CHECK(ldb_read(&journal, 2045, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 10);
+    TEST_CHECK(check_entry(&entries[9], 2054, "data-2054"));
+
+    // crash (buffered records lost)
+    TEST_CHECK(journal.writeback.num == 150);
+    journal.writeback.len = 0;
+    ldb_close(&journal);
+
+    // idx completed on open
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum1 == 20);
+    TEST_CHECK(journal.state.seqnum2 == 2200);
+    TEST_CHECK(journal.writeback.max_entries == 0);
+    TEST_CHECK(ldb_read(&journal, 2195, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 6);
+    TEST_CHECK(check_entry(&entries[5], 2200, "data-2200"));
+    TEST_CHECK(ldb_search(&journal, 2123, LDB_SEARCH_UPPER, &seqnum) == LDB_OK);
+    TEST_CHECK(seqnum == 2130);
+
+    // written on purge and close
+    TEST_CHECK(ldb_set_idx_writeback(&journal, 100) == LDB_OK);
+    append_entries(&journal, 2201, 2250);
+    TEST_CHECK(ldb_purge(&journal, 1000) == 980);
+    TEST_CHECK(journal.writeback.len == 0);
+    append_entries(&journal, 2251, 2300);
+    ldb_close(&journal);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum1 == 1000);
+    TEST_CHECK(journal.state.seqnum2 == 2300);
+    TEST_CHECK(ldb_read(&journal, 2295, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 6);
+    TEST_CHECK(check_entry(&entries[5], 2300, "data-2300"));
+    ldb_close(&journal);
+}
+
+void test_prealloc_all(void)
+{
+    ldb_journal_t journal = {0};
+    ldb_entry_t entries[10] = {{0}};
+    char buf[1024] = {0};
+    size_t dat_end = 0;
+    size_t idx_end = 0;
+    size_t num = 0;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_CHECK(ldb_set_prealloc(NULL, 1024) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_set_prealloc(&journal, 1024) == LDB_ERR);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(ldb_set_prealloc(&journal, 1024 * 1024) == LDB_OK);
+    append_entries(&journal, 20, 1000);
+
+    // files are allocated ahead of their end
+    idx_end = ldb_get_end_idx(journal.idx_format, &journal.state);
+    TEST_CHECK(journal.dat_alloc > journal.dat_end + 1000 * 1000);
+    TEST_CHECK(file_size("test.dat") == journal.dat_alloc);
+    TEST_CHECK(file_size("test.idx") == journal.idx_alloc);
+    TEST_CHECK(journal.idx_alloc > idx_end);
+
+    TEST_CHECK(ldb_read(&journal, 995, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 6);
+    TEST_CHECK(check_entry(&entries[5], 1000, "data-1000"));
+    TEST_CHECK(entries[6].seqnum == 0);
+
+    // rollback and append
+    TEST_CHECK(ldb_rollback(&journal, 900) == 100);
+    append_entries(&journal, 901, 1100);
+    TEST_CHECK(ldb_read(&journal, 1095, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 6);
+
+    // trimmed on close
+    dat_end = journal.dat_end;
+    idx_end = ldb_get_end_idx(journal.idx_format, &journal.state);
+    ldb_close(&journal);
+    TEST_CHECK(file_size("test.dat") == dat_end);
+    TEST_CHECK(file_size("test.idx") == idx_end);
+
+    // zeroed tail (crash) is ignored on open
+    TEST_ASSERT(truncate("test.dat", (off_t) (dat_end + 1024 * 1024)) == 0);
+    TEST_ASSERT(truncate("test.idx", (off_t) (idx_end + 1024 * 1024)) == 0);
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum1 == 20);
+    TEST_CHECK(journal.state.seqnum2 == 1100);
+    TEST_CHECK(journal.dat_end == dat_end);
+    ldb_close(&journal);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum2 == 1100);
+    TEST_CHECK(journal.dat_end == dat_end);
+    TEST_CHECK(journal.dat_alloc == dat_end + 1024 * 1024);
+
+    // preallocated space is reused
+    TEST_CHECK(ldb_set_prealloc(&journal, 64 * 1024) == LDB_OK);
+    append_entries(&journal, 1101, 1200);
+    TEST_CHECK(journal.dat_alloc == dat_end + 1024 * 1024);
+    TEST_CHECK(ldb_read(&journal, 1195, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 6);
+    TEST_CHECK(check_entry(&entries[5], 1200, "data-1200"));
+    dat_end = journal.dat_end;
+    ldb_close(&journal);
+    TEST_CHECK(file_size("test.dat") == dat_end);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum2 == 1200);
+    ldb_close(&journal);
+}
+
+bool check_histogram(const ldb_histogram_t *hist)
+{
+    uint64_t count = 0;
+
+    for (int i = 0; i < LDB_METRICS_BUCKETS; i++)
+        count += hist->buckets[i];
+
+    return (count == hist->count && hist->max_ns * hist->count >= hist->sum_ns);
+}
+
+void test_metrics_all(void)
+{
+    ldb_journal_t journal = {0};
+    ldb_metrics_t metrics = {0};
+    ldb_entry_t entries[10] = {{0}};
+    char buf[1024] = {0};
+    uint64_t seqnum = 0;
+    size_t num = 0;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_CHECK(ldb_set_metrics(NULL, true) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_set_metrics(&journal, true) == LDB_ERR);
+    TEST_CHECK(ldb_get_metrics(NULL, &metrics) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_get_metrics(&journal, NULL) == LDB_ERR_ARG);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+
+    // disabled by default
+    append_entries(&journal, 20, 100);
+    TEST_CHECK(ldb_read(&journal, 20, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(ldb_get_metrics(&journal, &metrics) == LDB_OK);
+    TEST_CHECK(metrics.entries_written == 0);
+    TEST_CHECK(metrics.entries_read == 0);
+    TEST_CHECK(metrics.append_write.count == 0);
+    TEST_CHECK(metrics.lock_files.count == 0);
+
+    TEST_CHECK(ldb_set_metrics(&journal, true) == LDB_OK);
+    TEST_CHECK(ldb_set_fsync(&journal, true) == LDB_OK);
+    append_entries(&journal, 101, 200);
+    TEST_CHECK(ldb_read(&journal, 150, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 10);
+    TEST_CHECK(ldb_search(&journal, 120, LDB_SEARCH_LOWER, &seqnum) == LDB_OK);
+    TEST_CHECK(seqnum == 120);
+    TEST_CHECK(ldb_rollback(&journal, 190) == 10);
+    TEST_CHECK(ldb_purge(&journal, 50) == 30);
+
+    TEST_CHECK(ldb_get_metrics(&journal, &metrics) == LDB_OK);
+    TEST_CHECK(metrics.entries_written == 100);
+    TEST_CHECK(metrics.bytes_written > 100 * sizeof(ldb_record_dat_t));
+    TEST_CHECK(metrics.entries_read == 10);
+    TEST_CHECK(metrics.bytes_read > 0);
+    TEST_CHECK(metrics.search_probes > 0);
+    TEST_CHECK(metrics.append_write.count == 100);
+    TEST_CHECK(metrics.append_flush.count == 100);
+    TEST_CHECK(metrics.append_fsync.count == 100);
+    TEST_CHECK(metrics.read_idx.count == 1);
+    TEST_CHECK(metrics.read_dat.count == 1);
+    TEST_CHECK(metrics.search.count == 1);
+    TEST_CHECK(metrics.rollback.count == 1);
+    TEST_CHECK(metrics.purge.count == 1);
+    TEST_CHECK(metrics.lock_files.count > 0);
+    TEST_CHECK(metrics.lock_state.count > 0);
+    TEST_CHECK(metrics.append_fsync.max_ns > 0);
+
+    TEST_CHECK(check_histogram(&metrics.append_write));
+    TEST_CHECK(check_histogram(&metrics.append_flush));
+    TEST_CHECK(check_histogram(&metrics.append_fsync));
+    TEST_CHECK(check_histogram(&metrics.read_idx));
+    TEST_CHECK(check_histogram(&metrics.read_dat));
+    TEST_CHECK(check_histogram(&metrics.search));
+    TEST_CHECK(check_histogram(&metrics.lock_files));
+    TEST_CHECK(check_histogram(&metrics.lock_state));
+    TEST_CHECK(check_histogram(&metrics.purge));
+    TEST_CHECK(check_histogram(&metrics.rollback));
+
+    // disabling keeps collected values
+    TEST_CHECK(ldb_set_metrics(&journal, false) == LDB_OK);
+    append_entries(&journal, 191, 200);
+    TEST_CHECK(ldb_get_metrics(&journal, &metrics) == LDB_OK);
+    TEST_CHECK(metrics.entries_written == 100);
+    ldb_close(&journal);
+
+    // reset on open
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(ldb_get_metrics(&journal, &metrics) == LDB_OK);
+    TEST_CHECK(metrics.entries_written == 0);
+    TEST_CHECK(metrics.rollback.count == 0);
+    ldb_close(&journal);
+}
+
+void remove_segments(const char *name, uint32_t max_id)
+{
+    char filename[128] = {0};
+
+    for (uint32_t id = 1; id <= max_id; id++) {
+        snprintf(filename, sizeof(filename), "%s.%06u.dat", name, (unsigned) id);
+        remove(filename);
+        snprintf(filename, sizeof(filename), "%s.%06u.idx", name, (unsigned) id);
+        remove(filename);
+    }
+}
+
+void seg_append_entries(ldb_segments_t *segments, uint64_t seqnum1, uint64_t seqnum2)
+{
+    char data[128] = {0};
+
+    for (uint64_t seqnum = seqnum1; seqnum <= seqnum2; seqnum++)
+    {
+        snprintf(data, sizeof(data), "data-%d", (int) seqnum);
+
+        ldb_entry_t entry = {
+            .seqnum = seqnum,
+            .timestamp = (seqnum < 10 ? 1 : 0) + seqnum - (seqnum % 10),
+            .data_len = (uint32_t) strlen(data) + 1,
+            .data = data
+        };
+
+        TEST_ASSERT(ldb_seg_append(segments, &entry, 1, NULL) == LDB_OK);
+    }
+}
+
+void test_segments(void)
+{
+    ldb_segments_t segments = {0};
+    ldb_entry_t entries[10] = {{0}};
+    ldb_stats_t stats = {0};
+    char buf[1024] = {0};
+    uint64_t seqnum = 0;
+    size_t num = 0;
+
+    remove_segments("test", 20);
+
+    TEST_CHECK(ldb_seg_open(NULL, "", "test", false, 0, 100) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_seg_open(&segments, "", "test", false, 0, 0) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_seg_open(&segments, "", "test.1", false, 0, 100) == LDB_ERR_NAME);
+    TEST_CHECK(ldb_seg_append(&segments, entries, 1, NULL) == LDB_ERR);
+    TEST_CHECK(ldb_seg_read(&segments, 1, entries, 1, buf, sizeof(buf), NULL) == LDB_ERR);
+
+    TEST_ASSERT(ldb_seg_open(&segments, "", "test", false, 0, 100) == LDB_OK);
+    TEST_CHECK(segments.num_segments == 1);
+    TEST_CHECK(access("test.000001.dat", F_OK) == 0);
+
+    // segments rolled every 100 entries
+    seg_append_entries(&segments, 1, 1000);
+    TEST_CHECK(segments.num_segments == 10);
+    TEST_CHECK(segments.segments[1].journal->state.seqnum1 == 101);
+    TEST_CHECK(access("test.000010.idx", F_OK) == 0);
+
+    // broken sequence between segments (new segment remains empty)
+    entries[0] = (ldb_entry_t){ .seqnum = 2000 };
+    TEST_CHECK(ldb_seg_append(&segments, entries, 1, &num) == LDB_ERR_ENTRY_SEQNUM);
+    TEST_CHECK(num == 0);
+    TEST_CHECK(segments.num_segments == 11);
+
+    // read across segments
+    TEST_CHECK(ldb_seg_read(&segments, 95, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 10);
+    TEST_CHECK(check_entry(&entries[0], 95, "data-95"));
+    TEST_CHECK(check_entry(&entries[5], 100, "data-100"));
+    TEST_CHECK(check_entry(&entries[6], 101, "data-101"));
+    TEST_CHECK(check_entry(&entries[9], 104, "data-104"));
+
+    TEST_CHECK(ldb_seg_read(&segments, 995, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 6);
+    TEST_CHECK(entries[6].seqnum == 0);
+    TEST_CHECK(ldb_seg_read(&segments, 1001, entries, 10, buf, sizeof(buf), &num) == LDB_ERR_NOT_FOUND);
+
+    // buffer exhausted at segment boundary (records of 40 bytes)
+    TEST_CHECK(ldb_seg_read(&segments, 99, entries, 10, buf, 80, &num) == LDB_OK);
+    TEST_CHECK(num == 2);
+    TEST_CHECK(entries[2].seqnum == 101);
+    TEST_CHECK(entries[2].data == NULL);
+
+    TEST_CHECK(ldb_seg_stats(&segments, 0, 2000, &stats) == LDB_OK);
+    TEST_CHECK(stats.num_entries == 1000);
+    TEST_CHECK(stats.min_seqnum == 1);
+    TEST_CHECK(stats.max_seqnum == 1000);
+    TEST_CHECK(ldb_seg_stats(&segments, 150, 250, &stats) == LDB_OK);
+    TEST_CHECK(stats.num_entries == 101);
+    TEST_CHECK(stats.max_timestamp == 250);
+
+    TEST_CHECK(ldb_seg_search(&segments, 505, LDB_SEARCH_LOWER, &seqnum) == LDB_OK);
+    TEST_CHECK(seqnum == 510);
+    TEST_CHECK(ldb_seg_search(&segments, 500, LDB_SEARCH_UPPER, &seqnum) == LDB_OK);
+    TEST_CHECK(seqnum == 510);
+    TEST_CHECK(ldb_seg_search(&segments, 100, LDB_SEARCH_LOWER, &seqnum) == LDB_OK);
+    TEST_CHECK(seqnum == 100);
+    TEST_CHECK(ldb_seg_search(&segments, 95, LDB_SEARCH_UPPER, &seqnum) == LDB_OK);
+    TEST_CHECK(seqnum == 100);
+    TEST_CHECK(ldb_seg_search(&segments, 1000, LDB_SEARCH_UPPER, &seqnum) == LDB_ERR_NOT_FOUND);
+
+    // reopen and append (seqnum assigned across segments)
+    TEST_CHECK(ldb_seg_close(&segments) == LDB_OK);
+    TEST_ASSERT(ldb_seg_open(&segments, "", "test", true, 0, 100) == LDB_OK);
+    TEST_CHECK(segments.num_segments == 11);
+    entries[0] = (ldb_entry_t){0};
+    TEST_CHECK(ldb_seg_append(&segments, entries, 1, &num) == LDB_OK);
+    TEST_CHECK(entries[0].seqnum == 1001);
+    TEST_CHECK(segments.num_segments == 11);
+
+    // purge removes whole segments
+    TEST_CHECK(ldb_seg_purge(&segments, 350) == 349);
+    TEST_CHECK(segments.num_segments == 8);
+    TEST_CHECK(segments.segments[0].journal->state.seqnum1 == 350);
+    TEST_CHECK(access("test.000003.dat", F_OK) != 0);
+    TEST_CHECK(ldb_seg_read(&segments, 350, entries, 1, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(check_entry(&entries[0], 350, "data-350"));
+
+    // rollback removes whole segments
+    TEST_CHECK(ldb_seg_rollback(&segments, 720) == 281);
+    TEST_CHECK(segments.num_segments == 5);
+    TEST_CHECK(access("test.000009.dat", F_OK) != 0);
+    TEST_CHECK(ldb_seg_stats(&segments, 0, 2000, &stats) == LDB_OK);
+    TEST_CHECK(stats.min_seqnum == 350);
+    TEST_CHECK(stats.max_seqnum == 720);
+
+    // purge all
+    TEST_CHECK(ldb_seg_purge(&segments, 2000) == 371);
+    TEST_CHECK(segments.num_segments == 1);
+    TEST_CHECK(ldb_seg_stats(&segments, 0, 2000, &stats) == LDB_OK);
+    TEST_CHECK(stats.num_entries == 0);
+
+    ldb_seg_close(&segments);
+    remove_segments("test", 20);
+}
+
+void test_flock(void)
+{
+    ldb_journal_t journal1 = {0};
+    ldb_journal_t journal2 = {0};
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_ASSERT(ldb_open(&journal1, "", "test", false) == LDB_OK);
+    TEST_CHECK(ldb_open(&journal2, "", "test", false) == LDB_ERR_LOCK);
+    ldb_close(&journal1);
+}
+
+void test_mmap_all(void)
+{
+    ldb_journal_t journal = {0};
+    ldb_entry_t entries[10] = {{0}};
+    ldb_stats_t stats = {0};
+    char buf[1024] = {0};
+    uint64_t seqnum = 0;
+    size_t num = 0;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_CHECK(ldb_set_mmap(NULL, LDB_MMAP_ALL) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_set_mmap(&journal, -1) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_set_mmap(&journal, 99) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_set_mmap(&journal, LDB_MMAP_ALL) == LDB_ERR);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(ldb_set_mmap(&journal, LDB_MMAP_IDX) == LDB_OK);
+    TEST_CHECK(journal.idx_map.addr != NULL);
+    TEST_CHECK(journal.dat_map.addr == NULL);
+    TEST_CHECK(ldb_set_mmap(&journal, LDB_MMAP_ALL) == LDB_OK);
+    TEST_CHECK(journal.idx_map.addr != NULL);
+    TEST_CHECK(journal.dat_map.addr != NULL);
+
+    // idx window grows (24 bytes x 200000 entries > 4MB)
+    append_entries(&journal, 20, 200000);
+    TEST_CHECK(journal.idx_map.len >= ldb_get_pos_idx(journal.idx_format, &journal.state, journal.state.seqnum2));
+    TEST_CHECK(journal.dat_map.len >= journal.dat_end);
+
+    TEST_CHECK(ldb_read(&journal, 20, entries, 3, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 3);
+    TEST_CHECK(check_entry(&entries[0], 20, "data-20"));
+    TEST_CHECK(check_entry(&entries[2], 22, "data-22"));
+
+    // reading the last entries (mapped content bounded to last record)
+    TEST_CHECK(ldb_read(&journal, 199999, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 2);
+    TEST_CHECK(check_entry(&entries[0], 199999, "data-199999"));
+    TEST_CHECK(check_entry(&entries[1], 200000, "data-200000"));
+    TEST_CHECK(entries[2].seqnum == 0);
+
+    TEST_CHECK(ldb_search(&journal, 25, LDB_SEARCH_LOWER, &seqnum) == LDB_OK);
+    TEST_CHECK(seqnum == 30);
+    TEST_CHECK(ldb_stats(&journal, 100, 200, &stats) == LDB_OK);
+    TEST_CHECK(stats.num_entries == 101);
+
+    TEST_CHECK(ldb_rollback(&journal, 1000) == 199000);
+    TEST_CHECK(ldb_read(&journal, 999, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 2);
+
+    // files are remapped after purge
+    TEST_CHECK(ldb_purge(&journal, 100) == 80);
+    TEST_CHECK(journal.idx_map.addr != NULL);
+    TEST_CHECK(journal.dat_map.addr != NULL);
+    TEST_CHECK(ldb_read(&journal, 100, entries, 1, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(check_entry(&entries[0], 100, "data-100"));
+
+    TEST_CHECK(ldb_set_mmap(&journal, LDB_MMAP_NONE) == LDB_OK);
+    TEST_CHECK(journal.idx_map.addr == NULL);
+    TEST_CHECK(journal.dat_map.addr == NULL);
+
+    ldb_close(&journal);
+}
+
+// Last record ends close to a page boundary (padded header reads cross it).
+void check_mmap_page_end(int format)
+{
+    ldb_journal_t journal = {0};
+    ldb_entry_t entries[10] = {{0}};
+    ldb_stats_t stats = {0};
+    char buf[1024] = {0};
+    char data[8] = "1234567";
+    uint64_t seqnum = 1;
+    size_t num = 0;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_ASSERT(ldb_set_format(&journal, format) == LDB_OK);
+    TEST_ASSERT(ldb_set_mmap(&journal, LDB_MMAP_ALL) == LDB_OK);
+
+    while (seqnum < 100000 && (seqnum < 1000 || journal.dat_end % 4096 < 4096 - 10))
+    {
+        ldb_entry_t entry = { .seqnum = seqnum, .timestamp = seqnum, .data_len = (uint32_t) (1 + seqnum % 7), .data = data };
+        TEST_ASSERT(ldb_append(&journal, &entry, 1, NULL) == LDB_OK);
+        seqnum++;
+    }
+
+    TEST_ASSERT(journal.dat_end % 4096 >= 4096 - 10);
+    TEST_CHECK(file_size("test.dat") == journal.dat_end);
+
+    TEST_CHECK(ldb_stats(&journal, 0, UINT64_MAX, &stats) == LDB_OK);
+    TEST_CHECK(stats.num_entries == seqnum - 1);
+    TEST_CHECK(ldb_read(&journal, seqnum - 2, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 2);
+    TEST_CHECK(entries[1].seqnum == seqnum - 1);
+    TEST_CHECK(ldb_read_view(&journal, seqnum - 1, entries, 10, &num) == LDB_OK);
+    TEST_CHECK(num == 1);
+    TEST_CHECK(ldb_release_view(&journal) == LDB_OK);
+
+    // last record removed
+    TEST_CHECK(ldb_rollback(&journal, seqnum - 2) == 1);
+    TEST_CHECK(ldb_read(&journal, seqnum - 2, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 1);
+
+    ldb_close(&journal);
+}
+
+void test_mmap_page_end(void)
+{
+    check_mmap_page_end(LDB_FORMAT_DENSE);
+    check_mmap_page_end(LDB_FORMAT_BATCH);
+}
+
+typedef struct rollback_worker_t {
+    ldb_journal_t *journal;
+    uint64_t seqnum;
+    long ret;
+    volatile bool done;
+} rollback_worker_t;
+
+void * run_rollback_worker(void *args)
+{
+    rollback_worker_t *worker = (rollback_worker_t *) args;
+    worker->ret = ldb_rollback(worker->journal, worker->seqnum);
+    worker->done = true;
+    return NULL;
+}
+
+void * run_purge_worker(void *args)
+{
+    rollback_worker_t *worker = (rollback_worker_t *) args;
+    worker->ret = ldb_purge(worker->journal, worker->seqnum);
+    worker->done = true;
+    return NULL;
+}
+
+void test_read_view(void)
+{
+    ldb_journal_t journal = {0};
+    ldb_entry_t entries[10] = {{0}};
+    rollback_worker_t worker = {0};
+    pthread_t thread;
+    struct timespec delay = {0, 50 * 1000 * 1000};
+    const char *data = NULL;
+    size_t num = 0;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_CHECK(ldb_read_view(NULL, 1, entries, 1, &num) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_read_view(&journal, 1, NULL, 1, &num) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_read_view(&journal, 1, entries, 0, &num) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_read_view(&journal, 1, entries, 1, &num) == LDB_ERR);
+    TEST_CHECK(ldb_release_view(NULL) == LDB_ERR_ARG);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    append_entries(&journal, 20, 314);
+
+    // dat file not mapped
+    TEST_CHECK(ldb_read_view(&journal, 20, entries, 1, &num) == LDB_ERR);
+    TEST_CHECK(ldb_set_mmap(&journal, LDB_MMAP_DAT) == LDB_OK);
+
+    TEST_CHECK(ldb_read_view(&journal, 0, entries, 1, &num) == LDB_ERR_NOT_FOUND);
+    TEST_CHECK(ldb_read_view(&journal, 19, entries, 1, &num) == LDB_ERR_NOT_FOUND);
+    TEST_CHECK(ldb_read_view(&journal, 315, entries, 1, &num) == LDB_ERR_NOT_FOUND);
+    TEST_CHECK(num == 0);
+    TEST_CHECK(ldb_release_view(&journal) == LDB_ERR);
+
+    // view points to the mapping
+    TEST_CHECK(ldb_read_view(&journal, 20, entries, 3, &num) == LDB_OK);
+    TEST_CHECK(num == 3);
+    TEST_CHECK(check_entry(&entries[0], 20, "data-20"));
+    TEST_CHECK(check_entry(&entries[2], 22, "data-22"));
+    TEST_CHECK((char *) entries[0].data > journal.dat_map.addr);
+    TEST_CHECK((char *) entries[0].data < journal.dat_map.addr + journal.dat_map.len);
+    TEST_CHECK(ldb_release_view(&journal) == LDB_OK);
+
+    // view bounded to last entry
+    TEST_CHECK(ldb_read_view(&journal, 313, entries, 10, &num) == LDB_OK);
+    TEST_CHECK(num == 2);
+    TEST_CHECK(check_entry(&entries[1], 314, "data-314"));
+    TEST_CHECK(entries[2].seqnum == 0);
+    TEST_CHECK(ldb_release_view(&journal) == LDB_OK);
+
+    // pinned view survives the dat window growth
+    TEST_CHECK(ldb_read_view(&journal, 100, entries, 1, &num) == LDB_OK);
+    data = entries[0].data;
+    append_entries(&journal, 315, 200000);
+    TEST_CHECK(journal.retired != NULL);
+    TEST_CHECK(strcmp(data, "data-100") == 0);
+    TEST_CHECK(ldb_release_view(&journal) == LDB_OK);
+    TEST_CHECK(journal.retired == NULL);
+
+    // rollback waits until view is released
+    TEST_CHECK(ldb_read_view(&journal, 1000, entries, 1, &num) == LDB_OK);
+    worker.journal = &journal;
+    worker.seqnum = 999;
+    TEST_ASSERT(pthread_create(&thread, NULL, run_rollback_worker, &worker) == 0);
+    nanosleep(&delay, NULL);
+    TEST_CHECK(!worker.done);
+    TEST_CHECK(check_entry(&entries[0], 1000, "data-1000"));
+    TEST_CHECK(ldb_release_view(&journal) == LDB_OK);
+    pthread_join(thread, NULL);
+    TEST_CHECK(worker.done);
+    TEST_CHECK(worker.ret == 199001);
+
+    ldb_close(&journal);
+}
+
+void test_purge_concurrent(void)
+{
+    char buf[1024] = {0};
+    ldb_journal_t journal = {0};
+    ldb_entry_t entry = {0};
+    rollback_worker_t worker = {0};
+    pthread_t thread;
+    struct timespec delay = {0, 50 * 1000 * 1000};
+
+    remove("test.dat");
+    remove("test.idx");
+    remove("test.dat.tmp");
+    remove("test.idx.tmp");
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    append_entries(&journal, 20, 314);
+
+    // copy phase runs while readers hold the files
+    pthread_rwlock_rdlock(&journal.rwlock_files);
+    worker.journal = &journal;
+    worker.seqnum = 100;
+    TEST_ASSERT(pthread_create(&thread, NULL, run_purge_worker, &worker) == 0);
+    nanosleep(&delay, NULL);
+    TEST_CHECK(!worker.done);
+    TEST_CHECK(access("test.dat.tmp", F_OK) == 0);
+    TEST_CHECK(access("test.idx.tmp", F_OK) == 0);
+    TEST_CHECK(journal.state.seqnum1 == 20);
+    TEST_CHECK(ldb_read_record_dat(fileno(journal.dat_fp), NULL, journal.format, sizeof(ldb_header_dat_t), NULL, (ldb_record_dat_t *) buf, NULL, true) == LDB_OK);
+    pthread_rwlock_unlock(&journal.rwlock_files);
+    pthread_join(thread, NULL);
+
+    TEST_CHECK(worker.done);
+    TEST_CHECK(worker.ret == 80);
+    TEST_CHECK(access("test.dat.tmp", F_OK) != 0);
+    TEST_CHECK(access("test.idx.tmp", F_OK) != 0);
+    TEST_CHECK(journal.state.seqnum1 == 100);
+    TEST_CHECK(journal.state.seqnum2 == 314);
+    TEST_CHECK(ldb_read(&journal, 314, &entry, 1, buf, sizeof(buf), NULL) == LDB_OK);
+    TEST_CHECK(check_entry(&entry, 314, "data-314"));
+    append_entries(&journal, 315, 400);
+    ldb_close(&journal);
+
+    // copied index is consistent
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum1 == 100);
+    TEST_CHECK(journal.state.seqnum2 == 400);
+    TEST_CHECK(ldb_read(&journal, 200, &entry, 1, buf, sizeof(buf), NULL) == LDB_OK);
+    TEST_CHECK(check_entry(&entry, 200, "data-200"));
+    ldb_close(&journal);
+}
+
+typedef struct append_worker_t {
+    ldb_journal_t *journal;
+    size_t num_entries;
+    size_t num_appended;
+    int ret;
+} append_worker_t;
+
+void * run_append_worker(void *args)
+{
+    append_worker_t *worker = (append_worker_t *) args;
+    char data[] = "data";
+
+    worker->ret = LDB_OK;
+
+    for (size_t i = 0; i < worker->num_entries && worker->ret == LDB_OK; i++)
+    {
+        ldb_entry_t entry = {0, 1, sizeof(data), data};
+        size_t num = 0;
+
+        worker->ret = ldb_append(worker->journal, &entry, 1, &num);
+        worker->num_appended += num;
+    }
+
+    return NULL;
+}
+
+void test_group_commit(void)
+{
+    ldb_journal_t journal = {0};
+    append_worker_t workers[4] = {{0}};
+    pthread_t threads[4];
+    ldb_entry_t entries[10] = {{0}};
+    char buf[1024] = {0};
+    size_t num = 0;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_CHECK(ldb_set_group_commit(NULL, 10) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_set_group_commit(&journal, 10) == LDB_ERR);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(ldb_set_fsync(&journal, true) == LDB_OK);
+    TEST_CHECK(ldb_set_group_commit(&journal, 10) == LDB_OK);
+    TEST_CHECK(journal.group != NULL);
+    TEST_CHECK(ldb_set_group_commit(&journal, 3) == LDB_OK);
+
+    // concurrent producers
+    for (size_t i = 0; i < 4; i++) {
+        workers[i].journal = &journal;
+        workers[i].num_entries = 250;
+        TEST_ASSERT(pthread_create(&threads[i], NULL, run_append_worker, &workers[i]) == 0);
+    }
+
+    for (size_t i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        TEST_CHECK(workers[i].ret == LDB_OK);
+        TEST_CHECK(workers[i].num_appended == 250);
+    }
+
+    TEST_CHECK(journal.state.seqnum1 == 1);
+    TEST_CHECK(journal.state.seqnum2 == 1000);
+    TEST_CHECK(ldb_read(&journal, 995, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 6);
+    TEST_CHECK(check_entry(&entries[5], 1000, "data"));
+
+    // oversized request accepted, failed request reported to its caller
+    for (size_t i = 0; i < 10; i++)
+        entries[i] = (ldb_entry_t){0, 1000, 0, NULL};
+    TEST_CHECK(ldb_append(&journal, entries, 10, &num) == LDB_OK);
+    TEST_CHECK(num == 10);
+    TEST_CHECK(entries[9].seqnum == 1010);
+    TEST_CHECK(journal.state.seqnum2 == 1010);
+    entries[0] = (ldb_entry_t){0};
+    entries[0].seqnum = 2000;
+    TEST_CHECK(ldb_append(&journal, entries, 1, &num) == LDB_ERR_ENTRY_SEQNUM);
+    TEST_CHECK(num == 0);
+
+    // destructive writes are serialized with the writer thread
+    TEST_CHECK(ldb_rollback(&journal, 1005) == 5);
+    append_entries(&journal, 1006, 1020);
+    TEST_CHECK(journal.state.seqnum2 == 1020);
+    TEST_CHECK(ldb_purge(&journal, 1000) == 999);
+    TEST_CHECK(journal.state.seqnum1 == 1000);
+
+    // disabled (back to single-writer)
+    TEST_CHECK(ldb_set_group_commit(&journal, 0) == LDB_OK);
+    TEST_CHECK(journal.group == NULL);
+    append_entries(&journal, 1021, 1030);
+    TEST_CHECK(journal.state.seqnum2 == 1030);
+
+    // writer thread stopped on close
+    TEST_CHECK(ldb_set_group_commit(&journal, 10) == LDB_OK);
+    ldb_close(&journal);
+    TEST_CHECK(journal.group == NULL);
+}
+
+void * run_delayed_append(void *args)
+{
+    ldb_journal_t *journal = (ldb_journal_t *) args;
+    struct timespec delay = {0, 50 * 1000 * 1000};
+
+    nanosleep(&delay, NULL);
+    append_entries(journal, 11, 20);
+    return NULL;
+}
+
+void test_wait_all(void)
+{
+    ldb_journal_t journal = {0};
+    struct pollfd pfd = {0};
+    pthread_t thread;
+    uint64_t t0 = 0;
+    char buf[64] = {0};
+    int fd = -1;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_CHECK(ldb_wait(NULL, 1, 0) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_wait(&journal, 1, 0) == LDB_ERR);
+    TEST_CHECK(ldb_get_notify_fd(NULL) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_get_notify_fd(&journal) == LDB_ERR);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(ldb_wait(&journal, 0, 0) == LDB_ERR_NOT_FOUND);
+    append_entries(&journal, 1, 10);
+
+    // entries already available
+    TEST_CHECK(ldb_wait(&journal, 0, 0) == LDB_OK);
+    TEST_CHECK(ldb_wait(&journal, 10, 0) == LDB_OK);
+    TEST_CHECK(ldb_wait(&journal, 11, 0) == LDB_ERR_NOT_FOUND);
+
+    // timeout
+    t0 = ldb_get_millis();
+    TEST_CHECK(ldb_wait(&journal, 11, 50) == LDB_ERR_NOT_FOUND);
+    TEST_CHECK(ldb_get_millis() >= t0 + 49);
+
+    // notification descriptor
+    fd = ldb_get_notify_fd(&journal);
+    TEST_ASSERT(fd >= 0);
+    TEST_CHECK(ldb_get_notify_fd(&journal) == fd);
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    TEST_CHECK(poll(&pfd, 1, 0) == 0);
+
+    // wakes up on append
+    TEST_ASSERT(pthread_create(&thread, NULL, run_delayed_append, &journal) == 0);
+    TEST_CHECK(ldb_wait(&journal, 15, -1) == LDB_OK);
+    TEST_CHECK(LDB_ATOMIC_LOAD(&journal.state.seqnum2) >= 15);
+    pthread_join(thread, NULL);
+
+    TEST_CHECK(poll(&pfd, 1, 0) == 1);
+    TEST_CHECK(read(fd, buf, sizeof(buf)) > 0);
+    TEST_CHECK(read(fd, buf, sizeof(buf)) == -1 && errno == EAGAIN);
+    TEST_CHECK(poll(&pfd, 1, 0) == 0);
+
+    ldb_close(&journal);
+}
+
+void test_cursor_all(void)
+{
+    char data[64] = {0};
+    ldb_journal_t journal = {0};
+    ldb_cursor_t cursor = {0};
+    ldb_entry_t entry = {0};
+    bool ok = true;
+    char *big = NULL;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_CHECK(ldb_cursor_open(NULL, &journal, 1) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_cursor_open(&cursor, NULL, 1) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_cursor_open(&cursor, &journal, 1) == LDB_ERR);
+    TEST_CHECK(ldb_cursor_next(NULL, &entry) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_cursor_next(&cursor, NULL) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_cursor_next(&cursor, &entry) == LDB_ERR);
+    TEST_CHECK(ldb_cursor_close(NULL) == LDB_OK);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+
+    // empty journal
+    TEST_ASSERT(ldb_cursor_open(&cursor, &journal, 0) == LDB_OK);
+    TEST_CHECK(ldb_cursor_next(&cursor, &entry) == LDB_ERR_NOT_FOUND);
+    append_entries(&journal, 20, 314);
+
+    // sequential replay
+    for (uint64_t seqnum = 20; seqnum <= 314 && ok; seqnum++) {
+        snprintf(data, sizeof(data), "data-%d", (int) seqnum);
+        ok = (ldb_cursor_next(&cursor, &entry) == LDB_OK && check_entry(&entry, seqnum, data));
+    }
+    TEST_CHECK(ok);
+    TEST_CHECK(cursor.buf_len == LDB_CURSOR_BUFSIZE);
+    TEST_CHECK(ldb_cursor_next(&cursor, &entry) == LDB_ERR_NOT_FOUND);
+
+    // following the head
+    append_entries(&journal, 315, 316);
+    TEST_CHECK(ldb_cursor_next(&cursor, &entry) == LDB_OK);
+    TEST_CHECK(check_entry(&entry, 315, "data-315"));
+
+    // oversized record
+    big = (char *) calloc(3 * LDB_CURSOR_BUFSIZE, 1);
+    TEST_ASSERT(big != NULL);
+    entry = (ldb_entry_t){ .seqnum = 317, .timestamp = 310, .data = big, .data_len = 3 * LDB_CURSOR_BUFSIZE };
+    TEST_ASSERT(ldb_append(&journal, &entry, 1, NULL) == LDB_OK);
+    append_entries(&journal, 318, 319);
+    TEST_CHECK(ldb_cursor_next(&cursor, &entry) == LDB_OK);
+    TEST_CHECK(check_entry(&entry, 316, "data-316"));
+    TEST_CHECK(ldb_cursor_next(&cursor, &entry) == LDB_OK);
+    TEST_CHECK(entry.seqnum == 317 && entry.data_len == 3 * LDB_CURSOR_BUFSIZE);
+    TEST_CHECK(cursor.buf_len > 3 * LDB_CURSOR_BUFSIZE);
+    TEST_CHECK(ldb_cursor_next(&cursor, &entry) == LDB_OK);
+    TEST_CHECK(check_entry(&entry, 318, "data-318"));
+    TEST_CHECK(ldb_cursor_close(&cursor) == LDB_OK);
+    free(big);
+
+    // open at timestamp
+    TEST_CHECK(ldb_cursor_open_timestamp(&cursor, &journal, 10000, LDB_SEARCH_LOWER) == LDB_ERR_NOT_FOUND);
+    TEST_ASSERT(ldb_cursor_open_timestamp(&cursor, &journal, 105, LDB_SEARCH_LOWER) == LDB_OK);
+    TEST_CHECK(ldb_cursor_next(&cursor, &entry) == LDB_OK);
+    TEST_CHECK(check_entry(&entry, 110, "data-110"));
+    TEST_CHECK(ldb_cursor_close(&cursor) == LDB_OK);
+
+    // buffer discarded on rollback
+    TEST_ASSERT(ldb_cursor_open(&cursor, &journal, 200) == LDB_OK);
+    TEST_CHECK(ldb_cursor_next(&cursor, &entry) == LDB_OK);
+    TEST_CHECK(check_entry(&entry, 200, "data-200"));
+    TEST_CHECK(ldb_rollback(&journal, 200) == 119);
+    TEST_CHECK(ldb_cursor_next(&cursor, &entry) == LDB_ERR_NOT_FOUND);
+    entry = (ldb_entry_t){ .seqnum = 201, .timestamp = 500, .data = "new", .data_len = 4 };
+    TEST_ASSERT(ldb_append(&journal, &entry, 1, NULL) == LDB_OK);
+    TEST_CHECK(ldb_cursor_next(&cursor, &entry) == LDB_OK);
+    TEST_CHECK(check_entry(&entry, 201, "new"));
+
+    // purged entries are not found
+    TEST_CHECK(ldb_cursor_close(&cursor) == LDB_OK);
+    TEST_ASSERT(ldb_cursor_open(&cursor, &journal, 100) == LDB_OK);
+    TEST_CHECK(ldb_cursor_next(&cursor, &entry) == LDB_OK);
+    TEST_CHECK(ldb_purge(&journal, 150) == 130);
+    TEST_CHECK(ldb_cursor_next(&cursor, &entry) == LDB_ERR_NOT_FOUND);
+    TEST_CHECK(ldb_cursor_close(&cursor) == LDB_OK);
+
+    ldb_close(&journal);
+}
+
+typedef struct scan_ctx_t {
+    uint64_t seqnum1;
+    uint64_t seqnum2;
+    size_t count;
+    size_t max_count;
+    bool valid;
+} scan_ctx_t;
+
+bool scan_callback(void *ctx, const ldb_entry_t *entry)
+{
+    scan_ctx_t *scan = (scan_ctx_t *) ctx;
+    char data[32] = {0};
+
+    snprintf(data, sizeof(data), "data-%d", (int) entry->seqnum);
+
+    if (scan->count == 0)
+        scan->seqnum1 = entry->seqnum;
+    else if (entry->seqnum != scan->seqnum2 + 1)
+        scan->valid = false;
+
+    if (!check_entry((ldb_entry_t *) entry, entry->seqnum, data))
+        scan->valid = false;
+
+    scan->seqnum2 = entry->seqnum;
+    scan->count++;
+
+    return (scan->count < scan->max_count);
+}
+
+void test_scan_time(void)
+{
+    ldb_journal_t journal = {0};
+    scan_ctx_t scan = {0};
+    size_t num = 0;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_CHECK(ldb_scan_time(NULL, 1, 2, scan_callback, &scan, &num) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_scan_time(&journal, 1, 2, NULL, &scan, &num) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_scan_time(&journal, 2, 1, scan_callback, &scan, &num) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_scan_time(&journal, 1, 2, scan_callback, &scan, &num) == LDB_ERR);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(ldb_scan_time(&journal, 1, 2, scan_callback, &scan, &num) == LDB_OK);
+    TEST_CHECK(num == 0);
+
+    // timestamp equals seqnum to the ten
+    append_entries(&journal, 20, 1000);
+
+    scan = (scan_ctx_t){ .max_count = SIZE_MAX, .valid = true };
+    TEST_CHECK(ldb_scan_time(&journal, 100, 129, scan_callback, &scan, &num) == LDB_OK);
+    TEST_CHECK(num == 30);
+    TEST_CHECK(scan.valid);
+    TEST_CHECK(scan.seqnum1 == 100);
+    TEST_CHECK(scan.seqnum2 == 129);
+
+    scan = (scan_ctx_t){ .max_count = SIZE_MAX, .valid = true };
+    TEST_CHECK(ldb_scan_time(&journal, 0, 25, scan_callback, &scan, &num) == LDB_OK);
+    TEST_CHECK(num == 10);
+    TEST_CHECK(scan.seqnum1 == 20);
+    TEST_CHECK(scan.seqnum2 == 29);
+
+    scan = (scan_ctx_t){ .max_count = SIZE_MAX, .valid = true };
+    TEST_CHECK(ldb_scan_time(&journal, 995, 5000, scan_callback, &scan, &num) == LDB_OK);
+    TEST_CHECK(num == 1);
+    TEST_CHECK(scan.seqnum1 == 1000);
+
+    // no entries in range
+    TEST_CHECK(ldb_scan_time(&journal, 105, 109, scan_callback, &scan, &num) == LDB_OK);
+    TEST_CHECK(num == 0);
+    TEST_CHECK(ldb_scan_time(&journal, 2000, 3000, scan_callback, &scan, &num) == LDB_OK);
+    TEST_CHECK(num == 0);
+
+    // stopped by callback
+    scan = (scan_ctx_t){ .max_count = 5, .valid = true };
+    TEST_CHECK(ldb_scan_time(&journal, 0, UINT64_MAX, scan_callback, &scan, &num) == LDB_OK);
+    TEST_CHECK(num == 5);
+    TEST_CHECK(scan.valid);
+    TEST_CHECK(scan.seqnum2 == 24);
+
+    // whole journal
+    scan = (scan_ctx_t){ .max_count = SIZE_MAX, .valid = true };
+    TEST_CHECK(ldb_scan_time(&journal, 0, UINT64_MAX, scan_callback, &scan, NULL) == LDB_OK);
+    TEST_CHECK(scan.count == 981);
+    TEST_CHECK(scan.valid);
+
+    ldb_close(&journal);
+}
+
+typedef struct async_session_t {
+    ldb_entry_t entries[5];
+    char buf[256];
+    int ret;
+    size_t num;
+    size_t calls;
+} async_session_t;
+
+void async_read_done(void *ctx, int ret, size_t num)
+{
+    async_session_t *session = (async_session_t *) ctx;
+    session->ret = ret;
+    session->num = num;
+    session->calls++;
+}
+
+void test_read_async(void)
+{
+    static async_session_t sessions[100];
+    ldb_journal_t journal = {0};
+    ldb_async_t pool = {0};
+    async_session_t *session = &sessions[0];
+    char data[64] = {0};
+    bool ok = true;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_CHECK(ldb_async_open(NULL, 2) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_async_open(&pool, 0) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_async_close(NULL) == LDB_OK);
+    TEST_CHECK(ldb_read_async(&pool, &journal, 20, session->entries, 5, session->buf, sizeof(session->buf), async_read_done, session) == LDB_ERR);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    append_entries(&journal, 20, 314);
+
+    TEST_ASSERT(ldb_async_open(&pool, 2) == LDB_OK);
+    TEST_CHECK(ldb_read_async(NULL, &journal, 20, session->entries, 5, session->buf, sizeof(session->buf), async_read_done, session) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_read_async(&pool, NULL, 20, session->entries, 5, session->buf, sizeof(session->buf), async_read_done, session) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_read_async(&pool, &journal, 20, session->entries, 0, session->buf, sizeof(session->buf), async_read_done, session) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_read_async(&pool, &journal, 20, session->entries, 5, session->buf, sizeof(session->buf), NULL, session) == LDB_ERR_ARG);
+
+    // concurrent sessions served by 2 threads
+    for (size_t i = 0; i < 99; i++) {
+        session = &sessions[i];
+        TEST_ASSERT(ldb_read_async(&pool, &journal, 20 + 2 * i, session->entries, 5, session->buf, sizeof(session->buf), async_read_done, session) == LDB_OK);
+    }
+
+    // not found
+    session = &sessions[99];
+    TEST_ASSERT(ldb_read_async(&pool, &journal, 1000, session->entries, 5, session->buf, sizeof(session->buf), async_read_done, session) == LDB_OK);
+
+    // pending requests are served before close
+    TEST_CHECK(ldb_async_close(&pool) == LDB_OK);
+    TEST_CHECK(ldb_read_async(&pool, &journal, 20, session->entries, 5, session->buf, sizeof(session->buf), async_read_done, session) == LDB_ERR);
+
+    for (size_t i = 0; i < 99 && ok; i++)
+    {
+        session = &sessions[i];
+        ok = (session->calls == 1 && session->ret == LDB_OK && session->num == 5);
+
+        for (size_t j = 0; j < 5 && ok; j++) {
+            snprintf(data, sizeof(data), "data-%d", (int) (20 + 2 * i + j));
+            ok = check_entry(&session->entries[j], 20 + 2 * i + j, data);
+        }
+    }
+    TEST_CHECK(ok);
+    TEST_CHECK(sessions[99].calls == 1);
+    TEST_CHECK(sessions[99].ret == LDB_ERR_NOT_FOUND);
+
+    ldb_close(&journal);
+}
+
+// Fills buf with content of entry seqnum (compressible, small or random).
+static uint32_t fill_compression_data(uint64_t seqnum, char *buf)
+{
+    uint32_t len = 0;
+    uint64_t x = seqnum * 0x9E3779B97F4A7C15ull + 1;
+
+    switch (seqnum % 3)
+    {
+        case 0: // repetitive
+            len = 200 + (uint32_t) (seqnum % 7) * 150;
+            for (uint32_t i = 0; i < len; i++)
+                buf[i] = "journal-compression-"[(i + seqnum) % 20];
+            break;
+        case 1: // small
+            len = (uint32_t) snprintf(buf, 64, "data-%d", (int) seqnum) + 1;
+            break;
+        default: // incompressible
+            len = 300;
+            for (uint32_t i = 0; i < len; i++) {
+                x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+                buf[i] = (char) (x & 0xFF);
+            }
+            break;
+    }
+
+    return len;
+}
+
+static bool check_compression_entry(const ldb_entry_t *entry, uint64_t seqnum)
+{
+    char data[2048] = {0};
+    uint32_t len = fill_compression_data(seqnum, data);
+
+    return (entry->seqnum == seqnum && entry->data != NULL && entry->data_len == len && 
+            memcmp(entry->data, data, len) == 0);
+}
+
+typedef struct mgr_worker_t {
+    ldb_manager_t *manager;
+    char name[16];
+    size_t num_entries;
+    size_t num_appended;
+    int ret;
+} mgr_worker_t;
+
+void * run_mgr_worker(void *args)
+{
+    mgr_worker_t *worker = (mgr_worker_t *) args;
+    char data[] = "data";
+
+    worker->ret = LDB_OK;
+
+    for (size_t i = 0; i < worker->num_entries && worker->ret == LDB_OK; i++)
+    {
+        ldb_entry_t entry = {0, 1, sizeof(data), data};
+        size_t num = 0;
+
+        worker->ret = ldb_mgr_append(worker->manager, worker->name, &entry, 1, &num);
+        worker->num_appended += num;
+    }
+
+    return NULL;
+}
+
+void remove_mgr_journals(size_t num)
+{
+    char filename[32] = {0};
+
+    for (size_t i = 0; i < num; i++) {
+        snprintf(filename, sizeof(filename), "mgr%zu.dat", i);
+        remove(filename);
+        snprintf(filename, sizeof(filename), "mgr%zu.idx", i);
+        remove(filename);
+    }
+}
+
+void test_manager(void)
+{
+    ldb_manager_impl_t manager = {0};
+    ldb_journal_t *journals[6] = {0};
+    ldb_journal_t *journal = NULL;
+    mgr_worker_t workers[8] = {{0}};
+    pthread_t threads[8];
+    ldb_entry_t entries[10] = {{0}};
+    ldb_stats_t stats = {0};
+    char buf[1024] = {0};
+    char name[16] = {0};
+    size_t num = 0;
+
+    remove_mgr_journals(7);
+
+    TEST_CHECK(ldb_mgr_open(NULL, "", 4, 64) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_mgr_open(&manager, NULL, 4, 64) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_mgr_open(&manager, "", 0, 64) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_mgr_open(&manager, "", 4, 0) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_mgr_open(&manager, "/non_existent/", 4, 64) == LDB_ERR_PATH);
+    TEST_CHECK(ldb_mgr_append(&manager, "mgr0", entries, 1, &num) == LDB_ERR);
+    TEST_CHECK(ldb_mgr_acquire(&manager, "mgr0", &journal) == LDB_ERR);
+
+    TEST_ASSERT(ldb_mgr_open(&manager, "", 4, 64) == LDB_OK);
+    TEST_CHECK(ldb_mgr_set_fsync(&manager, true) == LDB_OK);
+    TEST_CHECK(ldb_mgr_acquire(&manager, "mgr-0", &journal) == LDB_ERR_NAME);
+    TEST_CHECK(ldb_mgr_acquire(&manager, "mgr0", NULL) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_mgr_append(&manager, NULL, entries, 1, &num) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_mgr_release(&manager, NULL) == LDB_ERR_ARG);
+
+    // concurrent producers, 2 threads per journal in journals 0 and 1
+    for (size_t i = 0; i < 8; i++) {
+        workers[i].manager = &manager;
+        workers[i].num_entries = 100;
+        snprintf(workers[i].name, sizeof(workers[i].name), "mgr%zu", i % 6);
+        TEST_ASSERT(pthread_create(&threads[i], NULL, run_mgr_worker, &workers[i]) == 0);
+    }
+
+    for (size_t i = 0; i < 8; i++) {
+        pthread_join(threads[i], NULL);
+        TEST_CHECK(workers[i].ret == LDB_OK);
+        TEST_CHECK(workers[i].num_appended == 100);
+    }
+
+    // idle journals closed (least recently used first)
+    TEST_CHECK(manager.num_journals == 6);
+    TEST_CHECK(manager.num_open <= 4);
+
+    for (size_t i = 0; i < 6; i++)
+    {
+        snprintf(name, sizeof(name), "mgr%zu", i);
+        TEST_ASSERT(ldb_mgr_acquire(&manager, name, &journal) == LDB_OK);
+        TEST_CHECK(ldb_stats(journal, 0, UINT64_MAX, &stats) == LDB_OK);
+        TEST_CHECK(stats.num_entries == (i < 2 ? 200 : 100));
+        TEST_CHECK(ldb_read(journal, 91, entries, 10, buf, sizeof(buf), &num) == LDB_OK);
+        TEST_CHECK(num == 10);
+        TEST_CHECK(check_entry(&entries[9], 100, "data"));
+        TEST_CHECK(ldb_mgr_release(&manager, journal) == LDB_OK);
+        TEST_CHECK(manager.num_open <= 4);
+    }
+
+    TEST_CHECK(ldb_mgr_release(&manager, journal) == LDB_ERR_ARG);
+
+    // acquired journals are never closed (limit exceeded meanwhile)
+    for (size_t i = 0; i < 6; i++) {
+        snprintf(name, sizeof(name), "mgr%zu", i);
+        TEST_ASSERT(ldb_mgr_acquire(&manager, name, &journals[i]) == LDB_OK);
+    }
+
+    TEST_CHECK(manager.num_open == 6);
+    entries[0] = (ldb_entry_t){1000, 1, 5, "data"};
+    TEST_CHECK(ldb_mgr_append(&manager, "mgr5", entries, 1, &num) == LDB_ERR_ENTRY_SEQNUM);
+    entries[0] = (ldb_entry_t){0, 1, 5, "data"};
+    TEST_CHECK(ldb_mgr_append(&manager, "mgr5", entries, 1, &num) == LDB_OK);
+    TEST_CHECK(num == 1);
+    TEST_CHECK(journals[5]->state.seqnum2 == 101);
+
+    for (size_t i = 0; i < 6; i++)
+        TEST_CHECK(ldb_mgr_release(&manager, journals[i]) == LDB_OK);
+
+    TEST_CHECK(manager.num_open == 4);
+
+    // new journal evicts the idle ones
+    entries[0] = (ldb_entry_t){0, 1, 5, "data"};
+    TEST_CHECK(ldb_mgr_append(&manager, "mgr6", entries, 1, &num) == LDB_OK);
+    TEST_CHECK(manager.num_journals == 7);
+    TEST_CHECK(manager.num_open <= 4);
+
+    // destructive writes
+    TEST_CHECK(ldb_mgr_rollback(&manager, "mgr0", 150) == 50);
+    TEST_CHECK(ldb_mgr_purge(&manager, "mgr0", 101) == 100);
+    TEST_ASSERT(ldb_mgr_acquire(&manager, "mgr0", &journal) == LDB_OK);
+    TEST_CHECK(journal->state.seqnum1 == 101);
+    TEST_CHECK(journal->state.seqnum2 == 150);
+    TEST_CHECK(ldb_mgr_release(&manager, journal) == LDB_OK);
+
+    TEST_CHECK(ldb_mgr_close(&manager) == LDB_OK);
+    TEST_CHECK(ldb_mgr_close(&manager) == LDB_OK);
+
+    // content is persisted
+    TEST_ASSERT(ldb_mgr_open(&manager, "", 2, 64) == LDB_OK);
+    TEST_ASSERT(ldb_mgr_acquire(&manager, "mgr1", &journal) == LDB_OK);
+    TEST_CHECK(journal->state.seqnum1 == 1);
+    TEST_CHECK(journal->state.seqnum2 == 200);
+    TEST_CHECK(ldb_mgr_release(&manager, journal) == LDB_OK);
+    TEST_CHECK(ldb_mgr_close(&manager) == LDB_OK);
+
+    remove_mgr_journals(7);
+}
+
+void test_compression(void)
+{
+    ldb_journal_t journal = {0};
+    ldb_cursor_t cursor = {0};
+    ldb_entry_t wentries[100] = {{0}};
+    ldb_entry_t rentries[100] = {{0}};
+    ldb_record_dat_t record = {0};
+    ldb_record_idx_t record_idx = {0};
+    char *wbuf = NULL;
+    char buf[1024 * 1024] = {0};
+    char lz[4096] = {0};
+    char out[2048] = {0};
+    size_t num = 0;
+    size_t pos = 0;
+    bool ok = true;
+
+    // codec round-trip
+    for (uint64_t seqnum = 1; seqnum <= 6; seqnum++) {
+        uint32_t len = fill_compression_data(seqnum, out);
+        size_t lz_len = ldb_lz_compress(out, len, lz, sizeof(lz));
+        TEST_CHECK(lz_len > 0);
+        TEST_CHECK(ldb_lz_decompress(lz, lz_len, buf, len));
+        TEST_CHECK(memcmp(buf, out, len) == 0);
+        TEST_CHECK(!ldb_lz_decompress(lz, lz_len, buf, len + 1));
+    }
+    TEST_CHECK(ldb_lz_compress(out, fill_compression_data(5, out), lz, 100) == 0);
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_CHECK(ldb_set_compression(NULL, LDB_CODEC_LZ4) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_set_compression(&journal, LDB_CODEC_LZ4) == LDB_ERR);
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(ldb_set_compression(&journal, LDB_CODEC_LZ4 + 1) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_set_compression(&journal, LDB_CODEC_LZ4) == LDB_OK);
+
+    wbuf = (char *) calloc(100, 2048);
+    TEST_ASSERT(wbuf != NULL);
+
+    for (size_t i = 0; i < 100; i++) {
+        char *data = wbuf + i * 2048;
+        uint32_t len = fill_compression_data(i + 1, data);
+        wentries[i] = (ldb_entry_t){ .seqnum = i + 1, .timestamp = i + 1, .data = data, .data_len = len };
+    }
+    TEST_ASSERT(ldb_append(&journal, wentries, 100, &num) == LDB_OK);
+    TEST_CHECK(num == 100);
+
+    // only repetitive entries are compressed
+    for (uint64_t seqnum = 1; seqnum <= 6; seqnum++) {
+        TEST_ASSERT(ldb_read_record_idx(&journal, &journal.state, seqnum, &record_idx) == LDB_OK);
+        TEST_ASSERT(ldb_read_record_dat(fileno(journal.dat_fp), NULL, journal.format, record_idx.pos, &record_idx, &record, NULL, true) == LDB_OK);
+        TEST_CHECK(((record.data_len & LDB_DATA_COMPRESSED) != 0) == (seqnum % 3 == 0));
+    }
+
+    // read (enough buffer)
+    ldb_set_verify(&journal, true);
+    TEST_CHECK(ldb_read(&journal, 1, rentries, 100, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 100);
+    for (size_t i = 0; i < num && ok; i++)
+        ok = check_compression_entry(&rentries[i], i + 1);
+    TEST_CHECK(ok);
+
+    // read (small buffer)
+    TEST_CHECK(ldb_read(&journal, 3, rentries, 100, buf, 300, &num) == LDB_OK);
+    TEST_CHECK(num == 0);
+    TEST_CHECK(rentries[0].seqnum == 3 && rentries[0].data == NULL && rentries[0].data_len == 650);
+    TEST_CHECK(rentries[1].seqnum == 0);
+    TEST_CHECK(ldb_read(&journal, 3, rentries, 100, buf, 2 * (rentries[0].data_len + 24), &num) == LDB_OK);
+    TEST_CHECK(num >= 1);
+    TEST_CHECK(check_compression_entry(&rentries[0], 3));
+
+    // read (buffer exhausted in the middle)
+    for (uint64_t seqnum = 1; seqnum <= 100 && ok; seqnum += num) {
+        ok = (ldb_read(&journal, seqnum, rentries, 100, buf, 2048, &num) == LDB_OK && num > 0);
+        for (size_t i = 0; i < num && ok; i++)
+            ok = check_compression_entry(&rentries[i], seqnum + i);
+    }
+    TEST_CHECK(ok);
+
+    // cursor
+    TEST_ASSERT(ldb_cursor_open(&cursor, &journal, 0) == LDB_OK);
+    for (uint64_t seqnum = 1; seqnum <= 100 && ok; seqnum++) {
+        ldb_entry_t entry = {0};
+        ok = (ldb_cursor_next(&cursor, &entry) == LDB_OK && check_compression_entry(&entry, seqnum));
+    }
+    TEST_CHECK(ok);
+    TEST_CHECK(ldb_cursor_close(&cursor) == LDB_OK);
+
+    // view stops before compressed entries
+    TEST_ASSERT(ldb_set_mmap(&journal, LDB_MMAP_ALL) == LDB_OK);
+    TEST_CHECK(ldb_read_view(&journal, 1, rentries, 10, &num) == LDB_OK);
+    TEST_CHECK(num == 2);
+    TEST_CHECK(ldb_release_view(&journal) == LDB_OK);
+    TEST_CHECK(ldb_read_view(&journal, 3, rentries, 10, &num) == LDB_ERR_ENTRY_DATA);
+    TEST_CHECK(num == 0);
+
+    // compression disabled, previous entries remain readable
+    TEST_CHECK(ldb_set_compression(&journal, LDB_CODEC_NONE) == LDB_OK);
+    TEST_CHECK(fill_compression_data(102, wbuf) > LDB_COMPRESS_MIN_LEN);
+    wentries[0] = (ldb_entry_t){ .seqnum = 101, .timestamp = 101, .data = wbuf, .data_len = fill_compression_data(102, wbuf) };
+    TEST_ASSERT(ldb_append(&journal, wentries, 1, NULL) == LDB_OK);
+    TEST_ASSERT(ldb_read_record_idx(&journal, &journal.state, 101, &record_idx) == LDB_OK);
+    TEST_ASSERT(ldb_read_record_dat(fileno(journal.dat_fp), NULL, journal.format, record_idx.pos, &record_idx, &record, NULL, true) == LDB_OK);
+    TEST_CHECK((record.data_len & LDB_DATA_COMPRESSED) == 0);
+    pos = record_idx.pos;
+    ldb_close(&journal);
+
+    // reopen checking the files
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum2 == 101);
+    TEST_CHECK(journal.codec == LDB_CODEC_NONE);
+    TEST_ASSERT(ldb_read_record_idx(&journal, &journal.state, 101, &record_idx) == LDB_OK);
+    TEST_CHECK(record_idx.pos == pos);
+    ldb_set_verify(&journal, true);
+    TEST_CHECK(ldb_read(&journal, 1, rentries, 100, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 100);
+    for (size_t i = 0; i < num && ok; i++)
+        ok = check_compression_entry(&rentries[i], i + 1);
+    TEST_CHECK(ok);
+
+    // invalid entry length
+    wentries[0] = (ldb_entry_t){ .seqnum = 102, .timestamp = 102, .data = wbuf, .data_len = LDB_DATA_COMPRESSED | 10 };
+    TEST_CHECK(ldb_append(&journal, wentries, 1, NULL) == LDB_ERR_ENTRY_DATA);
+
+    ldb_close(&journal);
+    free(wbuf);
+}
+
+// timestamps jump beyond the idx delta capacity from seqnum 1500
+static uint64_t idx_timestamp(uint64_t seqnum)
+{
+    return seqnum + (seqnum < 1500 ? 0 : (seqnum - 1499) * ((uint64_t) 1 << 25));
+}
+
+static void append_idx_entries(ldb_journal_t *journal, uint64_t seqnum1, uint64_t seqnum2)
+{
+    ldb_entry_t entries[100] = {{0}};
+    char data[64] = {0};
+    size_t num = 0;
+
+    while (seqnum1 <= seqnum2)
+    {
+        size_t len = ldb_min(seqnum2 - seqnum1 + 1, 100);
+
+        for (size_t i = 0; i < len; i++)
+            entries[i] = (ldb_entry_t){ .seqnum = seqnum1 + i, .timestamp = idx_timestamp(seqnum1 + i), .data = data, .data_len = 1 + (seqnum1 + i) % 40 };
+
+        TEST_ASSERT(ldb_append(journal, entries, len, &num) == LDB_OK);
+        TEST_ASSERT(num == len);
+        seqnum1 += len;
+    }
+}
+
+// checks every idx record against its dat record
+static bool check_idx_records(ldb_journal_t *journal)
+{
+    ldb_record_idx_t record_idx = {0};
+    ldb_record_dat_t record_dat = {0};
+
+    for (uint64_t seqnum = journal->state.seqnum1; seqnum <= journal->state.seqnum2; seqnum++)
+    {
+        if (ldb_read_record_idx(journal, &journal->state, seqnum, &record_idx) != LDB_OK || record_idx.seqnum != seqnum)
+            return false;
+
+        if (ldb_read_record_dat(fileno(journal->dat_fp), NULL, journal->format, record_idx.pos, &record_idx, &record_dat, NULL, false) != LDB_OK)
+            return false;
+
+        if (record_dat.seqnum != seqnum || record_dat.timestamp != record_idx.timestamp || record_idx.timestamp != idx_timestamp(seqnum))
+            return false;
+    }
+
+    return true;
+}
+
+void test_idx_compact(void)
+{
+    ldb_journal_t journal = {0};
+    ldb_stats_t stats = {0};
+    uint64_t seqnum = 0;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(journal.idx_format == LDB_IDX_FORMAT);
+    append_idx_entries(&journal, 1, 2000);
+    TEST_CHECK(check_idx_records(&journal));
+
+    // blocks starting at 1, 511, 1021, 1531
+    TEST_CHECK(ldb_get_len_idx(journal.idx_format, &journal.state, 1531) == sizeof(ldb_record_idx_t));
+    TEST_CHECK(ldb_get_len_idx(journal.idx_format, &journal.state, 1532) == sizeof(uint64_t));
+    TEST_CHECK(ldb_stats(&journal, 1, 2000, &stats) == LDB_OK);
+    TEST_CHECK(stats.index_size == 3 * LDB_IDX_BLOCK_LEN + sizeof(ldb_record_idx_t) + 469 * sizeof(uint64_t));
+
+    // search (deltas and overflowed timestamps)
+    TEST_CHECK(ldb_search(&journal, idx_timestamp(700), LDB_SEARCH_LOWER, &seqnum) == LDB_OK);
+    TEST_CHECK(seqnum == 700);
+    TEST_CHECK(ldb_search(&journal, idx_timestamp(1021), LDB_SEARCH_UPPER, &seqnum) == LDB_OK);
+    TEST_CHECK(seqnum == 1022);
+    TEST_CHECK(ldb_search(&journal, idx_timestamp(1800), LDB_SEARCH_LOWER, &seqnum) == LDB_OK);
+    TEST_CHECK(seqnum == 1800);
+    TEST_CHECK(ldb_search(&journal, idx_timestamp(1800) - 1, LDB_SEARCH_UPPER, &seqnum) == LDB_OK);
+    TEST_CHECK(seqnum == 1800);
+    ldb_close(&journal);
+
+    // reopen
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum2 == 2000);
+    TEST_CHECK(journal.state.timestamp2 == idx_timestamp(2000));
+    ldb_close(&journal);
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum2 == 2000);
+    TEST_CHECK(check_idx_records(&journal));
+
+    // rollback across a block boundary
+    TEST_CHECK(ldb_rollback(&journal, 1015) == 985);
+    TEST_CHECK(check_idx_records(&journal));
+    append_idx_entries(&journal, 1016, 1600);
+    TEST_CHECK(check_idx_records(&journal));
+
+    // purge re-encodes the blocks from the new first entry
+    TEST_CHECK(ldb_purge(&journal, 300) == 299);
+    TEST_CHECK(journal.state.seqnum1 == 300);
+    TEST_CHECK(ldb_get_len_idx(journal.idx_format, &journal.state, 810) == sizeof(ldb_record_idx_t));
+    TEST_CHECK(check_idx_records(&journal));
+    append_idx_entries(&journal, 1601, 1700);
+    TEST_CHECK(check_idx_records(&journal));
+    ldb_close(&journal);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum1 == 300);
+    TEST_CHECK(journal.state.seqnum2 == 1700);
+    TEST_CHECK(check_idx_records(&journal));
+    ldb_close(&journal);
+
+    // wide format remains appendable
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    set_idx_format_wide(&journal);
+    append_idx_entries(&journal, 1, 1000);
+    TEST_CHECK(ldb_stats(&journal, 1, 1000, &stats) == LDB_OK);
+    TEST_CHECK(stats.index_size == 1000 * sizeof(ldb_record_idx_t));
+    TEST_CHECK(ldb_search(&journal, idx_timestamp(700), LDB_SEARCH_LOWER, &seqnum) == LDB_OK);
+    TEST_CHECK(seqnum == 700);
+    TEST_CHECK(ldb_rollback(&journal, 900) == 100);
+    TEST_CHECK(ldb_purge(&journal, 100) == 99);
+    TEST_CHECK(check_idx_records(&journal));
+    ldb_close(&journal);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.idx_format == LDB_IDX_FORMAT_WIDE);
+    TEST_CHECK(journal.state.seqnum1 == 100);
+    TEST_CHECK(journal.state.seqnum2 == 900);
+    TEST_CHECK(check_idx_records(&journal));
+    ldb_close(&journal);
+
+    // checkpoint of wide idx files is honored
+    TEST_CHECK(ldb_read_checkpoint("test.idx").seqnum == 900);
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.checkpoint.seqnum == 900);
+    ldb_close(&journal);
+}
+
+void test_dense_format(void)
+{
+    ldb_journal_t journal = {0};
+    ldb_cursor_t cursor = {0};
+    ldb_stats_t stats = {0};
+    ldb_entry_t wentries[100] = {{0}};
+    ldb_entry_t rentries[100] = {{0}};
+    char data[64] = {0};
+    char buf[64 * 1024] = {0};
+    char *wbuf = NULL;
+    uint64_t seqnum = 0;
+    size_t fixed_size = sizeof(ldb_header_dat_t);
+    size_t num = 0;
+    bool ok = true;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_CHECK(ldb_set_format(NULL, LDB_FORMAT_DENSE) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_set_format(&journal, LDB_FORMAT_DENSE) == LDB_ERR);
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(ldb_set_format(&journal, LDB_FORMAT_BATCH + 1) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_set_format(&journal, LDB_FORMAT_DENSE) == LDB_OK);
+    TEST_CHECK(journal.format == LDB_FILE_FORMAT_DENSE);
+
+    // timestamp gaps overflow the compact idx deltas (resolved walking the dat records)
+    append_idx_entries(&journal, 1, 2000);
+    TEST_CHECK(check_idx_records(&journal));
+    TEST_CHECK(ldb_set_format(&journal, LDB_FORMAT_FIXED) == LDB_ERR);
+    TEST_CHECK(ldb_set_format(&journal, LDB_FORMAT_DENSE) == LDB_OK);
+
+    for (seqnum = 1; seqnum <= 2000; seqnum++)
+        fixed_size += ldb_record_len(LDB_FILE_FORMAT, sizeof(ldb_record_dat_t), 1 + seqnum % 40);
+    TEST_CHECK(ldb_stats(&journal, 1, 2000, &stats) == LDB_OK);
+    TEST_CHECK(stats.num_entries == 2000);
+    TEST_CHECK(journal.dat_end < fixed_size - 2000 * 16);
+    TEST_CHECK(stats.data_size == journal.dat_end - sizeof(ldb_header_dat_t));
+
+    // read
+    TEST_CHECK(ldb_read(&journal, 1490, rentries, 100, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 100);
+    for (size_t i = 0; i < num && ok; i++)
+        ok = (rentries[i].seqnum == 1490 + i && rentries[i].timestamp == idx_timestamp(1490 + i) && rentries[i].data_len == 1 + (1490 + i) % 40);
+    TEST_CHECK(ok);
+
+    // read (buffer exhausted in the middle)
+    for (seqnum = 1; seqnum <= 2000 && ok; seqnum += num) {
+        ok = (ldb_read(&journal, seqnum, rentries, 100, buf, 200, &num) == LDB_OK && num > 0);
+        for (size_t i = 0; i < num && ok; i++)
+            ok = (rentries[i].seqnum == seqnum + i && rentries[i].timestamp == idx_timestamp(seqnum + i));
+    }
+    TEST_CHECK(ok);
+
+    // cursor
+    TEST_ASSERT(ldb_cursor_open(&cursor, &journal, 0) == LDB_OK);
+    for (seqnum = 1; seqnum <= 2000 && ok; seqnum++) {
+        ldb_entry_t entry = {0};
+        ok = (ldb_cursor_next(&cursor, &entry) == LDB_OK && entry.seqnum == seqnum && entry.timestamp == idx_timestamp(seqnum));
+    }
+    TEST_CHECK(ok);
+    TEST_CHECK(ldb_cursor_close(&cursor) == LDB_OK);
+
+    // view
+    TEST_ASSERT(ldb_set_mmap(&journal, LDB_MMAP_ALL) == LDB_OK);
+    TEST_CHECK(ldb_read_view(&journal, 1495, rentries, 10, &num) == LDB_OK);
+    TEST_CHECK(num == 10);
+    for (size_t i = 0; i < num && ok; i++)
+        ok = (rentries[i].seqnum == 1495 + i && rentries[i].timestamp == idx_timestamp(1495 + i) && rentries[i].data_len == 1 + (1495 + i) % 40);
+    TEST_CHECK(ok);
+    TEST_CHECK(ldb_release_view(&journal) == LDB_OK);
+    TEST_ASSERT(ldb_set_mmap(&journal, LDB_MMAP_NONE) == LDB_OK);
+
+    // search
+    TEST_CHECK(ldb_search(&journal, idx_timestamp(1800), LDB_SEARCH_LOWER, &seqnum) == LDB_OK);
+    TEST_CHECK(seqnum == 1800);
+
+    // zero-length entry
+    wentries[0] = (ldb_entry_t){ .seqnum = 2001, .timestamp = idx_timestamp(2001), .data = data, .data_len = 0 };
+    TEST_ASSERT(ldb_append(&journal, wentries, 1, NULL) == LDB_OK);
+    TEST_CHECK(ldb_read(&journal, 2000, rentries, 2, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 2);
+    TEST_CHECK(rentries[1].seqnum == 2001 && rentries[1].data_len == 0);
+    TEST_CHECK(ldb_rollback(&journal, 2000) == 1);
+    ldb_close(&journal);
+
+    // reopen
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.format == LDB_FILE_FORMAT_DENSE);
+    TEST_CHECK(journal.state.seqnum2 == 2000);
+    TEST_CHECK(journal.state.timestamp2 == idx_timestamp(2000));
+    ldb_close(&journal);
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum2 == 2000);
+    TEST_CHECK(check_idx_records(&journal));
+    ldb_close(&journal);
+
+    // idx rebuilt from dat
+    remove("test.idx");
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum1 == 1);
+    TEST_CHECK(journal.state.seqnum2 == 2000);
+    TEST_CHECK(check_idx_records(&journal));
+
+    // rollback and append
+    TEST_CHECK(ldb_rollback(&journal, 1015) == 985);
+    append_idx_entries(&journal, 1016, 1600);
+    TEST_CHECK(check_idx_records(&journal));
+
+    // purge re-encodes the first entry
+    TEST_CHECK(ldb_purge(&journal, 300) == 299);
+    TEST_CHECK(check_idx_records(&journal));
+    append_idx_entries(&journal, 1601, 1700);
+    TEST_CHECK(check_idx_records(&journal));
+    ldb_close(&journal);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum1 == 300);
+    TEST_CHECK(journal.state.seqnum2 == 1700);
+    TEST_CHECK(check_idx_records(&journal));
+
+    // purge all preserves format
+    TEST_CHECK(ldb_purge(&journal, 2000) == 1401);
+    TEST_CHECK(journal.format == LDB_FILE_FORMAT_DENSE);
+    TEST_CHECK(ldb_set_compression(&journal, LDB_CODEC_LZ4) == LDB_OK);
+
+    // compressed entries
+    wbuf = (char *) calloc(100, 2048);
+    TEST_ASSERT(wbuf != NULL);
+
+    for (size_t i = 0; i < 100; i++) {
+        char *ptr = wbuf + i * 2048;
+        wentries[i] = (ldb_entry_t){ .seqnum = 3000 + i, .timestamp = 3000 + i, .data = ptr, .data_len = fill_compression_data(3000 + i, ptr) };
+    }
+    TEST_ASSERT(ldb_append(&journal, wentries, 100, &num) == LDB_OK);
+    TEST_CHECK(num == 100);
+    ldb_close(&journal);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.format == LDB_FILE_FORMAT_DENSE);
+    TEST_CHECK(journal.state.seqnum1 == 3000);
+    ldb_set_verify(&journal, true);
+    TEST_CHECK(ldb_read(&journal, 3000, rentries, 100, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 100);
+    for (size_t i = 0; i < num && ok; i++)
+        ok = check_compression_entry(&rentries[i], 3000 + i);
+    TEST_CHECK(ok);
+
+    TEST_ASSERT(ldb_cursor_open(&cursor, &journal, 3000) == LDB_OK);
+    for (seqnum = 3000; seqnum < 3100 && ok; seqnum++) {
+        ldb_entry_t entry = {0};
+        ok = (ldb_cursor_next(&cursor, &entry) == LDB_OK && check_compression_entry(&entry, seqnum));
+    }
+    TEST_CHECK(ok);
+    TEST_CHECK(ldb_cursor_close(&cursor) == LDB_OK);
+
+    ldb_close(&journal);
+    free(wbuf);
+}
+
+// returns the dat position of the record seqnum
+static size_t batch_record_pos(ldb_journal_t *journal, uint64_t seqnum)
+{
+    ldb_record_idx_t record_idx = {0};
+
+    TEST_ASSERT(ldb_read_record_idx(journal, &journal->state, seqnum, &record_idx) == LDB_OK);
+    return record_idx.pos;
+}
+
+// checks the batch starting at seqnum
+static bool check_batch(ldb_journal_t *journal, uint64_t seqnum, uint32_t num, size_t end)
+{
+    ldb_record_dat_t record = {0};
+    ldb_batch_t batch = {0};
+    size_t header_len = 0;
+    size_t pos = batch_record_pos(journal, seqnum);
+
+    if (ldb_read_batch_dat(fileno(journal->dat_fp), NULL, pos, NULL, 0, 0, &record, &batch, &header_len, true) != LDB_OK)
+        return false;
+
+    return (record.seqnum == seqnum && batch.num == num && batch.len == end - pos);
+}
+
+void test_batch_format(void)
+{
+    ldb_journal_t journal = {0};
+    ldb_cursor_t cursor = {0};
+    ldb_record_dat_t record = {0};
+    ldb_batch_t batch = {0};
+    ldb_entry_t wentries[100] = {{0}};
+    ldb_entry_t rentries[100] = {{0}};
+    char buf[64 * 1024] = {0};
+    char *wbuf = NULL;
+    uint64_t seqnum = 0;
+    size_t header_len = 0;
+    size_t num = 0;
+    bool ok = true;
+
+    remove("test.dat");
+    remove("test.idx");
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(ldb_set_format(&journal, LDB_FORMAT_BATCH) == LDB_OK);
+    TEST_CHECK(journal.format == LDB_FILE_FORMAT_BATCH);
+
+    // appends of 100 entries are framed in batches of 64 + 36 entries
+    append_idx_entries(&journal, 1, 2000);
+    TEST_CHECK(check_idx_records(&journal));
+    TEST_CHECK(check_batch(&journal, 1, 64, batch_record_pos(&journal, 65)));
+    TEST_CHECK(check_batch(&journal, 65, 36, batch_record_pos(&journal, 101)));
+    TEST_CHECK(check_batch(&journal, 1965, 36, journal.dat_end));
+    TEST_CHECK(ldb_read_batch_dat(fileno(journal.dat_fp), NULL, batch_record_pos(&journal, 2), NULL, 0, 0, &record, &batch, &header_len, false) == LDB_ERR_FMT_DAT);
+
+    // verified reads (starting in the middle of a batch)
+    TEST_CHECK(ldb_set_verify(&journal, true) == LDB_OK);
+    TEST_CHECK(ldb_read(&journal, 1490, rentries, 100, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 100);
+    for (size_t i = 0; i < num && ok; i++)
+        ok = (rentries[i].seqnum == 1490 + i && rentries[i].timestamp == idx_timestamp(1490 + i) && rentries[i].data_len == 1 + (1490 + i) % 40);
+    TEST_CHECK(ok);
+
+    // verified reads (batch partially read into buffer)
+    for (seqnum = 1; seqnum <= 2000 && ok; seqnum += num) {
+        ok = (ldb_read(&journal, seqnum, rentries, 100, buf, 200, &num) == LDB_OK && num > 0);
+        for (size_t i = 0; i < num && ok; i++)
+            ok = (rentries[i].seqnum == seqnum + i && rentries[i].timestamp == idx_timestamp(seqnum + i));
+    }
+    TEST_CHECK(ok);
+
+    // verified cursor
+    TEST_ASSERT(ldb_cursor_open(&cursor, &journal, 30) == LDB_OK);
+    for (seqnum = 30; seqnum <= 2000 && ok; seqnum++) {
+        ldb_entry_t entry = {0};
+        ok = (ldb_cursor_next(&cursor, &entry) == LDB_OK && entry.seqnum == seqnum && entry.timestamp == idx_timestamp(seqnum));
+    }
+    TEST_CHECK(ok);
+    TEST_CHECK(ldb_cursor_close(&cursor) == LDB_OK);
+
+    // verified view
+    TEST_ASSERT(ldb_set_mmap(&journal, LDB_MMAP_ALL) == LDB_OK);
+    TEST_CHECK(ldb_read_view(&journal, 1495, rentries, 100, &num) == LDB_OK);
+    TEST_CHECK(num == 100);
+    for (size_t i = 0; i < num && ok; i++)
+        ok = (rentries[i].seqnum == 1495 + i && rentries[i].timestamp == idx_timestamp(1495 + i));
+    TEST_CHECK(ok);
+    TEST_CHECK(ldb_release_view(&journal) == LDB_OK);
+    TEST_ASSERT(ldb_set_mmap(&journal, LDB_MMAP_NONE) == LDB_OK);
+    ldb_close(&journal);
+
+    // reopen
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.format == LDB_FILE_FORMAT_BATCH);
+    TEST_CHECK(journal.state.seqnum2 == 2000);
+    ldb_close(&journal);
+
+    // idx rebuilt from dat
+    remove("test.idx");
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum1 == 1);
+    TEST_CHECK(journal.state.seqnum2 == 2000);
+    TEST_CHECK(check_idx_records(&journal));
+
+    // rollback in the middle of a batch shortens it
+    TEST_CHECK(ldb_rollback(&journal, 1030) == 970);
+    TEST_CHECK(check_batch(&journal, 1001, 30, journal.dat_end));
+    ldb_close(&journal);
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum2 == 1030);
+    append_idx_entries(&journal, 1031, 1600);
+    TEST_CHECK(check_idx_records(&journal));
+    TEST_CHECK(check_batch(&journal, 1031, 64, batch_record_pos(&journal, 1095)));
+
+    // purge in the middle of a batch reframes its remaining entries
+    TEST_CHECK(ldb_purge(&journal, 280) == 279);
+    TEST_CHECK(check_idx_records(&journal));
+    TEST_CHECK(check_batch(&journal, 280, 21, batch_record_pos(&journal, 301)));
+
+    // purge at a batch start
+    TEST_CHECK(ldb_purge(&journal, 301) == 21);
+    TEST_CHECK(check_idx_records(&journal));
+    TEST_CHECK(check_batch(&journal, 301, 64, batch_record_pos(&journal, 365)));
+    ldb_close(&journal);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum1 == 301);
+    TEST_CHECK(journal.state.seqnum2 == 1600);
+    TEST_CHECK(check_idx_records(&journal));
+
+    // corrupting data of entry 1550 (after checkpoint)
+    TEST_CHECK(ldb_rollback(&journal, 1500) == 100);
+    append_idx_entries(&journal, 1501, 1600);
+    TEST_ASSERT(pwrite(fileno(journal.dat_fp), "X", 1, (off_t)(batch_record_pos(&journal, 1551) - 1)) == 1);
+
+    // the whole batch fails verification
+    TEST_CHECK(ldb_set_verify(&journal, true) == LDB_OK);
+    TEST_CHECK(ldb_read(&journal, 1490, rentries, 100, buf, sizeof(buf), &num) == LDB_ERR_CHECKSUM);
+    TEST_CHECK(num == 11);
+    TEST_CHECK(ldb_read(&journal, 1563, rentries, 10, buf, sizeof(buf), &num) == LDB_ERR_CHECKSUM);
+    TEST_CHECK(ldb_read(&journal, 1565, rentries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(ldb_set_verify(&journal, false) == LDB_OK);
+    TEST_CHECK(ldb_read(&journal, 1550, rentries, 10, buf, sizeof(buf), &num) == LDB_OK);
+    ldb_close(&journal);
+
+    TEST_CHECK(ldb_open(&journal, "", "test", true) == LDB_ERR_CHECKSUM);
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    TEST_CHECK(ldb_rollback(&journal, 1500) == 100);
+    append_idx_entries(&journal, 1501, 1700);
+    ldb_close(&journal);
+
+    // torn batch (1665-1700) is removed as a whole
+    TEST_ASSERT(ldb_open(&journal, "", "test", false) == LDB_OK);
+    size_t torn_pos = batch_record_pos(&journal, 1680) + 3;
+    ldb_close(&journal);
+    TEST_ASSERT(truncate("test.dat", (off_t) torn_pos) == 0);
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum2 == 1664);
+    TEST_CHECK(check_idx_records(&journal));
+
+    // compressed entries
+    TEST_CHECK(ldb_purge(&journal, 2000) == 1364);
+    TEST_CHECK(journal.format == LDB_FILE_FORMAT_BATCH);
+    TEST_CHECK(ldb_set_compression(&journal, LDB_CODEC_LZ4) == LDB_OK);
+
+    wbuf = (char *) calloc(100, 2048);
+    TEST_ASSERT(wbuf != NULL);
+
+    for (size_t i = 0; i < 100; i++) {
+        char *ptr = wbuf + i * 2048;
+        wentries[i] = (ldb_entry_t){ .seqnum = 3000 + i, .timestamp = 3000 + i, .data = ptr, .data_len = fill_compression_data(3000 + i, ptr) };
+    }
+    TEST_ASSERT(ldb_append(&journal, wentries, 100, &num) == LDB_OK);
+    TEST_CHECK(num == 100);
+    ldb_close(&journal);
+
+    TEST_ASSERT(ldb_open(&journal, "", "test", true) == LDB_OK);
+    TEST_CHECK(journal.state.seqnum1 == 3000);
+    ldb_set_verify(&journal, true);
+    TEST_CHECK(ldb_read(&journal, 3000, rentries, 100, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 100);
+    for (size_t i = 0; i < num && ok; i++)
+        ok = check_compression_entry(&rentries[i], 3000 + i);
+    TEST_CHECK(ok);
+
+    TEST_ASSERT(ldb_cursor_open(&cursor, &journal, 3000) == LDB_OK);
+    for (seqnum = 3000; seqnum < 3100 && ok; seqnum++) {
+        ldb_entry_t entry = {0};
+        ok = (ldb_cursor_next(&cursor, &entry) == LDB_OK && check_compression_entry(&entry, seqnum));
+    }
+    TEST_CHECK(ok);
+    TEST_CHECK(ldb_cursor_close(&cursor) == LDB_OK);
+
+    ldb_close(&journal);
+    free(wbuf);
+}
+
+// ships [seqnum, seqnum + len) to fd (truncated) and rewinds it
+static size_t ship_entries(ldb_journal_t *journal, uint64_t seqnum, size_t len, int fd, size_t *num)
+{
+    size_t bytes = 0;
+
+    TEST_ASSERT(ftruncate(fd, 0) == 0 && lseek(fd, 0, SEEK_SET) == 0);
+    TEST_ASSERT(ldb_ship(journal, seqnum, len, fd, num, &bytes) == LDB_OK);
+    TEST_CHECK(lseek(fd, 0, SEEK_CUR) == (off_t) bytes);
+    TEST_ASSERT(lseek(fd, 0, SEEK_SET) == 0);
+
+    return bytes;
+}
+
+static void check_ship(int format)
+{
+    ldb_journal_t leader = {0};
+    ldb_journal_t follower = {0};
+    ldb_entry_t entries[20] = {{0}};
+    char buf[4096] = {0};
+    size_t dat_end = 0;
+    size_t bytes = 0;
+    size_t num = 0;
+    int fds[2] = {-1, -1};
+    int fd = -1;
+    char c = 0;
+
+    remove("test.dat");
+    remove("test.idx");
+    remove("test2.dat");
+    remove("test2.idx");
+
+    TEST_ASSERT(ldb_open(&leader, "", "test", false) == LDB_OK);
+    TEST_ASSERT(ldb_set_format(&leader, format) == LDB_OK);
+    append_idx_entries(&leader, 1, 2000);
+
+    TEST_ASSERT(ldb_open(&follower, "", "test2", false) == LDB_OK);
+    TEST_ASSERT(ldb_set_format(&follower, format) == LDB_OK);
+
+    fd = open("test.ship", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    TEST_ASSERT(fd >= 0);
+
+    // invalid args
+    TEST_CHECK(ldb_ship(NULL, 1, 10, fd, &num, &bytes) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_ship(&leader, 1, 10, -1, &num, &bytes) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_ingest(NULL, fd, 10, &num) == LDB_ERR_ARG);
+    TEST_CHECK(ldb_ingest(&follower, -1, 10, &num) == LDB_ERR_ARG);
+
+    // not found
+    TEST_CHECK(ldb_ship(&leader, 0, 10, fd, &num, &bytes) == LDB_ERR_NOT_FOUND);
+    TEST_CHECK(ldb_ship(&leader, 3000, 10, fd, &num, &bytes) == LDB_ERR_NOT_FOUND);
+    TEST_CHECK(num == 0 && bytes == 0);
+
+    // batches are shipped as a whole (batch 65-100)
+    ship_entries(&leader, 70, 10, fd, &num);
+    TEST_CHECK(num == (format == LDB_FORMAT_BATCH ? 36 : 10));
+
+    // file to empty journal
+    bytes = ship_entries(&leader, 1, 1000, fd, &num);
+    TEST_CHECK(num == 1000);
+    TEST_CHECK(ldb_ingest(&follower, fd, bytes, &num) == LDB_OK);
+    TEST_CHECK(num == 1000);
+    TEST_CHECK(follower.state.seqnum1 == 1);
+    TEST_CHECK(follower.state.seqnum2 == 1000);
+    TEST_CHECK(follower.dat_end == sizeof(ldb_header_dat_t) + bytes);
+    TEST_CHECK(check_idx_records(&follower));
+    TEST_CHECK(ldb_read(&follower, 990, entries, 20, buf, sizeof(buf), &num) == LDB_OK);
+    TEST_CHECK(num == 11);
+    TEST_CHECK(entries[10].seqnum == 1000 && entries[10].timestamp == idx_timestamp(1000) && entries[10].data_len == 1 + 1000 % 40);
+    dat_end = follower.dat_end;
+
+    // content not following the last entry (implied dense seqnums fail the checksum)
+    bytes = ship_entries(&leader, 1500, 10, fd, &num);
+    TEST_CHECK(ldb_ingest(&follower, fd, bytes, &num) == (format == LDB_FORMAT_DENSE ? LDB_ERR_CHECKSUM : LDB_ERR_FMT_DAT));
+    TEST_CHECK(num == 0);
+
+    // truncated content
+    bytes = ship_entries(&leader, 1001, 100, fd, &num);
+    TEST_CHECK(ldb_ingest(&follower, fd, bytes - 1, &num) == LDB_ERR_FMT_DAT);
+    TEST_CHECK(num == 0);
+    TEST_ASSERT(lseek(fd, 0, SEEK_SET) == 0);
+    TEST_CHECK(ldb_ingest(&follower, fd, bytes + 1, &num) == LDB_ERR_FMT_DAT);
+
+    // corrupted data (fixed records are padded)
+    size_t corrupted = (format == LDB_FORMAT_FIXED ? sizeof(ldb_record_dat_t) : bytes - 1);
+    TEST_ASSERT(pread(fd, &c, 1, (off_t) corrupted) == 1);
+    c ^= 0x01;
+    TEST_ASSERT(pwrite(fd, &c, 1, (off_t) corrupted) == 1);
+    TEST_ASSERT(lseek(fd, 0, SEEK_SET) == 0);
+    TEST_CHECK(ldb_ingest(&follower, fd, bytes, &num) == LDB_ERR_CHECKSUM);
+    TEST_CHECK(num == 0);
+
+    // rejected content was removed
+    TEST_CHECK(follower.state.seqnum2 == 1000);
+    TEST_CHECK(follower.dat_end == dat_end);
+    TEST_CHECK(check_idx_records(&follower));
+
+    // pipe (no kernel copy)
+    TEST_ASSERT(pipe(fds) == 0);
+    TEST_CHECK(ldb_ship(&leader, 1001, 100, fds[1], &num, &bytes) == LDB_OK);
+    TEST_CHECK(num == 100);
+    TEST_CHECK(ldb_ingest(&follower, fds[0], bytes, &num) == LDB_OK);
+    TEST_CHECK(num == 100);
+    TEST_CHECK(follower.state.seqnum2 == 1100);
+    close(fds[0]);
+    close(fds[1]);
+
+    // appends continue after the ingested entries
+    append_idx_entries(&follower, 1101, 2000);
+    TEST_CHECK(check_idx_records(&follower));
+    TEST_CHECK(ldb_close(&follower) == LDB_OK);
+    TEST_ASSERT(ldb_open(&follower, "", "test2", true) == LDB_OK);
+    TEST_CHECK(follower.state.seqnum1 == 1);
+    TEST_CHECK(follower.state.seqnum2 == 2000);
+    TEST_CHECK(check_idx_records(&follower));
+
+    close(fd);
+    ldb_close(&follower);
+    ldb_close(&leader);
+
+    remove("test.ship");
+    remove("test2.dat");
+    remove("test2.idx");
+}
+
+void test_ship_all(void)
+{
+    check_ship(LDB_FORMAT_FIXED);
+    check_ship(LDB_FORMAT_DENSE);
+    check_ship(LDB_FORMAT_BATCH);
 }
 
 void test_meta_all(void)
@@ -1373,21 +4037,29 @@ TEST_LIST = {
     { "open() dat corrupted",         test_open_dat_corrupted },
     { "open() idx check fails (I)",   test_open_idx_check_fails_1 },
     { "open() idx check fails (II)",  test_open_idx_check_fails_2 },
+    { "open() checkpoint",            test_open_checkpoint },
+    { "open() scan dat",              test_scan_dat },
     { "append() invalid args",        test_append_invalid_args },
     { "append() nothing",             test_append_nothing },
     { "append() auto",                test_append_auto },
     { "append() nominal case",        test_append_nominal_case },
     { "append() broken sequence",     test_append_broken_sequence },
     { "append() lack of data",        test_append_lack_of_data },
+    { "append() multiple chunks",     test_append_multiple_chunks },
+    { "append_buf() all",             test_append_buf },
     { "read() invalid args",          test_read_invalid_args },
     { "read() empty journal",         test_read_empty },
     { "read() nominal case",          test_read_nominal_case },
+    { "read() concurrent",            test_read_concurrent },
+    { "state() concurrent",           test_state_concurrent },
+    { "read_multi() all",             test_read_multi },
     { "stats() invalid args",         test_stats_invalid_args },
     { "stats() nominal case",         test_stats_nominal_case },
     { "search() invalid args",        test_search_invalid_args },
     { "search() nominal case",        test_search_nominal_case },
     { "rollback() invalid args",      test_rollback_invalid_args },
     { "rollback() nominal case",      test_rollback_nominal_case },
+    { "rollback() tail",              test_rollback_tail },
     { "purge() invalid args",         test_purge_invalid_args },
     { "purge() empty journal",        test_purge_empty },
     { "purge() nothing",              test_purge_nothing },
@@ -1395,7 +4067,28 @@ TEST_LIST = {
     { "purge() all",                  test_purge_all },
     { "alloc() all",                  test_alloc_all },
     { "fsync() all",                  test_fsync_all },
+    { "verify() all",                 test_verify_all },
+    { "sparse_index() all",           test_sparse_index },
+    { "idx_writeback() all",          test_idx_writeback },
+    { "prealloc() all",               test_prealloc_all },
+    { "metrics() all",                test_metrics_all },
+    { "segments() all",               test_segments },
     { "meta() all",                   test_meta_all },
+    { "mmap() all",                   test_mmap_all },
+    { "mmap() page end",              test_mmap_page_end },
+    { "read_view() all",              test_read_view },
+    { "purge() concurrent",           test_purge_concurrent },
+    { "group_commit() all",           test_group_commit },
+    { "wait() all",                   test_wait_all },
+    { "cursor() all",                 test_cursor_all },
+    { "scan_time() all",              test_scan_time },
+    { "read_async() all",             test_read_async },
+    { "manager() all",                test_manager },
+    { "compression() all",            test_compression },
+    { "idx compact format",           test_idx_compact },
+    { "dense format all",             test_dense_format },
+    { "batch format all",             test_batch_format },
+    { "ship() all",                   test_ship_all },
     { "flock()",                      test_flock },
     { NULL, NULL }
 };